@@ -0,0 +1,150 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+// Measures the false positive rate, size and costs of building and
+// probing NewBloomFilterPolicy(), NewBlockedBloomFilterPolicy() and
+// NewRibbonFilterPolicy() filters, from filters that fit in the CPU caches
+// to ones the size of a full filter of a large table.
+//
+// Usage: filter_bench [--keys=1000,100000,10000000] [--bits_per_key=10]
+//                     [--probes=N]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "leveldb/env.h"
+#include "leveldb/filter_policy.h"
+#include "leveldb/slice.h"
+#include "util/coding.h"
+#include "util/random.h"
+
+namespace leveldb {
+
+namespace {
+
+// Comma-separated numbers of keys per filter to run with.
+const char* FLAGS_keys = "1000,100000,10000000";
+
+// Bits per key of the bloom filters, and the equivalent for Ribbon.
+int FLAGS_bits_per_key = 10;
+
+// Number of lookups timed for each filter.
+int FLAGS_probes = 10000000;
+
+class Benchmark {
+ public:
+  Benchmark() : rnd_(301) {}
+
+  void Run() {
+    std::fprintf(stdout, "Bits/key:   %d\n", FLAGS_bits_per_key);
+    std::fprintf(stdout, "Probes:     %d\n", FLAGS_probes);
+    std::fprintf(stdout, "------------------------------------------------\n");
+    const FilterPolicy* bloom = NewBloomFilterPolicy(FLAGS_bits_per_key);
+    const FilterPolicy* blocked =
+        NewBlockedBloomFilterPolicy(FLAGS_bits_per_key);
+    const FilterPolicy* ribbon = NewRibbonFilterPolicy(FLAGS_bits_per_key);
+    const char* p = FLAGS_keys;
+    while (p != nullptr && *p != '\0') {
+      int n = std::atoi(p);
+      if (n > 0) {
+        Build(n);
+        RunOne(n, "bloom", bloom);
+        RunOne(n, "blocked", blocked);
+        RunOne(n, "ribbon", ribbon);
+      }
+      p = std::strchr(p, ',');
+      if (p != nullptr) p++;
+    }
+    delete ribbon;
+    delete blocked;
+    delete bloom;
+  }
+
+ private:
+  // Keys are the even numbers below 2n, so the odd ones are known absent.
+  static Slice Key(uint32_t i, char* buffer) {
+    EncodeFixed32(buffer, i);
+    return Slice(buffer, sizeof(uint32_t));
+  }
+
+  void Build(int n) {
+    keys_.resize(n * sizeof(uint32_t));
+    for (int i = 0; i < n; i++) {
+      EncodeFixed32(&keys_[i * sizeof(uint32_t)], 2 * i);
+    }
+    // Random probes, half of them for keys in the filter
+    lookups_.resize(FLAGS_probes);
+    for (int i = 0; i < FLAGS_probes; i++) {
+      lookups_[i] = 2 * rnd_.Uniform(n) + (i & 1);
+    }
+  }
+
+  void RunOne(int n, const char* name, const FilterPolicy* policy) {
+    std::vector<Slice> key_slices;
+    for (int i = 0; i < n; i++) {
+      key_slices.push_back(
+          Slice(&keys_[i * sizeof(uint32_t)], sizeof(uint32_t)));
+    }
+    std::string filter;
+    const uint64_t build_start = Env::Default()->NowMicros();
+    policy->CreateFilter(key_slices.data(), n, &filter);
+    const uint64_t build_micros = Env::Default()->NowMicros() - build_start;
+
+    char buffer[sizeof(uint32_t)];
+    int positives = 0;
+    const uint64_t start = Env::Default()->NowMicros();
+    for (uint32_t i : lookups_) {
+      if (policy->KeyMayMatch(Key(i, buffer), filter)) positives++;
+    }
+    const uint64_t micros = Env::Default()->NowMicros() - start;
+
+    int false_positives = 0;
+    const int absent = (n < 1000000 ? 1000000 : n);
+    for (int i = 0; i < absent; i++) {
+      if (policy->KeyMayMatch(Key(2 * i + 1, buffer), filter)) {
+        false_positives++;
+      }
+    }
+
+    std::fprintf(stdout,
+                 "keys=%-9d %-8s : %7.2f ns/probe; %7.2f ns/key to build;"
+                 " %5.2f%% false positives; %5.2f bits/key (%d positives)\n",
+                 n, name, micros * 1e3 / FLAGS_probes, build_micros * 1e3 / n,
+                 100.0 * false_positives / absent, filter.size() * 8.0 / n,
+                 positives);
+    std::fflush(stdout);
+  }
+
+  Random rnd_;
+  std::string keys_;
+  std::vector<uint32_t> lookups_;
+};
+
+}  // namespace
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    int n;
+    char junk;
+    if (strncmp(argv[i], "--keys=", 7) == 0) {
+      leveldb::FLAGS_keys = argv[i] + 7;
+    } else if (sscanf(argv[i], "--bits_per_key=%d%c", &n, &junk) == 1) {
+      leveldb::FLAGS_bits_per_key = n;
+    } else if (sscanf(argv[i], "--probes=%d%c", &n, &junk) == 1) {
+      leveldb::FLAGS_probes = n;
+    } else {
+      std::fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
+      std::exit(1);
+    }
+  }
+
+  leveldb::Benchmark benchmark;
+  benchmark.Run();
+  return 0;
+}
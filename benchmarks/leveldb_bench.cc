@@ -0,0 +1,1179 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <atomic>
+#include <cassert>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+
+#include "leveldb/cache.h"
+#include "leveldb/db.h"
+#include "leveldb/env.h"
+#include "leveldb/filter_policy.h"
+#include "leveldb/statistics.h"
+#include "leveldb/write_batch.h"
+#include "port/port.h"
+#include "util/histogram.h"
+#include "util/mutexlock.h"
+#include "util/random.h"
+
+// Comma-separated list of operations to run in the specified order
+//   Actual benchmarks:
+//      fillseq       -- write N values in sequential key order in async mode
+//      fillrandom    -- write N values in random key order in async mode
+//      overwrite     -- overwrite N values in random key order in async mode
+//      fillsync      -- write N/1000 values in random key order in sync mode
+//      readseq       -- read N times sequentially
+//      readreverse   -- read N times in reverse order
+//      readrandom    -- read N times in random order
+//      seekrandom    -- N random seeks
+//      deleterandom  -- delete N keys in random order
+//      compact       -- Compact the entire DB
+//   YCSB core workloads, over N records with 64-bit hashed keys; each
+//   thread does --reads operations:
+//      ycsbload      -- load N records into a fresh DB, split over threads
+//      ycsba         -- 50% read, 50% update, zipfian keys
+//      ycsbb         -- 95% read, 5% update, zipfian keys
+//      ycsbc         -- 100% read, zipfian keys
+//      ycsbd         -- 95% read, 5% insert, reads favour recent inserts
+//      ycsbe         -- 95% scan of up to --ycsb_max_scan_length records,
+//                       5% insert, zipfian start keys
+//      ycsbf         -- 50% read, 50% read-modify-write, zipfian keys
+//   Meta operations:
+//      stats         -- Print DB stats
+//      sstables      -- Print sstable info
+//      statistics    -- Print the tickers and histograms of --statistics
+static const char* FLAGS_benchmarks =
+    "fillseq,"
+    "fillsync,"
+    "fillrandom,"
+    "overwrite,"
+    "readrandom,"
+    "readrandom,"  // Extra run to allow previous compactions to quiesce
+    "readseq,"
+    "readreverse,"
+    "seekrandom,"
+    "compact,"
+    "readrandom,"
+    "readseq,"
+    "readreverse,"
+    "deleterandom,";
+
+// Number of key/values to place in database
+static int FLAGS_num = 1000000;
+
+// Number of read operations to do.  If negative, do FLAGS_num reads.
+static int FLAGS_reads = -1;
+
+// Number of concurrent threads to run.
+static int FLAGS_threads = 1;
+
+// Size of each value
+static int FLAGS_value_size = 100;
+
+// Arrange to generate values that shrink to this fraction of
+// their original size after compression
+static double FLAGS_compression_ratio = 0.5;
+
+// Print the full latency histogram of each benchmark, not just the
+// percentiles
+static bool FLAGS_histogram = false;
+
+// Number of bytes to buffer in memtable before compacting
+// (initialized to default value by "main")
+static int FLAGS_write_buffer_size = 0;
+
+// Maximum number of memtables, active and immutable, held in memory
+// (initialized to default value by "main")
+static int FLAGS_max_write_buffer_number = 0;
+
+// Number of bytes written to each file.
+// (initialized to default value by "main")
+static int FLAGS_max_file_size = 0;
+
+// If true, partition the index and filter of each table file.
+static bool FLAGS_partition_index_and_filters = false;
+
+// Approximate size of user data packed per block (before compression.
+// (initialized to default value by "main")
+static int FLAGS_block_size = 0;
+
+// Number of bytes to use as a cache of uncompressed data.
+// Negative means use default settings.
+static int FLAGS_cache_size = -1;
+
+// If true, the cache of --cache_size is a CLOCK cache instead of an LRU
+// cache.
+static bool FLAGS_clock_cache = false;
+
+// Fraction of an LRU cache reserved for blocks read more than once.
+static double FLAGS_cache_high_pri_pool_ratio = 0.5;
+
+// If true, charge index and filter blocks to the cache; if 2, also pin
+// those of level-0 tables.
+static int FLAGS_cache_index_and_filter_blocks = 0;
+
+// Maximum number of files to keep open at the same time (use default if == 0)
+static int FLAGS_open_files = 0;
+
+// Bloom filter bits per key.
+// Negative means use default settings.
+static int FLAGS_bloom_bits = -1;
+
+// If true, build one filter per table file, with a cache-line-blocked
+// bloom filter of --bloom_bits bits per key.
+static bool FLAGS_full_filter = false;
+
+// If non-negative, use Ribbon filters with the false positive rate of
+// --bloom_bits bloom filters, and bloom filters for levels below this one.
+static int FLAGS_ribbon_bloom_before_level = -1;
+
+// Compression: "snappy", "zstd" or "none".  Empty means use the default.
+static const char* FLAGS_compression = "";
+
+// If true, collect Options::statistics for the "statistics" benchmark.
+static bool FLAGS_statistics = false;
+
+// If true, do not destroy the existing database.  If you set this
+// flag and also specify a benchmark that wants a fresh database, that
+// benchmark will fail.
+static bool FLAGS_use_existing_db = false;
+
+// If true, reuse existing log/MANIFEST files when re-opening a database.
+static bool FLAGS_reuse_logs = false;
+
+// Use the db with the following name.
+static const char* FLAGS_db = nullptr;
+
+// Skew of the YCSB zipfian key distribution; YCSB uses 0.99.
+static double FLAGS_ycsb_zipfian_constant = 0.99;
+
+// Longest scan done by YCSB workload E.
+static int FLAGS_ycsb_max_scan_length = 100;
+
+namespace leveldb {
+
+namespace {
+leveldb::Env* g_env = nullptr;
+
+// Store in *dst a random string of length "len" that will compress to
+// about len*compressed_fraction bytes.
+Slice CompressibleString(Random* rnd, double compressed_fraction, size_t len,
+                         std::string* dst) {
+  int raw = static_cast<int>(len * compressed_fraction);
+  if (raw < 1) raw = 1;
+  std::string raw_data(raw, ' ');
+  for (int i = 0; i < raw; i++) {
+    raw_data[i] = static_cast<char>(' ' + rnd->Uniform(95));  // ' ' .. '~'
+  }
+
+  // Duplicate the random data until we have filled "len" bytes
+  dst->clear();
+  while (dst->size() < len) {
+    dst->append(raw_data);
+  }
+  dst->resize(len);
+  return Slice(*dst);
+}
+
+// Helper for quickly generating random data.
+class RandomGenerator {
+ private:
+  std::string data_;
+  int pos_;
+
+ public:
+  RandomGenerator() {
+    // We use a limited amount of data over and over again and ensure
+    // that it is larger than the compression window (32KB), and also
+    // large enough to serve all typical value sizes we want to write.
+    Random rnd(301);
+    std::string piece;
+    while (data_.size() < 1048576) {
+      // Add a short fragment that is as compressible as specified
+      // by FLAGS_compression_ratio.
+      CompressibleString(&rnd, FLAGS_compression_ratio, 100, &piece);
+      data_.append(piece);
+    }
+    pos_ = 0;
+  }
+
+  Slice Generate(size_t len) {
+    if (pos_ + len > data_.size()) {
+      pos_ = 0;
+      assert(len < data_.size());
+    }
+    pos_ += len;
+    return Slice(data_.data() + pos_ - len, len);
+  }
+};
+
+class KeyBuffer {
+ public:
+  KeyBuffer() { std::memset(buffer_, 0, sizeof(buffer_)); }
+  KeyBuffer& operator=(KeyBuffer& other) = delete;
+  KeyBuffer(KeyBuffer& other) = delete;
+
+  void Set(int k) {
+    std::snprintf(buffer_, sizeof(buffer_), "%016d", k);
+  }
+
+  void SetHex(uint64_t k) {
+    std::snprintf(buffer_, sizeof(buffer_), "%016llx",
+                  static_cast<unsigned long long>(k));
+  }
+
+  Slice slice() const { return Slice(buffer_, 16); }
+
+ private:
+  char buffer_[1024];
+};
+
+// Draws integers in [0, n) following YCSB's zipfian distribution, in
+// which 0 is the most popular (Gray et al., "Quickly Generating
+// Billion-Record Synthetic Databases").  Thread-safe once constructed.
+class ZipfianGenerator {
+ public:
+  ZipfianGenerator(uint64_t n, double theta)
+      : n_(n), theta_(theta), alpha_(1.0 / (1.0 - theta)) {
+    zetan_ = 0;
+    for (uint64_t i = 1; i <= n; i++) {
+      zetan_ += 1.0 / std::pow(static_cast<double>(i), theta);
+    }
+    double zeta2 = 1.0 + 1.0 / std::pow(2.0, theta);
+    eta_ = (1.0 - std::pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / zetan_);
+  }
+
+  uint64_t n() const { return n_; }
+
+  uint64_t Next(Random* rnd) const {
+    double u = rnd->Next() / 2147483647.0;
+    double uz = u * zetan_;
+    if (uz < 1.0) return 0;
+    if (uz < 1.0 + std::pow(0.5, theta_)) return 1;
+    uint64_t r = static_cast<uint64_t>(n_ * std::pow(eta_ * u - eta_ + 1.0,
+                                                     alpha_));
+    return (r < n_) ? r : n_ - 1;
+  }
+
+ private:
+  const uint64_t n_;
+  const double theta_;
+  const double alpha_;
+  double zetan_;
+  double eta_;
+};
+
+// Key of the i-th YCSB record.  Records are hashed, as YCSB does, so
+// that popular and recently inserted records spread over the key space.
+static void YcsbKey(uint64_t i, KeyBuffer* key) {
+  uint64_t h = 14695981039346656037ull;  // FNV-1a
+  for (int b = 0; b < 8; b++) {
+    h = (h ^ ((i >> (8 * b)) & 0xff)) * 1099511628211ull;
+  }
+  key->SetHex(h);
+}
+
+#if defined(__linux)
+static Slice TrimSpace(Slice s) {
+  size_t start = 0;
+  while (start < s.size() && isspace(s[start])) {
+    start++;
+  }
+  size_t limit = s.size();
+  while (limit > start && isspace(s[limit - 1])) {
+    limit--;
+  }
+  return Slice(s.data() + start, limit - start);
+}
+#endif
+
+// Kinds of operations timed separately by the YCSB workloads.
+enum OpType {
+  kOpRead,
+  kOpUpdate,
+  kOpInsert,
+  kOpScan,
+  kOpReadModifyWrite,
+  kNumOpTypes,
+  kOpOther = kNumOpTypes  // Only counted in the overall histogram
+};
+
+static const char* const kOpTypeNames[kNumOpTypes] = {
+    "read", "update", "insert", "scan", "readmodifywrite"};
+
+static void AppendWithSpace(std::string* str, Slice msg) {
+  if (msg.empty()) return;
+  if (!str->empty()) {
+    str->push_back(' ');
+  }
+  str->append(msg.data(), msg.size());
+}
+
+class Stats {
+ private:
+  double start_;
+  double finish_;
+  double seconds_;
+  int done_;
+  int next_report_;
+  int64_t bytes_;
+  double last_op_finish_;
+  Histogram hist_;
+  Histogram op_hist_[kNumOpTypes];
+  std::string message_;
+
+ public:
+  Stats() { Start(); }
+
+  void Start() {
+    next_report_ = 100;
+    hist_.Clear();
+    for (int i = 0; i < kNumOpTypes; i++) {
+      op_hist_[i].Clear();
+    }
+    done_ = 0;
+    bytes_ = 0;
+    seconds_ = 0;
+    message_.clear();
+    start_ = finish_ = last_op_finish_ = g_env->NowMicros();
+  }
+
+  void Merge(const Stats& other) {
+    hist_.Merge(other.hist_);
+    for (int i = 0; i < kNumOpTypes; i++) {
+      op_hist_[i].Merge(other.op_hist_[i]);
+    }
+    done_ += other.done_;
+    bytes_ += other.bytes_;
+    seconds_ += other.seconds_;
+    if (other.start_ < start_) start_ = other.start_;
+    if (other.finish_ > finish_) finish_ = other.finish_;
+
+    // Just keep the messages from one thread
+    if (message_.empty()) message_ = other.message_;
+  }
+
+  void Stop() {
+    finish_ = g_env->NowMicros();
+    seconds_ = (finish_ - start_) * 1e-6;
+  }
+
+  void AddMessage(Slice msg) { AppendWithSpace(&message_, msg); }
+
+  void FinishedSingleOp(OpType type = kOpOther) {
+    double now = g_env->NowMicros();
+    double micros = now - last_op_finish_;
+    hist_.Add(micros);
+    if (type != kOpOther) {
+      op_hist_[type].Add(micros);
+    }
+    if (micros > 20000 && FLAGS_histogram) {
+      std::fprintf(stderr, "long op: %.1f micros%30s\r", micros, "");
+      std::fflush(stderr);
+    }
+    last_op_finish_ = now;
+
+    done_++;
+    if (done_ >= next_report_) {
+      if (next_report_ < 1000)
+        next_report_ += 100;
+      else if (next_report_ < 5000)
+        next_report_ += 500;
+      else if (next_report_ < 10000)
+        next_report_ += 1000;
+      else if (next_report_ < 50000)
+        next_report_ += 5000;
+      else if (next_report_ < 100000)
+        next_report_ += 10000;
+      else if (next_report_ < 500000)
+        next_report_ += 50000;
+      else
+        next_report_ += 100000;
+      std::fprintf(stderr, "... finished %d ops%30s\r", done_, "");
+      std::fflush(stderr);
+    }
+  }
+
+  void AddBytes(int64_t n) { bytes_ += n; }
+
+  void Report(const Slice& name) {
+    // Pretend at least one op was done in case we are running a benchmark
+    // that does not call FinishedSingleOp().
+    if (done_ < 1) done_ = 1;
+
+    std::string extra;
+    if (bytes_ > 0) {
+      // Rate is computed on actual elapsed time, not the sum of per-thread
+      // elapsed times.
+      double elapsed = (finish_ - start_) * 1e-6;
+      char rate[100];
+      std::snprintf(rate, sizeof(rate), "%6.1f MB/s",
+                    (bytes_ / 1048576.0) / elapsed);
+      extra = rate;
+    }
+    AppendWithSpace(&extra, message_);
+
+    // Ops/sec is also computed on elapsed time, so it counts the work of
+    // all threads.
+    double elapsed = (finish_ - start_) * 1e-6;
+    std::fprintf(stdout, "%-12s : %11.3f micros/op; %10.0f ops/sec;%s%s\n",
+                 name.ToString().c_str(), seconds_ * 1e6 / done_,
+                 done_ / elapsed, (extra.empty() ? "" : " "), extra.c_str());
+    if (hist_.Count() > 0) {
+      std::fprintf(stdout,
+                   "%-12s   latency (micros): P50 %.2f  P99 %.2f  P99.9 %.2f  "
+                   "max %.0f\n",
+                   "", hist_.Percentile(50), hist_.Percentile(99),
+                   hist_.Percentile(99.9), hist_.Max());
+    }
+    if (FLAGS_histogram && hist_.Count() > 0) {
+      std::fprintf(stdout, "Microseconds per op:\n%s\n",
+                   hist_.ToString().c_str());
+    }
+    for (int i = 0; i < kNumOpTypes; i++) {
+      const Histogram& h = op_hist_[i];
+      if (h.Count() == 0) continue;
+      std::fprintf(stdout,
+                   "%-12s   %-15s %9.0f ops: P50 %.2f  P99 %.2f  P99.9 %.2f  "
+                   "max %.0f\n",
+                   "", kOpTypeNames[i], h.Count(), h.Percentile(50),
+                   h.Percentile(99), h.Percentile(99.9), h.Max());
+      if (FLAGS_histogram) {
+        std::fprintf(stdout, "Microseconds per %s:\n%s\n", kOpTypeNames[i],
+                     h.ToString().c_str());
+      }
+    }
+    std::fflush(stdout);
+  }
+};
+
+// State shared by all concurrent executions of the same benchmark.
+struct SharedState {
+  port::Mutex mu;
+  port::CondVar cv GUARDED_BY(mu);
+  int total GUARDED_BY(mu);
+
+  // Each thread goes through the following states:
+  //    (1) initializing
+  //    (2) waiting for others to be initialized
+  //    (3) running
+  //    (4) done
+
+  int num_initialized GUARDED_BY(mu);
+  int num_done GUARDED_BY(mu);
+  bool start GUARDED_BY(mu);
+
+  SharedState(int total)
+      : cv(&mu), total(total), num_initialized(0), num_done(0), start(false) {}
+};
+
+// Per-thread state for concurrent executions of the same benchmark.
+struct ThreadState {
+  int tid;      // 0..n-1 when running in n threads
+  Random rand;  // Has different seeds for different threads
+  Stats stats;
+  SharedState* shared;
+
+  ThreadState(int index, int seed) : tid(index), rand(seed), shared(nullptr) {}
+};
+
+// Operation mix of a YCSB core workload, in percent.
+struct YcsbMix {
+  int read;
+  int update;
+  int insert;
+  int scan;
+  int read_modify_write;
+  bool latest;  // Reads favour recent inserts rather than zipfian records
+};
+
+static const YcsbMix kYcsbMixes[] = {
+    {50, 50, 0, 0, 0, false},   // A: update heavy
+    {95, 5, 0, 0, 0, false},    // B: read mostly
+    {100, 0, 0, 0, 0, false},   // C: read only
+    {95, 0, 5, 0, 0, true},     // D: read latest
+    {0, 0, 5, 95, 0, false},    // E: short ranges
+    {50, 0, 0, 0, 50, false},   // F: read-modify-write
+};
+
+}  // namespace
+
+class Benchmark {
+ private:
+  Cache* cache_;
+  const FilterPolicy* filter_policy_;
+  Statistics* statistics_;
+  DB* db_;
+  int num_;
+  int value_size_;
+  int reads_;
+  int total_thread_count_;
+
+  // YCSB state: the mix being run, the distribution of record numbers,
+  // and the number of the next record to insert.
+  const YcsbMix* ycsb_mix_;
+  ZipfianGenerator* zipfian_;
+  std::atomic<uint64_t> ycsb_next_record_;
+
+  void PrintHeader() {
+    const int kKeySize = 16;
+    PrintEnvironment();
+    std::fprintf(stdout, "Keys:       %d bytes each\n", kKeySize);
+    std::fprintf(
+        stdout, "Values:     %d bytes each (%d bytes after compression)\n",
+        FLAGS_value_size,
+        static_cast<int>(FLAGS_value_size * FLAGS_compression_ratio + 0.5));
+    std::fprintf(stdout, "Entries:    %d\n", num_);
+    std::fprintf(stdout, "RawSize:    %.1f MB (estimated)\n",
+                 ((static_cast<int64_t>(kKeySize + FLAGS_value_size) * num_) /
+                  1048576.0));
+    std::fprintf(
+        stdout, "FileSize:   %.1f MB (estimated)\n",
+        (((kKeySize + FLAGS_value_size * FLAGS_compression_ratio) * num_) /
+         1048576.0));
+    PrintWarnings();
+    std::fprintf(stdout, "------------------------------------------------\n");
+  }
+
+  void PrintWarnings() {
+#if defined(__GNUC__) && !defined(__OPTIMIZE__)
+    std::fprintf(
+        stdout,
+        "WARNING: Optimization is disabled: benchmarks unnecessarily slow\n");
+#endif
+#ifndef NDEBUG
+    std::fprintf(
+        stdout,
+        "WARNING: Assertions are enabled; benchmarks unnecessarily slow\n");
+#endif
+  }
+
+  void PrintEnvironment() {
+    std::fprintf(stderr, "LevelDB:    version %d.%d\n", kMajorVersion,
+                 kMinorVersion);
+
+#if defined(__linux)
+    time_t now = time(nullptr);
+    std::fprintf(stderr, "Date:       %s",
+                 ctime(&now));  // ctime() adds newline
+
+    FILE* cpuinfo = std::fopen("/proc/cpuinfo", "r");
+    if (cpuinfo != nullptr) {
+      char line[1000];
+      int num_cpus = 0;
+      std::string cpu_type;
+      std::string cache_size;
+      while (fgets(line, sizeof(line), cpuinfo) != nullptr) {
+        const char* sep = strchr(line, ':');
+        if (sep == nullptr) {
+          continue;
+        }
+        Slice key = TrimSpace(Slice(line, sep - 1 - line));
+        Slice val = TrimSpace(Slice(sep + 1));
+        if (key == "model name") {
+          ++num_cpus;
+          cpu_type = val.ToString();
+        } else if (key == "cache size") {
+          cache_size = val.ToString();
+        }
+      }
+      std::fclose(cpuinfo);
+      std::fprintf(stderr, "CPU:        %d * %s\n", num_cpus, cpu_type.c_str());
+      std::fprintf(stderr, "CPUCache:   %s\n", cache_size.c_str());
+    }
+#endif
+  }
+
+ public:
+  Benchmark()
+      : cache_(FLAGS_cache_size < 0 ? nullptr
+               : FLAGS_clock_cache
+                   ? NewClockCache(FLAGS_cache_size)
+                   : NewLRUCache(FLAGS_cache_size,
+                                 FLAGS_cache_high_pri_pool_ratio)),
+        filter_policy_(FLAGS_bloom_bits < 0 ? nullptr
+                       : FLAGS_ribbon_bloom_before_level >= 0
+                           ? NewRibbonFilterPolicy(
+                                 FLAGS_bloom_bits,
+                                 FLAGS_ribbon_bloom_before_level)
+                       : FLAGS_full_filter
+                           ? NewBlockedBloomFilterPolicy(FLAGS_bloom_bits)
+                           : NewBloomFilterPolicy(FLAGS_bloom_bits)),
+        statistics_(FLAGS_statistics ? NewStatistics() : nullptr),
+        db_(nullptr),
+        num_(FLAGS_num),
+        value_size_(FLAGS_value_size),
+        reads_(FLAGS_reads < 0 ? FLAGS_num : FLAGS_reads),
+        total_thread_count_(0),
+        ycsb_mix_(nullptr),
+        zipfian_(nullptr),
+        ycsb_next_record_(0) {
+    if (!FLAGS_use_existing_db) {
+      DestroyDB(FLAGS_db, Options());
+    }
+  }
+
+  ~Benchmark() {
+    delete db_;
+    delete cache_;
+    delete filter_policy_;
+    delete statistics_;
+    delete zipfian_;
+  }
+
+  void Run() {
+    PrintHeader();
+    Open();
+
+    const char* benchmarks = FLAGS_benchmarks;
+    while (benchmarks != nullptr) {
+      const char* sep = strchr(benchmarks, ',');
+      Slice name;
+      if (sep == nullptr) {
+        name = benchmarks;
+        benchmarks = nullptr;
+      } else {
+        name = Slice(benchmarks, sep - benchmarks);
+        benchmarks = sep + 1;
+      }
+
+      // Reset parameters that may be overridden below
+      num_ = FLAGS_num;
+      reads_ = (FLAGS_reads < 0 ? FLAGS_num : FLAGS_reads);
+      value_size_ = FLAGS_value_size;
+
+      void (Benchmark::*method)(ThreadState*) = nullptr;
+      bool fresh_db = false;
+      int num_threads = FLAGS_threads;
+
+      if (name == Slice("open")) {
+        method = &Benchmark::OpenBench;
+        num_ /= 10000;
+        if (num_ < 1) num_ = 1;
+      } else if (name == Slice("fillseq")) {
+        fresh_db = true;
+        method = &Benchmark::WriteSeq;
+      } else if (name == Slice("fillrandom")) {
+        fresh_db = true;
+        method = &Benchmark::WriteRandom;
+      } else if (name == Slice("overwrite")) {
+        fresh_db = false;
+        method = &Benchmark::WriteRandom;
+      } else if (name == Slice("fillsync")) {
+        fresh_db = true;
+        num_ /= 1000;
+        write_options_.sync = true;
+        method = &Benchmark::WriteRandom;
+      } else if (name == Slice("readseq")) {
+        method = &Benchmark::ReadSequential;
+      } else if (name == Slice("readreverse")) {
+        method = &Benchmark::ReadReverse;
+      } else if (name == Slice("readrandom")) {
+        method = &Benchmark::ReadRandom;
+      } else if (name == Slice("seekrandom")) {
+        method = &Benchmark::SeekRandom;
+      } else if (name == Slice("deleterandom")) {
+        method = &Benchmark::DeleteRandom;
+      } else if (name == Slice("compact")) {
+        method = &Benchmark::Compact;
+        num_threads = 1;
+      } else if (name == Slice("ycsbload")) {
+        fresh_db = true;
+        method = &Benchmark::YcsbLoad;
+      } else if (name.size() == 5 && name.starts_with("ycsb") &&
+                 name[4] >= 'a' && name[4] <= 'f') {
+        ycsb_mix_ = &kYcsbMixes[name[4] - 'a'];
+        ycsb_next_record_.store(num_);
+        if (zipfian_ == nullptr || zipfian_->n() != uint64_t(num_)) {
+          delete zipfian_;
+          zipfian_ = new ZipfianGenerator(num_, FLAGS_ycsb_zipfian_constant);
+        }
+        method = &Benchmark::YcsbRun;
+      } else if (name == Slice("stats")) {
+        PrintStats("leveldb.stats");
+      } else if (name == Slice("sstables")) {
+        PrintStats("leveldb.sstables");
+      } else if (name == Slice("statistics")) {
+        PrintStats("leveldb.statistics");
+      } else {
+        if (!name.empty()) {  // No error message for empty name
+          std::fprintf(stderr, "unknown benchmark '%s'\n",
+                       name.ToString().c_str());
+        }
+      }
+
+      if (fresh_db) {
+        if (FLAGS_use_existing_db) {
+          std::fprintf(stdout, "%-12s : skipped (--use_existing_db is true)\n",
+                       name.ToString().c_str());
+          method = nullptr;
+        } else {
+          delete db_;
+          db_ = nullptr;
+          DestroyDB(FLAGS_db, Options());
+          Open();
+        }
+      }
+
+      if (method != nullptr) {
+        RunBenchmark(num_threads, name, method);
+      }
+      write_options_ = WriteOptions();
+    }
+  }
+
+ private:
+  WriteOptions write_options_;
+
+  struct ThreadArg {
+    Benchmark* bm;
+    SharedState* shared;
+    ThreadState* thread;
+    void (Benchmark::*method)(ThreadState*);
+  };
+
+  static void ThreadBody(void* v) {
+    ThreadArg* arg = reinterpret_cast<ThreadArg*>(v);
+    SharedState* shared = arg->shared;
+    ThreadState* thread = arg->thread;
+    {
+      MutexLock l(&shared->mu);
+      shared->num_initialized++;
+      if (shared->num_initialized >= shared->total) {
+        shared->cv.SignalAll();
+      }
+      while (!shared->start) {
+        shared->cv.Wait();
+      }
+    }
+
+    thread->stats.Start();
+    (arg->bm->*(arg->method))(thread);
+    thread->stats.Stop();
+
+    {
+      MutexLock l(&shared->mu);
+      shared->num_done++;
+      if (shared->num_done >= shared->total) {
+        shared->cv.SignalAll();
+      }
+    }
+  }
+
+  void RunBenchmark(int n, Slice name,
+                    void (Benchmark::*method)(ThreadState*)) {
+    SharedState shared(n);
+
+    ThreadArg* arg = new ThreadArg[n];
+    for (int i = 0; i < n; i++) {
+      arg[i].bm = this;
+      arg[i].method = method;
+      arg[i].shared = &shared;
+      ++total_thread_count_;
+      // Seed the thread's random state deterministically based upon thread
+      // creation across all benchmarks. This ensures that the seeds are
+      // unique but reproducible when rerunning the same set of benchmarks.
+      arg[i].thread = new ThreadState(i, /*seed=*/1000 + total_thread_count_);
+      arg[i].thread->shared = &shared;
+      g_env->StartThread(ThreadBody, &arg[i]);
+    }
+
+    shared.mu.Lock();
+    while (shared.num_initialized < n) {
+      shared.cv.Wait();
+    }
+
+    shared.start = true;
+    shared.cv.SignalAll();
+    while (shared.num_done < n) {
+      shared.cv.Wait();
+    }
+    shared.mu.Unlock();
+
+    for (int i = 1; i < n; i++) {
+      arg[0].thread->stats.Merge(arg[i].thread->stats);
+    }
+    arg[0].thread->stats.Report(name);
+
+    for (int i = 0; i < n; i++) {
+      delete arg[i].thread;
+    }
+    delete[] arg;
+  }
+
+  void Open() {
+    assert(db_ == nullptr);
+    Options options;
+    options.env = g_env;
+    options.create_if_missing = !FLAGS_use_existing_db;
+    options.block_cache = cache_;
+    options.cache_index_and_filter_blocks =
+        FLAGS_cache_index_and_filter_blocks > 0;
+    options.pin_l0_filter_and_index_blocks_in_cache =
+        FLAGS_cache_index_and_filter_blocks > 1;
+    if (FLAGS_write_buffer_size > 0) {
+      options.write_buffer_size = FLAGS_write_buffer_size;
+    }
+    options.max_write_buffer_number = FLAGS_max_write_buffer_number;
+    if (FLAGS_max_file_size > 0) {
+      options.max_file_size = FLAGS_max_file_size;
+    }
+    if (FLAGS_block_size > 0) {
+      options.block_size = FLAGS_block_size;
+    }
+    options.partition_index_and_filters = FLAGS_partition_index_and_filters;
+    if (FLAGS_open_files > 0) {
+      options.max_open_files = FLAGS_open_files;
+    }
+    if (std::strcmp(FLAGS_compression, "snappy") == 0) {
+      options.compression = kSnappyCompression;
+    } else if (std::strcmp(FLAGS_compression, "zstd") == 0) {
+      options.compression = kZstdCompression;
+    } else if (std::strcmp(FLAGS_compression, "none") == 0) {
+      options.compression = kNoCompression;
+    }
+    options.filter_policy = filter_policy_;
+    options.full_filter = FLAGS_full_filter;
+    options.reuse_logs = FLAGS_reuse_logs;
+    options.statistics = statistics_;
+    Status s = DB::Open(options, FLAGS_db, &db_);
+    if (!s.ok()) {
+      std::fprintf(stderr, "open error: %s\n", s.ToString().c_str());
+      std::exit(1);
+    }
+  }
+
+  void OpenBench(ThreadState* thread) {
+    for (int i = 0; i < num_; i++) {
+      delete db_;
+      db_ = nullptr;
+      Open();
+      thread->stats.FinishedSingleOp();
+    }
+  }
+
+  void WriteSeq(ThreadState* thread) { DoWrite(thread, true); }
+
+  void WriteRandom(ThreadState* thread) { DoWrite(thread, false); }
+
+  void DoWrite(ThreadState* thread, bool seq) {
+    if (num_ != FLAGS_num) {
+      char msg[100];
+      std::snprintf(msg, sizeof(msg), "(%d ops)", num_);
+      thread->stats.AddMessage(msg);
+    }
+
+    RandomGenerator gen;
+    WriteBatch batch;
+    Status s;
+    int64_t bytes = 0;
+    KeyBuffer key;
+    for (int i = 0; i < num_; i++) {
+      batch.Clear();
+      const int k = seq ? i : thread->rand.Uniform(FLAGS_num);
+      key.Set(k);
+      batch.Put(key.slice(), gen.Generate(value_size_));
+      bytes += value_size_ + key.slice().size();
+      s = db_->Write(write_options_, &batch);
+      if (!s.ok()) {
+        std::fprintf(stderr, "put error: %s\n", s.ToString().c_str());
+        std::exit(1);
+      }
+      thread->stats.FinishedSingleOp();
+    }
+    thread->stats.AddBytes(bytes);
+  }
+
+  void ReadSequential(ThreadState* thread) {
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    int i = 0;
+    int64_t bytes = 0;
+    for (iter->SeekToFirst(); i < reads_ && iter->Valid(); iter->Next()) {
+      bytes += iter->key().size() + iter->value().size();
+      thread->stats.FinishedSingleOp();
+      ++i;
+    }
+    delete iter;
+    thread->stats.AddBytes(bytes);
+  }
+
+  void ReadReverse(ThreadState* thread) {
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    int i = 0;
+    int64_t bytes = 0;
+    for (iter->SeekToLast(); i < reads_ && iter->Valid(); iter->Prev()) {
+      bytes += iter->key().size() + iter->value().size();
+      thread->stats.FinishedSingleOp();
+      ++i;
+    }
+    delete iter;
+    thread->stats.AddBytes(bytes);
+  }
+
+  void ReadRandom(ThreadState* thread) {
+    ReadOptions options;
+    std::string value;
+    int found = 0;
+    int64_t bytes = 0;
+    KeyBuffer key;
+    for (int i = 0; i < reads_; i++) {
+      const int k = thread->rand.Uniform(FLAGS_num);
+      key.Set(k);
+      if (db_->Get(options, key.slice(), &value).ok()) {
+        found++;
+        bytes += key.slice().size() + value.size();
+      }
+      thread->stats.FinishedSingleOp();
+    }
+    char msg[100];
+    std::snprintf(msg, sizeof(msg), "(%d of %d found)", found, reads_);
+    thread->stats.AddBytes(bytes);
+    thread->stats.AddMessage(msg);
+  }
+
+  void SeekRandom(ThreadState* thread) {
+    ReadOptions options;
+    int found = 0;
+    KeyBuffer key;
+    for (int i = 0; i < reads_; i++) {
+      Iterator* iter = db_->NewIterator(options);
+      const int k = thread->rand.Uniform(FLAGS_num);
+      key.Set(k);
+      iter->Seek(key.slice());
+      if (iter->Valid() && iter->key() == key.slice()) found++;
+      delete iter;
+      thread->stats.FinishedSingleOp();
+    }
+    char msg[100];
+    std::snprintf(msg, sizeof(msg), "(%d of %d found)", found, num_);
+    thread->stats.AddMessage(msg);
+  }
+
+  void DeleteRandom(ThreadState* thread) {
+    WriteBatch batch;
+    Status s;
+    KeyBuffer key;
+    for (int i = 0; i < num_; i++) {
+      batch.Clear();
+      const int k = thread->rand.Uniform(FLAGS_num);
+      key.Set(k);
+      batch.Delete(key.slice());
+      s = db_->Write(write_options_, &batch);
+      if (!s.ok()) {
+        std::fprintf(stderr, "del error: %s\n", s.ToString().c_str());
+        std::exit(1);
+      }
+      thread->stats.FinishedSingleOp();
+    }
+  }
+
+  void Compact(ThreadState* thread) { db_->CompactRange(nullptr, nullptr); }
+
+  void YcsbLoad(ThreadState* thread) {
+    RandomGenerator gen;
+    KeyBuffer key;
+    int64_t bytes = 0;
+    for (int i = thread->tid; i < num_; i += FLAGS_threads) {
+      YcsbKey(i, &key);
+      Status s =
+          db_->Put(write_options_, key.slice(), gen.Generate(value_size_));
+      if (!s.ok()) {
+        std::fprintf(stderr, "put error: %s\n", s.ToString().c_str());
+        std::exit(1);
+      }
+      bytes += value_size_ + key.slice().size();
+      thread->stats.FinishedSingleOp(kOpInsert);
+    }
+    thread->stats.AddBytes(bytes);
+  }
+
+  // Number of an existing record to operate on.
+  uint64_t YcsbChooseRecord(ThreadState* thread) {
+    uint64_t r = zipfian_->Next(&thread->rand);
+    if (ycsb_mix_->latest) {
+      uint64_t last = ycsb_next_record_.load(std::memory_order_relaxed) - 1;
+      r = (r <= last) ? last - r : 0;
+    }
+    return r;
+  }
+
+  void YcsbRun(ThreadState* thread) {
+    const YcsbMix& mix = *ycsb_mix_;
+    RandomGenerator gen;
+    ReadOptions options;
+    std::string value;
+    KeyBuffer key;
+    int reads = 0;
+    int found = 0;
+    for (int i = 0; i < reads_; i++) {
+      const int op = thread->rand.Uniform(100);
+      Status s;
+      if (op < mix.read) {
+        YcsbKey(YcsbChooseRecord(thread), &key);
+        reads++;
+        if (db_->Get(options, key.slice(), &value).ok()) {
+          found++;
+        }
+        thread->stats.FinishedSingleOp(kOpRead);
+      } else if (op < mix.read + mix.update) {
+        YcsbKey(YcsbChooseRecord(thread), &key);
+        s = db_->Put(write_options_, key.slice(), gen.Generate(value_size_));
+        thread->stats.FinishedSingleOp(kOpUpdate);
+      } else if (op < mix.read + mix.update + mix.insert) {
+        YcsbKey(ycsb_next_record_.fetch_add(1, std::memory_order_relaxed),
+                &key);
+        s = db_->Put(write_options_, key.slice(), gen.Generate(value_size_));
+        thread->stats.FinishedSingleOp(kOpInsert);
+      } else if (op < mix.read + mix.update + mix.insert + mix.scan) {
+        YcsbKey(YcsbChooseRecord(thread), &key);
+        const int length = 1 + thread->rand.Uniform(FLAGS_ycsb_max_scan_length);
+        Iterator* iter = db_->NewIterator(options);
+        iter->Seek(key.slice());
+        for (int n = 0; n < length && iter->Valid(); n++) {
+          value.assign(iter->value().data(), iter->value().size());
+          iter->Next();
+        }
+        s = iter->status();
+        delete iter;
+        thread->stats.FinishedSingleOp(kOpScan);
+      } else {
+        YcsbKey(YcsbChooseRecord(thread), &key);
+        reads++;
+        if (db_->Get(options, key.slice(), &value).ok()) {
+          found++;
+        }
+        s = db_->Put(write_options_, key.slice(), gen.Generate(value_size_));
+        thread->stats.FinishedSingleOp(kOpReadModifyWrite);
+      }
+      if (!s.ok()) {
+        std::fprintf(stderr, "ycsb error: %s\n", s.ToString().c_str());
+        std::exit(1);
+      }
+    }
+    if (reads > 0) {
+      char msg[100];
+      std::snprintf(msg, sizeof(msg), "(%d of %d found)", found, reads);
+      thread->stats.AddMessage(msg);
+    }
+  }
+
+  void PrintStats(const char* key) {
+    std::string stats;
+    if (!db_->GetProperty(key, &stats)) {
+      stats = "(failed)";
+    }
+    std::fprintf(stdout, "\n%s\n", stats.c_str());
+  }
+};
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  FLAGS_write_buffer_size = leveldb::Options().write_buffer_size;
+  FLAGS_max_write_buffer_number = leveldb::Options().max_write_buffer_number;
+  FLAGS_max_file_size = leveldb::Options().max_file_size;
+  FLAGS_block_size = leveldb::Options().block_size;
+  FLAGS_open_files = leveldb::Options().max_open_files;
+  std::string default_db_path;
+
+  for (int i = 1; i < argc; i++) {
+    double d;
+    int n;
+    char junk;
+    if (leveldb::Slice(argv[i]).starts_with("--benchmarks=")) {
+      FLAGS_benchmarks = argv[i] + strlen("--benchmarks=");
+    } else if (sscanf(argv[i], "--compression_ratio=%lf%c", &d, &junk) == 1) {
+      FLAGS_compression_ratio = d;
+    } else if (sscanf(argv[i], "--cache_high_pri_pool_ratio=%lf%c", &d,
+                      &junk) == 1) {
+      FLAGS_cache_high_pri_pool_ratio = d;
+    } else if (sscanf(argv[i], "--histogram=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_histogram = n;
+    } else if (sscanf(argv[i], "--use_existing_db=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_use_existing_db = n;
+    } else if (sscanf(argv[i], "--reuse_logs=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_reuse_logs = n;
+    } else if (sscanf(argv[i], "--clock_cache=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_clock_cache = n;
+    } else if (sscanf(argv[i], "--cache_index_and_filter_blocks=%d%c", &n,
+                      &junk) == 1 &&
+               n >= 0 && n <= 2) {
+      FLAGS_cache_index_and_filter_blocks = n;
+    } else if (sscanf(argv[i], "--statistics=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_statistics = n;
+    } else if (sscanf(argv[i], "--num=%d%c", &n, &junk) == 1) {
+      FLAGS_num = n;
+    } else if (sscanf(argv[i], "--reads=%d%c", &n, &junk) == 1) {
+      FLAGS_reads = n;
+    } else if (sscanf(argv[i], "--threads=%d%c", &n, &junk) == 1) {
+      FLAGS_threads = n;
+    } else if (sscanf(argv[i], "--value_size=%d%c", &n, &junk) == 1) {
+      FLAGS_value_size = n;
+    } else if (sscanf(argv[i], "--write_buffer_size=%d%c", &n, &junk) == 1) {
+      FLAGS_write_buffer_size = n;
+    } else if (sscanf(argv[i], "--max_write_buffer_number=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_max_write_buffer_number = n;
+    } else if (sscanf(argv[i], "--max_file_size=%d%c", &n, &junk) == 1) {
+      FLAGS_max_file_size = n;
+    } else if (sscanf(argv[i], "--partition_index_and_filters=%d%c", &n,
+                      &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_partition_index_and_filters = n;
+    } else if (sscanf(argv[i], "--block_size=%d%c", &n, &junk) == 1) {
+      FLAGS_block_size = n;
+    } else if (sscanf(argv[i], "--cache_size=%d%c", &n, &junk) == 1) {
+      FLAGS_cache_size = n;
+    } else if (sscanf(argv[i], "--bloom_bits=%d%c", &n, &junk) == 1) {
+      FLAGS_bloom_bits = n;
+    } else if (sscanf(argv[i], "--full_filter=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_full_filter = n;
+    } else if (sscanf(argv[i], "--ribbon_bloom_before_level=%d%c", &n,
+                      &junk) == 1) {
+      FLAGS_ribbon_bloom_before_level = n;
+    } else if (sscanf(argv[i], "--open_files=%d%c", &n, &junk) == 1) {
+      FLAGS_open_files = n;
+    } else if (sscanf(argv[i], "--ycsb_zipfian_constant=%lf%c", &d, &junk) ==
+                   1 &&
+               d > 0 && d < 1) {
+      FLAGS_ycsb_zipfian_constant = d;
+    } else if (sscanf(argv[i], "--ycsb_max_scan_length=%d%c", &n, &junk) ==
+                   1 &&
+               n > 0) {
+      FLAGS_ycsb_max_scan_length = n;
+    } else if (strncmp(argv[i], "--compression=", 14) == 0) {
+      FLAGS_compression = argv[i] + 14;
+    } else if (strncmp(argv[i], "--db=", 5) == 0) {
+      FLAGS_db = argv[i] + 5;
+    } else {
+      std::fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
+      std::exit(1);
+    }
+  }
+
+  leveldb::g_env = leveldb::Env::Default();
+
+  // Choose a location for the test database if none given with --db=<path>
+  if (FLAGS_db == nullptr) {
+    leveldb::g_env->GetTestDirectory(&default_db_path);
+    default_db_path += "/dbbench";
+    FLAGS_db = default_db_path.c_str();
+  }
+
+  leveldb::Benchmark benchmark;
+  benchmark.Run();
+  return 0;
+}
@@ -0,0 +1,242 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+// Measures NewMergingIterator() over a growing number of children, the
+// shape of a user iterator over many level-0 files or of a compaction
+// input, against the linear scan it used to do on every step.
+//
+// Usage: merger_bench [--entries=N] [--children=4,16,64]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "leveldb/comparator.h"
+#include "leveldb/env.h"
+#include "leveldb/iterator.h"
+#include "leveldb/options.h"
+#include "table/block.h"
+#include "table/block_builder.h"
+#include "table/format.h"
+#include "table/iterator_wrapper.h"
+#include "table/merger.h"
+#include "util/random.h"
+
+namespace leveldb {
+
+namespace {
+
+// Total number of entries merged, whatever the number of children.
+int FLAGS_entries = 1000000;
+
+// Comma-separated numbers of children to run with.
+const char* FLAGS_children = "4,16,64";
+
+// Bytewise order, counting the comparisons made.
+class CountingComparator : public Comparator {
+ public:
+  CountingComparator() : count_(0) {}
+
+  int Compare(const Slice& a, const Slice& b) const override {
+    count_++;
+    return a.compare(b);
+  }
+  const char* Name() const override { return "leveldb.BytewiseComparator"; }
+  void FindShortestSeparator(std::string*, const Slice&) const override {}
+  void FindShortSuccessor(std::string*) const override {}
+
+  uint64_t count() const { return count_; }
+  void Reset() { count_ = 0; }
+
+ private:
+  mutable uint64_t count_;
+};
+
+// The merge as it used to be: every step scans all children for the
+// smallest (or largest) key.  Only forward and reverse scans are
+// supported, which is all the benchmark needs.
+class LinearMergingIterator : public Iterator {
+ public:
+  LinearMergingIterator(const Comparator* comparator,
+                        const std::vector<Iterator*>& children)
+      : comparator_(comparator),
+        children_(children.size()),
+        current_(nullptr) {
+    for (size_t i = 0; i < children.size(); i++) {
+      children_[i].Set(children[i]);
+    }
+  }
+
+  bool Valid() const override { return current_ != nullptr; }
+  Slice key() const override { return current_->key(); }
+  Slice value() const override { return current_->value(); }
+  Status status() const override { return Status::OK(); }
+
+  void SeekToFirst() override {
+    for (IteratorWrapper& child : children_) child.SeekToFirst();
+    Find(+1);
+  }
+  void SeekToLast() override {
+    for (IteratorWrapper& child : children_) child.SeekToLast();
+    Find(-1);
+  }
+  void Seek(const Slice& target) override {
+    for (IteratorWrapper& child : children_) child.Seek(target);
+    Find(+1);
+  }
+  void Next() override {
+    current_->Next();
+    Find(+1);
+  }
+  void Prev() override {
+    current_->Prev();
+    Find(-1);
+  }
+
+ private:
+  void Find(int sign) {
+    current_ = nullptr;
+    for (IteratorWrapper& child : children_) {
+      if (child.Valid() &&
+          (current_ == nullptr ||
+           sign * comparator_->Compare(child.key(), current_->key()) < 0)) {
+        current_ = &child;
+      }
+    }
+  }
+
+  const Comparator* const comparator_;
+  std::vector<IteratorWrapper> children_;
+  IteratorWrapper* current_;
+};
+
+class Benchmark {
+ public:
+  Benchmark() : rnd_(301) {}
+
+  void Run() {
+    std::fprintf(stdout, "Entries:    %d\n", FLAGS_entries);
+    std::fprintf(stdout, "------------------------------------------------\n");
+    const char* p = FLAGS_children;
+    while (p != nullptr && *p != '\0') {
+      int n = std::atoi(p);
+      if (n > 0) {
+        Build(n);
+        RunOne(n, "forward", true);
+        RunOne(n, "reverse", false);
+      }
+      p = std::strchr(p, ',');
+      if (p != nullptr) p++;
+    }
+  }
+
+ private:
+  // Spread FLAGS_entries keys over n in-memory blocks at random.
+  void Build(int n) {
+    Options options;
+    std::vector<BlockBuilder*> builders;
+    for (int i = 0; i < n; i++) {
+      builders.push_back(new BlockBuilder(&options));
+    }
+    char key[20];
+    for (int i = 0; i < FLAGS_entries; i++) {
+      std::snprintf(key, sizeof(key), "%016d", i);
+      builders[rnd_.Uniform(n)]->Add(key, "value");
+    }
+    contents_.clear();
+    for (int i = 0; i < n; i++) {
+      contents_.push_back(builders[i]->Finish().ToString());
+      delete builders[i];
+    }
+  }
+
+  std::vector<Iterator*> NewChildren(std::vector<Block*>* blocks) {
+    std::vector<Iterator*> children;
+    for (const std::string& data : contents_) {
+      BlockContents contents;
+      contents.data = data;
+      contents.cachable = false;
+      contents.heap_allocated = false;
+      blocks->push_back(new Block(contents));
+      children.push_back(blocks->back()->NewIterator(&comparator_));
+    }
+    return children;
+  }
+
+  // Scan "iter" to the end in the given direction and return the number
+  // of entries seen.  Sets *micros and *compares to the cost of the scan.
+  int Scan(Iterator* iter, bool forward, uint64_t* micros,
+           uint64_t* compares) {
+    int entries = 0;
+    comparator_.Reset();
+    const uint64_t start = Env::Default()->NowMicros();
+    if (forward) {
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) entries++;
+    } else {
+      for (iter->SeekToLast(); iter->Valid(); iter->Prev()) entries++;
+    }
+    *micros = Env::Default()->NowMicros() - start;
+    *compares = comparator_.count();
+    return entries;
+  }
+
+  void RunOne(int n, const char* name, bool forward) {
+    std::vector<Block*> blocks;
+    uint64_t heap_micros, heap_compares, linear_micros, linear_compares;
+
+    Iterator* linear =
+        new LinearMergingIterator(&comparator_, NewChildren(&blocks));
+    std::vector<Iterator*> children = NewChildren(&blocks);
+    Iterator* heap = NewMergingIterator(&comparator_, children.data(), n);
+
+    // Warm up the blocks, then time each merge.
+    Scan(linear, forward, &linear_micros, &linear_compares);
+    Scan(linear, forward, &linear_micros, &linear_compares);
+    int entries = Scan(heap, forward, &heap_micros, &heap_compares);
+    delete linear;
+    delete heap;
+    for (Block* block : blocks) {
+      delete block;
+    }
+
+    if (entries == 0) entries = 1;
+    std::fprintf(stdout,
+                 "%3d children %-8s: heap %7.1f ns/op %5.1f cmp/op; "
+                 "linear %7.1f ns/op %5.1f cmp/op\n",
+                 n, name, heap_micros * 1e3 / entries,
+                 static_cast<double>(heap_compares) / entries,
+                 linear_micros * 1e3 / entries,
+                 static_cast<double>(linear_compares) / entries);
+  }
+
+  Random rnd_;
+  CountingComparator comparator_;
+  std::deque<std::string> contents_;
+};
+
+}  // namespace
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    int n;
+    char junk;
+    if (sscanf(argv[i], "--entries=%d%c", &n, &junk) == 1) {
+      leveldb::FLAGS_entries = n;
+    } else if (strncmp(argv[i], "--children=", 11) == 0) {
+      leveldb::FLAGS_children = argv[i] + 11;
+    } else {
+      std::fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
+      std::exit(1);
+    }
+  }
+
+  leveldb::Benchmark benchmark;
+  benchmark.Run();
+  return 0;
+}
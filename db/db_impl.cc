@@ -36,6 +36,9 @@
 #include "util/coding.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
+#include "util/perf_context_imp.h"
+#include "util/stop_watch.h"
+#include "util/thread_local.h"
 
 namespace leveldb {
 
@@ -44,12 +47,29 @@ const int kNumNonTableCacheFiles = 10;
 // Information kept for every waiting writer
 struct DBImpl::Writer {
   explicit Writer(port::Mutex* mu)
-      : batch(nullptr), sync(false), done(false), cv(mu) {}
+      : batch(nullptr),
+        sync(false),
+        done(false),
+        parallel_memtable(nullptr),
+        leader(nullptr),
+        pending_inserts(0),
+        cv(mu) {}
 
   Status status;
   WriteBatch* batch;
   bool sync;
   bool done;
+
+  // Set by the leader of a write group when this writer is to insert its
+  // own batch into parallel_memtable.
+  MemTable* parallel_memtable;
+  Writer* leader;
+
+  // For a leader: the number of parallel inserts still running, and the
+  // first error they returned.
+  int pending_inserts;
+  Status insert_status;
+
   port::CondVar cv;
 };
 
@@ -65,6 +85,10 @@ struct DBImpl::CompactionState {
 
   explicit CompactionState(Compaction* c)
       : compaction(c),
+        has_start(false),
+        has_limit(false),
+        input(nullptr),
+        imm_micros(0),
         smallest_snapshot(0),
         outfile(nullptr),
         builder(nullptr),
@@ -72,6 +96,18 @@ struct DBImpl::CompactionState {
 
   Compaction* const compaction;
 
+  // A subcompaction only processes the user keys in [start, limit).  Each
+  // one has its own input iterator and outputs, and they are installed
+  // together when all of them are done.
+  bool has_start;
+  bool has_limit;
+  std::string start;
+  std::string limit;
+  Iterator* input;
+  Compaction::Cursor cursor;
+  Status status;
+  int64_t imm_micros;  // Micros spent doing imm_ compactions
+
   // Sequence numbers < smallest_snapshot are not significant since we
   // will never have to service a snapshot below smallest_snapshot.
   // Therefore if we have seen a sequence number S <= smallest_snapshot,
@@ -87,6 +123,13 @@ struct DBImpl::CompactionState {
   uint64_t total_bytes;
 };
 
+// A subcompaction running on a thread of its own.
+struct DBImpl::SubcompactionJob {
+  DBImpl* db;
+  CompactionState* compact;
+  int* running;  // Guarded by db->mutex_
+};
+
 // Fix user-supplied options to be reasonable
 template <class T, class V>
 static void ClipToRange(T* ptr, V minvalue, V maxvalue) {
@@ -96,14 +139,32 @@ static void ClipToRange(T* ptr, V minvalue, V maxvalue) {
 Options SanitizeOptions(const std::string& dbname,
                         const InternalKeyComparator* icmp,
                         const InternalFilterPolicy* ipolicy,
+                        const InternalKeySliceTransform* iprefix,
                         const Options& src) {
   Options result = src;
   result.comparator = icmp;
   result.filter_policy = (src.filter_policy != nullptr) ? ipolicy : nullptr;
+  result.prefix_extractor =
+      (src.prefix_extractor != nullptr) ? iprefix : nullptr;
   ClipToRange(&result.max_open_files, 64 + kNumNonTableCacheFiles, 50000);
   ClipToRange(&result.write_buffer_size, 64 << 10, 1 << 30);
+  ClipToRange(&result.max_write_buffer_number, 2, 64);
   ClipToRange(&result.max_file_size, 1 << 20, 1 << 30);
   ClipToRange(&result.block_size, 1 << 10, 4 << 20);
+  ClipToRange(&result.max_background_compactions, 1, 64);
+  ClipToRange(&result.level0_slowdown_writes_trigger,
+              config::kL0_CompactionTrigger, 1000);
+  ClipToRange(&result.level0_stop_writes_trigger,
+              result.level0_slowdown_writes_trigger, 1000);
+  if (result.hard_pending_compaction_bytes_limit != 0 &&
+      result.soft_pending_compaction_bytes_limit >
+          result.hard_pending_compaction_bytes_limit) {
+    result.soft_pending_compaction_bytes_limit =
+        result.hard_pending_compaction_bytes_limit;
+  }
+  ClipToRange(&result.delayed_write_rate, uint64_t{1} << 10,
+              uint64_t{1} << 40);
+  ClipToRange(&result.max_subcompactions, 1, 64);
   if (result.info_log == nullptr) {
     // Open a log file in the same directory as the db
     src.env->CreateDir(dbname);  // In case it does not exist
@@ -115,7 +176,7 @@ Options SanitizeOptions(const std::string& dbname,
     }
   }
   if (result.block_cache == nullptr) {
-    result.block_cache = NewLRUCache(8 << 20);
+    result.block_cache = NewLRUCache(8 << 20, 0.5);
   }
   return result;
 }
@@ -129,8 +190,10 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
     : env_(raw_options.env),
       internal_comparator_(raw_options.comparator),
       internal_filter_policy_(raw_options.filter_policy),
+      internal_prefix_extractor_(raw_options.prefix_extractor),
       options_(SanitizeOptions(dbname, &internal_comparator_,
-                               &internal_filter_policy_, raw_options)),
+                               &internal_filter_policy_,
+                               &internal_prefix_extractor_, raw_options)),
       owns_info_log_(options_.info_log != raw_options.info_log),
       owns_cache_(options_.block_cache != raw_options.block_cache),
       dbname_(dbname),
@@ -139,14 +202,20 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
       shutting_down_(false),
       background_work_finished_signal_(&mutex_),
       mem_(nullptr),
-      imm_(nullptr),
       has_imm_(false),
       logfile_(nullptr),
       logfile_number_(0),
       log_(nullptr),
       seed_(0),
+      super_version_(nullptr),
+      local_super_version_(new ThreadLocalPtr(&UnrefThreadLocalSuperVersion)),
       tmp_batch_(new WriteBatch),
-      background_compaction_scheduled_(false),
+      write_controller_(options_.delayed_write_rate),
+      last_batch_group_size_(0),
+      background_compactions_scheduled_(0),
+      background_flush_scheduled_(false),
+      memtable_flush_running_(false),
+      manifest_write_in_progress_(false),
       manual_compaction_(nullptr),
       versions_(new VersionSet(dbname_, &options_, table_cache_,
                                &internal_comparator_)) {}
@@ -155,10 +224,16 @@ DBImpl::~DBImpl() {
   // Wait for background work to finish.
   mutex_.Lock();
   shutting_down_.store(true, std::memory_order_release);
-  while (background_compaction_scheduled_) {
+  while (background_compactions_scheduled_ > 0 || background_flush_scheduled_) {
     background_work_finished_signal_.Wait();
   }
+  if (super_version_ != nullptr) {
+    ResetThreadLocalSuperVersions();
+    CleanupSuperVersion(super_version_);
+    super_version_ = nullptr;
+  }
   mutex_.Unlock();
+  delete local_super_version_;
 
   if (db_lock_ != nullptr) {
     env_->UnlockFile(db_lock_);
@@ -166,7 +241,9 @@ DBImpl::~DBImpl() {
 
   delete versions_;
   if (mem_ != nullptr) mem_->Unref();
-  if (imm_ != nullptr) imm_->Unref();
+  for (const ImmutableMemTable& imm : imm_) {
+    imm.mem->Unref();
+  }
   delete tmp_batch_;
   delete log_;
   delete logfile_;
@@ -457,7 +534,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     if (mem->ApproximateMemoryUsage() > options_.write_buffer_size) {
       compactions++;
       *save_manifest = true;
-      status = WriteLevel0Table(mem, edit, nullptr);
+      status = WriteLevel0Table({mem}, edit, nullptr, nullptr);
       mem->Unref();
       mem = nullptr;
       if (!status.ok()) {
@@ -496,7 +573,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     // mem did not get reused; compact it.
     if (status.ok()) {
       *save_manifest = true;
-      status = WriteLevel0Table(mem, edit, nullptr);
+      status = WriteLevel0Table({mem}, edit, nullptr, nullptr);
     }
     mem->Unref();
   }
@@ -504,16 +581,30 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
   return status;
 }
 
-Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
-                                Version* base) {
+Status DBImpl::WriteLevel0Table(const std::vector<MemTable*>& mems,
+                                VersionEdit* edit, Version* base,
+                                uint64_t* pending_number) {
   mutex_.AssertHeld();
+  assert(!mems.empty());
   const uint64_t start_micros = env_->NowMicros();
   FileMetaData meta;
   meta.number = versions_->NewFileNumber();
   pending_outputs_.insert(meta.number);
-  Iterator* iter = mem->NewIterator();
-  Log(options_.info_log, "Level-0 table #%llu: started",
-      (unsigned long long)meta.number);
+  Iterator* iter;
+  if (mems.size() == 1) {
+    iter = mems[0]->NewIterator();
+  } else {
+    // Entries for the same user key carry distinct sequence numbers, so
+    // the merged stream keeps every version in internal key order.
+    std::vector<Iterator*> list;
+    list.reserve(mems.size());
+    for (MemTable* mem : mems) {
+      list.push_back(mem->NewIterator());
+    }
+    iter = NewMergingIterator(&internal_comparator_, &list[0], list.size());
+  }
+  Log(options_.info_log, "Level-0 table #%llu: started (%d memtables)",
+      (unsigned long long)meta.number, static_cast<int>(mems.size()));
 
   Status s;
   {
@@ -526,7 +617,11 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
       (unsigned long long)meta.number, (unsigned long long)meta.file_size,
       s.ToString().c_str());
   delete iter;
-  pending_outputs_.erase(meta.number);
+  if (pending_number != nullptr) {
+    *pending_number = meta.number;
+  } else {
+    pending_outputs_.erase(meta.number);
+  }
 
   // Note that if file_size is zero, the file has been deleted and
   // should not be added to the manifest.
@@ -535,7 +630,13 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
     const Slice min_user_key = meta.smallest.user_key();
     const Slice max_user_key = meta.largest.user_key();
     if (base != nullptr) {
-      level = base->PickLevelForMemTableOutput(min_user_key, max_user_key);
+      // Background compactions may have installed newer versions while the
+      // table was being built, so place it against the current one.  The
+      // chosen range stays claimed until CompactMemTable() installs it.
+      level = versions_->current()->PickLevelForMemTableOutput(min_user_key,
+                                                               max_user_key);
+      versions_->ReserveOutputRange(mems[0], level, meta.smallest,
+                                    meta.largest);
     }
     edit->AddFile(level, meta.number, meta.file_size, meta.smallest,
                   meta.largest);
@@ -545,42 +646,193 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
   stats.micros = env_->NowMicros() - start_micros;
   stats.bytes_written = meta.file_size;
   stats_[level].Add(stats);
+  if (options_.statistics != nullptr) {
+    options_.statistics->MeasureTime(kCompactionMicros, stats.micros);
+    options_.statistics->RecordTick(kCompactWriteBytes, stats.bytes_written);
+  }
   return s;
 }
 
 void DBImpl::CompactMemTable() {
   mutex_.AssertHeld();
-  assert(imm_ != nullptr);
-
-  // Save the contents of the memtable as a new Table
+  assert(!imm_.empty());
+  assert(!memtable_flush_running_);
+  memtable_flush_running_ = true;
+
+  // Save the contents of the memtables queued so far as a new Table.
+  // Writers may queue more while mutex_ is released; those stay for the
+  // next flush.
+  const size_t n = imm_.size();
+  std::vector<MemTable*> mems;
+  mems.reserve(n);
+  for (size_t i = 0; i < n; i++) {
+    mems.push_back(imm_[i].mem);
+  }
   VersionEdit edit;
   Version* base = versions_->current();
   base->Ref();
-  Status s = WriteLevel0Table(imm_, &edit, base);
+  uint64_t table_number;
+  Status s = WriteLevel0Table(mems, &edit, base, &table_number);
   base->Unref();
 
   if (s.ok() && shutting_down_.load(std::memory_order_acquire)) {
     s = Status::IOError("Deleting DB during memtable compaction");
   }
 
-  // Replace immutable memtable with the generated Table
+  // Replace the flushed memtables with the generated Table
   if (s.ok()) {
     edit.SetPrevLogNumber(0);
-    edit.SetLogNumber(logfile_number_);  // Earlier logs no longer needed
-    s = versions_->LogAndApply(&edit, &mutex_);
+    // Logs older than the one the newest flushed memtable's successor
+    // was written to are no longer needed.
+    edit.SetLogNumber(imm_[n - 1].next_log_number);
+    s = LogAndApply(&edit);
   }
+  versions_->ReleaseOutputRanges(mems[0]);
+  pending_outputs_.erase(table_number);
+  memtable_flush_running_ = false;
 
   if (s.ok()) {
     // Commit to the new state
-    imm_->Unref();
-    imm_ = nullptr;
-    has_imm_.store(false, std::memory_order_release);
+    for (size_t i = 0; i < n; i++) {
+      imm_.front().mem->Unref();
+      imm_.pop_front();
+    }
+    has_imm_.store(!imm_.empty(), std::memory_order_release);
+    InstallSuperVersion();
     RemoveObsoleteFiles();
   } else {
     RecordBackgroundError(s);
   }
 }
 
+Status DBImpl::LogAndApply(VersionEdit* edit) {
+  mutex_.AssertHeld();
+  // VersionSet::LogAndApply() releases mutex_ while it writes the MANIFEST,
+  // so flushes and compactions finishing at the same time take turns.
+  while (manifest_write_in_progress_) {
+    background_work_finished_signal_.Wait();
+  }
+  manifest_write_in_progress_ = true;
+  Status s = versions_->LogAndApply(edit, &mutex_);
+  manifest_write_in_progress_ = false;
+  background_work_finished_signal_.SignalAll();
+  if (s.ok()) {
+    InstallSuperVersion();
+  }
+  return s;
+}
+
+namespace {
+// Marks the thread-local SuperVersion slot while the thread uses the
+// SuperVersion it held.
+char super_version_in_use_marker;
+void* const kSuperVersionInUse = &super_version_in_use_marker;
+}  // namespace
+
+// Drops the reference of a thread-local SuperVersion when its thread exits.
+// This is never the last reference: the DB keeps its own reference to the
+// installed SuperVersion until it has reset all thread-local copies.
+void DBImpl::UnrefThreadLocalSuperVersion(void* ptr) {
+  if (ptr == kSuperVersionInUse) return;
+  SuperVersion* sv = reinterpret_cast<SuperVersion*>(ptr);
+  int old_refs = sv->refs.fetch_sub(1, std::memory_order_acq_rel);
+  assert(old_refs > 1);
+  (void)old_refs;
+}
+
+void DBImpl::InstallSuperVersion() {
+  mutex_.AssertHeld();
+  SuperVersion* sv = new SuperVersion;
+  sv->mem = mem_;
+  sv->imm.reserve(imm_.size());
+  for (auto it = imm_.rbegin(); it != imm_.rend(); ++it) {
+    sv->imm.push_back(it->mem);
+  }
+  sv->current = versions_->current();
+  sv->refs.store(1, std::memory_order_relaxed);
+  sv->mem->Ref();
+  for (MemTable* imm : sv->imm) {
+    imm->Ref();
+  }
+  sv->current->Ref();
+
+  SuperVersion* old = super_version_;
+  super_version_ = sv;
+  if (old != nullptr) {
+    // Thread-local copies must go before our reference to "old" does.
+    ResetThreadLocalSuperVersions();
+    if (old->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      CleanupSuperVersion(old);
+    }
+  }
+}
+
+void DBImpl::ResetThreadLocalSuperVersions() {
+  mutex_.AssertHeld();
+  std::vector<void*> cached;
+  local_super_version_->Scrape(&cached, nullptr);
+  for (void* ptr : cached) {
+    // A thread using its SuperVersion finds its slot emptied when it hands
+    // the SuperVersion back, and drops the reference itself.
+    if (ptr == kSuperVersionInUse) continue;
+    SuperVersion* sv = reinterpret_cast<SuperVersion*>(ptr);
+    if (sv->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      CleanupSuperVersion(sv);
+    }
+  }
+}
+
+void DBImpl::CleanupSuperVersion(SuperVersion* sv) {
+  mutex_.AssertHeld();
+  sv->mem->Unref();
+  for (MemTable* imm : sv->imm) {
+    imm->Unref();
+  }
+  sv->current->Unref();
+  delete sv;
+}
+
+DBImpl::SuperVersion* DBImpl::GetAndRefSuperVersion() {
+  void* ptr = local_super_version_->Swap(kSuperVersionInUse);
+  assert(ptr != kSuperVersionInUse);
+  SuperVersion* sv = reinterpret_cast<SuperVersion*>(ptr);
+  if (sv == nullptr) {
+    // Nothing cached, or a new SuperVersion was installed since
+    MutexLock l(&mutex_);
+    sv = super_version_;
+    sv->refs.fetch_add(1, std::memory_order_relaxed);
+  }
+  return sv;
+}
+
+void DBImpl::ReturnSuperVersion(SuperVersion* sv) {
+  void* expected = kSuperVersionInUse;
+  if (!local_super_version_->CompareAndSwap(sv, &expected)) {
+    // The slot was reset while we used "sv", so "sv" may be obsolete.
+    assert(expected == nullptr);
+    UnrefSuperVersion(sv);
+  }
+}
+
+DBImpl::SuperVersion* DBImpl::RefSuperVersion() {
+  SuperVersion* sv = GetAndRefSuperVersion();
+  sv->refs.fetch_add(1, std::memory_order_relaxed);
+  ReturnSuperVersion(sv);
+  return sv;
+}
+
+void DBImpl::UnrefSuperVersion(SuperVersion* sv) {
+  if (sv->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    MutexLock l(&mutex_);
+    CleanupSuperVersion(sv);
+  }
+}
+
+void DBImpl::UnrefSuperVersionCleanup(void* db, void* sv) {
+  reinterpret_cast<DBImpl*>(db)->UnrefSuperVersion(
+      reinterpret_cast<SuperVersion*>(sv));
+}
+
 void DBImpl::CompactRange(const Slice* begin, const Slice* end) {
   int max_level_with_files = 1;
   {
@@ -608,6 +860,7 @@ void DBImpl::TEST_CompactRange(int level, const Slice* begin,
   ManualCompaction manual;
   manual.level = level;
   manual.done = false;
+  manual.in_progress = false;
   if (begin == nullptr) {
     manual.begin = nullptr;
   } else {
@@ -631,9 +884,9 @@ void DBImpl::TEST_CompactRange(int level, const Slice* begin,
       background_work_finished_signal_.Wait();
     }
   }
-  // Finish current background compaction in the case where
+  // Finish current background compactions in the case where
   // `background_work_finished_signal_` was signalled due to an error.
-  while (background_compaction_scheduled_) {
+  while (background_compactions_scheduled_ > 0) {
     background_work_finished_signal_.Wait();
   }
   if (manual_compaction_ == &manual) {
@@ -648,10 +901,10 @@ Status DBImpl::TEST_CompactMemTable() {
   if (s.ok()) {
     // Wait until the compaction completes
     MutexLock l(&mutex_);
-    while (imm_ != nullptr && bg_error_.ok()) {
+    while (!imm_.empty() && bg_error_.ok()) {
       background_work_finished_signal_.Wait();
     }
-    if (imm_ != nullptr) {
+    if (!imm_.empty()) {
       s = bg_error_;
     }
   }
@@ -668,17 +921,26 @@ void DBImpl::RecordBackgroundError(const Status& s) {
 
 void DBImpl::MaybeScheduleCompaction() {
   mutex_.AssertHeld();
-  if (background_compaction_scheduled_) {
-    // Already scheduled
-  } else if (shutting_down_.load(std::memory_order_acquire)) {
+  if (shutting_down_.load(std::memory_order_acquire)) {
     // DB is being deleted; no more background compactions
-  } else if (!bg_error_.ok()) {
+    return;
+  }
+  if (!bg_error_.ok()) {
     // Already got an error; no more changes
-  } else if (imm_ == nullptr && manual_compaction_ == nullptr &&
-             !versions_->NeedsCompaction()) {
-    // No work to be done
-  } else {
-    background_compaction_scheduled_ = true;
+    return;
+  }
+
+  if (!imm_.empty() && !background_flush_scheduled_) {
+    background_flush_scheduled_ = true;
+    env_->ScheduleHighPriority(&DBImpl::BGWorkFlush, this);
+  }
+
+  // Every compaction picks its inputs when it starts running, so a job
+  // scheduled here may find that the running ones already own all the work.
+  while (background_compactions_scheduled_ <
+             options_.max_background_compactions &&
+         (manual_compaction_ != nullptr || versions_->NeedsCompaction())) {
+    background_compactions_scheduled_++;
     env_->Schedule(&DBImpl::BGWork, this);
   }
 }
@@ -687,38 +949,65 @@ void DBImpl::BGWork(void* db) {
   reinterpret_cast<DBImpl*>(db)->BackgroundCall();
 }
 
+void DBImpl::BGWorkFlush(void* db) {
+  reinterpret_cast<DBImpl*>(db)->BackgroundFlushCall();
+}
+
 void DBImpl::BackgroundCall() {
   MutexLock l(&mutex_);
-  assert(background_compaction_scheduled_);
+  assert(background_compactions_scheduled_ > 0);
+  bool made_progress = false;
   if (shutting_down_.load(std::memory_order_acquire)) {
     // No more background work when shutting down.
   } else if (!bg_error_.ok()) {
     // No more background work after a background error.
   } else {
-    BackgroundCompaction();
+    BackgroundCompaction(&made_progress);
   }
 
-  background_compaction_scheduled_ = false;
+  background_compactions_scheduled_--;
 
   // Previous compaction may have produced too many files in a level,
-  // so reschedule another compaction if needed.
-  MaybeScheduleCompaction();
+  // so reschedule another compaction if needed.  A job that found nothing
+  // to do does not: whatever blocked it reschedules once it finishes.
+  if (made_progress) {
+    MaybeScheduleCompaction();
+  }
   background_work_finished_signal_.SignalAll();
 }
 
-void DBImpl::BackgroundCompaction() {
-  mutex_.AssertHeld();
-
-  if (imm_ != nullptr) {
+void DBImpl::BackgroundFlushCall() {
+  MutexLock l(&mutex_);
+  assert(background_flush_scheduled_);
+  if (shutting_down_.load(std::memory_order_acquire)) {
+    // No more background work when shutting down.
+  } else if (!bg_error_.ok()) {
+    // No more background work after a background error.
+  } else if (!imm_.empty() && !memtable_flush_running_) {
     CompactMemTable();
-    return;
   }
 
+  background_flush_scheduled_ = false;
+
+  // The new level-0 file may call for a compaction.
+  MaybeScheduleCompaction();
+  background_work_finished_signal_.SignalAll();
+}
+
+void DBImpl::BackgroundCompaction(bool* made_progress) {
+  mutex_.AssertHeld();
+
   Compaction* c;
-  bool is_manual = (manual_compaction_ != nullptr);
+  ManualCompaction* m = manual_compaction_;
+  bool is_manual = (m != nullptr && !m->in_progress);
   InternalKey manual_end;
   if (is_manual) {
-    ManualCompaction* m = manual_compaction_;
+    if (versions_->HasPendingOutputs()) {
+      // A manual compaction runs alone.  Start nothing new until the
+      // running flushes and compactions are done; they reschedule us.
+      return;
+    }
+    m->in_progress = true;
     c = versions_->CompactRange(m->level, m->begin, m->end);
     m->done = (c == nullptr);
     if (c != nullptr) {
@@ -732,6 +1021,7 @@ void DBImpl::BackgroundCompaction() {
   } else {
     c = versions_->PickCompaction();
   }
+  *made_progress = (is_manual || c != nullptr);
 
   Status status;
   if (c == nullptr) {
@@ -743,7 +1033,7 @@ void DBImpl::BackgroundCompaction() {
     c->edit()->RemoveFile(c->level(), f->number);
     c->edit()->AddFile(c->level() + 1, f->number, f->file_size, f->smallest,
                        f->largest);
-    status = versions_->LogAndApply(c->edit(), &mutex_);
+    status = LogAndApply(c->edit());
     if (!status.ok()) {
       RecordBackgroundError(status);
     }
@@ -773,7 +1063,7 @@ void DBImpl::BackgroundCompaction() {
   }
 
   if (is_manual) {
-    ManualCompaction* m = manual_compaction_;
+    m->in_progress = false;
     if (!status.ok()) {
       m->done = true;
     }
@@ -824,7 +1114,8 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
   std::string fname = TableFileName(dbname_, file_number);
   Status s = env_->NewWritableFile(fname, &compact->outfile);
   if (s.ok()) {
-    compact->builder = new TableBuilder(options_, compact->outfile);
+    compact->builder = new TableBuilder(options_, compact->outfile,
+                                        compact->compaction->level() + 1);
   }
   return s;
 }
@@ -854,6 +1145,7 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
 
   // Finish and check for file errors
   if (s.ok()) {
+    StopWatch sw(env_, options_.statistics, kTableSyncMicros);
     s = compact->outfile->Sync();
   }
   if (s.ok()) {
@@ -864,8 +1156,8 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
 
   if (s.ok() && current_entries > 0) {
     // Verify that the table is usable
-    Iterator* iter =
-        table_cache_->NewIterator(ReadOptions(), output_number, current_bytes);
+    Iterator* iter = table_cache_->NewIterator(ReadOptions(), output_number,
+                                               current_bytes, -1);
     s = iter->status();
     delete iter;
     if (s.ok()) {
@@ -893,12 +1185,11 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact) {
     compact->compaction->edit()->AddFile(level + 1, out.number, out.file_size,
                                          out.smallest, out.largest);
   }
-  return versions_->LogAndApply(compact->compaction->edit(), &mutex_);
+  return LogAndApply(compact->compaction->edit());
 }
 
 Status DBImpl::DoCompactionWork(CompactionState* compact) {
   const uint64_t start_micros = env_->NowMicros();
-  int64_t imm_micros = 0;  // Micros spent doing imm_ compactions
 
   Log(options_.info_log, "Compacting %d@%d + %d@%d files",
       compact->compaction->num_input_files(0), compact->compaction->level(),
@@ -914,12 +1205,111 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     compact->smallest_snapshot = snapshots_.oldest()->sequence_number();
   }
 
-  Iterator* input = versions_->MakeInputIterator(compact->compaction);
+  // Split large compactions into key ranges that are compacted in parallel.
+  // "compact" itself takes the first range.
+  std::vector<std::string> boundaries;
+  if (options_.max_subcompactions > 1) {
+    versions_->GetSubcompactionBoundaries(
+        compact->compaction, options_.max_subcompactions, &boundaries);
+  }
+  std::vector<CompactionState*> subcompactions(1, compact);
+  for (const std::string& boundary : boundaries) {
+    subcompactions.back()->has_limit = true;
+    subcompactions.back()->limit = boundary;
+    CompactionState* sub = new CompactionState(compact->compaction);
+    sub->smallest_snapshot = compact->smallest_snapshot;
+    sub->has_start = true;
+    sub->start = boundary;
+    subcompactions.push_back(sub);
+  }
+  if (subcompactions.size() > 1) {
+    Log(options_.info_log, "Compacting in %d subcompactions",
+        static_cast<int>(subcompactions.size()));
+  }
+  for (CompactionState* sub : subcompactions) {
+    sub->input = versions_->MakeInputIterator(compact->compaction);
+  }
 
   // Release mutex while we're actually doing the compaction work
   mutex_.Unlock();
 
-  input->SeekToFirst();
+  int running = static_cast<int>(subcompactions.size()) - 1;
+  std::vector<SubcompactionJob> jobs(subcompactions.size());
+  for (size_t i = 1; i < subcompactions.size(); i++) {
+    jobs[i] = SubcompactionJob{this, subcompactions[i], &running};
+    env_->StartThread(&DBImpl::BGWorkSubcompaction, &jobs[i]);
+  }
+  RunSubcompaction(compact);
+
+  mutex_.Lock();
+  while (running > 0) {
+    background_work_finished_signal_.Wait();
+  }
+
+  // Hand the outputs of the other subcompactions, which follow ours in key
+  // order, over to "compact" so that they are installed (or cleaned up)
+  // together.
+  Status status = compact->status;
+  int64_t imm_micros = compact->imm_micros;
+  for (size_t i = 1; i < subcompactions.size(); i++) {
+    CompactionState* sub = subcompactions[i];
+    if (status.ok()) {
+      status = sub->status;
+    }
+    imm_micros += sub->imm_micros;
+    compact->outputs.insert(compact->outputs.end(), sub->outputs.begin(),
+                            sub->outputs.end());
+    compact->total_bytes += sub->total_bytes;
+    sub->outputs.clear();
+    CleanupCompaction(sub);
+  }
+
+  CompactionStats stats;
+  stats.micros = env_->NowMicros() - start_micros - imm_micros;
+  for (int which = 0; which < 2; which++) {
+    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
+      stats.bytes_read += compact->compaction->input(which, i)->file_size;
+    }
+  }
+  for (size_t i = 0; i < compact->outputs.size(); i++) {
+    stats.bytes_written += compact->outputs[i].file_size;
+  }
+
+  stats_[compact->compaction->level() + 1].Add(stats);
+  if (options_.statistics != nullptr) {
+    options_.statistics->MeasureTime(kCompactionMicros, stats.micros);
+    options_.statistics->RecordTick(kCompactReadBytes, stats.bytes_read);
+    options_.statistics->RecordTick(kCompactWriteBytes, stats.bytes_written);
+  }
+
+  if (status.ok()) {
+    status = InstallCompactionResults(compact);
+  }
+  if (!status.ok()) {
+    RecordBackgroundError(status);
+  }
+  VersionSet::LevelSummaryStorage tmp;
+  Log(options_.info_log, "compacted to: %s", versions_->LevelSummary(&tmp));
+  return status;
+}
+
+void DBImpl::BGWorkSubcompaction(void* job) {
+  SubcompactionJob* j = reinterpret_cast<SubcompactionJob*>(job);
+  j->db->RunSubcompaction(j->compact);
+  MutexLock l(&j->db->mutex_);
+  --*j->running;
+  j->db->background_work_finished_signal_.SignalAll();
+}
+
+void DBImpl::RunSubcompaction(CompactionState* compact) {
+  Iterator* input = compact->input;
+  int64_t imm_micros = 0;
+  if (compact->has_start) {
+    InternalKey start(compact->start, kMaxSequenceNumber, kValueTypeForSeek);
+    input->Seek(start.Encode());
+  } else {
+    input->SeekToFirst();
+  }
   Status status;
   ParsedInternalKey ikey;
   std::string current_user_key;
@@ -930,7 +1320,7 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     if (has_imm_.load(std::memory_order_relaxed)) {
       const uint64_t imm_start = env_->NowMicros();
       mutex_.Lock();
-      if (imm_ != nullptr) {
+      if (!imm_.empty() && !memtable_flush_running_) {
         CompactMemTable();
         // Wake up MakeRoomForWrite() if necessary.
         background_work_finished_signal_.SignalAll();
@@ -940,7 +1330,12 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     }
 
     Slice key = input->key();
-    if (compact->compaction->ShouldStopBefore(key) &&
+    if (compact->has_limit && key.size() >= 8 &&
+        user_comparator()->Compare(ExtractUserKey(key), compact->limit) >= 0) {
+      // The next subcompaction takes it from here.
+      break;
+    }
+    if (compact->compaction->ShouldStopBefore(key, &compact->cursor) &&
         compact->builder != nullptr) {
       status = FinishCompactionOutputFile(compact, input);
       if (!status.ok()) {
@@ -970,7 +1365,8 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         drop = true;  // (A)
       } else if (ikey.type == kTypeDeletion &&
                  ikey.sequence <= compact->smallest_snapshot &&
-                 compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
+                 compact->compaction->IsBaseLevelForKey(ikey.user_key,
+                                                        &compact->cursor)) {
         // For this user key:
         // (1) there is no data in higher levels
         // (2) data in lower levels will have larger sequence numbers
@@ -989,7 +1385,7 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         "%d smallest_snapshot: %d",
         ikey.user_key.ToString().c_str(),
         (int)ikey.sequence, ikey.type, kTypeValue, drop,
-        compact->compaction->IsBaseLevelForKey(ikey.user_key),
+        compact->compaction->IsBaseLevelForKey(ikey.user_key, &compact->cursor),
         (int)last_sequence_for_key, (int)compact->smallest_snapshot);
 #endif
 
@@ -1030,81 +1426,71 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     status = input->status();
   }
   delete input;
-  input = nullptr;
+  compact->input = nullptr;
 
-  CompactionStats stats;
-  stats.micros = env_->NowMicros() - start_micros - imm_micros;
-  for (int which = 0; which < 2; which++) {
-    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
-      stats.bytes_read += compact->compaction->input(which, i)->file_size;
-    }
-  }
-  for (size_t i = 0; i < compact->outputs.size(); i++) {
-    stats.bytes_written += compact->outputs[i].file_size;
-  }
-
-  mutex_.Lock();
-  stats_[compact->compaction->level() + 1].Add(stats);
-
-  if (status.ok()) {
-    status = InstallCompactionResults(compact);
-  }
-  if (!status.ok()) {
-    RecordBackgroundError(status);
-  }
-  VersionSet::LevelSummaryStorage tmp;
-  Log(options_.info_log, "compacted to: %s", versions_->LevelSummary(&tmp));
-  return status;
+  compact->status = status;
+  compact->imm_micros = imm_micros;
 }
 
 namespace {
 
-struct IterState {
-  port::Mutex* const mu;
-  Version* const version GUARDED_BY(mu);
-  MemTable* const mem GUARDED_BY(mu);
-  MemTable* const imm GUARDED_BY(mu);
-
-  IterState(port::Mutex* mutex, MemTable* mem, MemTable* imm, Version* version)
-      : mu(mutex), version(version), mem(mem), imm(imm) {}
+// The iterate bounds of a ReadOptions as internal keys, which the
+// iterators of the tables of a version compare with their keys.  Each
+// sorts before all the internal keys of its user key.
+struct InternalBounds {
+  InternalKey lower_key;
+  InternalKey upper_key;
+  Slice lower;
+  Slice upper;
 };
 
-static void CleanupIteratorState(void* arg1, void* arg2) {
-  IterState* state = reinterpret_cast<IterState*>(arg1);
-  state->mu->Lock();
-  state->mem->Unref();
-  if (state->imm != nullptr) state->imm->Unref();
-  state->version->Unref();
-  state->mu->Unlock();
-  delete state;
+void DeleteInternalBounds(void* bounds, void*) {
+  delete reinterpret_cast<InternalBounds*>(bounds);
 }
 
-}  // anonymous namespace
+}  // namespace
 
 Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
                                       SequenceNumber* latest_snapshot,
                                       uint32_t* seed) {
-  mutex_.Lock();
+  SuperVersion* sv = RefSuperVersion();
   *latest_snapshot = versions_->LastSequence();
 
+  ReadOptions table_options = options;
+  InternalBounds* bounds = nullptr;
+  if (options.iterate_lower_bound != nullptr ||
+      options.iterate_upper_bound != nullptr) {
+    bounds = new InternalBounds;
+    if (options.iterate_lower_bound != nullptr) {
+      bounds->lower_key = InternalKey(*options.iterate_lower_bound,
+                                      kMaxSequenceNumber, kValueTypeForSeek);
+      bounds->lower = bounds->lower_key.Encode();
+      table_options.iterate_lower_bound = &bounds->lower;
+    }
+    if (options.iterate_upper_bound != nullptr) {
+      bounds->upper_key = InternalKey(*options.iterate_upper_bound,
+                                      kMaxSequenceNumber, kValueTypeForSeek);
+      bounds->upper = bounds->upper_key.Encode();
+      table_options.iterate_upper_bound = &bounds->upper;
+    }
+  }
+
   // Collect together all needed child iterators
   std::vector<Iterator*> list;
-  list.push_back(mem_->NewIterator());
-  mem_->Ref();
-  if (imm_ != nullptr) {
-    list.push_back(imm_->NewIterator());
-    imm_->Ref();
+  list.push_back(sv->mem->NewIterator());
+  for (MemTable* imm : sv->imm) {
+    list.push_back(imm->NewIterator());
   }
-  versions_->current()->AddIterators(options, &list);
+  sv->current->AddIterators(table_options, &list);
   Iterator* internal_iter = NewMergingIterator(&internal_comparator_, &list[0],
                                                static_cast<int>(list.size()));
-  versions_->current()->Ref();
-
-  IterState* cleanup = new IterState(&mutex_, mem_, imm_, versions_->current());
-  internal_iter->RegisterCleanup(CleanupIteratorState, cleanup, nullptr);
+  internal_iter->RegisterCleanup(UnrefSuperVersionCleanup, this, sv);
+  if (bounds != nullptr) {
+    // Runs once the child iterators, which point to the bounds, are gone
+    internal_iter->RegisterCleanup(DeleteInternalBounds, bounds, nullptr);
+  }
 
-  *seed = ++seed_;
-  mutex_.Unlock();
+  *seed = seed_.fetch_add(1, std::memory_order_relaxed) + 1;
   return internal_iter;
 }
 
@@ -1119,10 +1505,28 @@ int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
   return versions_->MaxNextLevelOverlappingBytes();
 }
 
+bool DBImpl::GetFromMemTables(const SuperVersion* sv, const LookupKey& key,
+                              std::string* value, Status* s) {
+  if (sv->mem->Get(key, value, s)) {
+    return true;
+  }
+  for (MemTable* imm : sv->imm) {
+    if (imm->Get(key, value, s)) {
+      return true;
+    }
+  }
+  return false;
+}
+
 Status DBImpl::Get(const ReadOptions& options, const Slice& key,
                    std::string* value) {
+  Statistics* const statistics = options_.statistics;
+  StopWatch sw(env_, statistics, kGetMicros);
+  PerfTimer perf_timer(&PerfContext::get_nanos);
   Status s;
-  MutexLock l(&mutex_);
+  // Pin the SuperVersion before reading the sequence number: data at or
+  // below a sequence number read later cannot have been compacted away.
+  SuperVersion* sv = GetAndRefSuperVersion();
   SequenceNumber snapshot;
   if (options.snapshot != nullptr) {
     snapshot =
@@ -1131,39 +1535,118 @@ Status DBImpl::Get(const ReadOptions& options, const Slice& key,
     snapshot = versions_->LastSequence();
   }
 
-  MemTable* mem = mem_;
-  MemTable* imm = imm_;
-  Version* current = versions_->current();
-  mem->Ref();
-  if (imm != nullptr) imm->Ref();
-  current->Ref();
-
-  bool have_stat_update = false;
   Version::GetStats stats;
+  stats.seek_file = nullptr;
 
-  // Unlock while reading from files and memtables
-  {
-    mutex_.Unlock();
-    // First look in the memtable, then in the immutable memtable (if any).
-    LookupKey lkey(key, snapshot);
-    if (mem->Get(lkey, value, &s)) {
-      // Done
-    } else if (imm != nullptr && imm->Get(lkey, value, &s)) {
-      // Done
+  // First look in the memtables, newest first.
+  LookupKey lkey(key, snapshot);
+  if (GetFromMemTables(sv, lkey, value, &s)) {
+    RecordTick(statistics, kMemtableHit);
+  } else {
+    RecordTick(statistics, kMemtableMiss);
+    s = sv->current->Get(options, lkey, value, &stats);
+  }
+  if (s.ok()) {
+    RecordTick(statistics, kKeysRead);
+    RecordTick(statistics, kBytesRead, value->size());
+  }
+
+  // Only reads that had to seek more than one file update the stats.
+  if (stats.seek_file != nullptr) {
+    MutexLock l(&mutex_);
+    if (sv->current->UpdateStats(stats)) {
+      MaybeScheduleCompaction();
+    }
+  }
+  ReturnSuperVersion(sv);
+  return s;
+}
+
+void DBImpl::MultiGet(const ReadOptions& options,
+                      const std::vector<Slice>& keys,
+                      std::vector<std::string>* values,
+                      std::vector<Status>* statuses) {
+  Statistics* const statistics = options_.statistics;
+  values->assign(keys.size(), std::string());
+  statuses->assign(keys.size(), Status());
+
+  SuperVersion* sv = GetAndRefSuperVersion();
+  SequenceNumber snapshot;
+  if (options.snapshot != nullptr) {
+    snapshot =
+        static_cast<const SnapshotImpl*>(options.snapshot)->sequence_number();
+  } else {
+    snapshot = versions_->LastSequence();
+  }
+  Version* current = sv->current;
+
+  std::vector<Version::KeyLookup> lookups;
+  // Visit the keys in sorted order, so that the table files can serve
+  // them in a single pass.
+  std::vector<size_t> order(keys.size());
+  for (size_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  const Comparator* ucmp = user_comparator();
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return ucmp->Compare(keys[a], keys[b]) < 0;
+  });
+
+  // First look in the memtables, newest first.  The keys they do not
+  // answer go to the table files as one batch.
+  std::vector<LookupKey*> lkeys;
+  std::vector<size_t> lookup_index;
+  lkeys.reserve(keys.size());
+  for (size_t i : order) {
+    LookupKey* lkey = new LookupKey(keys[i], snapshot);
+    lkeys.push_back(lkey);
+    if (GetFromMemTables(sv, *lkey, &(*values)[i], &(*statuses)[i])) {
+      RecordTick(statistics, kMemtableHit);
     } else {
-      s = current->Get(options, lkey, value, &stats);
-      have_stat_update = true;
+      RecordTick(statistics, kMemtableMiss);
+      lookups.emplace_back(lkey, &(*values)[i]);
+      lookup_index.push_back(i);
     }
-    mutex_.Lock();
+  }
+  if (!lookups.empty()) {
+    current->MultiGet(options, &lookups);
+    for (size_t j = 0; j < lookups.size(); j++) {
+      (*statuses)[lookup_index[j]] = lookups[j].status;
+    }
+  }
+  for (LookupKey* lkey : lkeys) {
+    delete lkey;
+  }
+  if (statistics != nullptr) {
+    uint64_t keys_read = 0;
+    uint64_t bytes_read = 0;
+    for (size_t i = 0; i < keys.size(); i++) {
+      if ((*statuses)[i].ok()) {
+        keys_read++;
+        bytes_read += (*values)[i].size();
+      }
+    }
+    statistics->RecordTick(kKeysRead, keys_read);
+    statistics->RecordTick(kBytesRead, bytes_read);
   }
 
-  if (have_stat_update && current->UpdateStats(stats)) {
-    MaybeScheduleCompaction();
+  bool have_stat_update = false;
+  for (const Version::KeyLookup& lookup : lookups) {
+    if (lookup.stats.seek_file != nullptr) have_stat_update = true;
   }
-  mem->Unref();
-  if (imm != nullptr) imm->Unref();
-  current->Unref();
-  return s;
+  if (have_stat_update) {
+    MutexLock l(&mutex_);
+    bool need_compaction = false;
+    for (const Version::KeyLookup& lookup : lookups) {
+      if (current->UpdateStats(lookup.stats)) {
+        need_compaction = true;
+      }
+    }
+    if (need_compaction) {
+      MaybeScheduleCompaction();
+    }
+  }
+  ReturnSuperVersion(sv);
 }
 
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
@@ -1175,7 +1658,12 @@ Iterator* DBImpl::NewIterator(const ReadOptions& options) {
                             ? static_cast<const SnapshotImpl*>(options.snapshot)
                                   ->sequence_number()
                             : latest_snapshot),
-                       seed);
+                       seed, env_, options_.statistics,
+                       options.prefix_same_as_start
+                           ? internal_prefix_extractor_.user_transform()
+                           : nullptr,
+                       options.iterate_lower_bound,
+                       options.iterate_upper_bound);
 }
 
 void DBImpl::RecordReadSample(Slice key) {
@@ -1205,6 +1693,13 @@ Status DBImpl::Delete(const WriteOptions& options, const Slice& key) {
 }
 
 Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
+  StopWatch sw(env_, options_.statistics, kWriteMicros);
+  if (updates != nullptr) {
+    RecordTick(options_.statistics, kKeysWritten,
+               WriteBatchInternal::Count(updates));
+    RecordTick(options_.statistics, kBytesWritten,
+               WriteBatchInternal::ByteSize(updates));
+  }
   Writer w(&mutex_);
   w.batch = updates;
   w.sync = options.sync;
@@ -1212,12 +1707,21 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
 
   MutexLock l(&mutex_);
   writers_.push_back(&w);
-  while (!w.done && &w != writers_.front()) {
+  // With pipelined writes, a writer whose group has been logged has left
+  // writers_ and just waits for its batch to be applied.
+  while (!w.done && w.parallel_memtable == nullptr &&
+         (writers_.empty() || &w != writers_.front())) {
     w.cv.Wait();
   }
+  if (w.parallel_memtable != nullptr) {
+    InsertAsFollower(&w);
+  }
   if (w.done) {
     return w.status;
   }
+  if (options_.enable_pipelined_write && updates != nullptr) {
+    return PipelinedWrite(options, &w);
+  }
 
   // May temporarily unlock and wait.
   Status status = MakeRoomForWrite(updates == nullptr);
@@ -1226,6 +1730,21 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
   if (status.ok() && updates != nullptr) {  // nullptr batch is for compactions
     WriteBatch* write_batch = BuildBatchGroup(&last_writer);
     WriteBatchInternal::SetSequence(write_batch, last_sequence + 1);
+    const bool parallel = options_.allow_concurrent_memtable_write &&
+                          write_batch == tmp_batch_;
+    std::vector<Writer*> group;
+    if (parallel) {
+      // Give every batch of the group its place in the sequence.
+      SequenceNumber seq = last_sequence + 1;
+      for (Writer* writer : writers_) {
+        if (writer->batch != nullptr) {
+          WriteBatchInternal::SetSequence(writer->batch, seq);
+          seq += WriteBatchInternal::Count(writer->batch);
+        }
+        group.push_back(writer);
+        if (writer == last_writer) break;
+      }
+    }
     last_sequence += WriteBatchInternal::Count(write_batch);
 
     // Add to log and apply to memtable.  We can release the lock
@@ -1235,17 +1754,24 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
     {
       mutex_.Unlock();
       status = log_->AddRecord(WriteBatchInternal::Contents(write_batch));
+      RecordTick(options_.statistics, kWalBytes,
+                 WriteBatchInternal::ByteSize(write_batch));
       bool sync_error = false;
       if (status.ok() && options.sync) {
+        StopWatch sync_sw(env_, options_.statistics, kWalSyncMicros);
+        RecordTick(options_.statistics, kWalSynced);
         status = logfile_->Sync();
         if (!status.ok()) {
           sync_error = true;
         }
       }
-      if (status.ok()) {
+      if (status.ok() && !parallel) {
         status = WriteBatchInternal::InsertInto(write_batch, mem_);
       }
       mutex_.Lock();
+      if (status.ok() && parallel) {
+        status = InsertGroupConcurrently(group, mem_);
+      }
       if (sync_error) {
         // The state of the log file is indeterminate: the log record we
         // just added may or may not show up when the DB is re-opened.
@@ -1277,6 +1803,162 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
   return status;
 }
 
+// A write group that has been logged and is to be applied to the memtable.
+struct DBImpl::MemTableWriteGroup {
+  std::vector<Writer*> writers;  // Leader first
+  MemTable* mem;
+  SequenceNumber last_sequence;
+  Status status;
+};
+
+Status DBImpl::PipelinedWrite(const WriteOptions& options, Writer* w) {
+  mutex_.AssertHeld();
+  // May temporarily unlock and wait.
+  Status status = MakeRoomForWrite(false);
+  if (!status.ok()) {
+    writers_.pop_front();
+    if (!writers_.empty()) {
+      writers_.front()->cv.Signal();
+    }
+    return status;
+  }
+
+  // Sequence numbers up to the last one of the newest group still being
+  // applied are taken.
+  SequenceNumber last_sequence =
+      memtable_write_groups_.empty()
+          ? versions_->LastSequence()
+          : memtable_write_groups_.back()->last_sequence;
+  Writer* last_writer = w;
+  WriteBatch* write_batch = BuildBatchGroup(&last_writer);
+  WriteBatchInternal::SetSequence(write_batch, last_sequence + 1);
+
+  // The group's batches are applied one by one, after tmp_batch_ has
+  // been handed to the next group.
+  MemTableWriteGroup group;
+  for (Writer* writer : writers_) {
+    if (writer->batch != nullptr) {
+      WriteBatchInternal::SetSequence(writer->batch, last_sequence + 1);
+      last_sequence += WriteBatchInternal::Count(writer->batch);
+    }
+    group.writers.push_back(writer);
+    if (writer == last_writer) break;
+  }
+  group.mem = mem_;
+  group.last_sequence = last_sequence;
+
+  // Add to log.  &w is responsible for logging until it leaves writers_.
+  mutex_.Unlock();
+  status = log_->AddRecord(WriteBatchInternal::Contents(write_batch));
+  RecordTick(options_.statistics, kWalBytes,
+             WriteBatchInternal::ByteSize(write_batch));
+  bool sync_error = false;
+  if (status.ok() && options.sync) {
+    StopWatch sync_sw(env_, options_.statistics, kWalSyncMicros);
+    RecordTick(options_.statistics, kWalSynced);
+    status = logfile_->Sync();
+    if (!status.ok()) {
+      sync_error = true;
+    }
+  }
+  mutex_.Lock();
+  if (sync_error) {
+    // See Write().
+    RecordBackgroundError(status);
+  }
+  if (write_batch == tmp_batch_) tmp_batch_->Clear();
+  group.status = status;
+
+  // Let the next group at the log, and wait for every earlier group to be
+  // applied.  Even a group that failed to log goes through the queue to
+  // consume its sequence numbers in order.
+  while (writers_.front() != last_writer) {
+    writers_.pop_front();
+  }
+  writers_.pop_front();
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+  memtable_write_groups_.push_back(&group);
+  while (memtable_write_groups_.front() != &group) {
+    w->cv.Wait();
+  }
+
+  if (group.status.ok()) {
+    if (options_.allow_concurrent_memtable_write) {
+      group.status = InsertGroupConcurrently(group.writers, group.mem);
+    } else {
+      mutex_.Unlock();
+      for (Writer* writer : group.writers) {
+        if (writer->batch != nullptr) {
+          group.status = WriteBatchInternal::InsertInto(writer->batch,
+                                                        group.mem);
+          if (!group.status.ok()) break;
+        }
+      }
+      mutex_.Lock();
+    }
+  }
+  versions_->SetLastSequence(group.last_sequence);
+
+  memtable_write_groups_.pop_front();
+  for (Writer* writer : group.writers) {
+    if (writer != w) {
+      writer->status = group.status;
+      writer->done = true;
+      writer->cv.Signal();
+    }
+  }
+  if (!memtable_write_groups_.empty()) {
+    memtable_write_groups_.front()->writers[0]->cv.Signal();
+  } else {
+    // MakeRoomForWrite() may be waiting to switch memtables.
+    background_work_finished_signal_.SignalAll();
+  }
+  return group.status;
+}
+
+Status DBImpl::InsertGroupConcurrently(const std::vector<Writer*>& group,
+                                       MemTable* mem) {
+  mutex_.AssertHeld();
+  Writer* leader = group[0];
+  for (Writer* writer : group) {
+    if (writer != leader && writer->batch != nullptr) {
+      writer->parallel_memtable = mem;
+      writer->leader = leader;
+      leader->pending_inserts++;
+      writer->cv.Signal();
+    }
+  }
+  mutex_.Unlock();
+  Status s = WriteBatchInternal::InsertIntoConcurrently(leader->batch, mem);
+  mutex_.Lock();
+  while (leader->pending_inserts > 0) {
+    leader->cv.Wait();
+  }
+  if (s.ok()) {
+    s = leader->insert_status;
+  }
+  return s;
+}
+
+void DBImpl::InsertAsFollower(Writer* w) {
+  mutex_.AssertHeld();
+  mutex_.Unlock();
+  Status s = WriteBatchInternal::InsertIntoConcurrently(w->batch,
+                                                        w->parallel_memtable);
+  mutex_.Lock();
+  if (!s.ok() && w->leader->insert_status.ok()) {
+    w->leader->insert_status = s;
+  }
+  if (--w->leader->pending_inserts == 0) {
+    w->leader->cv.Signal();
+  }
+  while (!w->done) {
+    w->cv.Wait();
+  }
+}
+
 // REQUIRES: Writer list must be non-empty
 // REQUIRES: First writer must have a non-null batch
 WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
@@ -1324,6 +2006,7 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
     }
     *last_writer = w;
   }
+  last_batch_group_size_ = WriteBatchInternal::ByteSize(result);
   return result;
 }
 
@@ -1334,35 +2017,66 @@ Status DBImpl::MakeRoomForWrite(bool force) {
   assert(!writers_.empty());
   bool allow_delay = !force;
   Status s;
+  WriteStallCause delay_cause;
+  double pressure;
+  // Time spent sleeping or waiting on background work, for statistics.
+  uint64_t stall_micros = 0;
+  auto stall = [&](WriteStallCause cause, uint64_t micros) {
+    stall_stats_[cause].count++;
+    stall_stats_[cause].micros += micros;
+    stall_micros += micros;
+  };
+  auto wait = [&](WriteStallCause cause) {
+    const uint64_t start_micros = env_->NowMicros();
+    background_work_finished_signal_.Wait();
+    stall(cause, env_->NowMicros() - start_micros);
+  };
   while (true) {
     if (!bg_error_.ok()) {
       // Yield previous error
       s = bg_error_;
       break;
-    } else if (allow_delay && versions_->NumLevelFiles(0) >=
-                                  config::kL0_SlowdownWritesTrigger) {
-      // We are getting close to hitting a hard limit on the number of
-      // L0 files.  Rather than delaying a single write by several
-      // seconds when we hit the hard limit, start delaying each
-      // individual write by 1ms to reduce latency variance.  Also,
-      // this delay hands over some CPU to the compaction thread in
-      // case it is sharing the same core as the writer.
-      mutex_.Unlock();
-      env_->SleepForMicroseconds(1000);
+    } else if (allow_delay && ShouldDelayWrites(&delay_cause, &pressure)) {
+      // We are getting close to a limit at which writes stop.  Rather
+      // than stopping them for several seconds when we hit it, throttle
+      // the write rate, harder the closer we get, to spread the delay
+      // over many writes and reduce latency variance.  Also, the delay
+      // hands over some CPU to the compaction threads in case they are
+      // sharing the same core as the writer.
+      write_controller_.SetPressure(pressure);
+      const uint64_t delay = write_controller_.GetDelay(
+          env_->NowMicros(), last_batch_group_size_);
       allow_delay = false;  // Do not delay a single write more than once
-      mutex_.Lock();
+      if (delay > 0) {
+        mutex_.Unlock();
+        env_->SleepForMicroseconds(static_cast<int>(delay));
+        mutex_.Lock();
+        stall(delay_cause, delay);
+      }
     } else if (!force &&
                (mem_->ApproximateMemoryUsage() <= options_.write_buffer_size)) {
       // There is room in current memtable
       break;
-    } else if (imm_ != nullptr) {
-      // We have filled up the current memtable, but the previous
-      // one is still being compacted, so we wait.
+    } else if (static_cast<int>(imm_.size()) >=
+               options_.max_write_buffer_number - 1) {
+      // We have filled up the current memtable, but as many earlier
+      // ones as allowed are still waiting to be compacted, so we wait.
       Log(options_.info_log, "Current memtable full; waiting...\n");
-      background_work_finished_signal_.Wait();
-    } else if (versions_->NumLevelFiles(0) >= config::kL0_StopWritesTrigger) {
+      wait(kStallMemTableFull);
+    } else if (versions_->NumLevelFiles(0) >=
+               options_.level0_stop_writes_trigger) {
       // There are too many level-0 files.
       Log(options_.info_log, "Too many L0 files; waiting...\n");
+      wait(kStallLevel0Stop);
+    } else if (options_.hard_pending_compaction_bytes_limit != 0 &&
+               versions_->EstimatedPendingCompactionBytes() >=
+                   options_.hard_pending_compaction_bytes_limit) {
+      // Compactions are too far behind.
+      Log(options_.info_log,
+          "Too many pending compaction bytes; waiting...\n");
+      wait(kStallPendingBytesStop);
+    } else if (!memtable_write_groups_.empty()) {
+      // Logged writes are still being applied to mem_.
       background_work_finished_signal_.Wait();
     } else {
       // Attempt to switch to a new memtable and trigger compaction of old
@@ -1394,17 +2108,53 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       logfile_ = lfile;
       logfile_number_ = new_log_number;
       log_ = new log::Writer(lfile);
-      imm_ = mem_;
+      imm_.push_back(ImmutableMemTable{mem_, new_log_number});
       has_imm_.store(true, std::memory_order_release);
       mem_ = new MemTable(internal_comparator_);
       mem_->Ref();
+      InstallSuperVersion();
       force = false;  // Do not force another compaction if have room
       MaybeScheduleCompaction();
     }
   }
+  if (stall_micros > 0) {
+    RecordTick(options_.statistics, kStallMicros, stall_micros);
+  }
   return s;
 }
 
+bool DBImpl::ShouldDelayWrites(WriteStallCause* cause, double* pressure) {
+  mutex_.AssertHeld();
+  bool delay = false;
+  const int level0_files = versions_->NumLevelFiles(0);
+  if (level0_files >= options_.level0_slowdown_writes_trigger) {
+    const int span = std::max(options_.level0_stop_writes_trigger -
+                                  options_.level0_slowdown_writes_trigger,
+                              1);
+    *cause = kStallLevel0Slowdown;
+    *pressure = static_cast<double>(level0_files -
+                                    options_.level0_slowdown_writes_trigger) /
+                span;
+    delay = true;
+  }
+  const uint64_t soft_limit = options_.soft_pending_compaction_bytes_limit;
+  const uint64_t hard_limit = options_.hard_pending_compaction_bytes_limit;
+  const uint64_t pending = versions_->EstimatedPendingCompactionBytes();
+  if (soft_limit != 0 && pending >= soft_limit) {
+    const double bytes_pressure =
+        (hard_limit > soft_limit)
+            ? static_cast<double>(pending - soft_limit) /
+                  (hard_limit - soft_limit)
+            : 0;
+    if (!delay || bytes_pressure > *pressure) {
+      *cause = kStallPendingBytesSlowdown;
+      *pressure = bytes_pressure;
+    }
+    delay = true;
+  }
+  return delay;
+}
+
 bool DBImpl::GetProperty(const Slice& property, std::string* value) {
   value->clear();
 
@@ -1449,19 +2199,56 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
   } else if (in == "sstables") {
     *value = versions_->current()->DebugString();
     return true;
+  } else if (in == "num-immutable-mem-table") {
+    char buf[50];
+    std::snprintf(buf, sizeof(buf), "%d", static_cast<int>(imm_.size()));
+    *value = buf;
+    return true;
   } else if (in == "approximate-memory-usage") {
     size_t total_usage = options_.block_cache->TotalCharge();
     if (mem_) {
       total_usage += mem_->ApproximateMemoryUsage();
     }
-    if (imm_) {
-      total_usage += imm_->ApproximateMemoryUsage();
+    for (const ImmutableMemTable& imm : imm_) {
+      total_usage += imm.mem->ApproximateMemoryUsage();
     }
     char buf[50];
     std::snprintf(buf, sizeof(buf), "%llu",
                   static_cast<unsigned long long>(total_usage));
     value->append(buf);
     return true;
+  } else if (in == "statistics") {
+    if (options_.statistics == nullptr) {
+      return false;
+    }
+    *value = options_.statistics->ToString();
+    return true;
+  } else if (in == "write-stalls") {
+    static const char* const kCauseNames[kNumWriteStallCauses] = {
+        "level0-slowdown", "pending-bytes-slowdown", "memtable-full",
+        "level0-stop", "pending-bytes-stop"};
+    char buf[200];
+    std::snprintf(buf, sizeof(buf),
+                  "Cause                        Count     Seconds\n"
+                  "----------------------------------------------\n");
+    value->append(buf);
+    for (int cause = 0; cause < kNumWriteStallCauses; cause++) {
+      std::snprintf(buf, sizeof(buf), "%-24s %9llu %11.3f\n",
+                    kCauseNames[cause],
+                    static_cast<unsigned long long>(stall_stats_[cause].count),
+                    stall_stats_[cause].micros / 1e6);
+      value->append(buf);
+    }
+    std::snprintf(
+        buf, sizeof(buf),
+        "Level-0 files: %d\nPending compaction bytes: %llu\n"
+        "Delayed write rate: %llu bytes/s\n",
+        versions_->NumLevelFiles(0),
+        static_cast<unsigned long long>(
+            versions_->EstimatedPendingCompactionBytes()),
+        static_cast<unsigned long long>(write_controller_.rate()));
+    value->append(buf);
+    return true;
   }
 
   return false;
@@ -1499,6 +2286,16 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
   return Write(opt, &batch);
 }
 
+void DB::MultiGet(const ReadOptions& options, const std::vector<Slice>& keys,
+                  std::vector<std::string>* values,
+                  std::vector<Status>* statuses) {
+  values->assign(keys.size(), std::string());
+  statuses->resize(keys.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    (*statuses)[i] = Get(options, keys[i], &(*values)[i]);
+  }
+}
+
 DB::~DB() = default;
 
 Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
@@ -1531,6 +2328,7 @@ Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
     s = impl->versions_->LogAndApply(&edit, &impl->mutex_);
   }
   if (s.ok()) {
+    impl->InstallSuperVersion();
     impl->RemoveObsoleteFiles();
     impl->MaybeScheduleCompaction();
   }
@@ -9,10 +9,12 @@
 #include <deque>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "db/dbformat.h"
 #include "db/log_writer.h"
 #include "db/snapshot.h"
+#include "db/write_controller.h"
 
 #include "leveldb/db.h"
 #include "leveldb/env.h"
@@ -25,6 +27,7 @@ namespace leveldb {
 
 class MemTable;
 class TableCache;
+class ThreadLocalPtr;
 class Version;
 class VersionEdit;
 class VersionSet;
@@ -45,6 +48,9 @@ class DBImpl : public DB {
   Status Write(const WriteOptions& options, WriteBatch* updates) override;
   Status Get(const ReadOptions& options, const Slice& key,
              std::string* value) override;
+  void MultiGet(const ReadOptions& options, const std::vector<Slice>& keys,
+                std::vector<std::string>* values,
+                std::vector<Status>* statuses) override;
   Iterator* NewIterator(const ReadOptions&) override;
   const Snapshot* GetSnapshot() override;
   void ReleaseSnapshot(const Snapshot* snapshot) override;
@@ -77,12 +83,28 @@ class DBImpl : public DB {
  private:
   friend class DB;
   struct CompactionState;
+  struct SubcompactionJob;
   struct Writer;
+  struct MemTableWriteGroup;
+
+  // The memtables and version that reads go to, bundled so that a reader
+  // pins all three with one atomic reference count.  A new SuperVersion is
+  // installed whenever mem_, imm_ or the current version changes.
+  //
+  // Each thread caches a reference to the installed SuperVersion, so point
+  // lookups only take mutex_ the first time they see a new one.
+  struct SuperVersion {
+    MemTable* mem;
+    std::vector<MemTable*> imm;  // Newest first
+    Version* current;
+    std::atomic<int> refs;
+  };
 
   // Information for a manual compaction
   struct ManualCompaction {
     int level;
     bool done;
+    bool in_progress;          // A background thread is compacting a piece
     const InternalKey* begin;  // null means beginning of key range
     const InternalKey* end;    // null means end of key range
     InternalKey tmp_storage;   // Used to keep track of compaction progress
@@ -108,6 +130,32 @@ class DBImpl : public DB {
                                 SequenceNumber* latest_snapshot,
                                 uint32_t* seed);
 
+  // Return a referenced SuperVersion through this thread's cached copy.
+  // Must be handed back with ReturnSuperVersion() on the same thread, and
+  // not be held across another GetAndRefSuperVersion() call.
+  SuperVersion* GetAndRefSuperVersion();
+  void ReturnSuperVersion(SuperVersion* sv);
+
+  // Return a referenced SuperVersion that may be kept for any length of
+  // time and released on any thread with UnrefSuperVersion().
+  SuperVersion* RefSuperVersion();
+  void UnrefSuperVersion(SuperVersion* sv);
+  static void UnrefSuperVersionCleanup(void* db, void* sv);
+  static void UnrefThreadLocalSuperVersion(void* sv);
+
+  // Replace super_version_ by one for the current mem_, imm_ and version.
+  void InstallSuperVersion() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Drop the SuperVersion references cached by all threads.
+  void ResetThreadLocalSuperVersions() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  void CleanupSuperVersion(SuperVersion* sv) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Look "key" up in the memtables of "sv", newest first.  Returns true,
+  // with the result in *value and *s, if one of them has an entry for it.
+  static bool GetFromMemTables(const SuperVersion* sv, const LookupKey& key,
+                               std::string* value, Status* s);
+
   Status NewDB();
 
   // Recover the descriptor from persistent storage.  May do a significant
@@ -121,33 +169,89 @@ class DBImpl : public DB {
   // Delete any unneeded files and stale in-memory entries.
   void RemoveObsoleteFiles() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  // Compact the in-memory write buffer to disk.  Switches to a new
-  // log-file/memtable and writes a new descriptor iff successful.
+  // Compact the immutable memtables waiting in imm_ into one table and
+  // write a new descriptor without their log files iff successful.
+  // Memtables added to imm_ meanwhile are left for the next flush.
   // Errors are recorded in bg_error_.
+  // REQUIRES: !imm_.empty() && !memtable_flush_running_
   void CompactMemTable() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Apply *edit through versions_->LogAndApply(), waiting for any other
+  // thread's LogAndApply() to finish first.
+  Status LogAndApply(VersionEdit* edit) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   Status RecoverLogFile(uint64_t log_number, bool last_log, bool* save_manifest,
                         VersionEdit* edit, SequenceNumber* max_sequence)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base)
+  // Build one table from the merged contents of "mems" and add it to
+  // *edit.  If "pending_number" is non-null, the table stays in
+  // pending_outputs_ and its number is stored in *pending_number: the
+  // caller must erase it once *edit is applied, as compactions finishing
+  // in the meantime garbage-collect unlisted files.
+  Status WriteLevel0Table(const std::vector<MemTable*>& mems,
+                          VersionEdit* edit, Version* base,
+                          uint64_t* pending_number)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   Status MakeRoomForWrite(bool force /* compact even if there is room? */)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Why MakeRoomForWrite() delayed or stopped a writer.
+  enum WriteStallCause {
+    kStallLevel0Slowdown,
+    kStallPendingBytesSlowdown,
+    kStallMemTableFull,
+    kStallLevel0Stop,
+    kStallPendingBytesStop,
+    kNumWriteStallCauses  // Must be last
+  };
+
+  struct WriteStallStats {
+    uint64_t count = 0;  // Delays, or waits for background work
+    uint64_t micros = 0;
+  };
+
+  // If writes should be throttled, store the reason in *cause and how
+  // close the DB is to stopping writes, from 0 to 1, in *pressure, and
+  // return true.
+  bool ShouldDelayWrites(WriteStallCause* cause, double* pressure)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   WriteBatch* BuildBatchGroup(Writer** last_writer)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Write() for Options::enable_pipelined_write, called once *w leads the
+  // log queue.
+  Status PipelinedWrite(const WriteOptions& options, Writer* w)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Have every writer of "group" (leader first) insert its own batch into
+  // "mem" at the same time.  Releases mutex_ while inserting.
+  Status InsertGroupConcurrently(const std::vector<Writer*>& group,
+                                 MemTable* mem)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Run by a follower asked to insert its batch by the group leader.
+  void InsertAsFollower(Writer* w) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   void RecordBackgroundError(const Status& s);
 
   void MaybeScheduleCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   static void BGWork(void* db);
+  static void BGWorkFlush(void* db);
   void BackgroundCall();
-  void BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void BackgroundFlushCall();
+  // Sets *made_progress unless it found nothing it could do right now.
+  void BackgroundCompaction(bool* made_progress)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   void CleanupCompaction(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   Status DoCompactionWork(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Compact the key range of *compact, reading compact->input.
+  // REQUIRES: mutex_ is not held.
+  void RunSubcompaction(CompactionState* compact);
+  static void BGWorkSubcompaction(void* job);
 
   Status OpenCompactionOutputFile(CompactionState* compact);
   Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input);
@@ -162,6 +266,7 @@ class DBImpl : public DB {
   Env* const env_;
   const InternalKeyComparator internal_comparator_;
   const InternalFilterPolicy internal_filter_policy_;
+  const InternalKeySliceTransform internal_prefix_extractor_;
   const Options options_;  // options_.comparator == &internal_comparator_
   const bool owns_info_log_;
   const bool owns_cache_;
@@ -178,25 +283,56 @@ class DBImpl : public DB {
   std::atomic<bool> shutting_down_;
   port::CondVar background_work_finished_signal_ GUARDED_BY(mutex_);
   MemTable* mem_;
-  MemTable* imm_ GUARDED_BY(mutex_);  // Memtable being compacted
-  std::atomic<bool> has_imm_;         // So bg thread can detect non-null imm_
+  // Full memtables waiting to be flushed, oldest first.  Each records
+  // the number of the log file its successor was written to: once it
+  // and all older ones are flushed, earlier log files are not needed.
+  struct ImmutableMemTable {
+    MemTable* mem;
+    uint64_t next_log_number;
+  };
+  std::deque<ImmutableMemTable> imm_ GUARDED_BY(mutex_);
+  std::atomic<bool> has_imm_;  // So bg thread can detect non-empty imm_
   WritableFile* logfile_;
   uint64_t logfile_number_ GUARDED_BY(mutex_);
   log::Writer* log_;
-  uint32_t seed_ GUARDED_BY(mutex_);  // For sampling.
+  std::atomic<uint32_t> seed_;  // For sampling.
+
+  SuperVersion* super_version_ GUARDED_BY(mutex_);
+  // Per-thread cached SuperVersion*, each holding a reference.
+  ThreadLocalPtr* const local_super_version_;
 
   // Queue of writers.
   std::deque<Writer*> writers_ GUARDED_BY(mutex_);
   WriteBatch* tmp_batch_ GUARDED_BY(mutex_);
 
+  // Throttles writes while compactions are falling behind; it charges
+  // each write the size of the previous write group.
+  WriteController write_controller_ GUARDED_BY(mutex_);
+  uint64_t last_batch_group_size_ GUARDED_BY(mutex_);
+  WriteStallStats stall_stats_[kNumWriteStallCauses] GUARDED_BY(mutex_);
+
+  // Logged write groups waiting to be applied to mem_, oldest first.
+  // Only used with Options::enable_pipelined_write.
+  std::deque<MemTableWriteGroup*> memtable_write_groups_ GUARDED_BY(mutex_);
+
   SnapshotList snapshots_ GUARDED_BY(mutex_);
 
   // Set of table files to protect from deletion because they are
   // part of ongoing compactions.
   std::set<uint64_t> pending_outputs_ GUARDED_BY(mutex_);
 
-  // Has a background compaction been scheduled or is running?
-  bool background_compaction_scheduled_ GUARDED_BY(mutex_);
+  // Number of background compactions that are scheduled or running.
+  int background_compactions_scheduled_ GUARDED_BY(mutex_);
+
+  // Has a background memtable flush been scheduled or is running?
+  bool background_flush_scheduled_ GUARDED_BY(mutex_);
+
+  // Is CompactMemTable() running?  Besides the flush job, a compaction may
+  // flush imm_ itself when the flush job has not started yet.
+  bool memtable_flush_running_ GUARDED_BY(mutex_);
+
+  // Is some thread inside versions_->LogAndApply()?
+  bool manifest_write_in_progress_ GUARDED_BY(mutex_);
 
   ManualCompaction* manual_compaction_ GUARDED_BY(mutex_);
 
@@ -213,6 +349,7 @@ class DBImpl : public DB {
 Options SanitizeOptions(const std::string& db,
                         const InternalKeyComparator* icmp,
                         const InternalFilterPolicy* ipolicy,
+                        const InternalKeySliceTransform* iprefix,
                         const Options& src);
 
 }  // namespace leveldb
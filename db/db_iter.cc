@@ -10,11 +10,14 @@
 
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
+#include "leveldb/slice_transform.h"
 
 #include "port/port.h"
+#include "table/prefix_seek.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
 #include "util/random.h"
+#include "util/stop_watch.h"
 
 namespace leveldb {
 
@@ -48,7 +51,9 @@ class DBIter : public Iterator {
   enum Direction { kForward, kReverse };
 
   DBIter(DBImpl* db, const Comparator* cmp, Iterator* iter, SequenceNumber s,
-         uint32_t seed)
+         uint32_t seed, Env* env, Statistics* statistics,
+         const SliceTransform* prefix_extractor, const Slice* lower_bound,
+         const Slice* upper_bound)
       : db_(db),
         user_comparator_(cmp),
         iter_(iter),
@@ -56,7 +61,13 @@ class DBIter : public Iterator {
         direction_(kForward),
         valid_(false),
         rnd_(seed),
-        bytes_until_read_sampling_(RandomCompactionPeriod()) {}
+        bytes_until_read_sampling_(RandomCompactionPeriod()),
+        env_(env),
+        statistics_(statistics),
+        prefix_extractor_(prefix_extractor),
+        has_prefix_(false),
+        lower_bound_(lower_bound),
+        upper_bound_(upper_bound) {}
 
   DBIter(const DBIter&) = delete;
   DBIter& operator=(const DBIter&) = delete;
@@ -90,6 +101,33 @@ class DBIter : public Iterator {
   void FindPrevUserEntry();
   bool ParseKey(ParsedInternalKey* key);
 
+  // True if the iterator is confined to prefix_ and "user_key" does not
+  // have it.
+  bool OutOfPrefix(const Slice& user_key) const {
+    return has_prefix_ && (!prefix_extractor_->InDomain(user_key) ||
+                           prefix_extractor_->Transform(user_key) != prefix_);
+  }
+
+  bool BeforeLowerBound(const Slice& user_key) const {
+    return lower_bound_ != nullptr &&
+           user_comparator_->Compare(user_key, *lower_bound_) < 0;
+  }
+
+  bool AtOrPastUpperBound(const Slice& user_key) const {
+    return upper_bound_ != nullptr &&
+           user_comparator_->Compare(user_key, *upper_bound_) >= 0;
+  }
+
+  // Position iter_ at the first entry at or after the lower bound.
+  void SeekInternalToFirst() {
+    if (lower_bound_ != nullptr) {
+      iter_->Seek(
+          InternalKey(*lower_bound_, sequence_, kValueTypeForSeek).Encode());
+    } else {
+      iter_->SeekToFirst();
+    }
+  }
+
   inline void SaveKey(const Slice& k, std::string* dst) {
     dst->assign(k.data(), k.size());
   }
@@ -119,6 +157,19 @@ class DBIter : public Iterator {
   bool valid_;
   Random rnd_;
   size_t bytes_until_read_sampling_;
+
+  Env* const env_;
+  Statistics* const statistics_;  // May be null
+
+  // With ReadOptions::prefix_same_as_start, the keys yielded after a
+  // Seek() all have the prefix of its target.
+  const SliceTransform* const prefix_extractor_;  // May be null
+  bool has_prefix_;
+  std::string prefix_;
+
+  // ReadOptions::iterate_lower_bound and iterate_upper_bound
+  const Slice* const lower_bound_;  // May be null
+  const Slice* const upper_bound_;  // May be null
 };
 
 inline bool DBIter::ParseKey(ParsedInternalKey* ikey) {
@@ -149,7 +200,7 @@ void DBIter::Next() {
     // so advance into the range of entries for this->key() and then
     // use the normal skipping code below.
     if (!iter_->Valid()) {
-      iter_->SeekToFirst();
+      SeekInternalToFirst();
     } else {
       iter_->Next();
     }
@@ -182,7 +233,12 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   assert(direction_ == kForward);
   do {
     ParsedInternalKey ikey;
-    if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
+    const bool parsed = ParseKey(&ikey);
+    if (parsed &&
+        (OutOfPrefix(ikey.user_key) || AtOrPastUpperBound(ikey.user_key))) {
+      break;
+    }
+    if (parsed && ikey.sequence <= sequence_) {
       switch (ikey.type) {
         case kTypeDeletion:
           // Arrange to skip all upcoming entries for this key since
@@ -242,7 +298,13 @@ void DBIter::FindPrevUserEntry() {
   if (iter_->Valid()) {
     do {
       ParsedInternalKey ikey;
-      if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
+      const bool parsed = ParseKey(&ikey);
+      if (parsed &&
+          (OutOfPrefix(ikey.user_key) || BeforeLowerBound(ikey.user_key))) {
+        // iter_ stays just before the entries of saved_key_
+        break;
+      }
+      if (parsed && ikey.sequence <= sequence_) {
         if ((value_type != kTypeDeletion) &&
             user_comparator_->Compare(ikey.user_key, saved_key_) < 0) {
           // We encountered a non-deleted value in entries for previous keys,
@@ -278,12 +340,26 @@ void DBIter::FindPrevUserEntry() {
 }
 
 void DBIter::Seek(const Slice& target) {
+  StopWatch sw(env_, statistics_, kSeekMicros);
   direction_ = kForward;
   ClearSavedValue();
   saved_key_.clear();
+  has_prefix_ = prefix_extractor_ != nullptr &&
+                prefix_extractor_->InDomain(target);
+  if (has_prefix_) {
+    Slice prefix = prefix_extractor_->Transform(target);
+    prefix_.assign(prefix.data(), prefix.size());
+  }
   AppendInternalKey(&saved_key_,
-                    ParsedInternalKey(target, sequence_, kValueTypeForSeek));
-  iter_->Seek(saved_key_);
+                    ParsedInternalKey(BeforeLowerBound(target) ? *lower_bound_
+                                                               : target,
+                                      sequence_, kValueTypeForSeek));
+  if (has_prefix_) {
+    PrefixSeekScope scope;
+    iter_->Seek(saved_key_);
+  } else {
+    iter_->Seek(saved_key_);
+  }
   if (iter_->Valid()) {
     FindNextUserEntry(false, &saved_key_ /* temporary storage */);
   } else {
@@ -293,8 +369,9 @@ void DBIter::Seek(const Slice& target) {
 
 void DBIter::SeekToFirst() {
   direction_ = kForward;
+  has_prefix_ = false;
   ClearSavedValue();
-  iter_->SeekToFirst();
+  SeekInternalToFirst();
   if (iter_->Valid()) {
     FindNextUserEntry(false, &saved_key_ /* temporary storage */);
   } else {
@@ -304,8 +381,21 @@ void DBIter::SeekToFirst() {
 
 void DBIter::SeekToLast() {
   direction_ = kReverse;
+  has_prefix_ = false;
   ClearSavedValue();
-  iter_->SeekToLast();
+  if (upper_bound_ != nullptr) {
+    // The last entry before the entries of the bound
+    iter_->Seek(InternalKey(*upper_bound_, kMaxSequenceNumber,
+                            kValueTypeForSeek)
+                    .Encode());
+    if (iter_->Valid()) {
+      iter_->Prev();
+    } else {
+      iter_->SeekToLast();
+    }
+  } else {
+    iter_->SeekToLast();
+  }
   FindPrevUserEntry();
 }
 
@@ -313,8 +403,12 @@ void DBIter::SeekToLast() {
 
 Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
                         Iterator* internal_iter, SequenceNumber sequence,
-                        uint32_t seed) {
-  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed);
+                        uint32_t seed, Env* env, Statistics* statistics,
+                        const SliceTransform* prefix_extractor,
+                        const Slice* lower_bound, const Slice* upper_bound) {
+  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed,
+                    env, statistics, prefix_extractor, lower_bound,
+                    upper_bound);
 }
 
 }  // namespace leveldb
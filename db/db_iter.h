@@ -13,13 +13,25 @@
 namespace leveldb {
 
 class DBImpl;
+class Env;
+class SliceTransform;
+class Statistics;
 
 // Return a new iterator that converts internal keys (yielded by
 // "*internal_iter") that were live at the specified "sequence" number
-// into appropriate user keys.
+// into appropriate user keys.  If "statistics" is non-null, the time
+// taken by each Seek() is recorded in it, as measured by "env".  If
+// "prefix_extractor" is non-null, the keys yielded after a Seek() are
+// confined to the prefix of its target.  Non-null "lower_bound" and
+// "upper_bound" are user keys, as in ReadOptions::iterate_lower_bound
+// and ReadOptions::iterate_upper_bound.
 Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
                         Iterator* internal_iter, SequenceNumber sequence,
-                        uint32_t seed);
+                        uint32_t seed, Env* env = nullptr,
+                        Statistics* statistics = nullptr,
+                        const SliceTransform* prefix_extractor = nullptr,
+                        const Slice* lower_bound = nullptr,
+                        const Slice* upper_bound = nullptr);
 
 }  // namespace leveldb
 
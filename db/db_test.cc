@@ -0,0 +1,1182 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/db.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "db/db_impl.h"
+#include "leveldb/cache.h"
+#include "leveldb/env.h"
+#include "leveldb/filter_policy.h"
+#include "leveldb/iterator.h"
+#include "leveldb/perf_context.h"
+#include "leveldb/slice_transform.h"
+#include "leveldb/statistics.h"
+#include "leveldb/write_batch.h"
+#include "util/random.h"
+
+#include "gtest/gtest.h"
+#include "test/util/testutil.h"
+
+namespace leveldb {
+
+class DBTest : public testing::Test {
+ public:
+  DBTest() : env_(Env::Default()), db_(nullptr) {
+    dbname_ = testing::TempDir() + "db_test";
+    DestroyDB(dbname_, Options());
+  }
+
+  ~DBTest() {
+    delete db_;
+    DestroyDB(dbname_, Options());
+  }
+
+  DBImpl* dbfull() { return reinterpret_cast<DBImpl*>(db_); }
+
+  Status TryReopen(const Options& options) {
+    delete db_;
+    db_ = nullptr;
+    Options opts = options;
+    opts.create_if_missing = true;
+    return DB::Open(opts, dbname_, &db_);
+  }
+
+  void Reopen(const Options& options) {
+    ASSERT_LEVELDB_OK(TryReopen(options));
+  }
+
+  Status Put(const std::string& k, const std::string& v) {
+    return db_->Put(WriteOptions(), k, v);
+  }
+
+  Status Delete(const std::string& k) { return db_->Delete(WriteOptions(), k); }
+
+  std::string Get(const std::string& k) {
+    std::string result;
+    Status s = db_->Get(ReadOptions(), k, &result);
+    if (s.IsNotFound()) {
+      result = "NOT_FOUND";
+    } else if (!s.ok()) {
+      result = s.ToString();
+    }
+    return result;
+  }
+
+  // Check that the DB holds exactly the contents of "model".
+  void CheckContents(const std::map<std::string, std::string>& model) {
+    for (const auto& kv : model) {
+      ASSERT_EQ(kv.second, Get(kv.first)) << kv.first;
+    }
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    auto expected = model.begin();
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++expected) {
+      ASSERT_TRUE(expected != model.end()) << iter->key().ToString();
+      ASSERT_EQ(expected->first, iter->key().ToString());
+      ASSERT_EQ(expected->second, iter->value().ToString());
+    }
+    ASSERT_TRUE(expected == model.end());
+    ASSERT_LEVELDB_OK(iter->status());
+    delete iter;
+  }
+
+  int TotalTableFiles() {
+    int result = 0;
+    for (int level = 0; level < config::kNumLevels; level++) {
+      std::string property;
+      EXPECT_TRUE(db_->GetProperty(
+          "leveldb.num-files-at-level" + std::to_string(level), &property));
+      result += std::stoi(property);
+    }
+    return result;
+  }
+
+  std::string dbname_;
+  Env* env_;
+  DB* db_;
+};
+
+TEST_F(DBTest, ParallelCompactions) {
+  Options options;
+  options.write_buffer_size = 64 << 10;
+  options.max_file_size = 1 << 20;
+  options.max_background_compactions = 4;
+  env_->SetBackgroundThreads(options.max_background_compactions);
+  Reopen(options);
+
+  // Overwrite and delete a shared key space several times so that flushes
+  // and compactions on different levels run while writes keep coming.
+  Random rnd(test::RandomSeed());
+  std::map<std::string, std::string> model;
+  static const int kNumKeys = 20000;
+  for (int i = 0; i < 4 * kNumKeys; i++) {
+    char key[20];
+    std::snprintf(key, sizeof(key), "key%06d",
+                  static_cast<int>(rnd.Uniform(kNumKeys)));
+    if (rnd.OneIn(8)) {
+      ASSERT_LEVELDB_OK(Delete(key));
+      model.erase(key);
+    } else {
+      std::string value;
+      test::RandomString(&rnd, 100, &value);
+      ASSERT_LEVELDB_OK(Put(key, value));
+      model[key] = value;
+    }
+  }
+  ASSERT_GT(TotalTableFiles(), 0);
+  CheckContents(model);
+
+  db_->CompactRange(nullptr, nullptr);
+  CheckContents(model);
+
+  Reopen(options);
+  CheckContents(model);
+}
+
+TEST_F(DBTest, Subcompactions) {
+  Options options;
+  options.write_buffer_size = 256 << 10;
+  options.max_file_size = 1 << 20;
+  options.max_subcompactions = 4;
+  options.compression = kNoCompression;
+  Reopen(options);
+
+  // Enough data for level-1 compactions to be split into several ranges,
+  // with overwrites and deletions whose older versions sit in another range
+  // of the same compaction.
+  Random rnd(test::RandomSeed());
+  std::map<std::string, std::string> model;
+  static const int kNumKeys = 40000;
+  for (int round = 0; round < 3; round++) {
+    for (int i = 0; i < kNumKeys; i++) {
+      char key[20];
+      std::snprintf(key, sizeof(key), "key%06d", i);
+      if (round > 0 && rnd.OneIn(5)) {
+        ASSERT_LEVELDB_OK(Delete(key));
+        model.erase(key);
+      } else {
+        std::string value;
+        test::RandomString(&rnd, 100, &value);
+        ASSERT_LEVELDB_OK(Put(key, value));
+        model[key] = value;
+      }
+    }
+    db_->CompactRange(nullptr, nullptr);
+    CheckContents(model);
+  }
+
+  Reopen(options);
+  CheckContents(model);
+}
+
+TEST_F(DBTest, MultiGet) {
+  Options options;
+  options.write_buffer_size = 64 << 10;
+  Reopen(options);
+
+  // Spread the keys over deeper levels, level-0, the immutable memtable
+  // and the memtable, with every fourth key deleted on the way.
+  std::map<std::string, std::string> model;
+  static const int kNumKeys = 4000;
+  for (int round = 0; round < 3; round++) {
+    for (int i = round; i < kNumKeys; i += 3) {
+      char key[20];
+      std::snprintf(key, sizeof(key), "key%06d", i);
+      std::string value = std::string(key) + "_v" + std::to_string(round);
+      ASSERT_LEVELDB_OK(Put(key, value));
+      model[key] = value;
+      if (i % 4 == 0) {
+        ASSERT_LEVELDB_OK(Delete(key));
+        model.erase(key);
+      }
+    }
+    if (round == 0) {
+      db_->CompactRange(nullptr, nullptr);
+    } else if (round == 1) {
+      ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    }
+  }
+  const Snapshot* snapshot = db_->GetSnapshot();
+  std::map<std::string, std::string> snapshot_model = model;
+  for (int i = 1; i < kNumKeys; i += 2) {
+    char key[20];
+    std::snprintf(key, sizeof(key), "key%06d", i);
+    ASSERT_LEVELDB_OK(Put(key, "new"));
+    model[key] = "new";
+  }
+
+  // Unsorted keys, with duplicates and keys that never existed.
+  std::vector<std::string> key_storage;
+  for (int i = kNumKeys + 10; i >= -10; i -= 7) {
+    char key[20];
+    std::snprintf(key, sizeof(key), "key%06d", i);
+    key_storage.push_back(key);
+    key_storage.push_back(key);
+  }
+  std::vector<Slice> keys(key_storage.begin(), key_storage.end());
+
+  for (int pass = 0; pass < 2; pass++) {
+    const std::map<std::string, std::string>& expected =
+        (pass == 0) ? model : snapshot_model;
+    ReadOptions read_options;
+    if (pass == 1) read_options.snapshot = snapshot;
+
+    std::vector<std::string> values;
+    std::vector<Status> statuses;
+    db_->MultiGet(read_options, keys, &values, &statuses);
+    ASSERT_EQ(keys.size(), values.size());
+    ASSERT_EQ(keys.size(), statuses.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+      auto it = expected.find(key_storage[i]);
+      if (it == expected.end()) {
+        ASSERT_TRUE(statuses[i].IsNotFound()) << key_storage[i];
+      } else {
+        ASSERT_LEVELDB_OK(statuses[i]);
+        ASSERT_EQ(it->second, values[i]) << key_storage[i];
+      }
+    }
+  }
+  db_->ReleaseSnapshot(snapshot);
+}
+
+TEST_F(DBTest, ConcurrentReadsDuringFlushes) {
+  Options options;
+  options.write_buffer_size = 32 << 10;
+  Reopen(options);
+
+  // A writer keeps bumping per-key counters while the memtables are
+  // switched and flushed underneath the readers.  A reader must never see
+  // a counter go backwards.
+  static const int kNumKeys = 100;
+  static const int kNumReaders = 4;
+  std::atomic<bool> done(false);
+  std::atomic<int> errors(0);
+  std::vector<std::thread> readers;
+  for (int r = 0; r < kNumReaders; r++) {
+    readers.emplace_back([&, r]() {
+      Random rnd(r + 1);
+      std::vector<int> last_seen(kNumKeys, -1);
+      while (!done.load(std::memory_order_acquire)) {
+        int k = rnd.Uniform(kNumKeys);
+        std::string value;
+        Status s = db_->Get(ReadOptions(), std::to_string(k), &value);
+        if (s.IsNotFound()) {
+          if (last_seen[k] >= 0) errors.fetch_add(1);
+          continue;
+        } else if (!s.ok()) {
+          errors.fetch_add(1);
+          continue;
+        }
+        int counter = std::stoi(value.substr(0, value.find(':')));
+        if (counter < last_seen[k]) errors.fetch_add(1);
+        last_seen[k] = counter;
+      }
+    });
+  }
+
+  std::string padding(200, 'x');
+  for (int counter = 0; counter < 300; counter++) {
+    for (int k = 0; k < kNumKeys; k++) {
+      ASSERT_LEVELDB_OK(
+          Put(std::to_string(k), std::to_string(counter) + ":" + padding));
+    }
+  }
+  done.store(true, std::memory_order_release);
+  for (std::thread& t : readers) {
+    t.join();
+  }
+  ASSERT_EQ(0, errors.load());
+  ASSERT_GT(TotalTableFiles(), 0);
+}
+
+TEST_F(DBTest, ConcurrentMemTableWrites) {
+  Options options;
+  options.write_buffer_size = 256 << 10;
+  options.allow_concurrent_memtable_write = true;
+  Reopen(options);
+
+  // Writers overwrite their own keys, each with an increasing counter, in
+  // batches of several keys so that groups hold many entries.
+  static const int kNumThreads = 16;
+  static const int kNumKeys = 50;
+  static const int kNumRounds = 200;
+  std::vector<std::thread> writers;
+  std::atomic<int> errors(0);
+  for (int t = 0; t < kNumThreads; t++) {
+    writers.emplace_back([&, t]() {
+      for (int round = 0; round < kNumRounds; round++) {
+        WriteBatch batch;
+        for (int k = 0; k < kNumKeys; k += 5) {
+          for (int j = k; j < k + 5; j++) {
+            batch.Put("t" + std::to_string(t) + "k" + std::to_string(j),
+                      std::to_string(round));
+          }
+        }
+        batch.Delete("t" + std::to_string(t) + "k0");
+        if (!db_->Write(WriteOptions(), &batch).ok()) errors.fetch_add(1);
+      }
+    });
+  }
+  for (std::thread& t : writers) {
+    t.join();
+  }
+  ASSERT_EQ(0, errors.load());
+
+  std::map<std::string, std::string> model;
+  for (int t = 0; t < kNumThreads; t++) {
+    for (int k = 1; k < kNumKeys; k++) {
+      model["t" + std::to_string(t) + "k" + std::to_string(k)] =
+          std::to_string(kNumRounds - 1);
+    }
+  }
+  CheckContents(model);
+
+  Reopen(options);
+  CheckContents(model);
+}
+
+TEST_F(DBTest, PipelinedWrites) {
+  for (int concurrent = 0; concurrent < 2; concurrent++) {
+    Options options;
+    options.write_buffer_size = 64 << 10;
+    options.enable_pipelined_write = true;
+    options.allow_concurrent_memtable_write = (concurrent == 1);
+    DestroyDB(dbname_, Options());
+    Reopen(options);
+
+    // Sync and non-sync writers race through both stages while the
+    // memtable fills up and gets switched.  A reader checks that a key is
+    // never seen without the keys its writer wrote before it.
+    static const int kNumThreads = 8;
+    static const int kNumWrites = 500;
+    std::atomic<bool> done(false);
+    std::atomic<int> errors(0);
+    std::thread reader([&]() {
+      Random rnd(301);
+      while (!done.load(std::memory_order_acquire)) {
+        int t = rnd.Uniform(kNumThreads);
+        std::string value;
+        Status s = db_->Get(ReadOptions(), "t" + std::to_string(t), &value);
+        if (s.IsNotFound()) continue;
+        int i = std::stoi(value);
+        for (int j = std::max(0, i - 5); j <= i; j++) {
+          if (Get("t" + std::to_string(t) + "_" + std::to_string(j)) !=
+              std::to_string(j)) {
+            errors.fetch_add(1);
+          }
+        }
+      }
+    });
+    std::vector<std::thread> writers;
+    for (int t = 0; t < kNumThreads; t++) {
+      writers.emplace_back([&, t]() {
+        std::string prefix = "t" + std::to_string(t);
+        for (int i = 0; i < kNumWrites; i++) {
+          WriteOptions write_options;
+          write_options.sync = (i % 50 == 0);
+          std::string value(100, 'v');
+          if (!db_->Put(write_options, prefix + "_" + std::to_string(i),
+                        std::to_string(i))
+                   .ok() ||
+              !db_->Put(write_options, prefix + "_pad" + std::to_string(i),
+                        value)
+                   .ok() ||
+              !db_->Put(write_options, prefix, std::to_string(i)).ok()) {
+            errors.fetch_add(1);
+          }
+        }
+      });
+    }
+    for (std::thread& t : writers) {
+      t.join();
+    }
+    done.store(true, std::memory_order_release);
+    reader.join();
+    ASSERT_EQ(0, errors.load());
+
+    for (int reopen = 0; reopen < 2; reopen++) {
+      for (int t = 0; t < kNumThreads; t++) {
+        std::string prefix = "t" + std::to_string(t);
+        ASSERT_EQ(std::to_string(kNumWrites - 1), Get(prefix));
+        for (int i = 0; i < kNumWrites; i++) {
+          ASSERT_EQ(std::to_string(i), Get(prefix + "_" + std::to_string(i)));
+        }
+      }
+      Reopen(options);
+    }
+  }
+}
+
+TEST_F(DBTest, Statistics) {
+  std::unique_ptr<Statistics> statistics(NewStatistics());
+  std::unique_ptr<const FilterPolicy> filter_policy(NewBloomFilterPolicy(10));
+  Options options;
+  options.statistics = statistics.get();
+  options.filter_policy = filter_policy.get();
+  Reopen(options);
+
+  static const int kNumKeys = 1000;
+  for (int i = 0; i < kNumKeys; i += 2) {
+    ASSERT_LEVELDB_OK(Put("key" + std::to_string(i), "value"));
+  }
+  WriteOptions sync;
+  sync.sync = true;
+  ASSERT_LEVELDB_OK(db_->Put(sync, "key", "value"));
+  ASSERT_EQ(kNumKeys / 2 + 1, statistics->GetTickerCount(kKeysWritten));
+  ASSERT_EQ(1, statistics->GetTickerCount(kWalSynced));
+  ASSERT_GT(statistics->GetTickerCount(kWalBytes), 0);
+
+  ASSERT_EQ("value", Get("key0"));
+  ASSERT_EQ(1, statistics->GetTickerCount(kMemtableHit));
+
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_GT(statistics->GetTickerCount(kCompactWriteBytes), 0);
+  HistogramData data;
+  statistics->GetHistogramData(kCompactionMicros, &data);
+  ASSERT_EQ(1, data.count);
+
+  // Keys present in the table pass its filter; most absent ones do not.
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_EQ((i % 2 == 0) ? "value" : "NOT_FOUND",
+              Get("key" + std::to_string(i)));
+  }
+  ASSERT_EQ(kNumKeys, statistics->GetTickerCount(kMemtableMiss));
+  ASSERT_EQ(kNumKeys / 2 + 1, statistics->GetTickerCount(kKeysRead));
+  const uint64_t positive = statistics->GetTickerCount(kFilterPositive);
+  ASSERT_EQ(kNumKeys / 2, statistics->GetTickerCount(kFilterTruePositive));
+  ASSERT_GE(positive, kNumKeys / 2);
+  ASSERT_LT(positive - kNumKeys / 2, kNumKeys / 20);
+  // Absent keys past the end of the table ("key999") skip it entirely.
+  ASSERT_GT(statistics->GetTickerCount(kFilterUseful),
+            kNumKeys / 2 - kNumKeys / 20);
+  // Blocks read from mmap()ed files are not cached, so all that is
+  // certain is that the cache was consulted.
+  ASSERT_GE(statistics->GetTickerCount(kBlockCacheHit) +
+                statistics->GetTickerCount(kBlockCacheMiss),
+            kNumKeys / 2);
+  statistics->GetHistogramData(kGetMicros, &data);
+  ASSERT_EQ(kNumKeys + 1, data.count);
+
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  iter->Seek("key5");
+  ASSERT_TRUE(iter->Valid());
+  delete iter;
+  statistics->GetHistogramData(kSeekMicros, &data);
+  ASSERT_EQ(1, data.count);
+
+  std::string property;
+  ASSERT_TRUE(db_->GetProperty("leveldb.statistics", &property));
+  ASSERT_NE(std::string::npos, property.find("leveldb.wal.synced COUNT : 1"));
+
+  Reopen(Options());
+  ASSERT_FALSE(db_->GetProperty("leveldb.statistics", &property));
+}
+
+TEST_F(DBTest, PerfContext) {
+  std::unique_ptr<const FilterPolicy> filter_policy(NewBloomFilterPolicy(10));
+  Options options;
+  options.filter_policy = filter_policy.get();
+  Reopen(options);
+  ASSERT_LEVELDB_OK(Put("a", "va"));
+  ASSERT_LEVELDB_OK(Put("c", "vc"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LEVELDB_OK(Put("d", "vd"));
+
+  SetPerfLevel(kEnableTime);
+  PerfContext* perf = GetPerfContext();
+
+  perf->Reset();
+  ASSERT_EQ("vd", Get("d"));
+  ASSERT_EQ(1, perf->get_from_memtable_count);
+  ASSERT_EQ(0, perf->get_from_output_files_count);
+  ASSERT_GT(perf->get_nanos, 0);
+
+  perf->Reset();
+  ASSERT_EQ("va", Get("a"));
+  ASSERT_EQ(1, perf->get_from_memtable_count);
+  ASSERT_EQ(1, perf->get_from_output_files_count);
+  ASSERT_EQ(1, perf->find_table_count);
+  ASSERT_EQ(1, perf->filter_check_count);
+  ASSERT_EQ(0, perf->filter_useful_count);
+  ASSERT_EQ(1, perf->block_cache_hit_count + perf->block_read_count);
+  ASSERT_GE(perf->get_nanos, perf->get_from_output_files_nanos);
+  ASSERT_GE(perf->get_from_output_files_nanos, perf->find_table_nanos);
+
+  perf->Reset();
+  ASSERT_EQ("NOT_FOUND", Get("b"));
+  ASSERT_EQ(1, perf->filter_check_count);
+  ASSERT_EQ(1, perf->filter_useful_count);
+  ASSERT_EQ(0, perf->block_cache_hit_count + perf->block_read_count);
+
+  SetPerfLevel(kDisable);
+  perf->Reset();
+  ASSERT_EQ("va", Get("a"));
+  ASSERT_EQ("", perf->ToString());
+}
+
+TEST_F(DBTest, CacheIndexAndFilterBlocks) {
+  std::unique_ptr<Cache> block_cache(NewLRUCache(1 << 20, 0.5));
+  std::unique_ptr<const FilterPolicy> filter_policy(NewBloomFilterPolicy(10));
+  Options options;
+  options.block_cache = block_cache.get();
+  options.filter_policy = filter_policy.get();
+  Reopen(options);
+  std::map<std::string, std::string> model;
+  for (int i = 0; i < 1000; i++) {
+    model["key" + std::to_string(i)] = "v0";
+  }
+  for (const auto& kv : model) {
+    ASSERT_LEVELDB_OK(Put(kv.first, kv.second));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  // Data blocks of mmap()ed tables are not cached, nor is anything else.
+  CheckContents(model);
+  ASSERT_EQ(0, block_cache->TotalCharge());
+
+  options.cache_index_and_filter_blocks = true;
+  options.pin_l0_filter_and_index_blocks_in_cache = true;
+  Reopen(options);
+  CheckContents(model);
+  const size_t table_charge = block_cache->TotalCharge();
+  ASSERT_GT(table_charge, 0);
+
+  // Evicted blocks are read again when needed.
+  block_cache->Prune();
+  ASSERT_EQ(0, block_cache->TotalCharge());
+  CheckContents(model);
+  ASSERT_EQ(table_charge, block_cache->TotalCharge());
+
+  // Each flush lands one level higher than the last, until one lands in
+  // level 0.
+  for (int round = 1; round <= 2; round++) {
+    for (auto& kv : model) {
+      kv.second = "v" + std::to_string(round);
+      ASSERT_LEVELDB_OK(Put(kv.first, kv.second));
+    }
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  }
+  std::string property;
+  ASSERT_TRUE(db_->GetProperty("leveldb.num-files-at-level0", &property));
+  ASSERT_EQ("1", property);
+  CheckContents(model);
+
+  // Only the blocks of the level-0 table survive.
+  block_cache->Prune();
+  ASSERT_EQ(table_charge, block_cache->TotalCharge());
+  CheckContents(model);
+
+  // Closing the tables removes their blocks.
+  delete db_;
+  db_ = nullptr;
+  ASSERT_EQ(0, block_cache->TotalCharge());
+}
+
+TEST_F(DBTest, PartitionedIndexAndFilters) {
+  std::unique_ptr<Statistics> statistics(NewStatistics());
+  std::unique_ptr<const FilterPolicy> filter_policy(NewBloomFilterPolicy(10));
+  Options options;
+  options.statistics = statistics.get();
+  options.filter_policy = filter_policy.get();
+  options.block_size = 256;
+  options.partition_index_and_filters = true;
+  options.metadata_block_size = 256;
+  Reopen(options);
+
+  std::map<std::string, std::string> model;
+  static const int kNumKeys = 2000;
+  for (int i = 0; i < kNumKeys; i += 2) {
+    char key[20];
+    std::snprintf(key, sizeof(key), "key%06d", i);
+    model[key] = std::string(key) + "_value";
+    ASSERT_LEVELDB_OK(Put(key, model[key]));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  CheckContents(model);
+
+  // The filter partitions rule out most absent keys.
+  std::vector<std::string> key_storage;
+  for (int i = 1; i < kNumKeys; i += 2) {
+    char key[20];
+    std::snprintf(key, sizeof(key), "key%06d", i);
+    key_storage.push_back(key);
+  }
+  const uint64_t useful = statistics->GetTickerCount(kFilterUseful);
+  for (const std::string& key : key_storage) {
+    ASSERT_EQ("NOT_FOUND", Get(key));
+  }
+  ASSERT_GT(statistics->GetTickerCount(kFilterUseful) - useful,
+            kNumKeys / 2 - kNumKeys / 20);
+
+  std::vector<Slice> keys(key_storage.begin(), key_storage.end());
+  for (const auto& kv : model) {
+    keys.push_back(kv.first);
+  }
+  std::vector<std::string> values;
+  std::vector<Status> statuses;
+  db_->MultiGet(ReadOptions(), keys, &values, &statuses);
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (i < key_storage.size()) {
+      ASSERT_TRUE(statuses[i].IsNotFound()) << keys[i].ToString();
+    } else {
+      ASSERT_LEVELDB_OK(statuses[i]);
+      ASSERT_EQ(model[keys[i].ToString()], values[i]);
+    }
+  }
+
+  // The format is recorded in the tables themselves.
+  options.partition_index_and_filters = false;
+  Reopen(options);
+  CheckContents(model);
+  ASSERT_EQ("NOT_FOUND", Get("key000001"));
+}
+
+TEST_F(DBTest, FullFilter) {
+  std::unique_ptr<const FilterPolicy> filter_policy(
+      NewBlockedBloomFilterPolicy(10));
+  Options options;
+  options.filter_policy = filter_policy.get();
+  options.full_filter = true;
+  Reopen(options);
+
+  std::map<std::string, std::string> model;
+  for (int i = 0; i < 1000; i += 2) {
+    char key[20];
+    std::snprintf(key, sizeof(key), "key%06d", i);
+    model[key] = std::string(key) + "_value";
+    ASSERT_LEVELDB_OK(Put(key, model[key]));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  CheckContents(model);
+
+  SetPerfLevel(kEnableTime);
+  PerfContext* perf = GetPerfContext();
+  int useful = 0;
+  for (int i = 1; i < 998; i += 2) {  // Within the key range of the table
+    char key[20];
+    std::snprintf(key, sizeof(key), "key%06d", i);
+    perf->Reset();
+    ASSERT_EQ("NOT_FOUND", Get(key));
+    ASSERT_EQ(1, perf->filter_check_count);
+    if (perf->filter_useful_count == 1) {
+      // Ruled out before the index was searched
+      ASSERT_EQ(0, perf->index_seek_nanos);
+      ASSERT_EQ(0, perf->block_cache_hit_count + perf->block_read_count);
+      useful++;
+    }
+  }
+  SetPerfLevel(kDisable);
+  ASSERT_GT(useful, 499 - 499 / 20);
+
+  std::vector<std::string> key_storage;
+  for (int i = 0; i < 1000; i++) {
+    char key[20];
+    std::snprintf(key, sizeof(key), "key%06d", i);
+    key_storage.push_back(key);
+  }
+  std::vector<Slice> keys(key_storage.begin(), key_storage.end());
+  std::vector<std::string> values;
+  std::vector<Status> statuses;
+  db_->MultiGet(ReadOptions(), keys, &values, &statuses);
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (i % 2 == 1) {
+      ASSERT_TRUE(statuses[i].IsNotFound()) << key_storage[i];
+    } else {
+      ASSERT_LEVELDB_OK(statuses[i]);
+      ASSERT_EQ(model[key_storage[i]], values[i]);
+    }
+  }
+
+  // The format is recorded in the tables themselves.
+  options.full_filter = false;
+  Reopen(options);
+  CheckContents(model);
+  ASSERT_EQ("NOT_FOUND", Get("key000001"));
+}
+
+// Records the levels of the filters it is asked to create.
+class LevelRecordingFilterPolicy : public FilterPolicy {
+ public:
+  explicit LevelRecordingFilterPolicy(const FilterPolicy* policy)
+      : policy_(policy) {}
+
+  const char* Name() const override { return policy_->Name(); }
+  void CreateFilter(const Slice* keys, int n, std::string* dst) const override {
+    CreateFilterForLevel(keys, n, dst, -1);
+  }
+  void CreateFilterForLevel(const Slice* keys, int n, std::string* dst,
+                            int level) const override {
+    {
+      std::lock_guard<std::mutex> l(mu_);
+      levels_.insert(level);
+    }
+    policy_->CreateFilterForLevel(keys, n, dst, level);
+  }
+  bool KeyMayMatch(const Slice& key, const Slice& filter) const override {
+    return policy_->KeyMayMatch(key, filter);
+  }
+
+  std::set<int> TakeLevels() {
+    std::lock_guard<std::mutex> l(mu_);
+    std::set<int> result;
+    result.swap(levels_);
+    return result;
+  }
+
+ private:
+  const FilterPolicy* const policy_;
+  mutable std::mutex mu_;
+  mutable std::set<int> levels_;
+};
+
+TEST_F(DBTest, RibbonFilter) {
+  std::unique_ptr<const FilterPolicy> ribbon(NewRibbonFilterPolicy(10, 1));
+  LevelRecordingFilterPolicy filter_policy(ribbon.get());
+  Options options;
+  options.filter_policy = &filter_policy;
+  options.full_filter = true;
+  Reopen(options);
+
+  // Two overlapping level-0 tables, with bloom filters
+  std::map<std::string, std::string> model;
+  for (int pass = 0; pass < 2; pass++) {
+    for (int i = 0; i < 2000; i += 2) {
+      char key[20];
+      std::snprintf(key, sizeof(key), "key%06d", i);
+      model[key] = std::string(key) + "_value" + std::to_string(pass);
+      ASSERT_LEVELDB_OK(Put(key, model[key]));
+    }
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  }
+  ASSERT_EQ(std::set<int>({0}), filter_policy.TakeLevels());
+  CheckContents(model);
+
+  // Merged into deeper levels, with ribbon filters
+  db_->CompactRange(nullptr, nullptr);
+  std::set<int> levels = filter_policy.TakeLevels();
+  ASSERT_FALSE(levels.empty());
+  ASSERT_GE(*levels.begin(), 1);
+  CheckContents(model);
+
+  SetPerfLevel(kEnableCount);
+  PerfContext* perf = GetPerfContext();
+  perf->Reset();
+  for (int i = 1; i < 1998; i += 2) {
+    char key[20];
+    std::snprintf(key, sizeof(key), "key%06d", i);
+    ASSERT_EQ("NOT_FOUND", Get(key));
+  }
+  SetPerfLevel(kDisable);
+  ASSERT_EQ(999, perf->filter_check_count);
+  ASSERT_GT(perf->filter_useful_count, 999 - 999 / 20);
+
+  // Bloom filter policies read ribbon filters
+  std::unique_ptr<const FilterPolicy> bloom(NewBloomFilterPolicy(10));
+  options.filter_policy = bloom.get();
+  Reopen(options);
+  CheckContents(model);
+  ASSERT_EQ("NOT_FOUND", Get("key000001"));
+}
+
+TEST_F(DBTest, PrefixSameAsStart) {
+  std::unique_ptr<const FilterPolicy> bloom(NewBloomFilterPolicy(10));
+  std::unique_ptr<const SliceTransform> prefix3(NewFixedPrefixTransform(3));
+  Options options;
+  options.filter_policy = bloom.get();
+  options.full_filter = true;
+  options.prefix_extractor = prefix3.get();
+  Reopen(options);
+
+  // Three overlapping tables, each with its own prefixes.  "a"
+  // and "z" are too short to have a prefix.
+  const std::vector<std::vector<std::string>> kPrefixes = {
+      {"aaa", "ccc"}, {"bbb"}, {"ddd"}};
+  for (const auto& prefixes : kPrefixes) {
+    for (const std::string& prefix : prefixes) {
+      for (int i = 0; i < 5; i++) {
+        ASSERT_LEVELDB_OK(Put(prefix + std::to_string(i), "v"));
+      }
+    }
+    ASSERT_LEVELDB_OK(Put("a", "v"));
+    ASSERT_LEVELDB_OK(Put("z", "v"));
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  }
+  ASSERT_EQ(3, TotalTableFiles());
+
+  ReadOptions ropts;
+  ropts.prefix_same_as_start = true;
+  SetPerfLevel(kEnableCount);
+  PerfContext* perf = GetPerfContext();
+
+  // Only the table with the prefix is read
+  perf->Reset();
+  Iterator* iter = db_->NewIterator(ropts);
+  std::string keys;
+  for (iter->Seek("bbb"); iter->Valid(); iter->Next()) {
+    keys += iter->key().ToString() + ",";
+  }
+  ASSERT_EQ("bbb0,bbb1,bbb2,bbb3,bbb4,", keys);
+  ASSERT_EQ(2, perf->filter_useful_count);
+
+  // Prev() stops at the prefix too
+  iter->Seek("ccc1");
+  ASSERT_TRUE(iter->Valid());
+  iter->Prev();
+  ASSERT_EQ("ccc0", iter->key().ToString());
+  iter->Prev();
+  ASSERT_TRUE(!iter->Valid());
+  ASSERT_LEVELDB_OK(iter->status());
+
+  // No table has the prefix: nothing is read
+  perf->Reset();
+  iter->Seek("eee");
+  ASSERT_TRUE(!iter->Valid());
+  ASSERT_EQ(3, perf->filter_useful_count);
+  ASSERT_EQ(0, perf->block_cache_hit_count + perf->block_read_count);
+
+  // Neither SeekToFirst() nor a Seek() to a key without a prefix is
+  // confined
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) count++;
+  ASSERT_EQ(22, count);
+  iter->Seek("a");
+  ASSERT_EQ("a", iter->key().ToString());
+  iter->Next();
+  ASSERT_EQ("aaa0", iter->key().ToString());
+  delete iter;
+
+  // The prefixes in the filters are of another transform: iteration is
+  // still confined, but every table is read
+  std::unique_ptr<const SliceTransform> prefix2(NewFixedPrefixTransform(2));
+  options.prefix_extractor = prefix2.get();
+  Reopen(options);
+  perf->Reset();
+  iter = db_->NewIterator(ropts);
+  keys.clear();
+  for (iter->Seek("bb"); iter->Valid(); iter->Next()) {
+    keys += iter->key().ToString() + ",";
+  }
+  ASSERT_EQ("bbb0,bbb1,bbb2,bbb3,bbb4,", keys);
+  ASSERT_EQ(0, perf->filter_useful_count);
+  delete iter;
+
+  // Two files on level 2 without the prefix, which only the memtable
+  // has.  The Seek() stops at the first file without opening the second,
+  // and turning around positions the first file just before the keys of
+  // the memtable rather than walking back from its last key.
+  delete db_;
+  db_ = nullptr;
+  DestroyDB(dbname_, Options());
+  Reopen(options);
+  ASSERT_LEVELDB_OK(Put("a1x", "v"));
+  for (int i = 3000000; i < 3020000; i++) {
+    ASSERT_LEVELDB_OK(Put("a" + std::to_string(i), "v"));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LEVELDB_OK(Put("zz", "v"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  std::string property;
+  ASSERT_TRUE(db_->GetProperty("leveldb.num-files-at-level2", &property));
+  ASSERT_EQ("2", property);
+  ASSERT_LEVELDB_OK(Put("a2a", "v"));
+  ASSERT_LEVELDB_OK(Put("a2b", "v"));
+
+  perf->Reset();
+  iter = db_->NewIterator(ropts);
+  iter->Seek("a2");
+  ASSERT_EQ("a2a", iter->key().ToString());
+  ASSERT_EQ(1, perf->find_table_count);
+  ASSERT_EQ(0, perf->block_cache_hit_count + perf->block_read_count);
+  iter->Next();
+  ASSERT_EQ("a2b", iter->key().ToString());
+  perf->Reset();
+  iter->Prev();
+  ASSERT_EQ("a2a", iter->key().ToString());
+  ASSERT_LE(perf->block_cache_hit_count + perf->block_read_count, 2);
+  iter->Prev();
+  ASSERT_TRUE(!iter->Valid());
+  ASSERT_LEVELDB_OK(iter->status());
+  delete iter;
+  SetPerfLevel(kDisable);
+}
+
+TEST_F(DBTest, IterateBounds) {
+  Options options;
+  options.write_buffer_size = 100 << 10;
+  options.block_size = 1024;
+  Reopen(options);
+
+  // Keys spread over the levels and the memtable, with overwrites and
+  // deletions
+  Random rnd(test::RandomSeed());
+  std::map<std::string, std::string> model;
+  for (int round = 0; round < 4; round++) {
+    for (int i = 0; i < 500; i++) {
+      char key[20];
+      std::snprintf(key, sizeof(key), "key%04d", rnd.Uniform(2000));
+      if (rnd.OneIn(5)) {
+        ASSERT_LEVELDB_OK(Delete(key));
+        model.erase(key);
+      } else {
+        std::string value;
+        test::RandomString(&rnd, 100, &value);
+        model[key] = value;
+        ASSERT_LEVELDB_OK(Put(key, value));
+      }
+    }
+    if (round < 3) {
+      ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    }
+    if (round == 1) {
+      db_->CompactRange(nullptr, nullptr);
+    }
+  }
+
+  for (int trial = 0; trial < 200; trial++) {
+    char lower_buf[20], upper_buf[20];
+    std::snprintf(lower_buf, sizeof(lower_buf), "key%04d", rnd.Uniform(2100));
+    std::snprintf(upper_buf, sizeof(upper_buf), "key%04d", rnd.Uniform(2100));
+    Slice lower(lower_buf), upper(upper_buf);
+    ReadOptions ropts;
+    ropts.iterate_lower_bound = rnd.OneIn(4) ? nullptr : &lower;
+    ropts.iterate_upper_bound = rnd.OneIn(4) ? nullptr : &upper;
+
+    // The keys of the model within the bounds
+    std::vector<std::string> expected;
+    for (const auto& kv : model) {
+      if ((ropts.iterate_lower_bound == nullptr || kv.first >= lower_buf) &&
+          (ropts.iterate_upper_bound == nullptr || kv.first < upper_buf)) {
+        expected.push_back(kv.first);
+      }
+    }
+
+    Iterator* iter = db_->NewIterator(ropts);
+    std::vector<std::string> actual;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      actual.push_back(iter->key().ToString());
+    }
+    ASSERT_EQ(expected, actual);
+    actual.clear();
+    for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+      actual.insert(actual.begin(), iter->key().ToString());
+    }
+    ASSERT_EQ(expected, actual);
+
+    // A Seek() and a random walk, changing direction
+    char target[20];
+    std::snprintf(target, sizeof(target), "key%04d", rnd.Uniform(2100));
+    iter->Seek(target);
+    size_t pos = std::lower_bound(expected.begin(), expected.end(),
+                                  std::string(target)) -
+                 expected.begin();
+    for (int step = 0; step < 20 && pos < expected.size(); step++) {
+      ASSERT_TRUE(iter->Valid());
+      ASSERT_EQ(expected[pos], iter->key().ToString());
+      ASSERT_EQ(model[expected[pos]], iter->value().ToString());
+      if (rnd.OneIn(2)) {
+        iter->Next();
+        pos++;
+      } else {
+        iter->Prev();
+        pos = (pos == 0) ? expected.size() : pos - 1;
+      }
+    }
+    if (pos >= expected.size()) {
+      ASSERT_TRUE(!iter->Valid());
+    }
+    ASSERT_LEVELDB_OK(iter->status());
+    delete iter;
+  }
+}
+
+TEST_F(DBTest, IterateUpperBoundSkipsBlocks) {
+  Options options;
+  options.block_size = 1024;
+  Reopen(options);
+
+  // Five tables, each with the keys of one letter
+  for (char c = 'a'; c < 'f'; c++) {
+    for (int i = 0; i < 100; i++) {
+      ASSERT_LEVELDB_OK(Put(std::string(1, c) + std::to_string(1000 + i),
+                            std::string(100, c)));
+    }
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  }
+  ASSERT_EQ(5, TotalTableFiles());
+
+  // Open all the tables
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+  }
+  delete iter;
+
+  SetPerfLevel(kEnableCount);
+  PerfContext* perf = GetPerfContext();
+  Slice lower("c"), upper("d");
+
+  // Scan the "c" keys, stopping at the first key past them
+  perf->Reset();
+  iter = db_->NewIterator(ReadOptions());
+  int count = 0;
+  for (iter->Seek("c"); iter->Valid() && iter->key().compare(upper) < 0;
+       iter->Next()) {
+    count++;
+  }
+  ASSERT_EQ(100, count);
+  delete iter;
+  const uint64_t unbounded =
+      perf->block_read_count + perf->block_cache_hit_count;
+
+  // The same scan with bounds does not touch the blocks of other tables
+  perf->Reset();
+  ReadOptions ropts;
+  ropts.iterate_lower_bound = &lower;
+  ropts.iterate_upper_bound = &upper;
+  iter = db_->NewIterator(ropts);
+  count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) count++;
+  ASSERT_EQ(100, count);
+  const uint64_t bounded =
+      perf->block_read_count + perf->block_cache_hit_count;
+  ASSERT_LT(bounded, unbounded);
+
+  // Nor does a backward scan
+  perf->Reset();
+  count = 0;
+  for (iter->SeekToLast(); iter->Valid(); iter->Prev()) count++;
+  ASSERT_EQ(100, count);
+  ASSERT_LE(perf->block_read_count + perf->block_cache_hit_count, bounded);
+  delete iter;
+  SetPerfLevel(kDisable);
+}
+
+TEST_F(DBTest, WriteStalls) {
+  Options options;
+  options.write_buffer_size = 64 << 10;
+  options.level0_slowdown_writes_trigger = 4;
+  options.level0_stop_writes_trigger = 6;
+  options.delayed_write_rate = 4 << 20;
+  Reopen(options);
+
+  // Write fast enough to pile up level-0 files; the writes must all
+  // survive however they were throttled.
+  Random rnd(test::RandomSeed());
+  std::map<std::string, std::string> model;
+  for (int i = 0; i < 5000; i++) {
+    std::string key = "key" + std::to_string(rnd.Uniform(2000));
+    std::string value;
+    test::RandomString(&rnd, 200, &value);
+    ASSERT_LEVELDB_OK(Put(key, value));
+    model[key] = value;
+  }
+  CheckContents(model);
+
+  std::string property;
+  ASSERT_TRUE(db_->GetProperty("leveldb.write-stalls", &property));
+  for (const char* cause :
+       {"level0-slowdown", "pending-bytes-slowdown", "memtable-full",
+        "level0-stop", "pending-bytes-stop", "Delayed write rate"}) {
+    ASSERT_NE(std::string::npos, property.find(cause)) << property;
+  }
+}
+
+// Holds back memtable flushes until Release() is called.
+class BlockFlushEnv : public EnvWrapper {
+ public:
+  explicit BlockFlushEnv(Env* target) : EnvWrapper(target) {}
+
+  void ScheduleHighPriority(void (*function)(void*), void* arg) override {
+    std::lock_guard<std::mutex> l(mu_);
+    if (blocked_) {
+      held_.emplace_back(function, arg);
+    } else {
+      target()->ScheduleHighPriority(function, arg);
+    }
+  }
+
+  void Block() {
+    std::lock_guard<std::mutex> l(mu_);
+    blocked_ = true;
+  }
+
+  void Release() {
+    std::lock_guard<std::mutex> l(mu_);
+    blocked_ = false;
+    for (const auto& job : held_) {
+      target()->ScheduleHighPriority(job.first, job.second);
+    }
+    held_.clear();
+  }
+
+ private:
+  std::mutex mu_;
+  bool blocked_ = false;
+  std::vector<std::pair<void (*)(void*), void*>> held_;
+};
+
+TEST_F(DBTest, MultipleImmutableMemTables) {
+  BlockFlushEnv env(Env::Default());
+  Options options;
+  options.env = &env;
+  options.write_buffer_size = 64 << 10;
+  options.max_write_buffer_number = 4;
+  Reopen(options);
+
+  // With flushes held back, full memtables queue up and reads must see
+  // the entries in every one of them.
+  env.Block();
+  Random rnd(test::RandomSeed());
+  std::map<std::string, std::string> model;
+  std::string property;
+  int i = 0;
+  while (true) {
+    ASSERT_TRUE(db_->GetProperty("leveldb.num-immutable-mem-table",
+                                 &property));
+    if (property == "3") break;
+    ASSERT_LT(i, 100000) << "memtables did not fill up";
+    char key[20];
+    std::snprintf(key, sizeof(key), "key%06d",
+                  static_cast<int>(rnd.Uniform(5000)));
+    std::string value;
+    test::RandomString(&rnd, 100, &value);
+    ASSERT_LEVELDB_OK(Put(key, value));
+    model[key] = value;
+    i++;
+  }
+  ASSERT_EQ(0, TotalTableFiles());
+  CheckContents(model);
+
+  // One flush writes all of the queued memtables into a single table.
+  // TEST_CompactMemTable() would also flush the active memtable, so wait
+  // for the queue to drain instead.
+  env.Release();
+  for (int wait = 0; wait < 10000; wait++) {
+    ASSERT_TRUE(db_->GetProperty("leveldb.num-immutable-mem-table",
+                                 &property));
+    if (property == "0") break;
+    env_->SleepForMicroseconds(1000);
+  }
+  ASSERT_EQ("0", property);
+  ASSERT_EQ(1, TotalTableFiles());
+  CheckContents(model);
+
+  Reopen(options);
+  CheckContents(model);
+
+  // The DB must not outlive "env".
+  delete db_;
+  db_ = nullptr;
+}
+
+}  // namespace leveldb
@@ -100,20 +100,44 @@ const char* InternalFilterPolicy::Name() const { return user_policy_->Name(); }
 
 void InternalFilterPolicy::CreateFilter(const Slice* keys, int n,
                                         std::string* dst) const {
+  CreateFilterForLevel(keys, n, dst, -1);
+}
+
+void InternalFilterPolicy::CreateFilterForLevel(const Slice* keys, int n,
+                                                std::string* dst,
+                                                int level) const {
   // We rely on the fact that the code in table.cc does not mind us
-  // adjusting keys[].
+  // adjusting keys[].  Versions of a user key, and prefixes shared by
+  // several keys, are next to each other and passed on once.
   Slice* mkey = const_cast<Slice*>(keys);
+  int unique = 0;
   for (int i = 0; i < n; i++) {
-    mkey[i] = ExtractUserKey(keys[i]);
-    // TODO(sanjay): Suppress dups?
+    Slice user_key = ExtractUserKey(keys[i]);
+    if (unique == 0 || user_key != mkey[unique - 1]) {
+      mkey[unique++] = user_key;
+    }
   }
-  user_policy_->CreateFilter(keys, n, dst);
+  user_policy_->CreateFilterForLevel(keys, unique, dst, level);
 }
 
 bool InternalFilterPolicy::KeyMayMatch(const Slice& key, const Slice& f) const {
   return user_policy_->KeyMayMatch(ExtractUserKey(key), f);
 }
 
+const char* InternalKeySliceTransform::Name() const {
+  return user_transform_->Name();
+}
+
+Slice InternalKeySliceTransform::Transform(const Slice& key) const {
+  const Slice user_prefix = user_transform_->Transform(ExtractUserKey(key));
+  assert(user_prefix.data() == key.data());
+  return Slice(key.data(), user_prefix.size() + 8);
+}
+
+bool InternalKeySliceTransform::InDomain(const Slice& key) const {
+  return user_transform_->InDomain(ExtractUserKey(key));
+}
+
 LookupKey::LookupKey(const Slice& user_key, SequenceNumber s) {
   size_t usize = user_key.size();
   size_t needed = usize + 13;  // A conservative estimate
@@ -12,6 +12,7 @@
 #include "leveldb/comparator.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/slice_transform.h"
 
 #include "util/coding.h"
 #include "util/logging.h"
@@ -23,15 +24,11 @@ namespace leveldb {
 namespace config {
 static const int kNumLevels = 7;
 
-// Level-0 compaction is started when we hit this many files.
+// Level-0 compaction is started when we hit this many files.  Writes are
+// slowed down and stopped at Options::level0_slowdown_writes_trigger and
+// Options::level0_stop_writes_trigger files.
 static const int kL0_CompactionTrigger = 4;
 
-// Soft limit on number of level-0 files.  We slow down writes at this point.
-static const int kL0_SlowdownWritesTrigger = 8;
-
-// Maximum number of level-0 files.  We stop writes at this point.
-static const int kL0_StopWritesTrigger = 12;
-
 // Maximum level to which a new compacted memtable is pushed if it
 // does not create overlap.  We try to push to level 2 to avoid the
 // relatively expensive level 0=>1 compactions and to avoid some
@@ -124,9 +121,30 @@ class InternalFilterPolicy : public FilterPolicy {
   explicit InternalFilterPolicy(const FilterPolicy* p) : user_policy_(p) {}
   const char* Name() const override;
   void CreateFilter(const Slice* keys, int n, std::string* dst) const override;
+  void CreateFilterForLevel(const Slice* keys, int n, std::string* dst,
+                            int level) const override;
   bool KeyMayMatch(const Slice& key, const Slice& filter) const override;
 };
 
+// Prefix extractor wrapper that applies a user key transform to internal
+// keys.  The prefix of an internal key is the prefix of its user key
+// followed by the 8 bytes after it in the internal key, so that, like
+// any internal key, it gives back the user prefix once
+// InternalFilterPolicy strips its last 8 bytes.
+class InternalKeySliceTransform : public SliceTransform {
+ private:
+  const SliceTransform* const user_transform_;
+
+ public:
+  explicit InternalKeySliceTransform(const SliceTransform* t)
+      : user_transform_(t) {}
+  const char* Name() const override;
+  Slice Transform(const Slice& key) const override;
+  bool InDomain(const Slice& key) const override;
+
+  const SliceTransform* user_transform() const { return user_transform_; }
+};
+
 // Modules in this directory should keep internal keys wrapped inside
 // the following class instead of plain strings so that we do not
 // incorrectly use string comparisons instead of an InternalKeyComparator.
@@ -44,6 +44,11 @@ class MemTable {
   void Add(SequenceNumber seq, ValueType type, const Slice& key,
            const Slice& value);
 
+  // Like Add(), but several threads may call it at the same time.  Calls
+  // must not overlap with calls to Add().
+  void AddConcurrently(SequenceNumber seq, ValueType type, const Slice& key,
+                       const Slice& value);
+
   // If memtable contains a value for key, store it in *value and return true.
   // If memtable contains a deletion for key, store a NotFound() error
   // in *status and return true.
@@ -62,6 +67,11 @@ class MemTable {
   };
   using Table = SkipList<const char*, KeyComparator>;
 
+  // Encode an entry into "buf", which must have room for EntryLength().
+  static size_t EntryLength(const Slice& key, const Slice& value);
+  static void EncodeEntry(char* buf, SequenceNumber seq, ValueType type,
+                          const Slice& key, const Slice& value);
+
   KeyComparator comparator_;
   int refs_;
   Arena arena_;
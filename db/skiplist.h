@@ -1,6 +1,9 @@
 ﻿#ifndef LEVELDB_DB_SKIPLIST_H
 #define LEVELDB_DB_SKIPLIST_H
 
+#include <functional>
+#include <thread>
+
 #include "util/arena.h"
 #include "util/random.h"
 namespace leveldb {
@@ -15,6 +18,11 @@ class SkipList {
   SkipList& operator=(const SkipList&) = delete;
 
   void Insert(const Key& key);
+
+  // Like Insert(), but several threads may call it at the same time.
+  // Calls must not overlap with calls to Insert().
+  void InsertConcurrently(const Key& key);
+
   bool Contains(const Key& key) const;
   class Iterator {
    public:
@@ -39,14 +47,20 @@ class SkipList {
   inline int GetMaxHeight() const {
     return max_height_.load(std::memory_order_relaxed);
   }
-  Node* NewNode(const Key& key, int height);
+  Node* NewNode(const Key& key, int height, bool concurrently = false);
   int RandomHeight();
+  int RandomHeightConcurrently();
   bool Equal(const Key& a, const Key& b) const { return (compare_(a, b) == 0); }
   bool KeyIsAfterNode(const Key& key, Node* n) const;
   Node* FindGreaterOrEqual(const Key& key, Node** prev) const;
   Node* FindLessThan(const Key& key) const;
   Node* FindLast() const;
 
+  // Find the nodes between which "key" goes at "level", starting the
+  // search at "before", which must be before "key".
+  void FindSpliceForLevel(const Key& key, Node* before, int level,
+                          Node** out_prev, Node** out_next) const;
+
   Comparator const compare_;
   Arena* const arena_;
   Node* const head_;
@@ -76,6 +90,11 @@ struct SkipList<Key, Comparator>::Node {
     assert(n >= 0);
     next_[n].store(x, std::memory_order_relaxed);
   }
+  bool CASNext(int n, Node* expected, Node* x) {
+    assert(n >= 0);
+    return next_[n].compare_exchange_strong(expected, x,
+                                            std::memory_order_release);
+  }
 
  private:
   std::atomic<Node*> next_[1];
@@ -83,10 +102,13 @@ struct SkipList<Key, Comparator>::Node {
 
 template <typename Key, class Comparator>
 typename SkipList<Key, Comparator>::Node* SkipList<Key, Comparator>::NewNode(
-    const Key& key, int height) {
-  char* const node_memory = arena_->AllocateAligned(
-      sizeof(Node) +
-      sizeof(std::atomic<Node*>) * (height - 1));  // 动态内存分配Node*
+    const Key& key, int height, bool concurrently) {
+  // 动态内存分配Node*
+  const size_t bytes =
+      sizeof(Node) + sizeof(std::atomic<Node*>) * (height - 1);
+  char* const node_memory = concurrently
+                                ? arena_->AllocateAlignedConcurrently(bytes)
+                                : arena_->AllocateAligned(bytes);
   return new (node_memory) Node(key);
 }
 
@@ -155,6 +177,19 @@ int SkipList<Key, Comparator>::RandomHeight() {
   return height;
 }
 
+template <typename Key, class Comparator>
+int SkipList<Key, Comparator>::RandomHeightConcurrently() {
+  // rnd_ belongs to Insert(); concurrent inserters each use their own.
+  static thread_local Random rnd(static_cast<uint32_t>(
+      std::hash<std::thread::id>()(std::this_thread::get_id())));
+  static const unsigned int kBranching = 4;
+  int height = 1;
+  while (height < kMaxHeight && rnd.OneIn(kBranching)) {
+    height++;
+  }
+  return height;
+}
+
 template <typename Key, class Comparator>
 bool SkipList<Key, Comparator>::KeyIsAfterNode(const Key& key, Node* n) const {
   return (n != nullptr) && (compare_(n->key, key) < 0);
@@ -219,6 +254,22 @@ typename SkipList<Key, Comparator>::Node* SkipList<Key, Comparator>::FindLast()
   }
 }
 
+template <typename Key, class Comparator>
+void SkipList<Key, Comparator>::FindSpliceForLevel(const Key& key,
+                                                   Node* before, int level,
+                                                   Node** out_prev,
+                                                   Node** out_next) const {
+  while (true) {
+    Node* next = before->Next(level);
+    if (!KeyIsAfterNode(key, next)) {
+      *out_prev = before;
+      *out_next = next;
+      return;
+    }
+    before = next;
+  }
+}
+
 template <typename Key, class Comparator>
 SkipList<Key, Comparator>::SkipList(Comparator cmp, Arena* arena)
     : compare_(cmp),
@@ -252,6 +303,45 @@ void SkipList<Key, Comparator>::Insert(const Key& key) {
   }
 }
 
+template <typename Key, class Comparator>
+void SkipList<Key, Comparator>::InsertConcurrently(const Key& key) {
+  const int height = RandomHeightConcurrently();
+  int max_height = GetMaxHeight();
+  while (height > max_height) {
+    if (max_height_.compare_exchange_weak(max_height, height,
+                                          std::memory_order_relaxed)) {
+      max_height = height;
+      break;
+    }
+  }
+
+  // Find the splice at every level, top-down, each level's search
+  // starting from the node found on the level above.
+  Node* prev[kMaxHeight];
+  Node* next[kMaxHeight];
+  Node* before = head_;
+  for (int i = max_height - 1; i >= 0; i--) {
+    FindSpliceForLevel(key, before, i, &prev[i], &next[i]);
+    before = prev[i];
+  }
+  assert(next[0] == nullptr || !Equal(key, next[0]->key));
+
+  // Link the new node in bottom-up, so that it is reachable at level i
+  // only once it is at every level below.  A failed CAS means another
+  // node went in next to ours: search again from the old predecessor,
+  // which is still before "key".
+  Node* x = NewNode(key, height, true);
+  for (int i = 0; i < height; i++) {
+    while (true) {
+      x->NoBarrier_SetNext(i, next[i]);
+      if (prev[i]->CASNext(i, next[i], x)) {
+        break;
+      }
+      FindSpliceForLevel(key, prev[i], i, &prev[i], &next[i]);
+    }
+  }
+}
+
 template <typename Key, class Comparator>
 bool SkipList<Key, Comparator>::Contains(const Key& key) const {
   Node* x = FindGreaterOrEqual(key, nullptr);
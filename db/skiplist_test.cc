@@ -1,5 +1,10 @@
 ﻿#include "db/skiplist.h"
 
+#include <atomic>
+#include <set>
+#include <thread>
+#include <vector>
+
 #include "leveldb/env.h"
 
 #include "port/port.h"
@@ -306,4 +311,61 @@ TEST(SkipTest, Concurrent3) { RunConcurrent(3); }
 TEST(SkipTest, Concurrent4) { RunConcurrent(4); }
 TEST(SkipTest, Concurrent5) { RunConcurrent(5); }
 
+// Several threads insert disjoint keys at once while a reader checks that
+// every key it finds stays sorted.
+TEST(SkipTest, ConcurrentInserts) {
+  static const int kNumThreads = 8;
+  static const int kPerThread = 20000;
+  Arena arena;
+  Comparator cmp;
+  SkipList<Key, Comparator> list(cmp, &arena);
+
+  std::atomic<bool> done(false);
+  std::atomic<int> errors(0);
+  std::thread reader([&]() {
+    while (!done.load(std::memory_order_acquire)) {
+      SkipList<Key, Comparator>::Iterator iter(&list);
+      Key last = 0;
+      for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+        if (iter.key() <= last) errors.fetch_add(1);
+        last = iter.key();
+      }
+    }
+  });
+
+  std::vector<std::thread> writers;
+  for (int t = 0; t < kNumThreads; t++) {
+    writers.emplace_back([&, t]() {
+      Random rnd(t + 1);
+      for (int i = 0; i < kPerThread; i++) {
+        // Interleave the threads' keys, in random order within a thread.
+        Key key = static_cast<Key>(rnd.Next()) * kNumThreads + t + 1;
+        if (!list.Contains(key)) list.InsertConcurrently(key);
+      }
+    });
+  }
+  for (std::thread& t : writers) {
+    t.join();
+  }
+  done.store(true, std::memory_order_release);
+  reader.join();
+  ASSERT_EQ(0, errors.load());
+
+  std::set<Key> expected;
+  for (int t = 0; t < kNumThreads; t++) {
+    Random rnd(t + 1);
+    for (int i = 0; i < kPerThread; i++) {
+      expected.insert(static_cast<Key>(rnd.Next()) * kNumThreads + t + 1);
+    }
+  }
+  SkipList<Key, Comparator>::Iterator iter(&list);
+  iter.SeekToFirst();
+  for (Key key : expected) {
+    ASSERT_TRUE(iter.Valid());
+    ASSERT_EQ(key, iter.key());
+    iter.Next();
+  }
+  ASSERT_TRUE(!iter.Valid());
+}
+
 }  // namespace leveldb
\ No newline at end of file
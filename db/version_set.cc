@@ -14,12 +14,15 @@
 #include "db/table_cache.h"
 
 #include "leveldb/env.h"
+#include "leveldb/statistics.h"
 #include "leveldb/table_builder.h"
 
 #include "table/merger.h"
+#include "table/prefix_seek.h"
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
 #include "util/logging.h"
+#include "util/perf_context_imp.h"
 
 namespace leveldb {
 
@@ -106,6 +109,35 @@ int FindFile(const InternalKeyComparator& icmp,
   return right;
 }
 
+// Set [*begin, *end) to the range of "files", which are sorted and do
+// not overlap, that may hold keys between the internal keys
+// options.iterate_lower_bound and options.iterate_upper_bound.
+static void FindFilesInBounds(const InternalKeyComparator& icmp,
+                              const std::vector<FileMetaData*>& files,
+                              const ReadOptions& options, uint32_t* begin,
+                              uint32_t* end) {
+  *begin = 0;
+  *end = static_cast<uint32_t>(files.size());
+  if (options.iterate_lower_bound != nullptr) {
+    *begin = FindFile(icmp, files, *options.iterate_lower_bound);
+  }
+  if (options.iterate_upper_bound != nullptr) {
+    // Find the first file that starts at or after the upper bound
+    uint32_t left = *begin;
+    uint32_t right = *end;
+    while (left < right) {
+      uint32_t mid = (left + right) / 2;
+      if (icmp.Compare(files[mid]->smallest.Encode(),
+                       *options.iterate_upper_bound) < 0) {
+        left = mid + 1;
+      } else {
+        right = mid;
+      }
+    }
+    *end = right;
+  }
+}
+
 static bool AfterFile(const Comparator* ucmp, const Slice* user_key,
                       const FileMetaData* f) {
   // null user_key occurs before all keys and is therefore never after *f
@@ -161,31 +193,46 @@ bool SomeFileOverlapsRange(const InternalKeyComparator& icmp,
 // information about the files in the level.  For a given entry, key()
 // is the largest key that occurs in the file, and value() is an
 // 16-byte value containing the file number and file size, both
-// encoded using EncodeFixed64.
+// encoded using EncodeFixed64.  The files wholly outside the bounds of
+// "options" are skipped.
 class Version::LevelFileNumIterator : public Iterator {
  public:
   LevelFileNumIterator(const InternalKeyComparator& icmp,
-                       const std::vector<FileMetaData*>* flist)
+                       const std::vector<FileMetaData*>* flist,
+                       const ReadOptions& options)
       : icmp_(icmp),
         flist_(flist),
-        index_(static_cast<uint32_t>(flist->size())) {  // Marks as invalid
+        prefix_same_as_start_(options.prefix_same_as_start) {
+    FindFilesInBounds(icmp, *flist, options, &begin_, &end_);
+    index_ = end_;  // Marks as invalid
   }
-  bool Valid() const override { return index_ < flist_->size(); }
+  bool Valid() const override { return index_ < end_; }
   void Seek(const Slice& target) override {
     index_ = FindFile(icmp_, *flist_, target);
+    if (index_ < begin_) {
+      index_ = begin_;
+    } else if (index_ > end_) {
+      index_ = end_;
+    }
   }
-  void SeekToFirst() override { index_ = 0; }
-  void SeekToLast() override {
-    index_ = flist_->empty() ? 0 : static_cast<uint32_t>(flist_->size() - 1);
-  }
+  void SeekToFirst() override { index_ = begin_; }
+  void SeekToLast() override { index_ = (begin_ < end_) ? end_ - 1 : end_; }
   void Next() override {
     assert(Valid());
-    index_++;
+    if (prefix_same_as_start_ && PrefixSeekScope::Active()) {
+      // A Seek() only moves past the file it lands on, whose largest key
+      // is at or after the target, if the filter ruled the file out.
+      // That key is then past every key with the target's prefix, and
+      // so are all of the later files.
+      index_ = end_;  // Marks as invalid
+    } else {
+      index_++;
+    }
   }
   void Prev() override {
     assert(Valid());
-    if (index_ == 0) {
-      index_ = static_cast<uint32_t>(flist_->size());  // Marks as invalid
+    if (index_ == begin_) {
+      index_ = end_;  // Marks as invalid
     } else {
       index_--;
     }
@@ -205,6 +252,9 @@ class Version::LevelFileNumIterator : public Iterator {
  private:
   const InternalKeyComparator icmp_;
   const std::vector<FileMetaData*>* const flist_;
+  const bool prefix_same_as_start_;
+  uint32_t begin_;  // The files in bounds are [begin_, end_)
+  uint32_t end_;
   uint32_t index_;
 
   // Backing store for value().  Holds the file number and size.
@@ -218,37 +268,50 @@ static Iterator* GetFileIterator(void* arg, const ReadOptions& options,
     return NewErrorIterator(
         Status::Corruption("FileReader invoked with unexpected value"));
   } else {
+    // Only files of levels > 0 are read through concatenating iterators
     return cache->NewIterator(options, DecodeFixed64(file_value.data()),
-                              DecodeFixed64(file_value.data() + 8));
+                              DecodeFixed64(file_value.data() + 8), -1);
   }
 }
 
 Iterator* Version::NewConcatenatingIterator(const ReadOptions& options,
                                             int level) const {
   return NewTwoLevelIterator(
-      new LevelFileNumIterator(vset_->icmp_, &files_[level]), &GetFileIterator,
-      vset_->table_cache_, options);
+      new LevelFileNumIterator(vset_->icmp_, &files_[level], options),
+      &GetFileIterator, vset_->table_cache_, options, &vset_->icmp_);
 }
 
 void Version::AddIterators(const ReadOptions& options,
                            std::vector<Iterator*>* iters) {
+  const InternalKeyComparator& icmp = vset_->icmp_;
+
   // Merge all level zero files together since they may overlap
-  for (size_t i = 0; i < files_[0].size(); i++) {
-    iters->push_back(vset_->table_cache_->NewIterator(
-        options, files_[0][i]->number, files_[0][i]->file_size));
+  for (FileMetaData* f : files_[0]) {
+    if ((options.iterate_lower_bound != nullptr &&
+         icmp.Compare(f->largest.Encode(), *options.iterate_lower_bound) <
+             0) ||
+        (options.iterate_upper_bound != nullptr &&
+         icmp.Compare(f->smallest.Encode(), *options.iterate_upper_bound) >=
+             0)) {
+      continue;  // Wholly outside the bounds
+    }
+    iters->push_back(vset_->table_cache_->NewIterator(options, f->number,
+                                                      f->file_size, 0));
   }
 
   // For levels > 0, we can use a concatenating iterator that sequentially
   // walks through the non-overlapping files in the level, opening them
   // lazily.
   for (int level = 1; level < config::kNumLevels; level++) {
-    if (!files_[level].empty()) {
+    uint32_t begin, end;
+    FindFilesInBounds(icmp, files_[level], options, &begin, &end);
+    if (begin < end) {
       iters->push_back(NewConcatenatingIterator(options, level));
     }
   }
 }
 
-// Callback from TableCache::Get()
+// Callback from TableCache::Get() and TableCache::MultiGet()
 namespace {
 enum SaverState {
   kNotFound,
@@ -278,6 +341,27 @@ static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
   }
 }
 
+namespace {
+// Called when a table file held the key being looked up, so that its
+// filter, if it has one, let the lookup through rightly.
+void RecordFilterTruePositive(const Options* options) {
+  if (options->statistics != nullptr && options->filter_policy != nullptr) {
+    options->statistics->RecordTick(kFilterTruePositive, 1);
+  }
+}
+
+// The keys of a MultiGet() batch looked up in one table file.
+struct MultiSaver {
+  Saver* savers;                     // One per key of the whole batch
+  const std::vector<size_t>* batch;  // Indices of the keys searched
+};
+}  // namespace
+static void MultiSaveValue(void* arg, size_t i, const Slice& ikey,
+                           const Slice& v) {
+  MultiSaver* s = reinterpret_cast<MultiSaver*>(arg);
+  SaveValue(&s->savers[(*s->batch)[i]], ikey, v);
+}
+
 static bool NewestFirst(FileMetaData* a, FileMetaData* b) {
   return a->number > b->number;
 }
@@ -354,10 +438,11 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
 
       state->last_file_read = f;
       state->last_file_read_level = level;
+      PerfCount(&PerfContext::get_from_output_files_count);
 
-      state->s = state->vset->table_cache_->Get(*state->options, f->number,
-                                                f->file_size, state->ikey,
-                                                &state->saver, SaveValue);
+      state->s = state->vset->table_cache_->Get(
+          *state->options, f->number, f->file_size, level, state->ikey,
+          &state->saver, SaveValue);
       if (!state->s.ok()) {
         state->found = true;
         return false;
@@ -366,9 +451,11 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
         case kNotFound:
           return true;  // Keep searching in other files
         case kFound:
+          RecordFilterTruePositive(state->vset->options_);
           state->found = true;
           return false;
         case kDeleted:
+          RecordFilterTruePositive(state->vset->options_);
           return false;
         case kCorrupt:
           state->s =
@@ -398,11 +485,141 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
   state.saver.user_key = k.user_key();
   state.saver.value = value;
 
+  PerfTimer timer(&PerfContext::get_from_output_files_nanos);
   ForEachOverlapping(state.saver.user_key, state.ikey, &state, &State::Match);
+  timer.Stop();
 
   return state.found ? state.s : Status::NotFound(Slice());
 }
 
+void Version::MultiGet(const ReadOptions& options,
+                       std::vector<KeyLookup>* lookups) {
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
+  const size_t n = lookups->size();
+
+  std::vector<Saver> savers(n);
+  std::vector<FileMetaData*> last_file_read(n, nullptr);
+  std::vector<int> last_file_read_level(n, -1);
+  std::vector<size_t> pending;  // Unresolved keys, in increasing order
+  for (size_t i = 0; i < n; i++) {
+    KeyLookup& lookup = (*lookups)[i];
+    lookup.stats.seek_file = nullptr;
+    lookup.stats.seek_file_level = -1;
+    lookup.status = Status::NotFound(Slice());
+    savers[i].state = kNotFound;
+    savers[i].ucmp = ucmp;
+    savers[i].user_key = lookup.key->user_key();
+    savers[i].value = lookup.value;
+    pending.push_back(i);
+  }
+
+  // Search "f" for the keys in "batch" and record the outcome, as
+  // Get() does for a single key.
+  std::vector<Slice> ikeys;
+  auto search = [&](int level, FileMetaData* f,
+                    const std::vector<size_t>& batch) {
+    PerfTimer timer(&PerfContext::get_from_output_files_nanos);
+    PerfCount(&PerfContext::get_from_output_files_count);
+    ikeys.clear();
+    for (size_t i : batch) {
+      ikeys.push_back((*lookups)[i].key->internal_key());
+    }
+    MultiSaver multi_saver{savers.data(), &batch};
+    Status s = vset_->table_cache_->MultiGet(options, f->number, f->file_size,
+                                             level, ikeys, &multi_saver,
+                                             MultiSaveValue);
+    for (size_t i : batch) {
+      KeyLookup& lookup = (*lookups)[i];
+      if (lookup.stats.seek_file == nullptr && last_file_read[i] != nullptr) {
+        // We have had more than one seek for this read.  Charge the 1st file.
+        lookup.stats.seek_file = last_file_read[i];
+        lookup.stats.seek_file_level = last_file_read_level[i];
+      }
+      last_file_read[i] = f;
+      last_file_read_level[i] = level;
+
+      switch (savers[i].state) {
+        case kNotFound:
+          if (!s.ok()) {
+            lookup.status = s;
+            savers[i].state = kCorrupt;  // Stop searching
+          }
+          break;
+        case kFound:
+          RecordFilterTruePositive(vset_->options_);
+          lookup.status = Status::OK();
+          break;
+        case kDeleted:
+          RecordFilterTruePositive(vset_->options_);
+          break;
+        case kCorrupt:
+          lookup.status =
+              Status::Corruption("corrupted key for ", savers[i].user_key);
+          break;
+      }
+    }
+  };
+  auto drop_resolved = [&]() {
+    size_t kept = 0;
+    for (size_t i : pending) {
+      if (savers[i].state == kNotFound) {
+        pending[kept++] = i;
+      }
+    }
+    pending.resize(kept);
+  };
+
+  // Search level-0 in order from newest to oldest.
+  std::vector<FileMetaData*> tmp(files_[0]);
+  std::sort(tmp.begin(), tmp.end(), NewestFirst);
+  std::vector<size_t> batch;
+  for (FileMetaData* f : tmp) {
+    batch.clear();
+    for (size_t i : pending) {
+      const Slice user_key = savers[i].user_key;
+      if (ucmp->Compare(user_key, f->smallest.user_key()) >= 0 &&
+          ucmp->Compare(user_key, f->largest.user_key()) <= 0) {
+        batch.push_back(i);
+      }
+    }
+    if (!batch.empty()) {
+      search(0, f, batch);
+      drop_resolved();
+    }
+  }
+
+  // Search other levels.  Files in a level are disjoint and sorted, so the
+  // sorted pending keys map onto them in runs.
+  for (int level = 1; level < config::kNumLevels && !pending.empty();
+       level++) {
+    const size_t num_files = files_[level].size();
+    if (num_files == 0) continue;
+
+    size_t batch_file = num_files;
+    batch.clear();
+    for (size_t i : pending) {
+      const uint32_t index = FindFile(vset_->icmp_, files_[level],
+                                      (*lookups)[i].key->internal_key());
+      if (index >= num_files ||
+          ucmp->Compare(savers[i].user_key,
+                        files_[level][index]->smallest.user_key()) < 0) {
+        // All of the files are past any data for this key
+        continue;
+      }
+      if (index != batch_file && !batch.empty()) {
+        search(level, files_[level][batch_file], batch);
+        batch.clear();
+      }
+      batch_file = index;
+      batch.push_back(i);
+    }
+    if (!batch.empty()) {
+      search(level, files_[level][batch_file], batch);
+    }
+    drop_resolved();
+  }
+}
+
 bool Version::UpdateStats(const GetStats& stats) {
   FileMetaData* f = stats.seek_file;
   if (f != nullptr) {
@@ -484,6 +701,11 @@ int Version::PickLevelForMemTableOutput(const Slice& smallest_user_key,
       if (OverlapInLevel(level + 1, &smallest_user_key, &largest_user_key)) {
         break;
       }
+      if (vset_->OutputRangeBusy(level + 1, smallest_user_key,
+                                 largest_user_key)) {
+        // A running compaction may still add overlapping files there.
+        break;
+      }
       if (level + 2 < config::kNumLevels) {
         // Check that file does not overlap too many grandparent bytes.
         GetOverlappingInputs(level + 2, &start, &limit, &overlaps);
@@ -791,7 +1013,7 @@ Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
   }
 
   edit->SetNextFile(next_file_number_);
-  edit->SetLastSequence(last_sequence_);
+  edit->SetLastSequence(LastSequence());
 
   Version* v = new Version(this);
   {
@@ -1060,6 +1282,7 @@ void VersionSet::Finalize(Version* v) {
           static_cast<double>(level_bytes) / MaxBytesForLevel(options_, level);
     }
 
+    v->compaction_scores_[level] = score;
     if (score > best_score) {
       best_level = level;
       best_score = score;
@@ -1068,6 +1291,31 @@ void VersionSet::Finalize(Version* v) {
 
   v->compaction_level_ = best_level;
   v->compaction_score_ = best_score;
+
+  // Estimate the compaction debt: the bytes over each level's limit are
+  // merged into the next level, rewriting about as many bytes there as
+  // the ratio of the two levels' sizes, and add to that level in turn.
+  uint64_t pending = 0;
+  uint64_t incoming = 0;
+  for (int level = 0; level < config::kNumLevels - 1; level++) {
+    const uint64_t level_bytes = TotalFileSize(v->files_[level]) + incoming;
+    uint64_t excess = 0;
+    if (level == 0) {
+      if (v->files_[0].size() >= config::kL0_CompactionTrigger) {
+        excess = level_bytes;
+      }
+    } else if (level_bytes > MaxBytesForLevel(options_, level)) {
+      excess = level_bytes -
+               static_cast<uint64_t>(MaxBytesForLevel(options_, level));
+    }
+    if (excess > 0) {
+      const double next_bytes = TotalFileSize(v->files_[level + 1]);
+      pending += static_cast<uint64_t>(excess * (1.0 + next_bytes /
+                                                           level_bytes));
+    }
+    incoming = excess;
+  }
+  v->pending_compaction_bytes_ = pending;
 }
 
 Status VersionSet::WriteSnapshot(log::Writer* log) {
@@ -1138,8 +1386,9 @@ uint64_t VersionSet::ApproximateOffsetOf(Version* v, const InternalKey& ikey) {
         // "ikey" falls in the range for this table.  Add the
         // approximate offset of "ikey" within the table.
         Table* tableptr;
-        Iterator* iter = table_cache_->NewIterator(
-            ReadOptions(), files[i]->number, files[i]->file_size, &tableptr);
+        Iterator* iter =
+            table_cache_->NewIterator(ReadOptions(), files[i]->number,
+                                      files[i]->file_size, level, &tableptr);
         if (tableptr != nullptr) {
           result += tableptr->ApproximateOffsetOf(ikey.Encode());
         }
@@ -1238,12 +1487,13 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
         const std::vector<FileMetaData*>& files = c->inputs_[which];
         for (size_t i = 0; i < files.size(); i++) {
           list[num++] = table_cache_->NewIterator(options, files[i]->number,
-                                                  files[i]->file_size);
+                                                  files[i]->file_size, 0);
         }
       } else {
         // Create concatenating iterator for the files from this level
         list[num++] = NewTwoLevelIterator(
-            new Version::LevelFileNumIterator(icmp_, &c->inputs_[which]),
+            new Version::LevelFileNumIterator(icmp_, &c->inputs_[which],
+                                              options),
             &GetFileIterator, table_cache_, options);
       }
     }
@@ -1254,41 +1504,101 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
   return result;
 }
 
+void VersionSet::GetSubcompactionBoundaries(
+    Compaction* c, int max_ranges, std::vector<std::string>* boundaries) {
+  boundaries->clear();
+
+  // Candidate cut points are the smallest keys of the input files, each
+  // weighted by the amount of input data that comes before it.
+  std::vector<FileMetaData*> files(c->inputs_[0]);
+  files.insert(files.end(), c->inputs_[1].begin(), c->inputs_[1].end());
+  std::sort(files.begin(), files.end(),
+            [this](FileMetaData* a, FileMetaData* b) {
+              return icmp_.Compare(a->smallest, b->smallest) < 0;
+            });
+
+  const uint64_t total = TotalFileSize(files);
+  const uint64_t min_range_bytes = MaxFileSizeForLevel(options_, c->level());
+  const uint64_t ranges = std::min<uint64_t>(
+      std::max(max_ranges, 1), total / std::max<uint64_t>(min_range_bytes, 1));
+  if (ranges <= 1) {
+    return;
+  }
+
+  const Comparator* user_cmp = icmp_.user_comparator();
+  uint64_t bytes_before = 0;
+  for (FileMetaData* f : files) {
+    if (boundaries->size() + 1 == ranges) {
+      break;
+    }
+    const Slice key = f->smallest.user_key();
+    const Slice previous = boundaries->empty()
+                               ? files[0]->smallest.user_key()
+                               : Slice(boundaries->back());
+    if (bytes_before >= total * (boundaries->size() + 1) / ranges &&
+        user_cmp->Compare(key, previous) > 0) {
+      boundaries->push_back(key.ToString());
+    }
+    bytes_before += f->file_size;
+  }
+}
+
 Compaction* VersionSet::PickCompaction() {
-  Compaction* c;
-  int level;
+  // Levels that need a compaction because of their size, most urgent first.
+  // Running compactions may own the preferred files of a level, in which
+  // case other files and then other levels are tried.
+  std::vector<int> levels;
+  for (int level = 0; level < config::kNumLevels - 1; level++) {
+    if (current_->compaction_scores_[level] >= 1) {
+      levels.push_back(level);
+    }
+  }
+  std::stable_sort(levels.begin(), levels.end(), [this](int a, int b) {
+    return current_->compaction_scores_[a] > current_->compaction_scores_[b];
+  });
 
   // We prefer compactions triggered by too much data in a level over
   // the compactions triggered by seeks.
-  const bool size_compaction = (current_->compaction_score_ >= 1);
-  const bool seek_compaction = (current_->file_to_compact_ != nullptr);
-  if (size_compaction) {
-    level = current_->compaction_level_;
-    assert(level >= 0);
-    assert(level + 1 < config::kNumLevels);
-    c = new Compaction(options_, level);
-
-    // Pick the first file that comes after compact_pointer_[level]
-    for (size_t i = 0; i < current_->files_[level].size(); i++) {
-      FileMetaData* f = current_->files_[level][i];
-      if (compact_pointer_[level].empty() ||
-          icmp_.Compare(f->largest.Encode(), compact_pointer_[level]) > 0) {
-        c->inputs_[0].push_back(f);
-        break;
+  for (int level : levels) {
+    const std::vector<FileMetaData*>& files = current_->files_[level];
+
+    // Start with the first file that comes after compact_pointer_[level],
+    // wrapping around to the beginning of the key space.
+    size_t start = 0;
+    if (!compact_pointer_[level].empty()) {
+      while (start < files.size() &&
+             icmp_.Compare(files[start]->largest.Encode(),
+                           compact_pointer_[level]) <= 0) {
+        start++;
+      }
+      if (start == files.size()) {
+        start = 0;
       }
     }
-    if (c->inputs_[0].empty()) {
-      // Wrap-around to the beginning of the key space
-      c->inputs_[0].push_back(current_->files_[level][0]);
+    for (size_t i = 0; i < files.size(); i++) {
+      FileMetaData* f = files[(start + i) % files.size()];
+      if (f->being_compacted) {
+        continue;
+      }
+      Compaction* c = PickCompactionForFile(level, f);
+      if (c != nullptr) {
+        return c;
+      }
     }
-  } else if (seek_compaction) {
-    level = current_->file_to_compact_level_;
-    c = new Compaction(options_, level);
-    c->inputs_[0].push_back(current_->file_to_compact_);
-  } else {
-    return nullptr;
   }
 
+  FileMetaData* f = current_->file_to_compact_;
+  if (f != nullptr && !f->being_compacted) {
+    return PickCompactionForFile(current_->file_to_compact_level_, f);
+  }
+  return nullptr;
+}
+
+Compaction* VersionSet::PickCompactionForFile(int level, FileMetaData* f) {
+  assert(level >= 0);
+  assert(level + 1 < config::kNumLevels);
+  Compaction* c = new Compaction(options_, level);
+  c->inputs_[0].push_back(f);
   c->input_version_ = current_;
   c->input_version_->Ref();
 
@@ -1305,9 +1615,96 @@ Compaction* VersionSet::PickCompaction() {
 
   SetupOtherInputs(c);
 
+  if (!RegisterCompaction(c)) {
+    delete c;
+    return nullptr;
+  }
   return c;
 }
 
+bool VersionSet::RegisterCompaction(Compaction* c) {
+  assert(!c->registered_);
+  for (int which = 0; which < 2; which++) {
+    for (FileMetaData* f : c->inputs_[which]) {
+      if (f->being_compacted) {
+        return false;
+      }
+    }
+  }
+  InternalKey all_start, all_limit;
+  GetRange2(c->inputs_[0], c->inputs_[1], &all_start, &all_limit);
+  const int output_level = c->level() + 1;
+  if (OutputRangeBusy(output_level, all_start.user_key(),
+                      all_limit.user_key())) {
+    return false;
+  }
+
+  for (int which = 0; which < 2; which++) {
+    for (FileMetaData* f : c->inputs_[which]) {
+      f->being_compacted = true;
+    }
+  }
+  ReserveOutputRange(c, output_level, all_start, all_limit);
+  c->registered_ = true;
+
+  // Update the place where we will do the next compaction for this level.
+  // We update this immediately instead of waiting for the VersionEdit
+  // to be applied so that if the compaction fails, we will try a different
+  // key range next time.
+  InternalKey smallest, largest;
+  GetRange(c->inputs_[0], &smallest, &largest);
+  compact_pointer_[c->level()] = largest.Encode().ToString();
+  c->edit_.SetCompactPointer(c->level(), largest);
+  return true;
+}
+
+void VersionSet::UnregisterCompaction(Compaction* c) {
+  assert(c->registered_);
+  for (int which = 0; which < 2; which++) {
+    for (FileMetaData* f : c->inputs_[which]) {
+      assert(f->being_compacted);
+      f->being_compacted = false;
+    }
+  }
+  ReleaseOutputRanges(c);
+  c->registered_ = false;
+}
+
+bool VersionSet::OutputRangeBusy(int level, const Slice& smallest_user_key,
+                                 const Slice& largest_user_key) const {
+  if (level == 0) {
+    return false;
+  }
+  const Comparator* user_cmp = icmp_.user_comparator();
+  for (const OutputReservation& r : output_reservations_) {
+    if (r.level == level &&
+        user_cmp->Compare(smallest_user_key, r.largest.user_key()) <= 0 &&
+        user_cmp->Compare(largest_user_key, r.smallest.user_key()) >= 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void VersionSet::ReserveOutputRange(const void* owner, int level,
+                                    const InternalKey& smallest,
+                                    const InternalKey& largest) {
+  if (level == 0) {
+    return;
+  }
+  output_reservations_.push_back(
+      OutputReservation{owner, level, smallest, largest});
+}
+
+void VersionSet::ReleaseOutputRanges(const void* owner) {
+  output_reservations_.erase(
+      std::remove_if(output_reservations_.begin(), output_reservations_.end(),
+                     [owner](const OutputReservation& r) {
+                       return r.owner == owner;
+                     }),
+      output_reservations_.end());
+}
+
 // Finds the largest key in a vector of files. Returns true if files is not
 // empty.
 bool FindLargestKey(const InternalKeyComparator& icmp,
@@ -1426,8 +1823,6 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
             level, int(c->inputs_[0].size()), int(c->inputs_[1].size()),
             long(inputs0_size), long(inputs1_size), int(expanded0.size()),
             int(expanded1.size()), long(expanded0_size), long(inputs1_size));
-        smallest = new_start;
-        largest = new_limit;
         c->inputs_[0] = expanded0;
         c->inputs_[1] = expanded1;
         GetRange2(c->inputs_[0], c->inputs_[1], &all_start, &all_limit);
@@ -1441,13 +1836,6 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
     current_->GetOverlappingInputs(level + 2, &all_start, &all_limit,
                                    &c->grandparents_);
   }
-
-  // Update the place where we will do the next compaction for this level.
-  // We update this immediately instead of waiting for the VersionEdit
-  // to be applied so that if the compaction fails, we will try a different
-  // key range next time.
-  compact_pointer_[level] = largest.Encode().ToString();
-  c->edit_.SetCompactPointer(level, largest);
 }
 
 Compaction* VersionSet::CompactRange(int level, const InternalKey* begin,
@@ -1480,6 +1868,9 @@ Compaction* VersionSet::CompactRange(int level, const InternalKey* begin,
   c->input_version_->Ref();
   c->inputs_[0] = inputs;
   SetupOtherInputs(c);
+  const bool registered = RegisterCompaction(c);
+  assert(registered);
+  (void)registered;
   return c;
 }
 
@@ -1487,19 +1878,16 @@ Compaction::Compaction(const Options* options, int level)
     : level_(level),
       max_output_file_size_(MaxFileSizeForLevel(options, level)),
       input_version_(nullptr),
-      grandparent_index_(0),
-      seen_key_(false),
-      overlapped_bytes_(0) {
+      registered_(false) {}
+
+Compaction::Cursor::Cursor()
+    : grandparent_index(0), seen_key(false), overlapped_bytes(0) {
   for (int i = 0; i < config::kNumLevels; i++) {
-    level_ptrs_[i] = 0;
+    level_ptrs[i] = 0;
   }
 }
 
-Compaction::~Compaction() {
-  if (input_version_ != nullptr) {
-    input_version_->Unref();
-  }
-}
+Compaction::~Compaction() { ReleaseInputs(); }
 
 bool Compaction::IsTrivialMove() const {
   const VersionSet* vset = input_version_->vset_;
@@ -1519,13 +1907,14 @@ void Compaction::AddInputDeletions(VersionEdit* edit) {
   }
 }
 
-bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
+bool Compaction::IsBaseLevelForKey(const Slice& user_key,
+                                   Cursor* cursor) const {
   // Maybe use binary search to find right entry instead of linear search?
   const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
   for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
     const std::vector<FileMetaData*>& files = input_version_->files_[lvl];
-    while (level_ptrs_[lvl] < files.size()) {
-      FileMetaData* f = files[level_ptrs_[lvl]];
+    while (cursor->level_ptrs[lvl] < files.size()) {
+      FileMetaData* f = files[cursor->level_ptrs[lvl]];
       if (user_cmp->Compare(user_key, f->largest.user_key()) <= 0) {
         // We've advanced far enough
         if (user_cmp->Compare(user_key, f->smallest.user_key()) >= 0) {
@@ -1534,30 +1923,32 @@ bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
         }
         break;
       }
-      level_ptrs_[lvl]++;
+      cursor->level_ptrs[lvl]++;
     }
   }
   return true;
 }
 
-bool Compaction::ShouldStopBefore(const Slice& internal_key) {
+bool Compaction::ShouldStopBefore(const Slice& internal_key,
+                                  Cursor* cursor) const {
   const VersionSet* vset = input_version_->vset_;
   // Scan to find earliest grandparent file that contains key.
   const InternalKeyComparator* icmp = &vset->icmp_;
-  while (grandparent_index_ < grandparents_.size() &&
-         icmp->Compare(internal_key,
-                       grandparents_[grandparent_index_]->largest.Encode()) >
-             0) {
-    if (seen_key_) {
-      overlapped_bytes_ += grandparents_[grandparent_index_]->file_size;
+  while (cursor->grandparent_index < grandparents_.size() &&
+         icmp->Compare(
+             internal_key,
+             grandparents_[cursor->grandparent_index]->largest.Encode()) > 0) {
+    if (cursor->seen_key) {
+      cursor->overlapped_bytes +=
+          grandparents_[cursor->grandparent_index]->file_size;
     }
-    grandparent_index_++;
+    cursor->grandparent_index++;
   }
-  seen_key_ = true;
+  cursor->seen_key = true;
 
-  if (overlapped_bytes_ > MaxGrandParentOverlapBytes(vset->options_)) {
+  if (cursor->overlapped_bytes > MaxGrandParentOverlapBytes(vset->options_)) {
     // Too much overlap for current output; start new output
-    overlapped_bytes_ = 0;
+    cursor->overlapped_bytes = 0;
     return true;
   } else {
     return false;
@@ -1566,6 +1957,9 @@ bool Compaction::ShouldStopBefore(const Slice& internal_key) {
 
 void Compaction::ReleaseInputs() {
   if (input_version_ != nullptr) {
+    if (registered_) {
+      input_version_->vset_->UnregisterCompaction(this);
+    }
     input_version_->Unref();
     input_version_ = nullptr;
   }
@@ -15,6 +15,7 @@
 #ifndef STORAGE_LEVELDB_DB_VERSION_SET_H_
 #define STORAGE_LEVELDB_DB_VERSION_SET_H_
 
+#include <atomic>
 #include <map>
 #include <set>
 #include <vector>
@@ -66,7 +67,9 @@ class Version {
   };
 
   // Append to *iters a sequence of iterators that will
-  // yield the contents of this Version when merged together.
+  // yield the contents of this Version when merged together.  The
+  // iterate_lower_bound and iterate_upper_bound of "options", if set,
+  // are internal keys, and the files wholly outside them are left out.
   // REQUIRES: This version has been saved (see VersionSet::SaveTo)
   void AddIterators(const ReadOptions&, std::vector<Iterator*>* iters);
 
@@ -76,6 +79,22 @@ class Version {
   Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
              GetStats* stats);
 
+  // One key of a MultiGet() batch, with the outcome of its lookup.
+  struct KeyLookup {
+    KeyLookup(const LookupKey* key, std::string* value)
+        : key(key), value(value), stats{nullptr, -1} {}
+
+    const LookupKey* key;
+    std::string* value;
+    Status status;
+    GetStats stats;
+  };
+
+  // Like Get() for every element of *lookups, which must be sorted by user
+  // key.  Each table file is searched once for all the keys it may hold.
+  // REQUIRES: lock is not held
+  void MultiGet(const ReadOptions&, std::vector<KeyLookup>* lookups);
+
   // Adds "stats" into the current state.  Returns true if a new
   // compaction may need to be triggered, false otherwise.
   // REQUIRES: lock is held
@@ -107,6 +126,8 @@ class Version {
 
   // Return the level at which we should place a new memtable compaction
   // result that covers the range [smallest_user_key,largest_user_key].
+  // Levels into which a running compaction is still writing that range are
+  // never chosen.
   int PickLevelForMemTableOutput(const Slice& smallest_user_key,
                                  const Slice& largest_user_key);
 
@@ -131,7 +152,12 @@ class Version {
         file_to_compact_(nullptr),
         file_to_compact_level_(-1),
         compaction_score_(-1),
-        compaction_level_(-1) {}
+        compaction_level_(-1),
+        pending_compaction_bytes_(0) {
+    for (int level = 0; level < config::kNumLevels; level++) {
+      compaction_scores_[level] = -1;
+    }
+  }
 
   Version(const Version&) = delete;
   Version& operator=(const Version&) = delete;
@@ -165,6 +191,14 @@ class Version {
   // are initialized by Finalize().
   double compaction_score_;
   int compaction_level_;
+
+  // Compaction score of every level, so that another level can be picked
+  // when the best one is busy with running compactions.
+  double compaction_scores_[config::kNumLevels];
+
+  // Estimated bytes that compactions must write to bring every level
+  // within its size limit.  Initialized by Finalize().
+  uint64_t pending_compaction_bytes_;
 };
 
 class VersionSet {
@@ -180,7 +214,8 @@ class VersionSet {
   // is both saved to persistent state and installed as the new
   // current version.  Will release *mu while actually writing to the file.
   // REQUIRES: *mu is held on entry.
-  // REQUIRES: no other thread concurrently calls LogAndApply()
+  // REQUIRES: no other thread concurrently calls LogAndApply().  Callers that
+  // run compactions in parallel must serialize their calls.
   Status LogAndApply(VersionEdit* edit, port::Mutex* mu)
       EXCLUSIVE_LOCKS_REQUIRED(mu);
 
@@ -211,13 +246,22 @@ class VersionSet {
   // Return the combined file size of all files at the specified level.
   int64_t NumLevelBytes(int level) const;
 
-  // Return the last sequence number.
-  uint64_t LastSequence() const { return last_sequence_; }
+  // Return the estimated number of bytes that compactions must write to
+  // bring every level of the current version within its size limit.
+  uint64_t EstimatedPendingCompactionBytes() const {
+    return current_->pending_compaction_bytes_;
+  }
+
+  // Return the last sequence number.  Unlike the other methods, this may
+  // be called without holding the lock.
+  uint64_t LastSequence() const {
+    return last_sequence_.load(std::memory_order_acquire);
+  }
 
   // Set the last sequence number to s.
   void SetLastSequence(uint64_t s) {
-    assert(s >= last_sequence_);
-    last_sequence_ = s;
+    assert(s >= last_sequence_.load(std::memory_order_relaxed));
+    last_sequence_.store(s, std::memory_order_release);
   }
 
   // Mark the specified file number as used.
@@ -231,18 +275,41 @@ class VersionSet {
   uint64_t PrevLogNumber() const { return prev_log_number_; }
 
   // Pick level and inputs for a new compaction.
-  // Returns nullptr if there is no compaction to be done.
+  // Returns nullptr if there is no compaction to be done, or if every
+  // candidate conflicts with compactions that are still running.
   // Otherwise returns a pointer to a heap-allocated object that
-  // describes the compaction.  Caller should delete the result.
+  // describes the compaction.  Its input files and output key range stay
+  // claimed until the compaction releases its inputs or is deleted.
+  // Caller should delete the result.
   Compaction* PickCompaction();
 
   // Return a compaction object for compacting the range [begin,end] in
   // the specified level.  Returns nullptr if there is nothing in that
   // level that overlaps the specified range.  Caller should delete
   // the result.
+  // REQUIRES: !HasPendingOutputs()
   Compaction* CompactRange(int level, const InternalKey* begin,
                            const InternalKey* end);
 
+  // Returns true iff a running compaction or memtable flush has claimed some
+  // part of [smallest_user_key,largest_user_key] in "level" for files it
+  // has not installed yet.  Level-0 files may overlap, so level-0 ranges are
+  // never claimed.
+  bool OutputRangeBusy(int level, const Slice& smallest_user_key,
+                       const Slice& largest_user_key) const;
+
+  // Claim [smallest,largest] in "level" on behalf of "owner" until
+  // ReleaseOutputRanges(owner) is called.  Used by memtable flushes that
+  // push their table below level-0; compactions claim their output range
+  // automatically.
+  void ReserveOutputRange(const void* owner, int level,
+                          const InternalKey& smallest,
+                          const InternalKey& largest);
+  void ReleaseOutputRanges(const void* owner);
+
+  // Returns true iff some compaction or memtable flush holds a claim.
+  bool HasPendingOutputs() const { return !output_reservations_.empty(); }
+
   // Return the maximum overlapping data (in bytes) at next level for any
   // file at a level >= 1.
   int64_t MaxNextLevelOverlappingBytes();
@@ -251,6 +318,14 @@ class VersionSet {
   // The caller should delete the iterator when no longer needed.
   Iterator* MakeInputIterator(Compaction* c);
 
+  // Split the key range of "*c" into at most "max_ranges" pieces holding
+  // similar amounts of input data, cutting at input file boundaries and
+  // never producing pieces smaller than an output file.  Stores the user
+  // keys at which the second and later pieces begin in *boundaries, in
+  // increasing order; leaves it empty if "*c" should not be split.
+  void GetSubcompactionBoundaries(Compaction* c, int max_ranges,
+                                  std::vector<std::string>* boundaries);
+
   // Returns true iff some level needs a compaction.
   bool NeedsCompaction() const {
     Version* v = current_;
@@ -291,6 +366,16 @@ class VersionSet {
 
   void SetupOtherInputs(Compaction* c);
 
+  // Build a compaction of file "f" in "level", together with everything it
+  // must be merged with, and register it.  Returns nullptr if the inputs or
+  // the output range conflict with work that is already running.
+  Compaction* PickCompactionForFile(int level, FileMetaData* f);
+
+  // Claim the inputs and the output range of "c".  Returns false, leaving
+  // "c" unregistered, if any of them is already claimed.
+  bool RegisterCompaction(Compaction* c);
+  void UnregisterCompaction(Compaction* c);
+
   // Save current contents to *log
   Status WriteSnapshot(log::Writer* log);
 
@@ -303,7 +388,7 @@ class VersionSet {
   const InternalKeyComparator icmp_;
   uint64_t next_file_number_;
   uint64_t manifest_file_number_;
-  uint64_t last_sequence_;
+  std::atomic<uint64_t> last_sequence_;
   uint64_t log_number_;
   uint64_t prev_log_number_;  // 0 or backing store for memtable being compacted
 
@@ -316,6 +401,16 @@ class VersionSet {
   // Per-level key at which the next compaction at that level should start.
   // Either an empty string, or a valid InternalKey.
   std::string compact_pointer_[config::kNumLevels];
+
+  // Key ranges that running compactions and memtable flushes will write
+  // into.  Two of them must never add overlapping files to a level > 0.
+  struct OutputReservation {
+    const void* owner;
+    int level;
+    InternalKey smallest;
+    InternalKey largest;
+  };
+  std::vector<OutputReservation> output_reservations_;
 };
 
 // A Compaction encapsulates information about a compaction.
@@ -349,17 +444,38 @@ class Compaction {
   // Add all inputs to this compaction as delete operations to *edit.
   void AddInputDeletions(VersionEdit* edit);
 
+  // Progress of a scan through the compaction's input, in increasing key
+  // order.  Each subcompaction keeps its own cursor, so the methods below
+  // can serve several threads walking disjoint key ranges at once.
+  struct Cursor {
+    Cursor();
+
+    size_t grandparent_index;  // Index in grandparents_
+    bool seen_key;             // Some output key has been seen
+    int64_t overlapped_bytes;  // Bytes of overlap between current output
+                               // and grandparent files
+
+    // State for implementing IsBaseLevelForKey
+
+    // level_ptrs holds indices into input_version_->levels_: our state
+    // is that we are positioned at one of the file ranges for each
+    // higher level than the ones involved in this compaction (i.e. for
+    // all L >= level_ + 2).
+    size_t level_ptrs[config::kNumLevels];
+  };
+
   // Returns true if the information we have available guarantees that
   // the compaction is producing data in "level+1" for which no data exists
   // in levels greater than "level+1".
-  bool IsBaseLevelForKey(const Slice& user_key);
+  bool IsBaseLevelForKey(const Slice& user_key, Cursor* cursor) const;
 
   // Returns true iff we should stop building the current output
   // before processing "internal_key".
-  bool ShouldStopBefore(const Slice& internal_key);
+  bool ShouldStopBefore(const Slice& internal_key, Cursor* cursor) const;
 
   // Release the input version for the compaction, once the compaction
-  // is successful.
+  // is successful.  Also gives up the claim on the input files and output
+  // range, so other compactions may pick them again.
   void ReleaseInputs();
 
  private:
@@ -371,6 +487,7 @@ class Compaction {
   int level_;
   uint64_t max_output_file_size_;
   Version* input_version_;
+  bool registered_;  // Inputs and output range are claimed in the VersionSet
   VersionEdit edit_;
 
   // Each compaction reads inputs from "level_" and "level_+1"
@@ -379,18 +496,6 @@ class Compaction {
   // State used to check for number of overlapping grandparent files
   // (parent == level_ + 1, grandparent == level_ + 2)
   std::vector<FileMetaData*> grandparents_;
-  size_t grandparent_index_;  // Index in grandparent_starts_
-  bool seen_key_;             // Some output key has been seen
-  int64_t overlapped_bytes_;  // Bytes of overlap between current output
-                              // and grandparent files
-
-  // State for implementing IsBaseLevelForKey
-
-  // level_ptrs_ holds indices into input_version_->levels_: our state
-  // is that we are positioned at one of the file ranges for each
-  // higher level than the ones involved in this compaction (i.e. for
-  // all L >= level_ + 2).
-  size_t level_ptrs_[config::kNumLevels];
 };
 
 }  // namespace leveldb
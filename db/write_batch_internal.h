@@ -18,6 +18,11 @@ class WriteBatchInternal {
   static void Append(WriteBatch* dst, const WriteBatch* src);
   static void SetContents(WriteBatch* batch, const Slice& contents);
   static Status InsertInto(const WriteBatch* batch, MemTable* memtable);
+
+  // Like InsertInto(), for inserting several batches into "memtable" from
+  // different threads at once.
+  static Status InsertIntoConcurrently(const WriteBatch* batch,
+                                       MemTable* memtable);
 };
 
 }  // namespace leveldb
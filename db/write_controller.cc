@@ -0,0 +1,51 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/write_controller.h"
+
+#include <algorithm>
+
+namespace leveldb {
+
+namespace {
+
+// The bucket holds this much time's worth of writes.
+constexpr uint64_t kMaxBurstMicros = 1000;
+
+// The rate never drops below this fraction of the maximum, so writers
+// keep making progress until a stop threshold is actually reached.
+constexpr double kMinRateFraction = 0.1;
+
+}  // namespace
+
+WriteController::WriteController(uint64_t max_rate)
+    : max_rate_(std::max<uint64_t>(max_rate, 1)),
+      rate_(max_rate_),
+      credit_(0),
+      last_refill_micros_(0) {}
+
+void WriteController::SetPressure(double pressure) {
+  pressure = std::min(std::max(pressure, 0.0), 1.0);
+  const double fraction =
+      std::max(1.0 - pressure * (1.0 - kMinRateFraction), kMinRateFraction);
+  rate_ = std::max<uint64_t>(static_cast<uint64_t>(max_rate_ * fraction), 1);
+}
+
+uint64_t WriteController::GetDelay(uint64_t now_micros, uint64_t bytes) {
+  const double max_credit = rate_ * (kMaxBurstMicros / 1e6);
+  if (now_micros > last_refill_micros_) {
+    credit_ += (now_micros - last_refill_micros_) * (rate_ / 1e6);
+    credit_ = std::min(credit_, max_credit);
+  }
+  last_refill_micros_ = std::max(now_micros, last_refill_micros_);
+
+  credit_ -= bytes;
+  if (credit_ >= 0) {
+    return 0;
+  }
+  // Sleep until the bucket has refilled to cover the debt.
+  return static_cast<uint64_t>(-credit_ * 1e6 / rate_) + 1;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,53 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
+#define STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
+
+#include <cstdint>
+
+namespace leveldb {
+
+// Throttles writes to a rate with a token bucket, so that a DB whose
+// compactions are falling behind slows its writers down gradually
+// instead of making each of them sleep a fixed time.
+//
+// Not thread-safe: DBImpl only calls it from the writer at the head of
+// the write queue, under its mutex.
+class WriteController {
+ public:
+  // Writes are throttled to between "max_rate" bytes per second, when
+  // the slowdown has just begun, and a tenth of that just short of the
+  // stop.
+  explicit WriteController(uint64_t max_rate);
+
+  WriteController(const WriteController&) = delete;
+  WriteController& operator=(const WriteController&) = delete;
+
+  // Set how close the DB is to stopping writes altogether: 0 right at
+  // a slowdown threshold, approaching 1 as it nears a stop threshold.
+  void SetPressure(double pressure);
+
+  // Rate that writes are currently held to, in bytes per second.
+  uint64_t rate() const { return rate_; }
+
+  // Take "bytes" out of the bucket at time "now_micros", and return the
+  // number of microseconds the writer must sleep to stay within the
+  // rate.  The bucket holds at most a millisecond's worth of credit, so
+  // idle time does not let a later burst through unthrottled.
+  uint64_t GetDelay(uint64_t now_micros, uint64_t bytes);
+
+ private:
+  const uint64_t max_rate_;
+  uint64_t rate_;
+
+  // Bytes that may still be written without delay; negative while
+  // earlier writers are sleeping off a debt.
+  double credit_;
+  uint64_t last_refill_micros_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
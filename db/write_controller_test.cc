@@ -0,0 +1,60 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/write_controller.h"
+
+#include "gtest/gtest.h"
+
+namespace leveldb {
+
+static const uint64_t kRate = 1 << 20;  // 1MB/s
+
+TEST(WriteControllerTest, BurstWithinCredit) {
+  WriteController controller(kRate);
+  // A millisecond's worth of credit builds up while idle.
+  ASSERT_EQ(0, controller.GetDelay(1000000, 1000));
+  ASSERT_EQ(0, controller.GetDelay(1000000, 40));
+  // Idling longer does not build up more.
+  ASSERT_EQ(0, controller.GetDelay(5000000, 1000));
+  ASSERT_GT(controller.GetDelay(5000000, 1000), 0);
+}
+
+TEST(WriteControllerTest, SustainedRate) {
+  WriteController controller(kRate);
+  uint64_t now = 1000000;
+  controller.GetDelay(now, 0);
+  // Writing 64KB at a time, each writer sleeps off its own batch.
+  uint64_t total_delay = 0;
+  for (int i = 0; i < 16; i++) {
+    const uint64_t delay = controller.GetDelay(now, 64 << 10);
+    total_delay += delay;
+    now += delay;
+  }
+  // 1MB at 1MB/s takes a second, less the initial credit.
+  ASSERT_NEAR(1000000, total_delay, 2000);
+}
+
+TEST(WriteControllerTest, Pressure) {
+  WriteController controller(kRate);
+  ASSERT_EQ(kRate, controller.rate());
+  controller.SetPressure(0.5);
+  ASSERT_NEAR(kRate * 0.55, controller.rate(), 1);
+  controller.SetPressure(1);
+  ASSERT_NEAR(kRate / 10, controller.rate(), 1);
+  controller.SetPressure(7);
+  ASSERT_NEAR(kRate / 10, controller.rate(), 1);
+  controller.SetPressure(0);
+  ASSERT_EQ(kRate, controller.rate());
+
+  // The same write takes ten times as long at full pressure.
+  WriteController slow(kRate);
+  slow.SetPressure(1);
+  slow.GetDelay(1000000, 0);
+  controller.GetDelay(1000000, 0);
+  const uint64_t fast_delay = controller.GetDelay(1000000, 100 << 10);
+  const uint64_t slow_delay = slow.GetDelay(1000000, 100 << 10);
+  ASSERT_NEAR(10.0, static_cast<double>(slow_delay) / fast_delay, 0.2);
+}
+
+}  // namespace leveldb
@@ -10,10 +10,10 @@
 // length strings, may use the length of the string as the charge for
 // the string.
 //
-// A builtin cache implementation with a least-recently-used eviction
-// policy is provided.  Clients may use their own implementations if
-// they want something more sophisticated (like scan-resistance, a
-// custom eviction policy, variable cache sizing, etc.)
+// Builtin cache implementations with least-recently-used and CLOCK
+// eviction policies are provided.  Clients may use their own
+// implementations if they want something more sophisticated (like
+// scan-resistance, a custom eviction policy, variable cache sizing, etc.)
 
 #ifndef STORAGE_LEVELDB_INCLUDE_CACHE_H_
 #define STORAGE_LEVELDB_INCLUDE_CACHE_H_
@@ -29,7 +29,30 @@ class LEVELDB_EXPORT Cache;
 
 // Create a new cache with a fixed size capacity.  This implementation
 // of Cache uses a least-recently-used eviction policy.
-LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity);
+//
+// If "high_pri_pool_ratio" is positive, up to that fraction of the
+// capacity is reserved for entries inserted with Priority::kHigh and
+// for entries that were looked up again after being inserted.  Other
+// entries are inserted in the middle of the LRU list, below that pool,
+// and are evicted first: a scan that reads many blocks once cannot push
+// out blocks that are read repeatedly.  With a ratio of zero the cache
+// is a plain LRU cache.
+LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity,
+                                  double high_pri_pool_ratio = 0.0);
+
+// Create a new cache with a fixed size capacity.  This implementation
+// of Cache uses the CLOCK eviction policy, an approximation of
+// least-recently-used, and finds entries in lock-free hash tables:
+// Lookup() and Release() take no mutex, which helps when many threads
+// read the same few blocks.  Insert() and Erase() still take a mutex per
+// shard.
+//
+// The tables have a fixed number of slots, allotted for entries of about
+// "estimated_entry_charge" each; a cache of many smaller entries evicts
+// before it reaches "capacity".  The default suits a block cache with
+// the default Options::block_size.
+LEVELDB_EXPORT Cache* NewClockCache(size_t capacity,
+                                    size_t estimated_entry_charge = 4096);
 
 class LEVELDB_EXPORT Cache {
  public:
@@ -45,6 +68,10 @@ class LEVELDB_EXPORT Cache {
   // Opaque handle to an entry stored in the cache.
   struct Handle {};
 
+  // How hard the cache should try to keep an entry.  Implementations
+  // without a notion of priority treat every entry alike.
+  enum class Priority { kHigh, kLow };
+
   // Insert a mapping from key->value into the cache and assign it
   // the specified charge against the total cache capacity.
   //
@@ -57,6 +84,14 @@ class LEVELDB_EXPORT Cache {
   virtual Handle* Insert(const Slice& key, void* value, size_t charge,
                          void (*deleter)(const Slice& key, void* value)) = 0;
 
+  // Same as above, with a priority for the entry.  The default
+  // implementation ignores "priority".
+  virtual Handle* Insert(const Slice& key, void* value, size_t charge,
+                         void (*deleter)(const Slice& key, void* value),
+                         Priority priority) {
+    return Insert(key, value, charge, deleter);
+  }
+
   // If the cache has no mapping for "key", returns nullptr.
   //
   // Else return a handle that corresponds to the mapping.  The caller
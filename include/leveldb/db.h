@@ -1,6 +1,9 @@
 #ifndef LEVELDB_INCLUDE_DB_H
 #define LEVELDB_INCLUDE_DB_H
 
+#include <string>
+#include <vector>
+
 #include "leveldb/export.h"
 #include "leveldb/iterator.h"
 #include "leveldb/options.h"
@@ -73,6 +76,18 @@ class LEVELDB_EXPORT DB {
   virtual Status Get(const ReadOptions& options, const Slice& key,
                      std::string* value) = 0;
 
+  // Look up all of "keys" against a single snapshot.  On return, for every
+  // i, (*statuses)[i] and (*values)[i] hold what Get() would have returned
+  // for keys[i]; values of keys that were not found are empty.
+  //
+  // Sharing the snapshot and the per-file work makes this much cheaper
+  // than separate Get() calls for large batches.  The default
+  // implementation simply calls Get() for every key.
+  virtual void MultiGet(const ReadOptions& options,
+                        const std::vector<Slice>& keys,
+                        std::vector<std::string>* values,
+                        std::vector<Status>* statuses);
+
   // Return a heap-allocated iterator over the contents of the database.
   // The result of NewIterator() is initially invalid (caller must
   // call one of the Seek methods on the iterator before using it).
@@ -107,6 +122,13 @@ class LEVELDB_EXPORT DB {
   //     of the sstables that make up the db contents.
   //  "leveldb.approximate-memory-usage" - returns the approximate number of
   //     bytes of memory in use by the DB.
+  //  "leveldb.num-immutable-mem-table" - returns the number of full
+  //     memtables waiting to be flushed to level-0.
+  //  "leveldb.statistics" - returns the contents of Options::statistics,
+  //     one ticker or histogram per line.  Not supported if it is null.
+  //  "leveldb.write-stalls" - returns a multi-line string that describes
+  //     how often and for how long writes were delayed or stopped, by
+  //     cause, and the current write rate limit.
   virtual bool GetProperty(const Slice& property, std::string* value) = 0;
 
   // For each i in [0,n-1], store in "sizes[i]", the approximate
@@ -197,6 +197,18 @@ class LEVELDB_EXPORT Env {
   // serialized.
   virtual void Schedule(void (*function)(void* arg), void* arg) = 0;
 
+  // Set the maximum number of background threads used to run the functions
+  // passed to Schedule().  Threads are started lazily, as work is queued.
+  // The default implementation ignores the request, which leaves the Env
+  // with whatever (possibly single-threaded) scheduling it already has.
+  virtual void SetBackgroundThreads(int number);
+
+  // Like Schedule(), but "function" runs on threads reserved for short,
+  // latency-sensitive work (e.g. memtable flushes) so that it is never queued
+  // behind long-running Schedule() work.  The default implementation simply
+  // calls Schedule().
+  virtual void ScheduleHighPriority(void (*function)(void* arg), void* arg);
+
   // Start a new thread, invoking "function(arg)" within the new thread.
   // When "function(arg)" returns, the thread will be destroyed.
   virtual void StartThread(void (*function)(void* arg), void* arg) = 0;
@@ -384,6 +396,12 @@ class LEVELDB_EXPORT EnvWrapper : public Env {
   void Schedule(void (*f)(void*), void* a) override {
     return target_->Schedule(f, a);
   }
+  void SetBackgroundThreads(int number) override {
+    target_->SetBackgroundThreads(number);
+  }
+  void ScheduleHighPriority(void (*f)(void*), void* a) override {
+    return target_->ScheduleHighPriority(f, a);
+  }
   void StartThread(void (*f)(void*), void* a) override {
     return target_->StartThread(f, a);
   }
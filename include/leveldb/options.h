@@ -6,6 +6,7 @@
 #define STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
 
 #include <cstddef>
+#include <cstdint>
 
 #include "leveldb/export.h"
 
@@ -16,7 +17,10 @@ class Comparator;
 class Env;
 class FilterPolicy;
 class Logger;
+class Slice;
+class SliceTransform;
 class Snapshot;
+class Statistics;
 
 // DB contents are stored in a set of blocks, each of which holds a
 // sequence of key,value pairs.  Each block may be compressed before
@@ -76,24 +80,93 @@ struct LEVELDB_EXPORT Options {
   // on disk) before converting to a sorted on-disk file.
   //
   // Larger values increase performance, especially during bulk loads.
-  // Up to two write buffers may be held in memory at the same time,
-  // so you may wish to adjust this parameter to control memory usage.
+  // Up to max_write_buffer_number write buffers may be held in memory at
+  // the same time, so you may wish to adjust this parameter to control
+  // memory usage.
   // Also, a larger write buffer will result in a longer recovery time
   // the next time the database is opened.
   size_t write_buffer_size = 4 * 1024 * 1024;
 
+  // Maximum number of write buffers held in memory: the one being
+  // written to, plus full ones waiting to be flushed to level-0.  Once
+  // that many are held, writers wait for a flush to finish.  A flush
+  // writes all the full buffers waiting at the time into one table, so
+  // values above 2 absorb bursts of writes and may produce fewer, larger
+  // level-0 files.
+  int max_write_buffer_number = 2;
+
+  // If true, writes that are grouped together each insert their own batch
+  // into the memtable, in parallel, once the group has been logged.
+  // Otherwise the first writer of the group inserts all of them.  Helps
+  // when many threads write at the same time.
+  bool allow_concurrent_memtable_write = false;
+
+  // If true, appending a write group to the log and applying it to the
+  // memtable are separate stages: the next group may be logged (and
+  // synced) while the previous one is still being applied.  Writes become
+  // visible in the order in which they were logged either way.
+  bool enable_pipelined_write = false;
+
+  // Writes are throttled once level-0 holds this many files, and stop
+  // until compactions catch up once it holds level0_stop_writes_trigger
+  // files.  Between the two, the allowed write rate falls from
+  // delayed_write_rate to a tenth of it.
+  int level0_slowdown_writes_trigger = 8;
+  int level0_stop_writes_trigger = 12;
+
+  // The same, for the estimated number of bytes compactions must write
+  // to bring every level within its size limit.  0 disables the limit.
+  uint64_t soft_pending_compaction_bytes_limit = 64ull << 30;
+  uint64_t hard_pending_compaction_bytes_limit = 256ull << 30;
+
+  // Rate, in bytes per second, that writes are held to when throttling
+  // begins.
+  uint64_t delayed_write_rate = 16 << 20;
+
   // Number of open files that can be used by the DB.  You may need to
   // increase this if your database has a large working set (budget
   // one open file per 2MB of working set).
   int max_open_files = 1000;
 
+  // Maximum number of table compactions that may run concurrently in the
+  // background.  Compactions only run side by side when they touch disjoint
+  // files and key ranges.  Memtable flushes are scheduled separately, via
+  // Env::ScheduleHighPriority(), and do not count against this limit.
+  // Compactions run on the threads of Env::Schedule(), which the DB does
+  // not resize since the Env may be shared: raise their number with
+  // Env::SetBackgroundThreads() for compactions to actually overlap.
+  int max_background_compactions = 1;
+
+  // Maximum number of threads that work on a single compaction.  A large
+  // compaction is split into disjoint key ranges that are compacted side by
+  // side and installed together; compactions smaller than a couple of
+  // output files are never split.
+  int max_subcompactions = 1;
+
   // Control over blocks (user data is stored in a set of blocks, and
   // a block is the unit of reading from disk).
 
   // If non-null, use the specified cache for blocks.
-  // If null, leveldb will automatically create and use an 8MB internal cache.
+  // If null, leveldb will automatically create and use an 8MB internal
+  // cache, NewLRUCache(8 << 20, 0.5), which keeps blocks that are read
+  // more than once safe from scans.
   Cache* block_cache = nullptr;
 
+  // If true, the index and filter blocks of tables are kept in
+  // block_cache, inserted with Cache::Priority::kHigh and charged against
+  // its capacity, instead of held outside the cache for as long as the
+  // table is open.  This bounds the memory used by a database with many
+  // tables, at the cost of reading these blocks again once evicted.  With
+  // a high_pri_pool_ratio, such as the default cache has, they are evicted
+  // after data blocks that were read only once.
+  bool cache_index_and_filter_blocks = false;
+
+  // If true, along with cache_index_and_filter_blocks, the index and
+  // filter blocks of level-0 tables are never evicted from block_cache
+  // while the tables are open.  Every read may search all level-0 tables,
+  // so their blocks are the most used ones.
+  bool pin_l0_filter_and_index_blocks_in_cache = false;
+
   // Approximate size of user data packed per block.  Note that the
   // block size specified here corresponds to uncompressed data.  The
   // actual size of the unit read from disk may be smaller if
@@ -115,6 +188,18 @@ struct LEVELDB_EXPORT Options {
   // initially populating a large database.
   size_t max_file_size = 2 * 1024 * 1024;
 
+  // If true, the index and filter of each new table are split into
+  // partitions of about metadata_block_size bytes, found through a small
+  // top-level index.  Opening the table reads only the top-level index;
+  // partitions are read through block_cache when needed.  This keeps
+  // large tables (see max_file_size) cheap to open and to keep open.
+  // Tables are read correctly whatever this option says.
+  bool partition_index_and_filters = false;
+
+  // Approximate size of the index and filter partitions written with
+  // partition_index_and_filters.
+  size_t metadata_block_size = 4 * 1024;
+
   // Compress blocks using the specified compression algorithm.  This
   // parameter can be changed dynamically.
   //
@@ -135,6 +220,18 @@ struct LEVELDB_EXPORT Options {
   // Currently only the range [-5,22] is supported. Default is 1.
   int zstd_compression_level = 1;
 
+  // If non-zero and compression is kZstdCompression, every table file
+  // trains a zstd dictionary of at most this many bytes on its first data
+  // blocks, stores it in the file, and compresses all its data blocks
+  // with it.  This lets small blocks of similar records compress nearly
+  // as well as large ones.  Up to 100 times this many bytes of data
+  // blocks are buffered in memory, uncompressed, to train on.  They count
+  // towards max_file_size at that size, so a file that reaches
+  // max_file_size first is trained on what it holds and finished.
+  //
+  // Default: 0 (no dictionary).  Values around 16KB are typical.
+  size_t zstd_max_dict_bytes = 0;
+
   // EXPERIMENTAL: If true, append to existing MANIFEST and log files
   // when a database is opened.  This can significantly speed up open.
   //
@@ -145,6 +242,28 @@ struct LEVELDB_EXPORT Options {
   // Many applications will benefit from passing the result of
   // NewBloomFilterPolicy() here.
   const FilterPolicy* filter_policy = nullptr;
+
+  // If true, each new table has one filter for all its keys, instead of
+  // one per 2KB of data blocks.  A point lookup then probes the filter
+  // before searching the index, so a key absent from the table costs a
+  // single filter probe.  NewBlockedBloomFilterPolicy() suits such large
+  // filters best.  The keys of a table are kept in memory while it is
+  // built.  Ignored with partition_index_and_filters.
+  bool full_filter = false;
+
+  // If non-null, the full filter of each new table (see full_filter)
+  // also holds the prefixes this transform extracts from its keys.  An
+  // iterator opened with ReadOptions::prefix_same_as_start then skips,
+  // on Seek(), the tables that hold no key with the prefix of the
+  // target.  Tables written with another transform, or none, are never
+  // skipped.
+  const SliceTransform* prefix_extractor = nullptr;
+
+  // If non-null, record counters and latency histograms for the DB's
+  // operations in this object (see leveldb/statistics.h).  It may be
+  // shared by several DBs, and must outlive all of them.  Leave null
+  // to skip the bookkeeping altogether.
+  Statistics* statistics = nullptr;
 };
 
 // Options that control read operations
@@ -162,6 +281,25 @@ struct LEVELDB_EXPORT ReadOptions {
   // not have been released).  If "snapshot" is null, use an implicit
   // snapshot of the state at the beginning of this read operation.
   const Snapshot* snapshot = nullptr;
+
+  // If true, along with Options::prefix_extractor, an iterator only
+  // yields keys with the prefix of the target of its last Seek(), and
+  // becomes invalid past them.  Tables whose filter holds no key with
+  // that prefix are not read.  SeekToFirst() and SeekToLast(), and
+  // Seek()s to keys without a prefix, are not confined.
+  bool prefix_same_as_start = false;
+
+  // If non-null, an iterator yields no key before "*iterate_lower_bound",
+  // and SeekToFirst() and Seek()s to keys before it position the
+  // iterator at the first key at or after it.  The bound must outlive
+  // the iterator.
+  const Slice* iterate_lower_bound = nullptr;
+
+  // If non-null, an iterator yields no key at or after
+  // "*iterate_upper_bound", and SeekToLast() positions it at the last
+  // key before it.  Files and blocks past the bound are not read.  The
+  // bound must outlive the iterator.
+  const Slice* iterate_upper_bound = nullptr;
 };
 
 // Options that control write operations
@@ -0,0 +1,94 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A PerfContext breaks down where the calling thread's operations spent
+// their time: how many memtables, table files and blocks a DB::Get()
+// looked at, and how many nanoseconds went to each stage.  Unlike
+// Options::statistics it is per thread and meant for tracing single
+// slow operations:
+//
+//   leveldb::SetPerfLevel(leveldb::kEnableTime);
+//   leveldb::GetPerfContext()->Reset();
+//   db->Get(leveldb::ReadOptions(), key, &value);
+//   ... inspect or log leveldb::GetPerfContext()->ToString() ...
+//
+// At the default level, kDisable, nothing is recorded and the cost is a
+// thread-local load and a branch per stage.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_PERF_CONTEXT_H_
+#define STORAGE_LEVELDB_INCLUDE_PERF_CONTEXT_H_
+
+#include <cstdint>
+#include <string>
+
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+enum PerfLevel {
+  kDisable = 0,      // Record nothing
+  kEnableCount = 1,  // Record the counts only
+  kEnableTime = 2,   // Record the counts and the time spent in each stage
+};
+
+// Set and get the level of the calling thread.  Each thread starts at
+// kDisable.
+LEVELDB_EXPORT void SetPerfLevel(PerfLevel level);
+LEVELDB_EXPORT PerfLevel GetPerfLevel();
+
+// Counters accumulated by the calling thread's operations since the last
+// Reset().  "_nanos" fields are only updated at kEnableTime.
+struct LEVELDB_EXPORT PerfContext {
+  void Reset();
+
+  // "name = value" for every non-zero field.
+  std::string ToString() const;
+
+  // DB::Get() as a whole.
+  uint64_t get_nanos;
+
+  // Lookups in the memtable and the immutable memtables.
+  uint64_t get_from_memtable_count;
+  uint64_t get_from_memtable_nanos;
+
+  // Lookups in table files: the files searched, and the time spent on
+  // them in total.  The remaining fields break that time down.
+  uint64_t get_from_output_files_count;
+  uint64_t get_from_output_files_nanos;
+
+  // Table cache lookups, and the files that missed and had to be opened
+  // (which includes reading their index and filter blocks).
+  uint64_t find_table_count;
+  uint64_t find_table_nanos;
+  uint64_t table_open_count;
+
+  // Seeks in a table's index block.
+  uint64_t index_seek_nanos;
+
+  // Filter probes, and those that ruled the key out.
+  uint64_t filter_check_count;
+  uint64_t filter_check_nanos;
+  uint64_t filter_useful_count;
+
+  // Data block lookups answered by the block cache.
+  uint64_t block_cache_hit_count;
+
+  // Blocks read from files: the reads themselves, then the checksum
+  // check and decompression.
+  uint64_t block_read_count;
+  uint64_t block_read_bytes;
+  uint64_t block_read_nanos;
+  uint64_t block_checksum_nanos;
+  uint64_t block_decompress_nanos;
+
+  // Seeks within data blocks.
+  uint64_t block_seek_nanos;
+};
+
+// The calling thread's PerfContext.
+LEVELDB_EXPORT PerfContext* GetPerfContext();
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_PERF_CONTEXT_H_
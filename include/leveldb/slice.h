@@ -2,6 +2,8 @@
 #define LEVELDB_INCLUDE_SLICE_H_
 
 #include <cassert>
+#include <cstddef>
+#include <cstring>
 #include <string>
 
 #include "leveldb/export.h"
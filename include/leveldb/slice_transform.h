@@ -0,0 +1,62 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A database can be configured with a SliceTransform that extracts a
+// prefix from keys (see Options::prefix_extractor).  The prefixes of the
+// keys of a table are then added to its filter, so that an iterator
+// confined to one prefix (see ReadOptions::prefix_same_as_start) skips
+// the tables that hold no key with that prefix.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+#define STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+
+#include <cstddef>
+
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+class Slice;
+
+// A SliceTransform implementation must be thread-safe since leveldb may
+// invoke its methods concurrently from multiple threads.
+class LEVELDB_EXPORT SliceTransform {
+ public:
+  virtual ~SliceTransform();
+
+  // The name of the transform.  It is recorded in the tables whose
+  // filters hold prefixes, and their prefixes are only used while the
+  // database is opened with a transform of the same name.  Switch to a
+  // new name whenever Transform() changes for any key.
+  //
+  // Names starting with "leveldb." are reserved and should not be used
+  // by any clients of this package.
+  virtual const char* Name() const = 0;
+
+  // Return the prefix of "key", a slice of "key" that starts at
+  // key.data().
+  //
+  // REQUIRES: InDomain(key)
+  //
+  // The keys that share a prefix must be contiguous in the order of the
+  // database's comparator: if a <= b <= c and a and c have the same
+  // prefix, b has that prefix too.
+  virtual Slice Transform(const Slice& key) const = 0;
+
+  // Return true if "key" has a prefix.  Keys without one are left out of
+  // the filters, and Seek()s to them are not confined to a prefix.
+  virtual bool InDomain(const Slice& key) const = 0;
+};
+
+// Return a new transform whose prefix is the first "prefix_len" bytes of
+// keys.  Shorter keys have no prefix.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+LEVELDB_EXPORT const SliceTransform* NewFixedPrefixTransform(
+    size_t prefix_len);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
@@ -0,0 +1,122 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A Statistics object collects counters ("tickers") and value
+// distributions ("histograms") about the operations of the DBs it is
+// passed to through Options::statistics.  It may be shared by several
+// DBs and is safe to update and read from any number of threads.
+//
+// The builtin implementation keeps its state in per-core shards of
+// relaxed atomics, so recording is cheap enough to leave on in
+// production; reading sums the shards.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_STATISTICS_H_
+#define STORAGE_LEVELDB_INCLUDE_STATISTICS_H_
+
+#include <cstdint>
+#include <string>
+
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+enum Ticker : uint32_t {
+  // Data block lookups in the block cache.
+  kBlockCacheHit = 0,
+  kBlockCacheMiss,
+
+  // Table lookups that consulted a filter.  kFilterUseful counts those
+  // where the filter ruled the key out and saved a block read;
+  // kFilterPositive those where it did not, and kFilterTruePositive the
+  // subset of those where the table did hold the key.  The difference
+  // of the last two is the number of false positives.
+  kFilterUseful,
+  kFilterPositive,
+  kFilterTruePositive,
+
+  // Point lookups answered by a memtable, and those that had to go on
+  // to the table files.
+  kMemtableHit,
+  kMemtableMiss,
+
+  // Keys and bytes (keys plus values) written by DB::Write(), and keys
+  // found and bytes returned by DB::Get() and DB::MultiGet().
+  kKeysWritten,
+  kBytesWritten,
+  kKeysRead,
+  kBytesRead,
+
+  // Log writes and syncs.
+  kWalBytes,
+  kWalSynced,
+
+  // Time writers spent delayed or stopped waiting for compactions.
+  kStallMicros,
+
+  // Bytes read and written by compactions, memtable flushes included.
+  kCompactReadBytes,
+  kCompactWriteBytes,
+
+  kNumTickers  // Must be last
+};
+
+enum HistogramType : uint32_t {
+  kGetMicros = 0,         // DB::Get()
+  kWriteMicros,           // DB::Write(), including any stall
+  kSeekMicros,            // Seek() on DB iterators
+  kCompactionMicros,      // Compactions and memtable flushes
+  kWalSyncMicros,         // Log file syncs
+  kTableSyncMicros,       // Table file syncs
+  kNumHistogramTypes  // Must be last
+};
+
+// A summary of one histogram.
+struct LEVELDB_EXPORT HistogramData {
+  uint64_t count = 0;
+  uint64_t sum = 0;
+  uint64_t min = 0;
+  uint64_t max = 0;
+  double average = 0;
+  double standard_deviation = 0;
+  double median = 0;
+  double percentile95 = 0;
+  double percentile99 = 0;
+};
+
+class LEVELDB_EXPORT Statistics {
+ public:
+  Statistics() = default;
+
+  Statistics(const Statistics&) = delete;
+  Statistics& operator=(const Statistics&) = delete;
+
+  virtual ~Statistics();
+
+  // Add "count" to the ticker.
+  virtual void RecordTick(Ticker ticker, uint64_t count) = 0;
+
+  // Record "value" in the histogram.
+  virtual void MeasureTime(HistogramType type, uint64_t value) = 0;
+
+  virtual uint64_t GetTickerCount(Ticker ticker) const = 0;
+  virtual void GetHistogramData(HistogramType type,
+                                HistogramData* data) const = 0;
+
+  // Set every ticker and histogram back to zero.
+  virtual void Reset() = 0;
+
+  // A human-readable dump of every ticker and histogram.
+  virtual std::string ToString() const = 0;
+
+  // Names of the tickers and histograms, as used by ToString().
+  static const char* TickerName(Ticker ticker);
+  static const char* HistogramName(HistogramType type);
+};
+
+// Create a new Statistics object using the builtin implementation.
+LEVELDB_EXPORT Statistics* NewStatistics();
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_STATISTICS_H_
@@ -5,7 +5,9 @@
 #ifndef STORAGE_LEVELDB_INCLUDE_TABLE_H_
 #define STORAGE_LEVELDB_INCLUDE_TABLE_H_
 
+#include <cstddef>
 #include <cstdint>
+#include <vector>
 
 #include "leveldb/export.h"
 #include "leveldb/iterator.h"
@@ -48,6 +50,11 @@ class LEVELDB_EXPORT Table {
   // Returns a new iterator over the table contents.
   // The result of NewIterator() is initially invalid (caller must
   // call one of the Seek methods on the iterator before using it).
+  // The iterate_lower_bound and iterate_upper_bound of the ReadOptions
+  // are compared with table keys by options.comparator: SeekToFirst()
+  // and SeekToLast() start from them, and blocks wholly outside them
+  // are not read.  Keys outside them may still be yielded from the
+  // blocks that are read.
   Iterator* NewIterator(const ReadOptions&) const;
 
   // Given a key, return an approximate byte offset in the file where
@@ -61,8 +68,15 @@ class LEVELDB_EXPORT Table {
  private:
   friend class TableCache;
   struct Rep;
+  class IndexCursor;
+  class PrefixFilterIterator;
 
   static Iterator* BlockReader(void*, const ReadOptions&, const Slice&);
+  static Iterator* IndexPartitionReader(void*, const ReadOptions&,
+                                        const Slice&);
+  static Iterator* NewBlockIterator(const Table* table, const ReadOptions&,
+                                    const Slice& index_value,
+                                    bool index_partition);
 
   explicit Table(Rep* rep) : rep_(rep) {}
 
@@ -73,8 +87,24 @@ class LEVELDB_EXPORT Table {
                      void (*handle_result)(void* arg, const Slice& k,
                                            const Slice& v));
 
+  // Like InternalGet() for every element of "keys", which must be sorted.
+  // The index and filter are probed through a single iterator and every
+  // data block is read at most once, however many keys fall into it.
+  // Calls (*handle_result)(arg, i, ...) with the entry found for keys[i].
+  Status InternalMultiGet(const ReadOptions&, const std::vector<Slice>& keys,
+                          void* arg,
+                          void (*handle_result)(void* arg, size_t i,
+                                                const Slice& k,
+                                                const Slice& v));
+
+  // With Options::cache_index_and_filter_blocks, hold references to the
+  // cached index and filter blocks for the lifetime of the table so they
+  // are never evicted.  Does nothing otherwise, or when called again.
+  void PinIndexAndFilter();
+
   void ReadMeta(const Footer& footer);
-  void ReadFilter(const Slice& filter_handle_value);
+  void ReadFilter(const Slice& filter_handle_value, bool full);
+  void ReadZstdDictionary(const Slice& dict_handle_value);
 
   Rep* const rep_;
 };
@@ -29,8 +29,10 @@ class LEVELDB_EXPORT TableBuilder {
  public:
   // Create a builder that will store the contents of the table it is
   // building in *file.  Does not close the file.  It is up to the
-  // caller to close the file after calling Finish().
-  TableBuilder(const Options& options, WritableFile* file);
+  // caller to close the file after calling Finish().  "level" is the
+  // level of the database the table is written to, or -1 if unknown;
+  // it is passed on to Options::filter_policy.
+  TableBuilder(const Options& options, WritableFile* file, int level = -1);
 
   TableBuilder(const TableBuilder&) = delete;
   TableBuilder& operator=(const TableBuilder&) = delete;
@@ -75,13 +77,18 @@ class LEVELDB_EXPORT TableBuilder {
   // Number of calls to Add() so far.
   uint64_t NumEntries() const;
 
-  // Size of the file generated so far.  If invoked after a successful
-  // Finish() call, returns the size of the final generated file.
+  // Size of the file generated so far.  Data blocks buffered to train a
+  // zstd dictionary (see Options::zstd_max_dict_bytes) are counted at
+  // their uncompressed size.  If invoked after a successful Finish()
+  // call, returns the size of the final generated file.
   uint64_t FileSize() const;
 
  private:
   bool ok() const { return status().ok(); }
   void WriteBlock(BlockBuilder* block, BlockHandle* handle);
+  void WriteBlock(const Slice& raw, bool is_data_block, BlockHandle* handle);
+  void EnterUnbuffered();
+  void CutIndexPartition();
   void WriteRawBlock(const Slice& data, CompressionType, BlockHandle* handle);
 
   struct Rep;
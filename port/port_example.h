@@ -84,8 +84,51 @@ bool Snappy_GetUncompressedLength(const char* input, size_t length,
 bool Snappy_Uncompress(const char* input_data, size_t input_length,
                        char* output);
 
-// Store the zstd compression of "input[0,input_length-1]" in *output.
-// Returns false if zstd is not supported by this port.
+// Reusable zstd state.  Setting up a context costs a large allocation
+// and table initialization, about as much as compressing a small block,
+// so code handling many blocks should keep one around.  A context may be
+// used by one thread at a time.
+class ZstdCompressContext;
+class ZstdUncompressContext;
+ZstdCompressContext* NewZstdCompressContext();
+void DeleteZstdCompressContext(ZstdCompressContext* ctx);
+ZstdUncompressContext* NewZstdUncompressContext();
+void DeleteZstdUncompressContext(ZstdUncompressContext* ctx);
+
+// A zstd dictionary digested for compression at a fixed level, or for
+// decompression.  Unlike contexts, a dictionary may be shared by any
+// number of threads.
+class ZstdCompressDict;
+class ZstdUncompressDict;
+ZstdCompressDict* NewZstdCompressDict(const char* dict, size_t length,
+                                      int level);
+void DeleteZstdCompressDict(ZstdCompressDict* dict);
+ZstdUncompressDict* NewZstdUncompressDict(const char* dict, size_t length);
+void DeleteZstdUncompressDict(ZstdUncompressDict* dict);
+
+// Train a zstd dictionary of at most "max_dict_bytes" on the samples
+// stored back to back in "samples", whose lengths are "sample_lengths".
+// Stores the dictionary in *dict and returns true on success.  Returns
+// false if zstd is not supported or the samples are too few or too small
+// to train on.
+bool Zstd_TrainDictionary(const std::string& samples,
+                          const std::vector<size_t>& sample_lengths,
+                          size_t max_dict_bytes, std::string* dict);
+
+// Return contexts owned by the calling thread and freed when it exits.
+ZstdCompressContext* ThreadLocalZstdCompressContext();
+ZstdUncompressContext* ThreadLocalZstdUncompressContext();
+
+// Store the zstd compression of "input[0,input_length-1]" in *output,
+// using *ctx.  Returns false if zstd is not supported by this port.
+bool Zstd_Compress(ZstdCompressContext* ctx, int level, const char* input,
+                   size_t input_length, std::string* output);
+
+// Like the above, compressing with *dict at the level it was created for.
+bool Zstd_Compress(ZstdCompressContext* ctx, const ZstdCompressDict* dict,
+                   const char* input, size_t input_length, std::string* output);
+
+// Like the above, using the calling thread's context.
 bool Zstd_Compress(int level, const char* input, size_t input_length,
                    std::string* output);
 
@@ -102,6 +145,14 @@ bool Zstd_GetUncompressedLength(const char* input, size_t length,
 // REQUIRES: at least the first "n" bytes of output[] must be writable
 // where "n" is the result of a successful call to
 // Zstd_GetUncompressedLength.
+bool Zstd_Uncompress(ZstdUncompressContext* ctx, const char* input_data,
+                     size_t input_length, char* output);
+
+// Like the above, for input compressed with the dictionary *dict.
+bool Zstd_Uncompress(ZstdUncompressContext* ctx, const ZstdUncompressDict* dict,
+                     const char* input_data, size_t input_length, char* output);
+
+// Like the above, using the calling thread's context.
 bool Zstd_Uncompress(const char* input_data, size_t input_length, char* output);
 
 // ------------------ Miscellaneous -------------------
@@ -111,6 +162,11 @@ bool Zstd_Uncompress(const char* input_data, size_t input_length, char* output);
 // The concatenation of all "data[0,n-1]" fragments is the heap profile.
 bool GetHeapProfile(void (*func)(void*, const char*, int), void* arg);
 
+// Returns the index of the CPU the calling thread is running on, or a
+// negative value if that cannot be determined.  Only a hint: the thread
+// may be migrated as soon as this returns.
+int PhysicalCoreID();
+
 // Extend the CRC to include the first n bytes of buf.
 //
 // Returns zero if the CRC cannot be extended using acceleration, else returns
@@ -26,15 +26,21 @@
 #include <snappy.h>
 #if HAVE_ZSTD
 #define ZSTD_STATIC_LINKING_ONLY  // For ZSTD_compressionParameters.
+#include <zdict.h>
 #include <zstd.h>
 #endif  // HAVE_ZSTD
 
+#if defined(__linux__)
+#include <sched.h>
+#endif  // defined(__linux__)
+
 #include <cassert>
 #include <condition_variable>  // NOLINT
 #include <cstddef>
 #include <cstdint>
 #include <mutex>  // NOLINT
 #include <string>
+#include <vector>
 
 #include "port/thread_annotations.h"
 
@@ -103,7 +109,81 @@ inline bool Snappy_Uncompress(const char* input, size_t length, char* output) {
   return snappy::RawUncompress(input, length, output);
 }
 
-inline bool Zstd_Compress(int level, const char* input, size_t length,
+using ZstdCompressContext = ZSTD_CCtx;
+using ZstdUncompressContext = ZSTD_DCtx;
+using ZstdCompressDict = ZSTD_CDict;
+using ZstdUncompressDict = ZSTD_DDict;
+
+inline ZstdCompressContext* NewZstdCompressContext() {
+  return ZSTD_createCCtx();
+}
+
+inline void DeleteZstdCompressContext(ZstdCompressContext* ctx) {
+  ZSTD_freeCCtx(ctx);
+}
+
+inline ZstdUncompressContext* NewZstdUncompressContext() {
+  return ZSTD_createDCtx();
+}
+
+inline void DeleteZstdUncompressContext(ZstdUncompressContext* ctx) {
+  ZSTD_freeDCtx(ctx);
+}
+
+inline ZstdCompressDict* NewZstdCompressDict(const char* dict, size_t length,
+                                             int level) {
+  return ZSTD_createCDict(dict, length, level);
+}
+
+inline void DeleteZstdCompressDict(ZstdCompressDict* dict) {
+  ZSTD_freeCDict(dict);
+}
+
+inline ZstdUncompressDict* NewZstdUncompressDict(const char* dict,
+                                                 size_t length) {
+  return ZSTD_createDDict(dict, length);
+}
+
+inline void DeleteZstdUncompressDict(ZstdUncompressDict* dict) {
+  ZSTD_freeDDict(dict);
+}
+
+inline bool Zstd_TrainDictionary(const std::string& samples,
+                                 const std::vector<size_t>& sample_lengths,
+                                 size_t max_dict_bytes, std::string* dict) {
+  dict->resize(max_dict_bytes);
+  size_t length =
+      ZDICT_trainFromBuffer(&(*dict)[0], dict->size(), samples.data(),
+                            sample_lengths.data(), sample_lengths.size());
+  if (ZDICT_isError(length)) {
+    dict->clear();
+    return false;
+  }
+  dict->resize(length);
+  return true;
+}
+
+// Contexts owned by the calling thread, for callers that keep none.
+inline ZstdCompressContext* ThreadLocalZstdCompressContext() {
+  struct Holder {
+    ~Holder() { DeleteZstdCompressContext(ctx); }
+    ZstdCompressContext* const ctx = NewZstdCompressContext();
+  };
+  thread_local Holder holder;
+  return holder.ctx;
+}
+
+inline ZstdUncompressContext* ThreadLocalZstdUncompressContext() {
+  struct Holder {
+    ~Holder() { DeleteZstdUncompressContext(ctx); }
+    ZstdUncompressContext* const ctx = NewZstdUncompressContext();
+  };
+  thread_local Holder holder;
+  return holder.ctx;
+}
+
+inline bool Zstd_Compress(ZstdCompressContext* ctx, int level,
+                          const char* input, size_t length,
                           std::string* output) {
   // Get the MaxCompressedLength.
   size_t outlen = ZSTD_compressBound(length);
@@ -111,12 +191,10 @@ inline bool Zstd_Compress(int level, const char* input, size_t length,
     return false;
   }
   output->resize(outlen);
-  ZSTD_CCtx* ctx = ZSTD_createCCtx();
   ZSTD_compressionParameters parameters =
       ZSTD_getCParams(level, std::max(length, size_t{1}), /*dictSize=*/0);
   ZSTD_CCtx_setCParams(ctx, parameters);
   outlen = ZSTD_compress2(ctx, &(*output)[0], output->size(), input, length);
-  ZSTD_freeCCtx(ctx);
   if (ZSTD_isError(outlen)) {
     return false;
   }
@@ -124,6 +202,29 @@ inline bool Zstd_Compress(int level, const char* input, size_t length,
   return true;
 }
 
+inline bool Zstd_Compress(ZstdCompressContext* ctx,
+                          const ZstdCompressDict* dict, const char* input,
+                          size_t length, std::string* output) {
+  size_t outlen = ZSTD_compressBound(length);
+  if (ZSTD_isError(outlen)) {
+    return false;
+  }
+  output->resize(outlen);
+  outlen = ZSTD_compress_usingCDict(ctx, &(*output)[0], output->size(), input,
+                                    length, dict);
+  if (ZSTD_isError(outlen)) {
+    return false;
+  }
+  output->resize(outlen);
+  return true;
+}
+
+inline bool Zstd_Compress(int level, const char* input, size_t length,
+                          std::string* output) {
+  return Zstd_Compress(ThreadLocalZstdCompressContext(), level, input, length,
+                       output);
+}
+
 inline bool Zstd_GetUncompressedLength(const char* input, size_t length,
                                        size_t* result) {
   size_t size = ZSTD_getFrameContentSize(input, length);
@@ -132,20 +233,39 @@ inline bool Zstd_GetUncompressedLength(const char* input, size_t length,
   return true;
 }
 
-inline bool Zstd_Uncompress(const char* input, size_t length, char* output) {
+inline bool Zstd_Uncompress(ZstdUncompressContext* ctx, const char* input,
+                            size_t length, char* output) {
   size_t outlen;
   if (!Zstd_GetUncompressedLength(input, length, &outlen)) {
     return false;
   }
-  ZSTD_DCtx* ctx = ZSTD_createDCtx();
   outlen = ZSTD_decompressDCtx(ctx, output, outlen, input, length);
-  ZSTD_freeDCtx(ctx);
   if (ZSTD_isError(outlen)) {
     return false;
   }
   return true;
 }
 
+inline bool Zstd_Uncompress(ZstdUncompressContext* ctx,
+                            const ZstdUncompressDict* dict, const char* input,
+                            size_t length, char* output) {
+  size_t outlen;
+  if (!Zstd_GetUncompressedLength(input, length, &outlen)) {
+    return false;
+  }
+  outlen =
+      ZSTD_decompress_usingDDict(ctx, output, outlen, input, length, dict);
+  if (ZSTD_isError(outlen)) {
+    return false;
+  }
+  return true;
+}
+
+inline bool Zstd_Uncompress(const char* input, size_t length, char* output) {
+  return Zstd_Uncompress(ThreadLocalZstdUncompressContext(), input, length,
+                         output);
+}
+
 inline bool GetHeapProfile(void (*func)(void*, const char*, int), void* arg) {
   // Silence compiler warnings about unused arguments.
   (void)func;
@@ -153,6 +273,14 @@ inline bool GetHeapProfile(void (*func)(void*, const char*, int), void* arg) {
   return false;
 }
 
+inline int PhysicalCoreID() {
+#if defined(__linux__)
+  return sched_getcpu();
+#else
+  return -1;
+#endif  // defined(__linux__)
+}
+
 inline uint32_t AcceleratedCRC32C(uint32_t crc, const char* buf, size_t size) {
   return ::crc32c::Extend(crc, reinterpret_cast<const uint8_t*>(buf), size);
 }
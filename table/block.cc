@@ -55,7 +55,7 @@ static inline const char* DecodeEntry(const char* p, const char* limit,
   } else {
     if ((p = GetVarint32Ptr(p, limit, shared)) == nullptr) return nullptr;
     if ((p = GetVarint32Ptr(p, limit, non_shared)) == nullptr) return nullptr;
-    if ((p = GetVarint32Ptr(p, limit, value_length)) = nullptr) return nullptr;
+    if ((p = GetVarint32Ptr(p, limit, value_length)) == nullptr) return nullptr;
   }
   if (static_cast<uint32_t>(limit - p) < (*non_shared + *value_length)) {
     return nullptr;
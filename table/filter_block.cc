@@ -23,10 +23,14 @@ static const size_t kFilterBase = 1 << kFilterBaseLg;
 //[lg(base)]  // 1 字节，记录过滤器覆盖的粒度
 //[Filter 0][Filter 1][Offset 0][Offset 1][Offset Array Offset][lg(base)]
 //[24字节][26字节][  0  ][ 24  ][       50       ][  11    ]
-FilterBlockBuilder::FilterBlockBuilder(const FilterPolicy* policy)
-    : policy_(policy) {}
+FilterBlockBuilder::FilterBlockBuilder(const FilterPolicy* policy, bool full,
+                                       int level)
+    : policy_(policy), full_(full), level_(level) {}
 
 void FilterBlockBuilder::StartBlock(uint64_t block_offset) {
+  if (full_) {
+    return;
+  }
   uint64_t filter_index = (block_offset / kFilterBase);
   assert(filter_index >= filter_offsets_.size());
   while (filter_index > filter_offsets_.size()) {
@@ -40,7 +44,30 @@ void FilterBlockBuilder::AddKey(const Slice& key) {
   keys_.append(k.data(), k.size());
 }
 
+void FilterBlockBuilder::AddPrefix(const Slice& prefix) {
+  assert(full_);
+  if (!prefix_start_.empty() &&
+      Slice(prefixes_.data() + prefix_start_.back(),
+            prefixes_.size() - prefix_start_.back()) == prefix) {
+    return;
+  }
+  prefix_start_.push_back(prefixes_.size());
+  prefixes_.append(prefix.data(), prefix.size());
+}
+
 Slice FilterBlockBuilder::Finish() {
+  if (full_) {
+    // Prefixes go after the keys, so that equal ones stay next to each
+    // other.
+    prefix_start_.push_back(prefixes_.size());
+    for (size_t i = 0; i + 1 < prefix_start_.size(); i++) {
+      AddKey(Slice(prefixes_.data() + prefix_start_[i],
+                   prefix_start_[i + 1] - prefix_start_[i]));
+    }
+    // A full filter is just the filter, even with no keys
+    GenerateFilter();
+    return Slice(result_);
+  }
   if (!start_.empty()) {
     GenerateFilter();
   }
@@ -58,7 +85,7 @@ Slice FilterBlockBuilder::Finish() {
 
 void FilterBlockBuilder::GenerateFilter() {
   const size_t num_keys = start_.size();
-  if (num_keys == 0) {
+  if (num_keys == 0 && !full_) {
     // Fast path if there are no keys for this filter
     filter_offsets_.push_back(result_.size());
     return;
@@ -66,7 +93,7 @@ void FilterBlockBuilder::GenerateFilter() {
 
   // Make list of keys from flattened key structure
   start_.push_back(keys_.size());  // Simplify length computation
-  tmp_keys_.resize(num_keys);
+  tmp_keys_.resize(num_keys + 1);  // Keeps &tmp_keys_[0] valid for no keys
   for (size_t i = 0; i < num_keys; i++) {
     const char* base = keys_.data() + start_[i];
     size_t length = start_[i + 1] - start_[i];
@@ -75,7 +102,8 @@ void FilterBlockBuilder::GenerateFilter() {
 
   // Generate filter for current set of keys and append to result_.
   filter_offsets_.push_back(result_.size());
-  policy_->CreateFilter(&tmp_keys_[0], static_cast<int>(num_keys), &result_);
+  policy_->CreateFilterForLevel(&tmp_keys_[0], static_cast<int>(num_keys),
+                                &result_, level_);
 
   tmp_keys_.clear();
   keys_.clear();
@@ -83,8 +111,17 @@ void FilterBlockBuilder::GenerateFilter() {
 }
 
 FilterBlockReader::FilterBlockReader(const FilterPolicy* policy,
-                                     const Slice& contents)
-    : policy_(policy), data_(nullptr), offset_(nullptr), num_(0), base_lg_(0) {
+                                     const Slice& contents, bool full)
+    : policy_(policy),
+      full_(full),
+      data_(nullptr),
+      offset_(nullptr),
+      num_(0),
+      base_lg_(0) {
+  if (full_) {
+    full_filter_ = contents;
+    return;
+  }
   size_t n = contents.size();
   if (n < 5) return;  // 1 byte for base_lg_ and 4 for start of offset array
   base_lg_ = contents[n - 1];
@@ -96,6 +133,9 @@ FilterBlockReader::FilterBlockReader(const FilterPolicy* policy,
 }
 
 bool FilterBlockReader::KeyMayMatch(uint64_t block_offset, const Slice& key) {
+  if (full_) {
+    return policy_->KeyMayMatch(key, full_filter_);
+  }
   uint64_t index = block_offset >> base_lg_;
   if (index < num_) {
     uint32_t start = DecodeFixed32(offset_ + index * 4);
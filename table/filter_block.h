@@ -4,7 +4,8 @@
 //
 // A filter block is stored near the end of a Table file.  It contains
 // filters (e.g., bloom filters) for all data blocks in the table combined
-// into a single filter block.
+// into a single filter block.  A full filter block is instead one filter
+// for all the keys of the table.
 
 #ifndef STORAGE_LEVELDB_TABLE_FILTER_BLOCK_H_
 #define STORAGE_LEVELDB_TABLE_FILTER_BLOCK_H_
@@ -30,21 +31,31 @@ class FilterPolicy;
 //      (StartBlock AddKey*)* Finish
 class FilterBlockBuilder {
  public:
-  explicit FilterBlockBuilder(const FilterPolicy* policy);
+  // If "full", build a full filter block: the keys of every block are
+  // kept until Finish().  "level" is that of the table, or -1 if unknown.
+  explicit FilterBlockBuilder(const FilterPolicy* policy, bool full = false,
+                              int level = -1);
 
   FilterBlockBuilder(const FilterBlockBuilder&) = delete;
   FilterBlockBuilder& operator=(const FilterBlockBuilder&) = delete;
 
   void StartBlock(uint64_t block_offset);
   void AddKey(const Slice& key);
+  // Add the prefix of a key to a full filter.  Prefixes equal to the
+  // previous one are dropped.
+  void AddPrefix(const Slice& prefix);
   Slice Finish();
 
  private:
   void GenerateFilter();
 
   const FilterPolicy* policy_;
+  const bool full_;
+  const int level_;
   std::string keys_;             // Flattened key contents
   std::vector<size_t> start_;    // Starting index in keys_ of each key
+  std::string prefixes_;         // Flattened prefix contents
+  std::vector<size_t> prefix_start_;  // Starting index in prefixes_
   std::string result_;           // Filter data computed so far
   std::vector<Slice> tmp_keys_;  // policy_->CreateFilter() argument
   std::vector<uint32_t> filter_offsets_;
@@ -53,11 +64,16 @@ class FilterBlockBuilder {
 class FilterBlockReader {
  public:
   // REQUIRES: "contents" and *policy must stay live while *this is live.
-  FilterBlockReader(const FilterPolicy* policy, const Slice& contents);
+  FilterBlockReader(const FilterPolicy* policy, const Slice& contents,
+                    bool full = false);
+
+  // "block_offset" is ignored by full filters.
   bool KeyMayMatch(uint64_t block_offset, const Slice& key);
 
  private:
   const FilterPolicy* policy_;
+  const bool full_;
+  Slice full_filter_;   // The whole contents, if full_
   const char* data_;    // Pointer to filter data (at block-start)
   const char* offset_;  // Pointer to beginning of offset array (at block-end)
   size_t num_;          // Number of entries in offset array
@@ -121,4 +121,54 @@ TEST_F(FilterBlockTest, MultiChunk) {
   ASSERT_TRUE(!reader.KeyMayMatch(9000, "bar"));
 }
 
+TEST_F(FilterBlockTest, FullFilter) {
+  FilterBlockBuilder builder(&policy_, true);
+  builder.StartBlock(0);
+  builder.AddKey("foo");
+  builder.AddKey("bar");
+  builder.StartBlock(3100);
+  builder.AddKey("box");
+  builder.StartBlock(9000);
+  builder.AddKey("hello");
+  Slice block = builder.Finish();
+  // Just the filter: four hashes
+  ASSERT_EQ(16, block.size());
+  FilterBlockReader reader(&policy_, block, true);
+
+  // Every key matches at every offset
+  ASSERT_TRUE(reader.KeyMayMatch(0, "foo"));
+  ASSERT_TRUE(reader.KeyMayMatch(9000, "foo"));
+  ASSERT_TRUE(reader.KeyMayMatch(0, "hello"));
+  ASSERT_TRUE(reader.KeyMayMatch(3100, "bar"));
+  ASSERT_TRUE(reader.KeyMayMatch(100000, "box"));
+  ASSERT_TRUE(!reader.KeyMayMatch(0, "missing"));
+  ASSERT_TRUE(!reader.KeyMayMatch(9000, "other"));
+}
+
+TEST_F(FilterBlockTest, FullFilterPrefixes) {
+  FilterBlockBuilder builder(&policy_, true);
+  builder.AddKey("foo1");
+  builder.AddPrefix("foo");
+  builder.AddKey("foo2");
+  builder.AddPrefix("foo");
+  builder.AddKey("hello");
+  builder.AddPrefix("hel");
+  Slice block = builder.Finish();
+  // Three keys and two prefixes: repeated prefixes are added once
+  ASSERT_EQ(20, block.size());
+  FilterBlockReader reader(&policy_, block, true);
+  ASSERT_TRUE(reader.KeyMayMatch(0, "foo2"));
+  ASSERT_TRUE(reader.KeyMayMatch(0, "foo"));
+  ASSERT_TRUE(reader.KeyMayMatch(0, "hel"));
+  ASSERT_TRUE(!reader.KeyMayMatch(0, "bar"));
+}
+
+TEST_F(FilterBlockTest, EmptyFullFilter) {
+  FilterBlockBuilder builder(&policy_, true);
+  Slice block = builder.Finish();
+  ASSERT_EQ(0, block.size());
+  FilterBlockReader reader(&policy_, block, true);
+  ASSERT_TRUE(!reader.KeyMayMatch(0, "foo"));
+}
+
 }  // namespace leveldb
@@ -10,6 +10,7 @@
 #include "table/block.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
+#include "util/perf_context_imp.h"
 
 namespace leveldb {
 
@@ -67,7 +68,8 @@ Status Footer::DecodeFrom(Slice* input) {
 }
 
 Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
-                 const BlockHandle& handle, BlockContents* result) {
+                 const BlockHandle& handle, BlockContents* result,
+                 const port::ZstdUncompressDict* zstd_dict) {
   result->data = Slice();
   result->cachable = false;
   result->heap_allocated = false;
@@ -77,7 +79,11 @@ Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
   size_t n = static_cast<size_t>(handle.size());
   char* buf = new char[n + kBlockTrailerSize];
   Slice contents;
+  PerfTimer read_timer(&PerfContext::block_read_nanos);
   Status s = file->Read(handle.offset(), n + kBlockTrailerSize, &contents, buf);
+  read_timer.Stop();
+  PerfCount(&PerfContext::block_read_count);
+  PerfCount(&PerfContext::block_read_bytes, n + kBlockTrailerSize);
   if (!s.ok()) {
     delete[] buf;
     return s;
@@ -90,6 +96,7 @@ Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
   // Check the crc of the type and the block contents
   const char* data = contents.data();  // Pointer to where Read put the data
   if (options.verify_checksums) {
+    PerfTimer checksum_timer(&PerfContext::block_checksum_nanos);
     const uint32_t crc = crc32c::Unmask(DecodeFixed32(data + n + 1));
     const uint32_t actual = crc32c::Value(data, n + 1);
     if (actual != crc) {
@@ -124,6 +131,7 @@ Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
         return Status::Corruption("corrupted snappy compressed block length");
       }
       char* ubuf = new char[ulength];
+      PerfTimer decompress_timer(&PerfContext::block_decompress_nanos);
       if (!port::Snappy_Uncompress(data, n, ubuf)) {
         delete[] buf;
         delete[] ubuf;
@@ -142,7 +150,16 @@ Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
         return Status::Corruption("corrupted zstd compressed block length");
       }
       char* ubuf = new char[ulength];
-      if (!port::Zstd_Uncompress(data, n, ubuf)) {
+      PerfTimer decompress_timer(&PerfContext::block_decompress_nanos);
+      // Blocks are read from many threads at once, so each thread keeps
+      // its own context rather than setting one up per block.
+      bool uncompressed_ok =
+          zstd_dict != nullptr
+              ? port::Zstd_Uncompress(port::ThreadLocalZstdUncompressContext(),
+                                      zstd_dict, data, n, ubuf)
+              : port::Zstd_Uncompress(port::ThreadLocalZstdUncompressContext(),
+                                      data, n, ubuf);
+      if (!uncompressed_ok) {
         delete[] buf;
         delete[] ubuf;
         return Status::Corruption("corrupted zstd compressed block contents");
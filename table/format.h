@@ -11,6 +11,7 @@
 #include "leveldb/slice.h"
 #include "leveldb/status.h"
 #include "leveldb/table_builder.h"
+#include "port/port.h"
 
 namespace leveldb {
 
@@ -78,16 +79,47 @@ static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
 // 1-byte type + 32-bit crc
 static const size_t kBlockTrailerSize = 5;
 
+// Metaindex key of the zstd dictionary the file's data blocks were
+// compressed with, if any.
+static const char kZstdDictionaryMetaKey[] = "zstd.dictionary";
+
+// Prefix of the metaindex key of a full filter block, which holds one
+// filter for all keys of the file, followed by the filter policy name.
+// Per-block filters use the prefix "filter." instead.
+static const char kFullFilterMetaPrefix[] = "fullfilter.";
+
+// Metaindex key present, with an empty value, if the file's index is
+// partitioned.  The index block named by the footer is then a top-level
+// index whose entries map the last key of each index partition to
+//    index_partition_handle: BlockHandle
+//    filter_partition_handle: BlockHandle      (only with a filter)
+//    filter_partition_base: varint64           (only with a filter)
+// where the filter partition covers the data blocks of the index
+// partition, at offsets relative to filter_partition_base.
+static const char kPartitionedIndexMetaKey[] = "index.partitioned";
+
+// Prefix of the metaindex key that names the filter policy of a
+// partitioned filter, which has no block of its own.
+static const char kPartitionedFilterMetaPrefix[] = "partitionedfilter.";
+
+// Prefix of the metaindex key present, with an empty value, if the full
+// filter also holds the prefixes of the keys of the file, followed by the
+// name of the prefix extractor.
+static const char kPrefixExtractorMetaPrefix[] = "prefixextractor.";
+
 struct BlockContents {
   Slice data;           // Actual contents of data
   bool cachable;        // True iff data can be cached
   bool heap_allocated;  // True iff caller should delete[] data.data()
 };
 
-// Read the block identified by "handle" from "file".  On failure
-// return non-OK.  On success fill *result and return OK.
+// Read the block identified by "handle" from "file".  A zstd compressed
+// block is decompressed with "zstd_dict", which must be the dictionary
+// it was compressed with, if any.  On failure return non-OK.  On success
+// fill *result and return OK.
 Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
-                 const BlockHandle& handle, BlockContents* result);
+                 const BlockHandle& handle, BlockContents* result,
+                 const port::ZstdUncompressDict* zstd_dict = nullptr);
 
 // Implementation details follow.  Clients should ignore,
 
@@ -4,6 +4,8 @@
 
 #include "table/merger.h"
 
+#include <vector>
+
 #include "leveldb/comparator.h"
 #include "leveldb/iterator.h"
 
@@ -23,6 +25,7 @@ class MergingIterator : public Iterator {
     for (int i = 0; i < n; i++) {
       children_[i].Set(children[i]);
     }
+    heap_.reserve(n);
   }
 
   ~MergingIterator() override { delete[] children_; }
@@ -33,24 +36,24 @@ class MergingIterator : public Iterator {
     for (int i = 0; i < n_; i++) {
       children_[i].SeekToFirst();
     }
-    FindSmallest();
     direction_ = kForward;
+    BuildHeap();
   }
 
   void SeekToLast() override {
     for (int i = 0; i < n_; i++) {
       children_[i].SeekToLast();
     }
-    FindLargest();
     direction_ = kReverse;
+    BuildHeap();
   }
 
   void Seek(const Slice& target) override {
     for (int i = 0; i < n_; i++) {
       children_[i].Seek(target);
     }
-    FindSmallest();
     direction_ = kForward;
+    BuildHeap();
   }
 
   void Next() override {
@@ -73,10 +76,13 @@ class MergingIterator : public Iterator {
         }
       }
       direction_ = kForward;
+      current_->Next();
+      BuildHeap();
+      return;
     }
 
     current_->Next();
-    FindSmallest();
+    UpdateTop();
   }
 
   void Prev() override {
@@ -102,10 +108,13 @@ class MergingIterator : public Iterator {
         }
       }
       direction_ = kReverse;
+      current_->Prev();
+      BuildHeap();
+      return;
     }
 
     current_->Prev();
-    FindLargest();
+    UpdateTop();
   }
 
   Slice key() const override {
@@ -133,47 +142,75 @@ class MergingIterator : public Iterator {
   // Which direction is the iterator moving?
   enum Direction { kForward, kReverse };
 
-  void FindSmallest();
-  void FindLargest();
+  // True if "a" must be yielded before "b" in the current direction:
+  // the smaller key when moving forward, the larger one in reverse.  Ties
+  // go to the earlier child when moving forward and to the later one in
+  // reverse.
+  bool Before(const IteratorWrapper* a, const IteratorWrapper* b) const {
+    int r = comparator_->Compare(a->key(), b->key());
+    if (r == 0) {
+      r = (a < b) ? -1 : 1;
+    }
+    return (direction_ == kForward) ? (r < 0) : (r > 0);
+  }
+
+  void BuildHeap();
+  void UpdateTop();
+  void SiftDown(size_t i);
 
-  // We might want to use a heap in case there are lots of children.
-  // For now we use a simple array since we expect a very small number
-  // of children in leveldb.
+  // The valid children are kept in heap_, a binary heap ordered by
+  // Before(), so each step costs O(log n) comparisons rather than O(n).
+  // current_ is the top of the heap.  The heap is rebuilt when seeking
+  // and when the direction changes.
   const Comparator* comparator_;
   IteratorWrapper* children_;
   int n_;
+  std::vector<IteratorWrapper*> heap_;
   IteratorWrapper* current_;
   Direction direction_;
 };
 
-void MergingIterator::FindSmallest() {
-  IteratorWrapper* smallest = nullptr;
+void MergingIterator::BuildHeap() {
+  heap_.clear();
   for (int i = 0; i < n_; i++) {
-    IteratorWrapper* child = &children_[i];
-    if (child->Valid()) {
-      if (smallest == nullptr) {
-        smallest = child;
-      } else if (comparator_->Compare(child->key(), smallest->key()) < 0) {
-        smallest = child;
-      }
+    if (children_[i].Valid()) {
+      heap_.push_back(&children_[i]);
     }
   }
-  current_ = smallest;
+  for (size_t i = heap_.size() / 2; i > 0; i--) {
+    SiftDown(i - 1);
+  }
+  current_ = heap_.empty() ? nullptr : heap_[0];
 }
 
-void MergingIterator::FindLargest() {
-  IteratorWrapper* largest = nullptr;
-  for (int i = n_ - 1; i >= 0; i--) {
-    IteratorWrapper* child = &children_[i];
-    if (child->Valid()) {
-      if (largest == nullptr) {
-        largest = child;
-      } else if (comparator_->Compare(child->key(), largest->key()) > 0) {
-        largest = child;
-      }
+void MergingIterator::UpdateTop() {
+  // Only the top child moved; drop it if exhausted, then restore order.
+  if (!heap_[0]->Valid()) {
+    heap_[0] = heap_.back();
+    heap_.pop_back();
+  }
+  if (heap_.empty()) {
+    current_ = nullptr;
+    return;
+  }
+  SiftDown(0);
+  current_ = heap_[0];
+}
+
+void MergingIterator::SiftDown(size_t i) {
+  const size_t size = heap_.size();
+  IteratorWrapper* moving = heap_[i];
+  while (true) {
+    size_t best = 2 * i + 1;
+    if (best >= size) break;
+    if (best + 1 < size && Before(heap_[best + 1], heap_[best])) {
+      best++;
     }
+    if (!Before(heap_[best], moving)) break;
+    heap_[i] = heap_[best];
+    i = best;
   }
-  current_ = largest;
+  heap_[i] = moving;
 }
 }  // namespace
 
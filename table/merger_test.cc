@@ -0,0 +1,155 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "table/merger.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "leveldb/comparator.h"
+#include "leveldb/iterator.h"
+#include "leveldb/options.h"
+#include "table/block.h"
+#include "table/block_builder.h"
+#include "table/format.h"
+#include "util/random.h"
+
+namespace leveldb {
+
+static std::string Key(int i) {
+  char buf[20];
+  std::snprintf(buf, sizeof(buf), "%08d", i);
+  return buf;
+}
+
+class MergerTest : public testing::Test {
+ public:
+  ~MergerTest() override {
+    for (Block* block : blocks_) {
+      delete block;
+    }
+  }
+
+  // Build one child per element of "keys", each yielding its (sorted)
+  // keys with the child number as value, and return their merge.
+  Iterator* NewMerger(const std::vector<std::vector<std::string>>& keys) {
+    std::vector<Iterator*> children;
+    for (size_t c = 0; c < keys.size(); c++) {
+      BlockBuilder builder(&options_);
+      for (const std::string& key : keys[c]) {
+        builder.Add(key, std::to_string(c));
+      }
+      contents_.push_back(builder.Finish().ToString());
+      BlockContents contents;
+      contents.data = contents_.back();
+      contents.cachable = false;
+      contents.heap_allocated = false;
+      blocks_.push_back(new Block(contents));
+      children.push_back(blocks_.back()->NewIterator(BytewiseComparator()));
+    }
+    return NewMergingIterator(BytewiseComparator(), children.data(),
+                              children.size());
+  }
+
+ private:
+  Options options_;
+  std::deque<std::string> contents_;  // Never moves its elements
+  std::vector<Block*> blocks_;
+};
+
+TEST_F(MergerTest, Empty) {
+  std::vector<std::vector<std::string>> keys(5);
+  Iterator* iter = NewMerger(keys);
+  iter->SeekToFirst();
+  ASSERT_TRUE(!iter->Valid());
+  iter->SeekToLast();
+  ASSERT_TRUE(!iter->Valid());
+  iter->Seek("foo");
+  ASSERT_TRUE(!iter->Valid());
+  delete iter;
+}
+
+TEST_F(MergerTest, Duplicates) {
+  // Equal keys are yielded once per child, in child order going forward
+  // and in reverse child order going backward.
+  std::vector<std::vector<std::string>> keys = {
+      {"a", "c"}, {"b", "c"}, {"c", "d"}};
+  Iterator* iter = NewMerger(keys);
+  std::string forward, backward;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    forward += iter->key().ToString() + iter->value().ToString() + " ";
+  }
+  for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+    backward += iter->key().ToString() + iter->value().ToString() + " ";
+  }
+  ASSERT_EQ("a0 b1 c0 c1 c2 d2 ", forward);
+  ASSERT_EQ("d2 c2 c1 c0 b1 a0 ", backward);
+  delete iter;
+}
+
+TEST_F(MergerTest, Randomized) {
+  Random rnd(301);
+  for (int num_children : {2, 3, 7, 16, 64}) {
+    // Spread distinct keys over the children at random.
+    std::vector<std::vector<std::string>> keys(num_children);
+    std::vector<std::string> model;
+    for (int i = 0; i < 2000; i++) {
+      if (rnd.OneIn(3)) {
+        std::string key = Key(i);
+        keys[rnd.Uniform(num_children)].push_back(key);
+        model.push_back(key);
+      }
+    }
+    Iterator* iter = NewMerger(keys);
+
+    // Random walk, changing direction and seeking now and then.
+    int pos = -1;  // Index into model; -1 or model.size() when !Valid()
+    for (int step = 0; step < 5000; step++) {
+      switch (rnd.Uniform(6)) {
+        case 0: {
+          std::string target = Key(rnd.Uniform(2100));
+          iter->Seek(target);
+          pos = std::lower_bound(model.begin(), model.end(), target) -
+                model.begin();
+          break;
+        }
+        case 1:
+          iter->SeekToFirst();
+          pos = 0;
+          break;
+        case 2:
+          iter->SeekToLast();
+          pos = static_cast<int>(model.size()) - 1;
+          break;
+        case 3:
+        case 4:
+          if (iter->Valid()) {
+            iter->Next();
+            pos++;
+          }
+          break;
+        default:
+          if (iter->Valid()) {
+            iter->Prev();
+            pos--;
+          }
+          break;
+      }
+      if (pos >= 0 && pos < static_cast<int>(model.size())) {
+        ASSERT_TRUE(iter->Valid());
+        ASSERT_EQ(model[pos], iter->key().ToString());
+      } else {
+        ASSERT_TRUE(!iter->Valid());
+      }
+    }
+    ASSERT_TRUE(iter->status().ok());
+    delete iter;
+  }
+}
+
+}  // namespace leveldb
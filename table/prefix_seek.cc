@@ -0,0 +1,21 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "table/prefix_seek.h"
+
+namespace leveldb {
+
+namespace {
+thread_local bool prefix_seek_active = false;
+}  // namespace
+
+PrefixSeekScope::PrefixSeekScope() : saved_(prefix_seek_active) {
+  prefix_seek_active = true;
+}
+
+PrefixSeekScope::~PrefixSeekScope() { prefix_seek_active = saved_; }
+
+bool PrefixSeekScope::Active() { return prefix_seek_active; }
+
+}  // namespace leveldb
@@ -0,0 +1,33 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_TABLE_PREFIX_SEEK_H_
+#define STORAGE_LEVELDB_TABLE_PREFIX_SEEK_H_
+
+namespace leveldb {
+
+// Marks the Seek()s the calling thread makes while it is live as ones
+// that start an iteration confined to the prefix of their target (see
+// ReadOptions::prefix_same_as_start).  Only those may leave a table
+// iterator invalid because the table holds no key with that prefix.
+// Every other Seek(), such as the ones a merging iterator makes when it
+// changes direction, positions the iterator exactly.
+class PrefixSeekScope {
+ public:
+  PrefixSeekScope();
+  ~PrefixSeekScope();
+
+  PrefixSeekScope(const PrefixSeekScope&) = delete;
+  PrefixSeekScope& operator=(const PrefixSeekScope&) = delete;
+
+  // Returns true if a PrefixSeekScope is live on the calling thread.
+  static bool Active();
+
+ private:
+  const bool saved_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_TABLE_PREFIX_SEEK_H_
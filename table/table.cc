@@ -1,24 +1,126 @@
 #include "leveldb/table.h"
 
+#include <atomic>
+#include <cstring>
+
 #include "leveldb/cache.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/slice_transform.h"
+#include "leveldb/statistics.h"
 
+#include "port/port.h"
 #include "table/block.h"
 #include "table/filter_block.h"
 #include "table/format.h"
+#include "table/prefix_seek.h"
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
+#include "util/mutexlock.h"
+#include "util/perf_context_imp.h"
 
 namespace leveldb {
+
+// Key of the block at "offset" of the table with "cache_id" in the block
+// cache.
+static Slice BlockCacheKey(uint64_t cache_id, uint64_t offset,
+                           char (*buf)[16]) {
+  EncodeFixed64(*buf, cache_id);
+  EncodeFixed64(*buf + 8, offset);
+  return Slice(*buf, sizeof(*buf));
+}
+
+// Blocks in the cache may outlive the file they were read from, so they
+// must own their data.
+static void MakeHeapAllocated(BlockContents* contents) {
+  if (!contents->heap_allocated) {
+    char* copy = new char[contents->data.size()];
+    std::memcpy(copy, contents->data.data(), contents->data.size());
+    contents->data = Slice(copy, contents->data.size());
+    contents->heap_allocated = true;
+  }
+}
+
+// A filter block in the block cache, with the data its reader points into.
+struct CachedFilter {
+  CachedFilter(const FilterPolicy* policy, const Slice& contents, bool full)
+      : data(contents.data()), reader(policy, contents, full) {}
+  ~CachedFilter() { delete[] data; }
+
+  const char* const data;
+  FilterBlockReader reader;
+};
+
+static void DeleteCachedBlock(const Slice& key, void* value) {
+  Block* block = reinterpret_cast<Block*>(value);
+  delete block;
+}
+
+static void DeleteCachedFilter(const Slice& key, void* value) {
+  delete reinterpret_cast<CachedFilter*>(value);
+}
+
+static void ReleaseBlock(void* arg, void* h) {
+  Cache* cache = reinterpret_cast<Cache*>(arg);
+  Cache::Handle* handle = reinterpret_cast<Cache::Handle*>(h);
+  cache->Release(handle);
+}
+
 struct Table::Rep {
   ~Rep() {
+    if (cache_index_and_filter) {
+      Cache* cache = options.block_cache;
+      if (pinned_index != nullptr) cache->Release(pinned_index);
+      if (pinned_filter != nullptr) cache->Release(pinned_filter);
+      // Nobody else can look these up: the keys contain our cache_id.
+      char buf[16];
+      cache->Erase(BlockCacheKey(cache_id, index_handle.offset(), &buf));
+      if (has_filter) {
+        cache->Erase(BlockCacheKey(cache_id, filter_handle.offset(), &buf));
+      }
+    }
     delete filter;
     delete[] filter_data;
     delete index_block;
+    if (zstd_dict != nullptr) {
+      port::DeleteZstdUncompressDict(zstd_dict);
+    }
   }
+
+  ReadOptions MetaReadOptions() const {
+    ReadOptions opt;
+    if (options.paranoid_checks) {
+      opt.verify_checksums = true;
+    }
+    return opt;
+  }
+
+  // Look up the index block (if "is_filter" is false) or the filter
+  // block at "handle" in the block cache, reading and inserting it at
+  // high priority on a miss.  On success the caller must release
+  // *cache_handle.
+  Status LookupMetaBlock(const BlockHandle& handle, bool is_filter,
+                         Cache::Handle** cache_handle);
+
+  // Set *block to the index block.  If *cache_handle is set to non-null,
+  // the caller must release it once done with *block.
+  Status GetIndexBlock(Block** block, Cache::Handle** cache_handle);
+
+  // Same for the filter; returns nullptr if the table has no usable
+  // filter.
+  FilterBlockReader* GetFilter(Cache::Handle** cache_handle);
+
+  // Returns false if the table has a full filter that rules out "k".
+  bool FullFilterMayMatch(const Slice& k);
+
+  void Release(Cache::Handle* cache_handle) {
+    if (cache_handle != nullptr) {
+      options.block_cache->Release(cache_handle);
+    }
+  }
+
   Options options;
   Status status;
   RandomAccessFile* file;
@@ -27,8 +129,110 @@ struct Table::Rep {
   const char* filter_data;
   BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
   Block* index_block;
+  port::ZstdUncompressDict* zstd_dict;  // Dictionary of the data blocks
+
+  // If partitioned_index, index_block is the top-level index of a
+  // partitioned index (see kPartitionedIndexMetaKey).  If
+  // partitioned_filter, its entries also name filter partitions, and
+  // there is no filter block.
+  bool partitioned_index;
+  bool partitioned_filter;
+
+  // The filter block is a full filter, probed before the index.
+  bool full_filter;
+
+  // The full filter also holds the prefixes of the keys, as extracted by
+  // options.prefix_extractor.
+  bool prefix_filter;
+
+  // With Options::cache_index_and_filter_blocks, index_block and filter
+  // stay null and the blocks are looked up in options.block_cache.
+  bool cache_index_and_filter;
+  BlockHandle index_handle;
+  bool has_filter;
+  BlockHandle filter_handle;
+
+  // References that keep the cached blocks from being evicted, taken
+  // once by PinIndexAndFilter().  pinned_filter is null if the table has
+  // no usable filter.
+  port::Mutex pin_mutex;
+  std::atomic<bool> pinned;
+  Cache::Handle* pinned_index;
+  Cache::Handle* pinned_filter;
 };
 
+Status Table::Rep::LookupMetaBlock(const BlockHandle& handle, bool is_filter,
+                                   Cache::Handle** cache_handle) {
+  Cache* cache = options.block_cache;
+  char buf[16];
+  const Slice key = BlockCacheKey(cache_id, handle.offset(), &buf);
+  *cache_handle = cache->Lookup(key);
+  if (*cache_handle != nullptr) {
+    return Status::OK();
+  }
+
+  BlockContents contents;
+  Status s = ReadBlock(file, MetaReadOptions(), handle, &contents);
+  if (!s.ok()) {
+    return s;
+  }
+  MakeHeapAllocated(&contents);
+  if (is_filter) {
+    CachedFilter* cached =
+        new CachedFilter(options.filter_policy, contents.data, full_filter);
+    *cache_handle = cache->Insert(key, cached, contents.data.size(),
+                                  &DeleteCachedFilter, Cache::Priority::kHigh);
+  } else {
+    Block* block = new Block(contents);
+    *cache_handle = cache->Insert(key, block, block->size(),
+                                  &DeleteCachedBlock, Cache::Priority::kHigh);
+  }
+  return s;
+}
+
+Status Table::Rep::GetIndexBlock(Block** block, Cache::Handle** cache_handle) {
+  *cache_handle = nullptr;
+  if (!cache_index_and_filter) {
+    *block = index_block;
+    return Status::OK();
+  }
+  if (pinned.load(std::memory_order_acquire)) {
+    *block = reinterpret_cast<Block*>(options.block_cache->Value(pinned_index));
+    return Status::OK();
+  }
+  Status s = LookupMetaBlock(index_handle, false, cache_handle);
+  if (s.ok()) {
+    *block = reinterpret_cast<Block*>(options.block_cache->Value(*cache_handle));
+  }
+  return s;
+}
+
+FilterBlockReader* Table::Rep::GetFilter(Cache::Handle** cache_handle) {
+  *cache_handle = nullptr;
+  if (!cache_index_and_filter) {
+    return filter;
+  }
+  if (!has_filter) {
+    return nullptr;
+  }
+  if (pinned.load(std::memory_order_acquire)) {
+    if (pinned_filter == nullptr) {
+      return nullptr;
+    }
+    return &reinterpret_cast<CachedFilter*>(
+                options.block_cache->Value(pinned_filter))
+                ->reader;
+  }
+  if (!LookupMetaBlock(filter_handle, true, cache_handle).ok()) {
+    // As when a filter cannot be read at open: do without.
+    *cache_handle = nullptr;
+    return nullptr;
+  }
+  return &reinterpret_cast<CachedFilter*>(
+              options.block_cache->Value(*cache_handle))
+              ->reader;
+}
+
 Status Table::Open(const Options& options, RandomAccessFile* file,
                    uint64_t size, Table** table) {
   *table = nullptr;
@@ -54,27 +258,72 @@ Status Table::Open(const Options& options, RandomAccessFile* file,
   if (s.ok()) {
     // We've successfully read the footer and the index block: we're
     // ready to serve requests.
-    Block* index_block = new Block(index_block_contents);
     Rep* rep = new Table::Rep;
     rep->options = options;
     rep->file = file;
     rep->metaindex_handle = footer.metaindex_handle();
-    rep->index_block = index_block;
     rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
     rep->filter_data = nullptr;
     rep->filter = nullptr;
+    rep->zstd_dict = nullptr;
+    rep->partitioned_index = false;
+    rep->partitioned_filter = false;
+    rep->full_filter = false;
+    rep->prefix_filter = false;
+    rep->cache_index_and_filter =
+        options.cache_index_and_filter_blocks && options.block_cache != nullptr;
+    rep->index_handle = footer.index_handle();
+    rep->has_filter = false;
+    rep->pinned.store(false, std::memory_order_relaxed);
+    rep->pinned_index = nullptr;
+    rep->pinned_filter = nullptr;
+    if (rep->cache_index_and_filter) {
+      // Leave the block we just read in the cache for the first reads.
+      MakeHeapAllocated(&index_block_contents);
+      Block* index_block = new Block(index_block_contents);
+      char buf[16];
+      options.block_cache->Release(options.block_cache->Insert(
+          BlockCacheKey(rep->cache_id, rep->index_handle.offset(), &buf),
+          index_block, index_block->size(), &DeleteCachedBlock,
+          Cache::Priority::kHigh));
+      rep->index_block = nullptr;
+    } else {
+      rep->index_block = new Block(index_block_contents);
+    }
     *table = new Table(rep);
     (*table)->ReadMeta(footer);
   }
   return s;
 }
 
+void Table::PinIndexAndFilter() {
+  Rep* const r = rep_;
+  if (!r->cache_index_and_filter || r->pinned.load(std::memory_order_acquire)) {
+    return;
+  }
+  MutexLock l(&r->pin_mutex);
+  if (r->pinned.load(std::memory_order_relaxed)) {
+    return;
+  }
+  Cache::Handle* index = nullptr;
+  if (!r->LookupMetaBlock(r->index_handle, false, &index).ok()) {
+    return;  // Retried by the next call
+  }
+  Cache::Handle* filter = nullptr;
+  if (r->has_filter &&
+      !r->LookupMetaBlock(r->filter_handle, true, &filter).ok()) {
+    filter = nullptr;
+  }
+  r->pinned_index = index;
+  r->pinned_filter = filter;
+  r->pinned.store(true, std::memory_order_release);
+}
+
 Table::~Table() { delete rep_; }
 
 void Table::ReadMeta(const Footer& footer) {
-  if (rep_->options.filter_policy == nullptr) {
-    return;
-  }
+  // The metaindex is read even without a filter policy: the file may hold
+  // a zstd dictionary, whatever the current compression option says.
   ReadOptions opt;
   if (rep_->options.paranoid_checks) {
     opt.verify_checksums = true;
@@ -85,26 +334,66 @@ void Table::ReadMeta(const Footer& footer) {
   }
   Block* meta = new Block(contents);
   Iterator* iter = meta->NewIterator(BytewiseComparator());
-  std::string key = "filter.";
-  key.append(rep_->options.filter_policy->Name());
-  iter->Seek(key);
-  if (iter->Valid() && iter->key() == Slice(key)) {
-    ReadFilter(iter->value());
+  if (rep_->options.filter_policy != nullptr) {
+    std::string key = "filter.";
+    key.append(rep_->options.filter_policy->Name());
+    iter->Seek(key);
+    if (iter->Valid() && iter->key() == Slice(key)) {
+      ReadFilter(iter->value(), false);
+    } else {
+      key = kFullFilterMetaPrefix;
+      key.append(rep_->options.filter_policy->Name());
+      iter->Seek(key);
+      if (iter->Valid() && iter->key() == Slice(key)) {
+        ReadFilter(iter->value(), true);
+      }
+    }
+    key = kPartitionedFilterMetaPrefix;
+    key.append(rep_->options.filter_policy->Name());
+    iter->Seek(key);
+    rep_->partitioned_filter = iter->Valid() && iter->key() == Slice(key);
+    if (rep_->full_filter && rep_->options.prefix_extractor != nullptr) {
+      key = kPrefixExtractorMetaPrefix;
+      key.append(rep_->options.prefix_extractor->Name());
+      iter->Seek(key);
+      rep_->prefix_filter = iter->Valid() && iter->key() == Slice(key);
+    }
+  }
+  iter->Seek(kPartitionedIndexMetaKey);
+  rep_->partitioned_index =
+      iter->Valid() && iter->key() == Slice(kPartitionedIndexMetaKey);
+  if (!rep_->partitioned_index) {
+    rep_->partitioned_filter = false;
+  }
+  iter->Seek(kZstdDictionaryMetaKey);
+  if (iter->Valid() && iter->key() == Slice(kZstdDictionaryMetaKey)) {
+    ReadZstdDictionary(iter->value());
   }
   delete iter;
   delete meta;
 }
 
-void Table::ReadFilter(const Slice& filter_handle_value) {
+void Table::ReadFilter(const Slice& filter_handle_value, bool full) {
   Slice v = filter_handle_value;
   BlockHandle filter_handle;
   if (!filter_handle.DecodeFrom(&v).ok()) {
     return;
   }
+  rep_->full_filter = full;
   ReadOptions opt;
   if (rep_->options.paranoid_checks) {
     opt.verify_checksums = true;
   }
+  if (rep_->cache_index_and_filter) {
+    // Read it into the cache now, as the index block was.
+    rep_->has_filter = true;
+    rep_->filter_handle = filter_handle;
+    Cache::Handle* cache_handle;
+    if (rep_->LookupMetaBlock(filter_handle, true, &cache_handle).ok()) {
+      rep_->Release(cache_handle);
+    }
+    return;
+  }
   BlockContents block;
   if (!ReadBlock(rep_->file, opt, filter_handle, &block).ok()) {
     return;
@@ -112,28 +401,86 @@ void Table::ReadFilter(const Slice& filter_handle_value) {
   if (block.heap_allocated) {
     rep_->filter_data = block.data.data();
   }
-  rep_->filter = new FilterBlockReader(rep_->options.filter_policy, block.data);
+  rep_->filter =
+      new FilterBlockReader(rep_->options.filter_policy, block.data, full);
 }
+
+void Table::ReadZstdDictionary(const Slice& dict_handle_value) {
+  Slice v = dict_handle_value;
+  BlockHandle dict_handle;
+  if (!dict_handle.DecodeFrom(&v).ok()) {
+    return;
+  }
+  ReadOptions opt;
+  if (rep_->options.paranoid_checks) {
+    opt.verify_checksums = true;
+  }
+  BlockContents block;
+  if (!ReadBlock(rep_->file, opt, dict_handle, &block).ok()) {
+    return;
+  }
+  // The digested dictionary keeps its own copy of the contents.
+  rep_->zstd_dict =
+      port::NewZstdUncompressDict(block.data.data(), block.data.size());
+  if (block.heap_allocated) {
+    delete[] block.data.data();
+  }
+}
+
 static void DeleteBlock(void* arg, void* ignored) {
   delete reinterpret_cast<Block*>(arg);
 }
 
-static void DeleteCachedBlock(const Slice& key, void* value) {
-  Block* block = reinterpret_cast<Block*>(value);
-  delete block;
+// Probe "filter" for "k", recording the outcome in "statistics" and the
+// calling thread's PerfContext.
+static bool FilterMayMatch(FilterBlockReader* filter, uint64_t block_offset,
+                           const Slice& k, Statistics* statistics) {
+  PerfTimer timer(&PerfContext::filter_check_nanos);
+  const bool may_match = filter->KeyMayMatch(block_offset, k);
+  PerfCount(&PerfContext::filter_check_count);
+  if (!may_match) {
+    PerfCount(&PerfContext::filter_useful_count);
+  }
+  if (statistics != nullptr) {
+    statistics->RecordTick(may_match ? kFilterPositive : kFilterUseful, 1);
+  }
+  return may_match;
 }
 
-static void ReleaseBlock(void* arg, void* h) {
-  Cache* cache = reinterpret_cast<Cache*>(arg);
-  Cache::Handle* handle = reinterpret_cast<Cache::Handle*>(h);
-  cache->Release(handle);
+bool Table::Rep::FullFilterMayMatch(const Slice& k) {
+  if (!full_filter) {
+    return true;
+  }
+  Cache::Handle* cache_handle;
+  FilterBlockReader* reader = GetFilter(&cache_handle);
+  const bool may_match =
+      reader == nullptr || FilterMayMatch(reader, 0, k, options.statistics);
+  Release(cache_handle);
+  return may_match;
 }
 
 // read block by index_value;
 Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
                              const Slice& index_value) {
-  Table* table = reinterpret_cast<Table*>(arg);
+  return NewBlockIterator(reinterpret_cast<Table*>(arg), options, index_value,
+                          false);
+}
+
+// Index partitions are cached at high priority, and compressed without
+// the zstd dictionary, like the index itself.
+Iterator* Table::IndexPartitionReader(void* arg, const ReadOptions& options,
+                                      const Slice& index_value) {
+  return NewBlockIterator(reinterpret_cast<Table*>(arg), options, index_value,
+                          true);
+}
+
+Iterator* Table::NewBlockIterator(const Table* table,
+                                  const ReadOptions& options,
+                                  const Slice& index_value,
+                                  bool index_partition) {
   Cache* block_cache = table->rep_->options.block_cache;
+  const port::ZstdUncompressDict* zstd_dict =
+      index_partition ? nullptr : table->rep_->zstd_dict;
   Block* block = nullptr;
   Cache::Handle* cache_handle = nullptr;
 
@@ -146,24 +493,32 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
     BlockContents contents;
     if (block_cache != nullptr) {
       char cache_key_buffer[16];
-      EncodeFixed64(cache_key_buffer, table->rep_->cache_id);
-      EncodeFixed64(cache_key_buffer + 8, handle.offset());
-      Slice key(cache_key_buffer, sizeof(cache_key_buffer));
+      Slice key = BlockCacheKey(table->rep_->cache_id, handle.offset(),
+                                &cache_key_buffer);
       cache_handle = block_cache->Lookup(key);
+      Statistics* statistics = table->rep_->options.statistics;
+      if (statistics != nullptr) {
+        statistics->RecordTick(
+            cache_handle != nullptr ? kBlockCacheHit : kBlockCacheMiss, 1);
+      }
       if (cache_handle != nullptr) {
+        PerfCount(&PerfContext::block_cache_hit_count);
         block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
       } else {
-        s = ReadBlock(table->rep_->file, options, handle, &contents);
+        s = ReadBlock(table->rep_->file, options, handle, &contents,
+                      zstd_dict);
         if (s.ok()) {
           block = new Block(contents);
           if (contents.cachable && options.fill_cache) {
-            cache_handle = block_cache->Insert(key, block, block->size(),
-                                               &DeleteCachedBlock);
+            cache_handle = block_cache->Insert(
+                key, block, block->size(), &DeleteCachedBlock,
+                index_partition ? Cache::Priority::kHigh
+                                : Cache::Priority::kLow);
           }
         }
       }
     } else {
-      s = ReadBlock(table->rep_->file, options, handle, &contents);
+      s = ReadBlock(table->rep_->file, options, handle, &contents, zstd_dict);
       if (s.ok()) block = new Block(contents);
     }
   }
@@ -182,51 +537,352 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
   return iter;
 }
 
+// Finds the index entry of the data block that may hold a key, and the
+// filter covering that block, in either index format.  Any sequence of
+// seeks is correct; seeks to increasing keys reuse the loaded partition.
+class Table::IndexCursor {
+ public:
+  IndexCursor(const Table* table, const ReadOptions& options)
+      : rep_(table->rep_),
+        table_(table),
+        options_(options),
+        index_handle_(nullptr),
+        filter_handle_(nullptr),
+        filter_(nullptr),
+        partition_iter_(nullptr),
+        filter_loaded_(false),
+        filter_base_(0),
+        owned_filter_(nullptr) {
+    Block* index_block;
+    status_ = rep_->GetIndexBlock(&index_block, &index_handle_);
+    if (status_.ok()) {
+      top_iter_ = index_block->NewIterator(rep_->options.comparator);
+    } else {
+      top_iter_ = NewEmptyIterator();
+    }
+    // A full filter is probed before the cursor is needed.
+    if (!rep_->partitioned_filter && !rep_->full_filter) {
+      filter_ = rep_->GetFilter(&filter_handle_);
+    }
+    filter_loaded_ = !rep_->partitioned_filter;
+  }
+
+  IndexCursor(const IndexCursor&) = delete;
+  IndexCursor& operator=(const IndexCursor&) = delete;
+
+  ~IndexCursor() {
+    ReleasePartitionFilter();
+    delete partition_iter_;
+    delete top_iter_;
+    rep_->Release(filter_handle_);
+    rep_->Release(index_handle_);
+  }
+
+  // Position at the first index entry with a key >= "k".  Returns false
+  // if there is none or on error; see status().
+  bool Seek(const Slice& k) {
+    if (!status_.ok()) {
+      return false;
+    }
+    PerfTimer timer(&PerfContext::index_seek_nanos);
+    top_iter_->Seek(k);
+    if (!top_iter_->Valid()) {
+      status_ = top_iter_->status();
+      return false;
+    }
+    if (!rep_->partitioned_index) {
+      return true;
+    }
+    if (partition_iter_ == nullptr ||
+        top_iter_->value() != Slice(partition_value_)) {
+      LoadPartition();
+    }
+    // The top-level key is the last key of the partition, so this can
+    // only fail on errors.
+    partition_iter_->Seek(k);
+    if (!partition_iter_->Valid()) {
+      status_ = partition_iter_->status();
+      if (status_.ok()) {
+        status_ = Status::Corruption("bad index partition");
+      }
+      return false;
+    }
+    return true;
+  }
+
+  // The encoded handle of the data block found by Seek().
+  Slice value() const {
+    return rep_->partitioned_index ? partition_iter_->value()
+                                   : top_iter_->value();
+  }
+
+  // Returns false if the filter rules out "k" in the data block found by
+  // Seek().
+  bool KeyMayMatch(const Slice& k) {
+    if (!filter_loaded_) {
+      LoadPartitionFilter();
+    }
+    Slice input = value();
+    BlockHandle handle;
+    if (filter_ == nullptr || !handle.DecodeFrom(&input).ok() ||
+        handle.offset() < filter_base_) {
+      return true;
+    }
+    return FilterMayMatch(filter_, handle.offset() - filter_base_, k,
+                          rep_->options.statistics);
+  }
+
+  Status status() const { return status_; }
+
+ private:
+  void LoadPartition() {
+    delete partition_iter_;
+    ReleasePartitionFilter();
+    partition_value_ = top_iter_->value().ToString();
+    partition_iter_ = IndexPartitionReader(const_cast<Table*>(table_),
+                                           options_, partition_value_);
+  }
+
+  // Filter partitions are read only when a filter is probed: neither
+  // iterators nor ApproximateOffsetOf() need them.
+  void LoadPartitionFilter() {
+    filter_loaded_ = true;
+    Slice input = partition_value_;
+    BlockHandle index_handle, filter_handle;
+    if (!index_handle.DecodeFrom(&input).ok() ||
+        !filter_handle.DecodeFrom(&input).ok() ||
+        !GetVarint64(&input, &filter_base_)) {
+      return;  // Errors are treated as potential matches
+    }
+    if (rep_->options.block_cache != nullptr) {
+      if (rep_->LookupMetaBlock(filter_handle, true, &filter_handle_).ok()) {
+        filter_ = &reinterpret_cast<CachedFilter*>(
+                       rep_->options.block_cache->Value(filter_handle_))
+                       ->reader;
+      } else {
+        filter_handle_ = nullptr;
+      }
+      return;
+    }
+    BlockContents contents;
+    if (ReadBlock(rep_->file, rep_->MetaReadOptions(), filter_handle,
+                  &contents)
+            .ok()) {
+      MakeHeapAllocated(&contents);
+      owned_filter_ = new CachedFilter(rep_->options.filter_policy,
+                                       contents.data, false);
+      filter_ = &owned_filter_->reader;
+    }
+  }
+
+  void ReleasePartitionFilter() {
+    if (rep_->partitioned_filter) {
+      rep_->Release(filter_handle_);
+      filter_handle_ = nullptr;
+      delete owned_filter_;
+      owned_filter_ = nullptr;
+      filter_ = nullptr;
+      filter_loaded_ = false;
+    }
+  }
+
+  Rep* const rep_;
+  const Table* const table_;
+  const ReadOptions options_;
+  Status status_;
+  Cache::Handle* index_handle_;
+  Iterator* top_iter_;  // Over the whole or the top-level index
+
+  // The filter of the whole table or of the loaded partition.
+  Cache::Handle* filter_handle_;
+  FilterBlockReader* filter_;
+
+  // The loaded partition, and its entry in the top-level index.
+  std::string partition_value_;
+  Iterator* partition_iter_;
+  bool filter_loaded_;
+  uint64_t filter_base_;        // Offset the filter partition starts at
+  CachedFilter* owned_filter_;  // Filter partition read without a cache
+};
+
+// With ReadOptions::prefix_same_as_start, a Seek() made under a
+// PrefixSeekScope to a key whose prefix the full filter rules out leaves
+// the iterator invalid, without reading the index or any data block.
+// Other Seek()s are never filtered, so that the iterator can always be
+// positioned exactly around a key it is asked for.
+class Table::PrefixFilterIterator : public Iterator {
+ public:
+  PrefixFilterIterator(const Table* table, const ReadOptions& options)
+      : table_(table), options_(options), iter_(nullptr), filtered_(false) {
+    options_.prefix_same_as_start = false;
+  }
+
+  ~PrefixFilterIterator() override { delete iter_; }
+
+  bool Valid() const override {
+    return !filtered_ && iter_ != nullptr && iter_->Valid();
+  }
+  void Seek(const Slice& target) override {
+    const SliceTransform* prefix_extractor =
+        table_->rep_->options.prefix_extractor;
+    filtered_ = PrefixSeekScope::Active() &&
+                prefix_extractor->InDomain(target) &&
+                !table_->rep_->FullFilterMayMatch(
+                    prefix_extractor->Transform(target));
+    if (!filtered_) {
+      Iter()->Seek(target);
+    }
+  }
+  void SeekToFirst() override {
+    filtered_ = false;
+    Iter()->SeekToFirst();
+  }
+  void SeekToLast() override {
+    filtered_ = false;
+    Iter()->SeekToLast();
+  }
+  void Next() override {
+    assert(Valid());
+    iter_->Next();
+  }
+  void Prev() override {
+    assert(Valid());
+    iter_->Prev();
+  }
+  Slice key() const override {
+    assert(Valid());
+    return iter_->key();
+  }
+  Slice value() const override {
+    assert(Valid());
+    return iter_->value();
+  }
+  Status status() const override {
+    return iter_ == nullptr ? Status::OK() : iter_->status();
+  }
+
+ private:
+  // The table iterator, created by the first positioning that needs it.
+  Iterator* Iter() {
+    if (iter_ == nullptr) {
+      iter_ = table_->NewIterator(options_);
+    }
+    return iter_;
+  }
+
+  const Table* const table_;
+  ReadOptions options_;
+  Iterator* iter_;
+  bool filtered_;  // The last Seek() was ruled out by the filter
+};
+
 // TODO: learn it
 Iterator* Table::NewIterator(const ReadOptions& options) const {
-  return NewTwoLevelIterator(
-      rep_->index_block->NewIterator(rep_->options.comparator),
-      &Table::BlockReader, const_cast<Table*>(this), options);
+  if (options.prefix_same_as_start && rep_->prefix_filter) {
+    return new PrefixFilterIterator(this, options);
+  }
+  Block* index_block;
+  Cache::Handle* index_handle;
+  Status s = rep_->GetIndexBlock(&index_block, &index_handle);
+  if (!s.ok()) {
+    return NewErrorIterator(s);
+  }
+  Iterator* index_iter = index_block->NewIterator(rep_->options.comparator);
+  if (index_handle != nullptr) {
+    index_iter->RegisterCleanup(&ReleaseBlock, rep_->options.block_cache,
+                                index_handle);
+  }
+  if (rep_->partitioned_index) {
+    index_iter = NewTwoLevelIterator(index_iter, &Table::IndexPartitionReader,
+                                     const_cast<Table*>(this), options,
+                                     rep_->options.comparator);
+  }
+  return NewTwoLevelIterator(index_iter, &Table::BlockReader,
+                             const_cast<Table*>(this), options,
+                             rep_->options.comparator);
 }
 
 Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
                           void (*handle_result)(void*, const Slice&,
                                                 const Slice&)) {
+  if (!rep_->FullFilterMayMatch(k)) {
+    return Status::OK();  // Not found, without touching the index
+  }
   Status s;
-  Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
-  iiter->Seek(k);
-  if (iiter->Valid()) {
-    Slice handle_value = iiter->value();
-    FilterBlockReader* filter = rep_->filter;
-    BlockHandle handle;
-    if (filter != nullptr && handle.DecodeFrom(&handle_value).ok() &&
-        !filter->KeyMayMatch(handle.offset(), k)) {
-      // Not found
-    } else {
-      Iterator* block_iter = BlockReader(this, options, iiter->value());
+  IndexCursor index(this, options);
+  if (index.Seek(k) && index.KeyMayMatch(k)) {
+    Iterator* block_iter = BlockReader(this, options, index.value());
+    {
+      PerfTimer timer(&PerfContext::block_seek_nanos);
       block_iter->Seek(k);
-      if (block_iter->Valid()) {
-        (*handle_result)(arg, block_iter->key(), block_iter->value());
-      }
-      s = block_iter->status();
+    }
+    if (block_iter->Valid()) {
+      (*handle_result)(arg, block_iter->key(), block_iter->value());
+    }
+    s = block_iter->status();
+    delete block_iter;
+  }
+  if (s.ok()) {
+    s = index.status();
+  }
+  return s;
+}
+
+Status Table::InternalMultiGet(const ReadOptions& options,
+                               const std::vector<Slice>& keys, void* arg,
+                               void (*handle_result)(void*, size_t,
+                                                     const Slice&,
+                                                     const Slice&)) {
+  Status s;
+  IndexCursor index(this, options);
+
+  // Iterator over the data block last read, and that block's handle.
+  Iterator* block_iter = nullptr;
+  std::string block_handle;
+
+  for (size_t i = 0; i < keys.size(); i++) {
+    const Slice& k = keys[i];
+    if (!rep_->FullFilterMayMatch(k)) {
+      continue;  // Not found
+    }
+    if (!index.Seek(k)) {
+      // This key and, since they are sorted, all remaining ones are past
+      // the last block.
+      break;
+    }
+    if (!index.KeyMayMatch(k)) {
+      continue;  // Not found
+    }
+    if (block_iter == nullptr || index.value() != Slice(block_handle)) {
       delete block_iter;
+      block_handle = index.value().ToString();
+      block_iter = BlockReader(this, options, index.value());
+    }
+    {
+      PerfTimer timer(&PerfContext::block_seek_nanos);
+      block_iter->Seek(k);
+    }
+    if (block_iter->Valid()) {
+      (*handle_result)(arg, i, block_iter->key(), block_iter->value());
+    }
+    s = block_iter->status();
+    if (!s.ok()) {
+      break;
     }
   }
+  delete block_iter;
   if (s.ok()) {
-    s = iiter->status();
+    s = index.status();
   }
-  delete iiter;
   return s;
 }
 
 uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
-  Iterator* index_iter =
-      rep_->index_block->NewIterator(rep_->options.comparator);
-  index_iter->Seek(key);
+  IndexCursor index(this, ReadOptions());
   uint64_t result;
-  if (index_iter->Valid()) {
+  if (index.Seek(key)) {
     BlockHandle handle;
-    Slice input = index_iter->value();
+    Slice input = index.value();
     Status s = handle.DecodeFrom(&input);
     if (s.ok()) {
       result = handle.offset();
@@ -242,7 +898,6 @@ uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
     // right near the end of the file).
     result = rep_->metaindex_handle.offset();
   }
-  delete index_iter;
   return result;
 }
 
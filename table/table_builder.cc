@@ -1,10 +1,14 @@
 ﻿#include "leveldb/table_builder.h"
 
+#include <vector>
+
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/slice_transform.h"
 
 #include "port/port.h"
+#include "table/block.h"
 #include "table/block_builder.h"
 #include "table/filter_block.h"
 #include "table/format.h"
@@ -13,8 +17,13 @@
 
 
 namespace leveldb {
+
+// Bytes of data blocks buffered to train a zstd dictionary, per byte of
+// Options::zstd_max_dict_bytes.  zstd suggests about a hundred.
+static const size_t kZstdTrainingBytesPerDictByte = 100;
+
 struct TableBuilder::Rep {
-  Rep(const Options& opt, WritableFile* f)
+  Rep(const Options& opt, WritableFile* f, int lvl)
       : options(opt),
         index_block_options(opt),
         file(f),
@@ -23,13 +32,35 @@ struct TableBuilder::Rep {
         index_block(&index_block_options),
         num_entries(0),
         closed(false),
+        level(lvl),
+        full_filter(opt.full_filter && !opt.partition_index_and_filters),
         filter_block(opt.filter_policy == nullptr
                          ? nullptr
-                         : new FilterBlockBuilder(opt.filter_policy)),
-        pending_index_entry(false) {
+                         : new FilterBlockBuilder(opt.filter_policy,
+                                                  full_filter, lvl)),
+        prefix_extractor(full_filter && filter_block != nullptr
+                             ? opt.prefix_extractor
+                             : nullptr),
+        pending_index_entry(false),
+        partitioned(opt.partition_index_and_filters),
+        filter_base(0),
+        zstd_context(nullptr),
+        buffering(opt.compression == kZstdCompression &&
+                  opt.zstd_max_dict_bytes > 0),
+        buffered_bytes(0),
+        zstd_dict(nullptr) {
     index_block_options.block_restart_interval = 1;
   }
 
+  ~Rep() {
+    if (zstd_context != nullptr) {
+      port::DeleteZstdCompressContext(zstd_context);
+    }
+    if (zstd_dict != nullptr) {
+      port::DeleteZstdCompressDict(zstd_dict);
+    }
+  }
+
   Options options;
   Options index_block_options;
   WritableFile* file;
@@ -40,7 +71,18 @@ struct TableBuilder::Rep {
   std::string last_key;
   int64_t num_entries;
   bool closed;  // Either Finish() or Abandon() has been called.
+  const int level;  // Of the database, or -1 if unknown
+  const bool full_filter;
   FilterBlockBuilder* filter_block;
+  // Non-null if the prefixes of keys go into the full filter too
+  const SliceTransform* const prefix_extractor;
+
+  void AddToFilter(const Slice& key) {
+    filter_block->AddKey(key);
+    if (prefix_extractor != nullptr && prefix_extractor->InDomain(key)) {
+      filter_block->AddPrefix(prefix_extractor->Transform(key));
+    }
+  }
 
   // We do not emit the index entry for a block until we have seen the
   // first key for the next data block.  This allows us to use shorter
@@ -54,11 +96,41 @@ struct TableBuilder::Rep {
   bool pending_index_entry;
   BlockHandle pending_handle;  // Handle to add to index block
 
+  // With Options::partition_index_and_filters, index_block and
+  // filter_block hold the current partition only.  Finished partitions
+  // wait here until Finish() writes them after the data blocks.
+  struct Partition {
+    std::string last_key;  // Last key in the index partition
+    std::string index;
+    std::string filter;
+    uint64_t filter_base;  // Offset of the first data block covered
+  };
+  const bool partitioned;
+  std::vector<Partition> partitions;
+  uint64_t filter_base;  // Same, for filter_block
+
   std::string compressed_output;
+
+  // Reused for every block; created by the first zstd-compressed block.
+  port::ZstdCompressContext* zstd_context;
+
+  // While training a zstd dictionary, finished data blocks are kept in
+  // buffered_blocks, uncompressed, instead of being written.  Their keys
+  // reach the index and filter only when the blocks are written by
+  // EnterUnbuffered().
+  bool buffering;
+  std::vector<std::string> buffered_blocks;
+  size_t buffered_bytes;
+
+  // The trained dictionary, if any.  All data blocks written after
+  // training are compressed with it.
+  std::string zstd_dict_contents;
+  port::ZstdCompressDict* zstd_dict;
 };
 
-TableBuilder::TableBuilder(const Options& options, WritableFile* file)
-    : rep_(new Rep(options, file)) {
+TableBuilder::TableBuilder(const Options& options, WritableFile* file,
+                           int level)
+    : rep_(new Rep(options, file, level)) {
   if (rep_->filter_block != nullptr) {
     rep_->filter_block->StartBlock(0);
   }
@@ -97,9 +169,13 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
     r->pending_handle.EncodeTo(&handle_encoding);
     r->index_block.Add(r->last_key, Slice(handle_encoding));
     r->pending_index_entry = false;
+    if (r->partitioned && r->index_block.CurrentSizeEstimate() >=
+                              r->options.metadata_block_size) {
+      CutIndexPartition();
+    }
   }
-  if (r->filter_block != nullptr) {
-    r->filter_block->AddKey(key);
+  if (r->filter_block != nullptr && !r->buffering) {
+    r->AddToFilter(key);
   }
   r->last_key.assign(key.data(), key.size());
   r->num_entries++;
@@ -116,24 +192,132 @@ void TableBuilder::Flush() {
   if (!ok()) return;
   if (r->data_block.empty()) return;
   assert(!r->pending_index_entry);
-  WriteBlock(&r->data_block, &r->pending_handle);  // 处理datablock并返回handle
+  if (r->buffering) {
+    Slice raw = r->data_block.Finish();
+    r->buffered_blocks.emplace_back(raw.data(), raw.size());
+    r->buffered_bytes += raw.size();
+    r->data_block.Reset();
+    if (r->buffered_bytes >=
+        r->options.zstd_max_dict_bytes * kZstdTrainingBytesPerDictByte) {
+      EnterUnbuffered();
+    }
+    return;
+  }
+  // 处理datablock并返回handle
+  WriteBlock(r->data_block.Finish(), true, &r->pending_handle);
+  r->data_block.Reset();
   if (ok()) {
     r->pending_index_entry = true;
     r->status = r->file->Flush();
   }
   if (r->filter_block != nullptr) {
-    r->filter_block->StartBlock(r->offset);  // 一个block对应一个过滤器
+    // 一个block对应一个过滤器
+    r->filter_block->StartBlock(r->offset - r->filter_base);
   }
 }
 
+void TableBuilder::EnterUnbuffered() {
+  Rep* r = rep_;
+  assert(r->buffering);
+  r->buffering = false;
+
+  if (!r->buffered_blocks.empty()) {
+    std::string samples;
+    samples.reserve(r->buffered_bytes);
+    std::vector<size_t> sample_lengths;
+    for (const std::string& block : r->buffered_blocks) {
+      samples.append(block);
+      sample_lengths.push_back(block.size());
+    }
+    // If training fails (e.g. too little data) the file simply has no
+    // dictionary.
+    if (port::Zstd_TrainDictionary(samples, sample_lengths,
+                                   r->options.zstd_max_dict_bytes,
+                                   &r->zstd_dict_contents)) {
+      r->zstd_dict = port::NewZstdCompressDict(
+          r->zstd_dict_contents.data(), r->zstd_dict_contents.size(),
+          r->options.zstd_compression_level);
+    }
+  }
+
+  // Write the buffered blocks as Add() and Flush() would have, recovering
+  // their keys for the index and filter by parsing them.
+  for (const std::string& raw : r->buffered_blocks) {
+    if (!ok()) break;
+    BlockContents contents;
+    contents.data = raw;
+    contents.cachable = false;
+    contents.heap_allocated = false;
+    Block block(contents);
+    Iterator* iter = block.NewIterator(r->options.comparator);
+    iter->SeekToFirst();
+    if (r->pending_index_entry && iter->Valid()) {
+      r->options.comparator->FindShortestSeparator(&r->last_key, iter->key());
+      std::string handle_encoding;
+      r->pending_handle.EncodeTo(&handle_encoding);
+      r->index_block.Add(r->last_key, Slice(handle_encoding));
+      r->pending_index_entry = false;
+      if (r->partitioned && r->index_block.CurrentSizeEstimate() >=
+                                r->options.metadata_block_size) {
+        CutIndexPartition();
+      }
+    }
+    for (; iter->Valid(); iter->Next()) {
+      if (r->filter_block != nullptr) {
+        r->AddToFilter(iter->key());
+      }
+      r->last_key.assign(iter->key().data(), iter->key().size());
+    }
+    delete iter;
+
+    WriteBlock(raw, true, &r->pending_handle);
+    if (ok()) {
+      r->pending_index_entry = true;
+    }
+    if (r->filter_block != nullptr) {
+      r->filter_block->StartBlock(r->offset - r->filter_base);
+    }
+  }
+  if (ok()) {
+    r->status = r->file->Flush();
+  }
+  std::vector<std::string>().swap(r->buffered_blocks);
+  r->buffered_bytes = 0;
+}
+
+// Called right after the index entry of a data block is added, so the
+// filter holds the keys of exactly the data blocks in the partition.
+void TableBuilder::CutIndexPartition() {
+  Rep* r = rep_;
+  Rep::Partition partition;
+  partition.last_key = r->last_key;
+  partition.index = r->index_block.Finish().ToString();
+  r->index_block.Reset();
+  if (r->filter_block != nullptr) {
+    partition.filter = r->filter_block->Finish().ToString();
+    partition.filter_base = r->filter_base;
+    delete r->filter_block;
+    r->filter_block =
+        new FilterBlockBuilder(r->options.filter_policy, false, r->level);
+    r->filter_base = r->offset;
+    r->filter_block->StartBlock(0);
+  }
+  r->partitions.push_back(std::move(partition));
+}
+
 void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
+  WriteBlock(block->Finish(), false, handle);
+  block->Reset();
+}
+
+void TableBuilder::WriteBlock(const Slice& raw, bool is_data_block,
+                              BlockHandle* handle) {
   // File format contains a sequence of blocks where each block has:
   //    block_data: uint8[n]
   //    type: uint8
   //    crc: uint32
   assert(ok());
   Rep* r = rep_;
-  Slice raw = block->Finish();
   Slice block_contents;
   CompressionType type = r->options.compression;
   switch (type) {
@@ -155,8 +339,19 @@ void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
     }
     case kZstdCompression: {
       std::string* compressed = &r->compressed_output;
-      if (port::Zstd_Compress(r->options.zstd_compression_level, raw.data(),
-                              raw.size(), compressed) &&
+      if (r->zstd_context == nullptr) {
+        r->zstd_context = port::NewZstdCompressContext();
+      }
+      // Only data blocks use the dictionary: the index and metaindex
+      // blocks must be readable before it is loaded.
+      bool compressed_ok =
+          (is_data_block && r->zstd_dict != nullptr)
+              ? port::Zstd_Compress(r->zstd_context, r->zstd_dict,
+                                    raw.data(), raw.size(), compressed)
+              : port::Zstd_Compress(r->zstd_context,
+                                    r->options.zstd_compression_level,
+                                    raw.data(), raw.size(), compressed);
+      if (compressed_ok &&
           compressed->size() < raw.size() - (raw.size() / 8u)) {
         block_contents = *compressed;
       } else {
@@ -172,7 +367,6 @@ void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
   }
   WriteRawBlock(block_contents, type, handle);
   r->compressed_output.clear();
-  block->Reset();
 }
 
 void TableBuilder::WriteRawBlock(const Slice& block_contents,
@@ -199,25 +393,55 @@ Status TableBuilder::status() const { return rep_->status; }
 Status TableBuilder::Finish() {
   Rep* r = rep_;
   Flush();
+  if (ok() && r->buffering) {
+    EnterUnbuffered();
+  }
   assert(!r->closed);
   r->closed = true;
-  BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle;
+  BlockHandle filter_block_handle, zstd_dict_handle, metaindex_block_handle,
+      index_block_handle;
 
-  // Write filter block
-  if (ok() && r->filter_block != nullptr) {
+  // Write filter block; the partitions of a partitioned filter are
+  // written along with the index partitions.
+  if (ok() && r->filter_block != nullptr && !r->partitioned) {
     WriteRawBlock(r->filter_block->Finish(), kNoCompression,
                   &filter_block_handle);
   }
+
+  // Write zstd dictionary block
+  if (ok() && r->zstd_dict != nullptr) {
+    WriteRawBlock(r->zstd_dict_contents, kNoCompression, &zstd_dict_handle);
+  }
+
   // Write metaindex block
   if (ok()) {
     BlockBuilder meta_index_block(&r->options);
-    if (r->filter_block != nullptr) {
-      std::string key = "filter.";
+    // Keys must be added in sorted order.
+    if (r->filter_block != nullptr && !r->partitioned) {
+      std::string key = r->full_filter ? kFullFilterMetaPrefix : "filter.";
       key.append(r->options.filter_policy->Name());
       std::string handle_encoding;
       filter_block_handle.EncodeTo(&handle_encoding);
       meta_index_block.Add(key, handle_encoding);
     }
+    if (r->partitioned) {
+      meta_index_block.Add(kPartitionedIndexMetaKey, Slice());
+      if (r->filter_block != nullptr) {
+        std::string key = kPartitionedFilterMetaPrefix;
+        key.append(r->options.filter_policy->Name());
+        meta_index_block.Add(key, Slice());
+      }
+    }
+    if (r->prefix_extractor != nullptr) {
+      std::string key = kPrefixExtractorMetaPrefix;
+      key.append(r->prefix_extractor->Name());
+      meta_index_block.Add(key, Slice());
+    }
+    if (r->zstd_dict != nullptr) {
+      std::string handle_encoding;
+      zstd_dict_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add(kZstdDictionaryMetaKey, handle_encoding);
+    }
 
     // TODO(postrelease): Add stats and other meta blocks
     WriteBlock(&meta_index_block, &metaindex_block_handle);
@@ -232,7 +456,29 @@ Status TableBuilder::Finish() {
       r->index_block.Add(r->last_key, Slice(handle_encoding));
       r->pending_index_entry = false;
     }
-    WriteBlock(&r->index_block, &index_block_handle);
+    if (r->partitioned) {
+      if (!r->index_block.empty()) {
+        CutIndexPartition();
+      }
+      // Write the partitions, and the top-level index in index_block.
+      for (const Rep::Partition& partition : r->partitions) {
+        if (!ok()) break;
+        std::string entry;
+        BlockHandle handle;
+        WriteBlock(partition.index, false, &handle);
+        handle.EncodeTo(&entry);
+        if (ok() && r->filter_block != nullptr) {
+          WriteRawBlock(partition.filter, kNoCompression, &handle);
+          handle.EncodeTo(&entry);
+          PutVarint64(&entry, partition.filter_base);
+        }
+        r->index_block.Add(partition.last_key, entry);
+      }
+      std::vector<Rep::Partition>().swap(r->partitions);
+    }
+    if (ok()) {
+      WriteBlock(&r->index_block, &index_block_handle);
+    }
   }
 
   // Write footer
@@ -258,5 +504,9 @@ void TableBuilder::Abandon() {
 
 uint64_t TableBuilder::NumEntries() const { return rep_->num_entries; }
 
-uint64_t TableBuilder::FileSize() const { return rep_->offset; }
+uint64_t TableBuilder::FileSize() const {
+  // Blocks held to train a dictionary count at their uncompressed size,
+  // so that callers cutting files at a size stop before training ends.
+  return rep_->offset + rep_->buffered_bytes;
+}
 }  // namespace leveldb
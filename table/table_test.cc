@@ -4,6 +4,7 @@
 
 #include "leveldb/table.h"
 
+#include <cstdio>
 #include <map>
 #include <string>
 
@@ -15,6 +16,7 @@
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
 #include "leveldb/options.h"
+#include "leveldb/perf_context.h"
 #include "leveldb/table_builder.h"
 
 #include "table/block.h"
@@ -241,6 +243,10 @@ class TableConstructor : public Constructor {
     return table_->NewIterator(ReadOptions());
   }
 
+  Iterator* NewIterator(const ReadOptions& options) const {
+    return table_->NewIterator(options);
+  }
+
   uint64_t ApproximateOffsetOf(const Slice& key) const {
     return table_->ApproximateOffsetOf(key);
   }
@@ -374,7 +380,13 @@ class DBConstructor : public Constructor {
   DB* db_;
 };
 
-enum TestType { TABLE_TEST, BLOCK_TEST, MEMTABLE_TEST, DB_TEST };
+enum TestType {
+  TABLE_TEST,
+  PARTITIONED_TABLE_TEST,
+  BLOCK_TEST,
+  MEMTABLE_TEST,
+  DB_TEST
+};
 
 struct TestArgs {
   TestType type;
@@ -390,6 +402,11 @@ static const TestArgs kTestArgList[] = {
     {TABLE_TEST, true, 1},
     {TABLE_TEST, true, 1024},
 
+    // Tiny partitions, so that most tables have several
+    {PARTITIONED_TABLE_TEST, false, 16},
+    {PARTITIONED_TABLE_TEST, false, 1},
+    {PARTITIONED_TABLE_TEST, true, 16},
+
     {BLOCK_TEST, false, 16},
     {BLOCK_TEST, false, 1},
     {BLOCK_TEST, false, 1024},
@@ -427,6 +444,11 @@ class Harness : public testing::Test {
       case TABLE_TEST:
         constructor_ = new TableConstructor(options_.comparator);
         break;
+      case PARTITIONED_TABLE_TEST:
+        options_.partition_index_and_filters = true;
+        options_.metadata_block_size = 64;
+        constructor_ = new TableConstructor(options_.comparator);
+        break;
       case BLOCK_TEST:
         constructor_ = new BlockConstructor(options_.comparator);
         break;
@@ -788,6 +810,90 @@ TEST(TableTest, ApproximateOffsetOfPlain) {
   ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 610000, 612000));
 }
 
+TEST(TableTest, ApproximateOffsetOfPartitioned) {
+  TableConstructor c(BytewiseComparator());
+  for (int i = 0; i < 1000; i++) {
+    char key[20];
+    std::snprintf(key, sizeof(key), "k%04d", i);
+    c.Add(key, std::string(100, 'x'));
+  }
+  std::vector<std::string> keys;
+  KVMap kvmap;
+  Options options;
+  options.block_size = 1024;
+  options.compression = kNoCompression;
+  options.partition_index_and_filters = true;
+  options.metadata_block_size = 128;
+  c.Finish(options, &keys, &kvmap);
+
+  // The index partitions are written after the data blocks.
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("abc"), 0, 0));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k0500"), 50000, 55000));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k0999"), 100000, 110000));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 105000, 115000));
+}
+
+TEST(TableTest, IterateBounds) {
+  for (bool partitioned : {false, true}) {
+    TableConstructor c(BytewiseComparator());
+    for (int i = 0; i < 1000; i++) {
+      char key[20];
+      std::snprintf(key, sizeof(key), "k%04d", i);
+      c.Add(key, std::string(100, 'x'));
+    }
+    std::vector<std::string> keys;
+    KVMap kvmap;
+    Options options;
+    options.block_size = 1024;
+    options.compression = kNoCompression;
+    options.partition_index_and_filters = partitioned;
+    options.metadata_block_size = 128;
+    c.Finish(options, &keys, &kvmap);
+
+    Slice lower("k0500");
+    Slice upper("k0520");
+    ReadOptions ropts;
+    ropts.iterate_lower_bound = &lower;
+    ropts.iterate_upper_bound = &upper;
+    Iterator* iter = c.NewIterator(ropts);
+    SetPerfLevel(kEnableCount);
+    PerfContext* perf = GetPerfContext();
+
+    // Forward: only the blocks around the bounds are read, out of about
+    // a hundred
+    perf->Reset();
+    int count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      ASSERT_GE(iter->key().compare(lower), 0);
+      if (iter->key().compare(upper) < 0) count++;
+    }
+    ASSERT_LEVELDB_OK(iter->status());
+    ASSERT_EQ(20, count);
+    ASSERT_LE(perf->block_read_count, partitioned ? 8 : 4) << partitioned;
+
+    // Backward, from the last key before the upper bound
+    perf->Reset();
+    count = 0;
+    iter->SeekToLast();
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ("k0519", iter->key().ToString());
+    for (; iter->Valid(); iter->Prev()) {
+      ASSERT_LT(iter->key().compare(upper), 0);
+      if (iter->key().compare(lower) >= 0) count++;
+    }
+    ASSERT_LEVELDB_OK(iter->status());
+    ASSERT_EQ(20, count);
+    ASSERT_LE(perf->block_read_count, partitioned ? 8 : 4) << partitioned;
+
+    // Seek() is not confined by the bounds
+    iter->Seek("k0900");
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ("k0900", iter->key().ToString());
+    SetPerfLevel(kDisable);
+    delete iter;
+  }
+}
+
 static bool CompressionSupported(CompressionType type) {
   std::string out;
   Slice in = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
@@ -842,4 +948,127 @@ TEST_P(CompressionTableTest, ApproximateOffsetOfCompressed) {
   ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 2 * min_z, 2 * max_z));
 }
 
+TEST(TableTest, ZstdContextReuse) {
+  if (!CompressionSupported(kZstdCompression)) {
+    GTEST_SKIP() << "skipping zstd context test";
+  }
+
+  // One context of each kind serves many blocks of varying size and level.
+  Random rnd(301);
+  port::ZstdCompressContext* cctx = port::NewZstdCompressContext();
+  port::ZstdUncompressContext* dctx = port::NewZstdUncompressContext();
+  for (int i = 0; i < 50; i++) {
+    std::string raw, compressed;
+    test::CompressibleString(&rnd, 0.25, 100 + rnd.Uniform(8000), &raw);
+    ASSERT_TRUE(port::Zstd_Compress(cctx, 1 + i % 5, raw.data(), raw.size(),
+                                    &compressed));
+    size_t ulength;
+    ASSERT_TRUE(port::Zstd_GetUncompressedLength(compressed.data(),
+                                                 compressed.size(), &ulength));
+    ASSERT_EQ(raw.size(), ulength);
+    std::string uncompressed(ulength, '\0');
+    ASSERT_TRUE(port::Zstd_Uncompress(dctx, compressed.data(),
+                                      compressed.size(), &uncompressed[0]));
+    ASSERT_EQ(raw, uncompressed);
+  }
+  port::DeleteZstdCompressContext(cctx);
+  port::DeleteZstdUncompressContext(dctx);
+}
+
+static std::string JsonRecord(Random* rnd, int i) {
+  char buf[200];
+  std::snprintf(buf, sizeof(buf),
+                "{\"id\":%d,\"name\":\"user-%u\",\"email\":\"u%u@example.com\","
+                "\"active\":%s,\"score\":%u,\"tags\":[\"t%u\",\"t%u\"]}",
+                i, rnd->Uniform(100000), rnd->Uniform(100000),
+                rnd->OneIn(2) ? "true" : "false", rnd->Uniform(1000),
+                rnd->Uniform(50), rnd->Uniform(50));
+  return buf;
+}
+
+TEST(TableTest, ZstdDictionary) {
+  if (!CompressionSupported(kZstdCompression)) {
+    GTEST_SKIP() << "skipping zstd dictionary test";
+  }
+
+  // Enough data that training ends before the last block, so the file
+  // mixes blocks written from the training buffer and blocks written
+  // directly.
+  static const int kNumRecords = 5000;
+  for (int partitioned = 0; partitioned < 2; partitioned++) {
+    uint64_t size[2];
+    for (int use_dict = 0; use_dict < 2; use_dict++) {
+      Random rnd(301);
+      TableConstructor c(BytewiseComparator());
+      for (int i = 0; i < kNumRecords; i++) {
+        char key[20];
+        std::snprintf(key, sizeof(key), "user%06d", i);
+        c.Add(key, JsonRecord(&rnd, i));
+      }
+      std::vector<std::string> keys;
+      KVMap kvmap;
+      Options options;
+      options.block_size = 1024;
+      options.compression = kZstdCompression;
+      options.zstd_max_dict_bytes = use_dict ? 2048 : 0;
+      if (partitioned) {
+        // Index partitions are compressed, like the index, without the
+        // dictionary.
+        options.partition_index_and_filters = true;
+        options.metadata_block_size = 256;
+      }
+      c.Finish(options, &keys, &kvmap);
+
+      // The table is opened without the zstd options, so the dictionary
+      // must be found in the file itself.
+      Iterator* iter = c.NewIterator();
+      KVMap::const_iterator model = kvmap.begin();
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++model) {
+        ASSERT_TRUE(model != kvmap.end());
+        ASSERT_EQ(model->first, iter->key().ToString());
+        ASSERT_EQ(model->second, iter->value().ToString());
+      }
+      ASSERT_TRUE(model == kvmap.end());
+      ASSERT_LEVELDB_OK(iter->status());
+      iter->Seek("user004321");
+      ASSERT_TRUE(iter->Valid());
+      ASSERT_EQ(kvmap["user004321"], iter->value().ToString());
+      delete iter;
+
+      size[use_dict] = c.ApproximateOffsetOf("xyz");
+    }
+    // Small blocks of similar records compress better with a dictionary,
+    // even counting the dictionary itself.
+    ASSERT_LT(size[1], size[0]);
+  }
+}
+
+TEST(TableTest, ZstdDictionaryFileSize) {
+  if (!CompressionSupported(kZstdCompression)) {
+    GTEST_SKIP() << "skipping zstd dictionary test";
+  }
+
+  // The blocks buffered for training are counted while nothing is
+  // written, so that compactions can cut files at max_file_size.
+  Options options;
+  options.block_size = 1024;
+  options.compression = kZstdCompression;
+  options.zstd_max_dict_bytes = 64 << 10;
+  StringSink sink;
+  TableBuilder builder(options, &sink);
+  Random rnd(301);
+  uint64_t last_size = 0;
+  for (int i = 0; i < 5000; i++) {
+    char key[20];
+    std::snprintf(key, sizeof(key), "user%06d", i);
+    builder.Add(key, JsonRecord(&rnd, i));
+    ASSERT_GE(builder.FileSize(), last_size);
+    last_size = builder.FileSize();
+  }
+  ASSERT_TRUE(sink.contents().empty());
+  ASSERT_GT(last_size, 5000 * 100);
+  ASSERT_LEVELDB_OK(builder.Finish());
+  ASSERT_EQ(sink.contents().size(), builder.FileSize());
+}
+
 }  // namespace leveldb
@@ -1,5 +1,6 @@
 #include "table/two_level_iterator.h"
 
+#include "leveldb/comparator.h"
 #include "leveldb/options.h"
 #include "leveldb/table.h"
 
@@ -14,11 +15,17 @@ using BlockFunction = Iterator* (*)(void*, const ReadOptions&, const Slice&);
 
 class TwoLevelIterator : public Iterator {
  public:
-  explicit TwoLevelIterator(Iterator* index_iter, BlockFunction block_function,
-                            void* arg, const ReadOptions& options)
+  TwoLevelIterator(Iterator* index_iter, BlockFunction block_function,
+                   void* arg, const ReadOptions& options,
+                   const Comparator* comparator)
       : block_function_(block_function),
         arg_(arg),
         options_(options),
+        lower_bound_(comparator != nullptr ? options.iterate_lower_bound
+                                           : nullptr),
+        upper_bound_(comparator != nullptr ? options.iterate_upper_bound
+                                           : nullptr),
+        comparator_(comparator),
         index_iter_(index_iter),
         data_iter_(nullptr) {}
   ~TwoLevelIterator() override = default;
@@ -58,9 +65,26 @@ class TwoLevelIterator : public Iterator {
   void SkipEmptyDataBlocksForward();
   void SkipEmptyDataBlocksBackward();
 
+  // True if the blocks after the current one hold no key before
+  // upper_bound_: its index key is at or past the bound.
+  bool NextBlocksPastUpperBound() const {
+    return upper_bound_ != nullptr &&
+           comparator_->Compare(index_iter_.key(), *upper_bound_) >= 0;
+  }
+
+  // True if the current block, and those before it, hold no key at or
+  // after lower_bound_.
+  bool BlockBeforeLowerBound() const {
+    return lower_bound_ != nullptr &&
+           comparator_->Compare(index_iter_.key(), *lower_bound_) < 0;
+  }
+
   BlockFunction block_function_;
   void* arg_;
   const ReadOptions options_;
+  const Slice* const lower_bound_;  // May be null
+  const Slice* const upper_bound_;  // May be null
+  const Comparator* const comparator_;
   Status status_;
   IteratorWrapper index_iter_;
   IteratorWrapper data_iter_;  // May be nullptr
@@ -98,6 +122,10 @@ void TwoLevelIterator::SkipEmptyDataBlocksForward() {
       SetDataIterator(nullptr);
       return;
     }
+    if (NextBlocksPastUpperBound()) {
+      // Keep the exhausted block, which a SeekToLast() is likely to need
+      return;
+    }
     index_iter_.Next();
     InitDataBlock();
     if (data_iter_.iter() != nullptr) data_iter_.SeekToFirst();
@@ -111,6 +139,10 @@ void TwoLevelIterator::SkipEmptyDataBlocksBackward() {
       return;
     }
     index_iter_.Prev();
+    if (index_iter_.Valid() && BlockBeforeLowerBound()) {
+      SetDataIterator(nullptr);
+      return;
+    }
     InitDataBlock();
     if (data_iter_.iter() != nullptr) data_iter_.SeekToLast();
   }
@@ -124,6 +156,10 @@ void TwoLevelIterator::Seek(const Slice& target) {
 }
 
 void TwoLevelIterator::SeekToFirst() {
+  if (lower_bound_ != nullptr) {
+    Seek(*lower_bound_);
+    return;
+  }
   index_iter_.SeekToFirst();
   InitDataBlock();
   if (data_iter_.iter() != nullptr) data_iter_.SeekToFirst();
@@ -131,6 +167,25 @@ void TwoLevelIterator::SeekToFirst() {
 }
 
 void TwoLevelIterator::SeekToLast() {
+  if (upper_bound_ != nullptr) {
+    // Position at the last key before the bound: merging iterators rely
+    // on SeekToLast() not passing the keys a Seek() skipped.
+    index_iter_.Seek(*upper_bound_);
+    if (!index_iter_.Valid() && index_iter_.status().ok()) {
+      index_iter_.SeekToLast();
+    }
+    InitDataBlock();
+    if (data_iter_.iter() != nullptr) {
+      data_iter_.Seek(*upper_bound_);
+      if (data_iter_.Valid()) {
+        data_iter_.Prev();
+      } else if (data_iter_.status().ok()) {
+        data_iter_.SeekToLast();
+      }
+    }
+    SkipEmptyDataBlocksBackward();
+    return;
+  }
   index_iter_.SeekToLast();
   InitDataBlock();
   if (data_iter_.iter() != nullptr) data_iter_.SeekToLast();
@@ -153,8 +208,10 @@ void TwoLevelIterator::Prev() {
 
 Iterator* NewTwoLevelIterator(Iterator* index_iter,
                               BlockFunction block_function, void* arg,
-                              const ReadOptions& options) {
-  return new TwoLevelIterator(index_iter, block_function, arg, options);
+                              const ReadOptions& options,
+                              const Comparator* comparator) {
+  return new TwoLevelIterator(index_iter, block_function, arg, options,
+                              comparator);
 }
 
 }  // namespace leveldb
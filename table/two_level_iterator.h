@@ -9,6 +9,7 @@
 
 namespace leveldb {
 
+class Comparator;
 struct ReadOptions;
 
 // Return a new two level iterator.  A two-level iterator contains an
@@ -20,11 +21,19 @@ struct ReadOptions;
 //
 // Uses a supplied function to convert an index_iter value into
 // an iterator over the contents of the corresponding block.
+//
+// If "comparator" is non-null, the keys of "index_iter" must each be >=
+// the keys of their block and < the keys of the next one.  The iterator
+// then does not open the blocks that lie wholly outside
+// options.iterate_lower_bound and options.iterate_upper_bound, which it
+// compares with those keys, and starts SeekToFirst() and SeekToLast()
+// from the bounds.
 Iterator* NewTwoLevelIterator(
     Iterator* index_iter,
     Iterator* (*block_function)(void* arg, const ReadOptions& options,
                                 const Slice& index_value),
-    void* arg, const ReadOptions& options);
+    void* arg, const ReadOptions& options,
+    const Comparator* comparator = nullptr);
 
 }  // namespace leveldb
 
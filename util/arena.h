@@ -2,7 +2,12 @@
 #define LEVELDB_UTIL_ARENA_H
 #include <atomic>
 #include <cassert>
+#include <cstddef>
 #include <vector>
+
+#include "port/port.h"
+#include "port/thread_annotations.h"
+
 namespace leveldb {
 class Arena {
  public:
@@ -12,6 +17,13 @@ class Arena {
   ~Arena();
   char* Allocate(size_t bytes);
   char* AllocateAligned(size_t bytes);
+
+  // Like Allocate() and AllocateAligned(), but safe to call from several
+  // threads at once.  Calls to these must not overlap with calls to the
+  // two methods above.
+  char* AllocateConcurrently(size_t bytes);
+  char* AllocateAlignedConcurrently(size_t bytes);
+
   size_t MemoryUsage() const {
     return memory_usage_.load(std::memory_order_relaxed);
   }
@@ -23,6 +35,9 @@ class Arena {
   size_t alloc_bytes_remaining_;
   std::vector<char*> blocks_;
   std::atomic<size_t> memory_usage_;
+
+  // Serializes the concurrent allocation methods
+  port::Mutex mu_;
 };
 
 inline char* Arena::Allocate(size_t bytes) {
@@ -37,6 +52,20 @@ inline char* Arena::Allocate(size_t bytes) {
   }
 }
 
+inline char* Arena::AllocateConcurrently(size_t bytes) {
+  mu_.Lock();
+  char* result = Allocate(bytes);
+  mu_.Unlock();
+  return result;
+}
+
+inline char* Arena::AllocateAlignedConcurrently(size_t bytes) {
+  mu_.Lock();
+  char* result = AllocateAligned(bytes);
+  mu_.Unlock();
+  return result;
+}
+
 }  // namespace leveldb
 
 #endif  // LEVELDB_UTIL_ARENA_H
\ No newline at end of file
@@ -2,6 +2,14 @@
 #include "leveldb/slice.h"
 
 #include "util/hash.h"
+#include "util/ribbon.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define LEVELDB_BLOOM_AVX2 1
+#else
+#define LEVELDB_BLOOM_AVX2 0
+#endif
 
 namespace leveldb {
 
@@ -10,6 +18,116 @@ static uint32_t BloomHash(const Slice& key) {
   return Hash(key.data(), key.size(), 0xbc9f1d34);
 }
 
+// The filters of BlockedBloomFilterPolicy are made of 64-byte lines.
+// Each key sets all its bits in the one line its hash selects, so
+// probing it touches a single cache line (or two, if the filter is not
+// 64-byte aligned) instead of one per bit.  Crowding the bits of a key
+// into one line costs some accuracy, which using fewer probes mostly
+// wins back.
+//
+// Filter layout:
+//    line: char[64]   (repeated)
+//    num_probes: uint8
+//    kBlockedMarker: uint8
+//
+// The last byte of the filters of BloomFilterPolicy is their number of
+// probes, at most 30, so both policies can tell the two formats apart
+// and read either.
+constexpr size_t kLineBytes = 64;
+constexpr size_t kLineBits = kLineBytes * 8;
+constexpr char kBlockedMarker = static_cast<char>(0xff);
+constexpr uint32_t kProbeMultiplier = 0x9e3779b9;
+
+bool IsBlockedFilter(const Slice& filter) {
+  const size_t len = filter.size();
+  return len >= kLineBytes + 2 && (len - 2) % kLineBytes == 0 &&
+         filter[len - 1] == kBlockedMarker;
+}
+
+// Map "h" onto [0, num_lines) by its high bits, which FirstProbe()
+// mixes away, so line and bit choices look independent.
+uint32_t LineIndex(uint32_t h, uint32_t num_lines) {
+  return static_cast<uint32_t>((static_cast<uint64_t>(h) * num_lines) >> 32);
+}
+
+// Probe j of a key tests bit (FirstProbe(h) * kProbeMultiplier^j) >> 23
+// of its line.
+uint32_t FirstProbe(uint32_t h) {
+  return ((h << 16) | (h >> 16)) * kProbeMultiplier;
+}
+
+bool LineMayMatchPortable(const char* line, uint32_t h2, int num_probes) {
+  for (int j = 0; j < num_probes; j++) {
+    const uint32_t bitpos = h2 >> 23;  // 9 bits: [0, kLineBits)
+    if ((line[bitpos / 8] & (1 << (bitpos % 8))) == 0) return false;
+    h2 *= kProbeMultiplier;
+  }
+  return true;
+}
+
+#if LEVELDB_BLOOM_AVX2
+// Same as LineMayMatchPortable(), eight probes at a time.  Bit b of the
+// line is bit b % 32 of its little-endian 32-bit word b / 32.
+__attribute__((target("avx2"))) bool LineMayMatchAVX2(const char* line,
+                                                       uint32_t h2,
+                                                       int num_probes) {
+  // kProbeMultiplier^0 .. kProbeMultiplier^7
+  const __m256i multipliers = _mm256_setr_epi32(
+      0x00000001, 0x9e3779b9, 0xe35e67b1, 0x734297e9, 0x35fbe861, 0xdeb7c719,
+      0x448b211, 0x3459b749);
+  const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256i low_words =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(line));
+  const __m256i high_words =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(line + 32));
+  for (;;) {
+    const __m256i hashes =
+        _mm256_mullo_epi32(_mm256_set1_epi32(h2), multipliers);
+    const __m256i word_index = _mm256_srli_epi32(hashes, 28);
+    const __m256i words = _mm256_blendv_epi8(
+        _mm256_permutevar8x32_epi32(low_words, word_index),
+        _mm256_permutevar8x32_epi32(high_words, word_index),
+        _mm256_cmpgt_epi32(word_index, _mm256_set1_epi32(7)));
+    const __m256i bits = _mm256_sllv_epi32(
+        _mm256_set1_epi32(1),
+        _mm256_and_si256(_mm256_srli_epi32(hashes, 23), _mm256_set1_epi32(31)));
+    // Lanes past the last probe are ignored
+    const __m256i active =
+        _mm256_cmpgt_epi32(_mm256_set1_epi32(num_probes), lanes);
+    const __m256i missing =
+        _mm256_and_si256(_mm256_andnot_si256(words, bits), active);
+    if (!_mm256_testz_si256(missing, missing)) {
+      return false;
+    }
+    if (num_probes <= 8) {
+      return true;
+    }
+    num_probes -= 8;
+    h2 *= 0xab25f4c1;  // kProbeMultiplier^8
+  }
+}
+
+bool HaveAVX2() {
+  static const bool have_avx2 = __builtin_cpu_supports("avx2");
+  return have_avx2;
+}
+#endif  // LEVELDB_BLOOM_AVX2
+
+// REQUIRES: IsBlockedFilter(filter)
+bool BlockedFilterMayMatch(const Slice& key, const Slice& filter) {
+  const size_t len = filter.size();
+  const uint32_t num_lines = static_cast<uint32_t>((len - 2) / kLineBytes);
+  const int num_probes = static_cast<uint8_t>(filter[len - 2]);
+  const uint32_t h = BloomHash(key);
+  const char* line = filter.data() + LineIndex(h, num_lines) * kLineBytes;
+#if LEVELDB_BLOOM_AVX2
+  if (HaveAVX2()) {
+    return LineMayMatchAVX2(line, FirstProbe(h), num_probes);
+  }
+#endif  // LEVELDB_BLOOM_AVX2
+  return LineMayMatchPortable(line, FirstProbe(h), num_probes);
+}
+
 class BloomFilterPolicy : public FilterPolicy {
  public:
   // 通过k个无偏hash函数计算得到k个hash值
@@ -53,9 +171,20 @@ class BloomFilterPolicy : public FilterPolicy {
   bool KeyMayMatch(const Slice& key, const Slice& bloom_filter) const override {
     const size_t len=bloom_filter.size();
     if(len<2) return false;
+    if (IsBlockedFilter(bloom_filter)) {
+      return BlockedFilterMayMatch(key, bloom_filter);
+    }
+    if (IsRibbonFilter(bloom_filter)) {
+      return RibbonFilterMayMatch(key, bloom_filter);
+    }
     const char* array=bloom_filter.data();
     const size_t bits=8*(len-1);
-    const size_t k = array[len - 1];
+    const size_t k = static_cast<uint8_t>(array[len - 1]);
+    if (k > 30) {
+      // Reserved for potentially new encodings for short bloom filters.
+      // Consider it a match.
+      return true;
+    }
 
     uint32_t h = BloomHash(key);
     const uint32_t delta = (h >> 17) | (h << 15);  // Rotate right 17 bits
@@ -72,10 +201,64 @@ class BloomFilterPolicy : public FilterPolicy {
   size_t k_;
 };
 
+class BlockedBloomFilterPolicy : public FilterPolicy {
+ public:
+  explicit BlockedBloomFilterPolicy(int bits_per_key)
+      : bits_per_key_(bits_per_key < 1 ? 1 : bits_per_key) {
+    // Bits crowd into single lines, so fewer probes than the ln(2) ratio
+    // of a standard bloom filter do best.
+    num_probes_ = static_cast<int>(bits_per_key_ * 0.6);
+    if (num_probes_ < 1) num_probes_ = 1;
+    if (num_probes_ > 16) num_probes_ = 16;
+  }
+
+  // Shared with BloomFilterPolicy, which reads the same filters, so that
+  // the filters of existing tables stay in use when switching policies.
+  const char* Name() const override { return "leveldb.BuiltinBloomFilter2"; }
+
+  void CreateFilter(const Slice* keys, int n, std::string* dst) const override {
+    uint32_t num_lines = static_cast<uint32_t>(
+        (static_cast<size_t>(n) * bits_per_key_ + kLineBits - 1) / kLineBits);
+    if (num_lines == 0) num_lines = 1;
+
+    const size_t init_size = dst->size();
+    dst->resize(init_size + num_lines * kLineBytes, 0);
+    dst->push_back(static_cast<char>(num_probes_));
+    dst->push_back(kBlockedMarker);
+    char* array = &(*dst)[init_size];
+    for (int i = 0; i < n; i++) {
+      const uint32_t h = BloomHash(keys[i]);
+      char* line = array + LineIndex(h, num_lines) * kLineBytes;
+      uint32_t h2 = FirstProbe(h);
+      for (int j = 0; j < num_probes_; j++) {
+        const uint32_t bitpos = h2 >> 23;
+        line[bitpos / 8] |= (1 << (bitpos % 8));
+        h2 *= kProbeMultiplier;
+      }
+    }
+  }
+
+  bool KeyMayMatch(const Slice& key, const Slice& filter) const override {
+    if (IsBlockedFilter(filter)) {
+      return BlockedFilterMayMatch(key, filter);
+    }
+    return legacy_.KeyMayMatch(key, filter);
+  }
+
+ private:
+  size_t bits_per_key_;
+  int num_probes_;
+  BloomFilterPolicy legacy_{10};  // Only reads filters
+};
+
 }  // namespace
 
 const FilterPolicy* NewBloomFilterPolicy(int bits_per_key) {
   return new BloomFilterPolicy(bits_per_key);
 }
 
+const FilterPolicy* NewBlockedBloomFilterPolicy(int bits_per_key) {
+  return new BlockedBloomFilterPolicy(bits_per_key);
+}
+
 }  // namespace leveldb
@@ -15,7 +15,8 @@ static Slice Key(int i, char* buffer) {
 
 class BloomTest : public testing::Test {
  public:
-  BloomTest() : policy_(NewBloomFilterPolicy(10)) {}
+  explicit BloomTest(const FilterPolicy* policy = NewBloomFilterPolicy(10))
+      : policy_(policy) {}
   ~BloomTest() { delete policy_; }
   void Reset() {
     keys_.clear();
@@ -143,4 +144,118 @@ TEST_F(BloomTest, VaryingLengths) {
 
 // Different bits-per-byte
 
+class BlockedBloomTest : public BloomTest {
+ public:
+  BlockedBloomTest() : BloomTest(NewBlockedBloomFilterPolicy(10)) {}
+};
+
+TEST_F(BlockedBloomTest, Small) {
+  Add("hello");
+  Add("world");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(!Matches("x"));
+  ASSERT_TRUE(!Matches("foo"));
+}
+
+TEST_F(BlockedBloomTest, VaryingLengths) {
+  char buffer[sizeof(int)];
+
+  // Count number of filters that significantly exceed the false positive rate
+  int mediocre_filters = 0;
+  int good_filters = 0;
+
+  for (int length = 1; length <= 100000; length = NextLength(length)) {
+    Reset();
+    for (int i = 0; i < length; i++) {
+      Add(Key(i, buffer));
+    }
+    Build();
+
+    // Whole 64-byte lines, and two bytes of trailer
+    ASSERT_LE(FilterSize(), static_cast<size_t>((length * 10 / 8) + 64 + 2))
+        << length;
+    ASSERT_EQ(2, FilterSize() % 64);
+
+    // All added keys must match
+    for (int i = 0; i < length; i++) {
+      ASSERT_TRUE(Matches(Key(i, buffer)))
+          << "Length " << length << "; key " << i;
+    }
+
+    // Check false positive rate
+    double rate = FalsePositiveRate();
+    if (kVerbose >= 1) {
+      std::fprintf(stderr,
+                   "False positives: %5.2f%% @ length = %6d ; bytes = %6d\n",
+                   rate * 100.0, length, static_cast<int>(FilterSize()));
+    }
+    ASSERT_LE(rate, 0.025);  // Must not be over 2.5%
+    if (rate > 0.015)
+      mediocre_filters++;  // Allowed, but not too often
+    else
+      good_filters++;
+  }
+  if (kVerbose >= 1) {
+    std::fprintf(stderr, "Filters: %d good, %d mediocre\n", good_filters,
+                 mediocre_filters);
+  }
+  ASSERT_LE(mediocre_filters, good_filters / 5);
+}
+
+TEST(BlockedBloomFormatTest, ReadEitherFormat) {
+  // Both policies read the filters of the other, under one name
+  const FilterPolicy* bloom = NewBloomFilterPolicy(10);
+  const FilterPolicy* blocked = NewBlockedBloomFilterPolicy(10);
+  ASSERT_EQ(std::string(bloom->Name()), std::string(blocked->Name()));
+
+  char buffer[sizeof(int)];
+  std::vector<std::string> keys;
+  for (int i = 0; i < 1000; i++) {
+    keys.push_back(Key(i, buffer).ToString());
+  }
+  std::vector<Slice> key_slices(keys.begin(), keys.end());
+  for (const FilterPolicy* writer : {bloom, blocked}) {
+    std::string filter;
+    writer->CreateFilter(&key_slices[0], static_cast<int>(key_slices.size()),
+                         &filter);
+    for (const FilterPolicy* reader : {bloom, blocked}) {
+      int false_positives = 0;
+      for (int i = 0; i < 1000; i++) {
+        ASSERT_TRUE(reader->KeyMayMatch(key_slices[i], filter)) << i;
+        if (reader->KeyMayMatch(Key(i + 1000000000, buffer), filter)) {
+          false_positives++;
+        }
+      }
+      ASSERT_LE(false_positives, 25);
+    }
+  }
+  delete blocked;
+  delete bloom;
+}
+
+TEST(BlockedBloomFormatTest, ManyProbes) {
+  // More probes than one batch of the vectorized path
+  const FilterPolicy* policy = NewBlockedBloomFilterPolicy(25);
+  char buffer[sizeof(int)];
+  std::vector<std::string> keys;
+  for (int i = 0; i < 500; i++) {
+    keys.push_back(Key(i, buffer).ToString());
+  }
+  std::vector<Slice> key_slices(keys.begin(), keys.end());
+  std::string filter;
+  policy->CreateFilter(&key_slices[0], static_cast<int>(key_slices.size()),
+                       &filter);
+  ASSERT_EQ(15, filter[filter.size() - 2]);
+  int false_positives = 0;
+  for (int i = 0; i < 500; i++) {
+    ASSERT_TRUE(policy->KeyMayMatch(key_slices[i], filter)) << i;
+    if (policy->KeyMayMatch(Key(i + 1000000000, buffer), filter)) {
+      false_positives++;
+    }
+  }
+  ASSERT_LE(false_positives, 5);
+  delete policy;
+}
+
 }  // namespace leveldb
\ No newline at end of file
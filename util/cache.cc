@@ -18,6 +18,9 @@ struct LRUHandle {
   size_t charge;
   size_t key_length;
   bool in_cache;
+  bool is_high_pri;       // Inserted with Cache::Priority::kHigh
+  bool has_hit;           // Returned by Lookup() at least once
+  bool in_high_pri_pool;  // On lru_, on the high-priority side of the split
   uint32_t refs;
   uint32_t hash;
   char key_data[1];
@@ -125,10 +128,15 @@ class LRUCache {
   LRUCache();
   ~LRUCache();
 
-  void SetCapacity(size_t capacity) { capacity_ = capacity; }
+  void SetCapacity(size_t capacity, double high_pri_pool_ratio) {
+    capacity_ = capacity;
+    high_pri_pool_capacity_ =
+        static_cast<size_t>(capacity * high_pri_pool_ratio);
+  }
   Cache::Handle* Insert(const Slice& key, uint32_t hash, void* value,
                         size_t charge,
-                        void (*deleter)(const Slice& key, void* value));
+                        void (*deleter)(const Slice& key, void* value),
+                        Cache::Priority priority);
   Cache::Handle* Lookup(const Slice& key, uint32_t hash);
   void Release(Cache::Handle* handle);
   void Erase(const Slice& key, uint32_t hash);  // 从缓存中删除节点
@@ -142,24 +150,46 @@ class LRUCache {
  private:
   void LRU_Remove(LRUHandle* e);
   void LRU_Append(LRUHandle* list, LRUHandle* e);
+  // Put an unreferenced entry back on lru_: high-priority and
+  // previously hit entries become the newest entry, others are inserted
+  // at the split, as the newest low-priority entry.
+  void LRU_Insert(LRUHandle* e) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Move the oldest high-priority entries to the low-priority side until
+  // the high-priority side fits high_pri_pool_capacity_.
+  void MaintainPoolSize() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   void Ref(LRUHandle* e);
   void Unref(LRUHandle* e);  // 节点引用等于0 ，才能调用free函数
 
   bool FinishErase(LRUHandle* e) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   size_t capacity_;
+  size_t high_pri_pool_capacity_;
   mutable port::Mutex mutex_;
   size_t usage_ GUARDED_BY(mutex_);
   LRUHandle lru_
       GUARDED_BY(mutex_);  // lru.prev is newest entry, lru.next is oldest
                            // entry;Entries have refs==1 and in_cache==true
 
+  // lru_ is split in two: the older entries, up to and including
+  // *lru_low_pri_, are the low-priority side and get evicted first; the
+  // newer ones are the high-priority side, whose charge is
+  // high_pri_pool_usage_.  Entries seen only once, such as blocks read
+  // by a scan, never reach the high-priority side, so they cannot push
+  // out entries that are read again.
+  LRUHandle* lru_low_pri_ GUARDED_BY(mutex_);
+  size_t high_pri_pool_usage_ GUARDED_BY(mutex_);
+
   LRUHandle in_use_ GUARDED_BY(mutex_);  // Entries are in use by clients, and
                                          // have refs >= 2 and in_cache==true
 
   HandleTable table_ GUARDED_BY(mutex_);
 };
 
-LRUCache::LRUCache() : capacity_(0), usage_(0) {
+LRUCache::LRUCache()
+    : capacity_(0),
+      high_pri_pool_capacity_(0),
+      usage_(0),
+      lru_low_pri_(&lru_),
+      high_pri_pool_usage_(0) {
   lru_.next = &lru_;
   lru_.prev = &lru_;
   in_use_.next = &in_use_;
@@ -195,15 +225,49 @@ void LRUCache::Unref(LRUHandle* e) {
     free(e);
   } else if (e->refs == 1 && e->in_cache) {
     LRU_Remove(e);
-    LRU_Append(&lru_, e);
+    LRU_Insert(e);
   }
 }
 
 void LRUCache::LRU_Remove(LRUHandle* e) {
+  if (lru_low_pri_ == e) {
+    lru_low_pri_ = e->prev;
+  }
+  if (e->in_high_pri_pool) {
+    assert(high_pri_pool_usage_ >= e->charge);
+    high_pri_pool_usage_ -= e->charge;
+    e->in_high_pri_pool = false;
+  }
   e->next->prev = e->prev;
   e->prev->next = e->next;
 }
 
+void LRUCache::LRU_Insert(LRUHandle* e) {
+  if (high_pri_pool_capacity_ > 0 && (e->is_high_pri || e->has_hit)) {
+    LRU_Append(&lru_, e);
+    e->in_high_pri_pool = true;
+    high_pri_pool_usage_ += e->charge;
+    MaintainPoolSize();
+  } else {
+    // Insert just after *lru_low_pri_.
+    e->next = lru_low_pri_->next;
+    e->prev = lru_low_pri_;
+    e->prev->next = e;
+    e->next->prev = e;
+    lru_low_pri_ = e;
+  }
+}
+
+void LRUCache::MaintainPoolSize() {
+  while (high_pri_pool_usage_ > high_pri_pool_capacity_) {
+    lru_low_pri_ = lru_low_pri_->next;
+    assert(lru_low_pri_ != &lru_);
+    assert(lru_low_pri_->in_high_pri_pool);
+    lru_low_pri_->in_high_pri_pool = false;
+    high_pri_pool_usage_ -= lru_low_pri_->charge;
+  }
+}
+
 // make "e" newest entry by inserting just before *list
 void LRUCache::LRU_Append(LRUHandle* list, LRUHandle* e) {
   e->next = list;
@@ -216,6 +280,7 @@ Cache::Handle* LRUCache::Lookup(const Slice& key, uint32_t hash) {
   MutexLock l(&mutex_);
   LRUHandle* e = table_.Lookup(key, hash);
   if (e != nullptr) {
+    e->has_hit = true;
     Ref(e);
   }
   return reinterpret_cast<Cache::Handle*>(e);
@@ -228,8 +293,8 @@ void LRUCache::Release(Cache::Handle* handle) {
 
 Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value,
                                 size_t charge,
-                                void (*deleter)(const Slice& key,
-                                                void* value)) {
+                                void (*deleter)(const Slice& key, void* value),
+                                Cache::Priority priority) {
   MutexLock l(&mutex_);
   LRUHandle* e =
       reinterpret_cast<LRUHandle*>(malloc(sizeof(LRUHandle) - 1 + key.size()));
@@ -239,6 +304,9 @@ Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value,
   e->key_length = key.size();
   e->hash = hash;
   e->in_cache = false;
+  e->is_high_pri = (priority == Cache::Priority::kHigh);
+  e->has_hit = false;
+  e->in_high_pri_pool = false;
   e->refs = 1;
   std::memcpy(e->key_data, key.data(), key.size());
 
@@ -317,17 +385,24 @@ class ShardedLRUCache : public Cache {
   static uint32_t Shard(uint32_t hash) { return hash >> (32 - kNumShardBits); }
 
  public:
-  explicit ShardedLRUCache(size_t capacity) : last_id_(0) {
+  ShardedLRUCache(size_t capacity, double high_pri_pool_ratio)
+      : last_id_(0) {
     const size_t per_shard = (capacity + kNumShards - 1) / kNumShards;
     for (int s = 0; s < kNumShards; s++) {
-      shards_[s].SetCapacity(per_shard);
+      shards_[s].SetCapacity(per_shard, high_pri_pool_ratio);
     }
   }
   ~ShardedLRUCache() override{};
   Handle* Insert(const Slice& key, void* value, size_t charge,
                  void (*deleter)(const Slice& key, void* value)) override {
+    return Insert(key, value, charge, deleter, Priority::kLow);
+  }
+  Handle* Insert(const Slice& key, void* value, size_t charge,
+                 void (*deleter)(const Slice& key, void* value),
+                 Priority priority) override {
     const uint32_t hash = HashSlice(key);
-    return shards_[Shard(hash)].Insert(key, hash, value, charge, deleter);
+    return shards_[Shard(hash)].Insert(key, hash, value, charge, deleter,
+                                       priority);
   }
 
   Handle* Lookup(const Slice& key) override {
@@ -368,5 +443,12 @@ class ShardedLRUCache : public Cache {
 };
 
 }  // namespace
-Cache* NewLRUCache(size_t capacity) { return new ShardedLRUCache(capacity); }
+Cache* NewLRUCache(size_t capacity, double high_pri_pool_ratio) {
+  if (high_pri_pool_ratio < 0) {
+    high_pri_pool_ratio = 0;
+  } else if (high_pri_pool_ratio > 1) {
+    high_pri_pool_ratio = 1;
+  }
+  return new ShardedLRUCache(capacity, high_pri_pool_ratio);
+}
 }  // namespace leveldb
\ No newline at end of file
@@ -25,6 +25,8 @@ class CacheTest : public testing::Test {
     current_->deleted_values_.push_back(DecodeValue(v));
   }
   static constexpr int kCacheSize = 1000;
+  // The capacity is split evenly between the shards, rounding up.
+  static constexpr int kNumShardsSlack = 16;
   std::vector<int> deleted_keys_;
   std::vector<int> deleted_values_;
   Cache* cache_;
@@ -202,6 +204,58 @@ TEST_F(CacheTest, Prune) {
   ASSERT_EQ(-1, Lookup(2));
 }
 
+TEST_F(CacheTest, MidpointInsertion) {
+  delete cache_;
+  cache_ = NewLRUCache(kCacheSize, 0.5);
+
+  // Entries that are read again move to the high-priority pool...
+  for (int i = 0; i < 100; i++) {
+    Insert(i, 1000 + i);
+    ASSERT_EQ(1000 + i, Lookup(i));
+  }
+
+  // ...where a scan inserting many entries once does not reach them.
+  for (int i = 0; i < 4 * kCacheSize; i++) {
+    Insert(10000 + i, i);
+  }
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(1000 + i, Lookup(i));
+  }
+  ASSERT_EQ(-1, Lookup(10000));
+  ASSERT_LE(cache_->TotalCharge(), kCacheSize + kNumShardsSlack);
+}
+
+TEST_F(CacheTest, HighPriorityEntries) {
+  delete cache_;
+  cache_ = NewLRUCache(kCacheSize, 0.5);
+
+  for (int i = 0; i < 100; i++) {
+    cache_->Release(cache_->Insert(EncodeKey(i), EncodeValue(1000 + i), 1,
+                                   &Deleter, Cache::Priority::kHigh));
+  }
+  for (int i = 0; i < 4 * kCacheSize; i++) {
+    Insert(10000 + i, i);
+  }
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(1000 + i, Lookup(i));
+  }
+}
+
+TEST_F(CacheTest, HighPriorityPoolIsBounded) {
+  delete cache_;
+  cache_ = NewLRUCache(kCacheSize, 0.5);
+
+  // Once the high-priority pool is full, its oldest entries compete with
+  // the low-priority ones again.
+  for (int i = 0; i < 4 * kCacheSize; i++) {
+    Insert(i, 1000 + i);
+    ASSERT_EQ(1000 + i, Lookup(i));
+  }
+  ASSERT_EQ(-1, Lookup(0));
+  ASSERT_EQ(1000 + 4 * kCacheSize - 1, Lookup(4 * kCacheSize - 1));
+  ASSERT_LE(cache_->TotalCharge(), kCacheSize + kNumShardsSlack);
+}
+
 TEST_F(CacheTest, ZeroSizeCache) {
   delete cache_;
   cache_ = NewLRUCache(0);
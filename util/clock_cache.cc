@@ -0,0 +1,458 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A Cache whose shards are fixed-size open-addressed tables of entries.
+// Each entry has one atomic word holding its state, its reference count
+// and its CLOCK counter, so Lookup() and Release() are a few atomic
+// operations on that word and never take a lock.  Insert(), Erase() and
+// Prune() change which entries the table holds; they are serialized by a
+// per-shard mutex, which also owns the CLOCK hand.
+//
+// Entry states:
+//   kEmpty:        The slot holds nothing.
+//   kConstruction: One thread owns the slot and is filling or freeing it.
+//   kVisible:      The entry can be found by Lookup().
+//   kInvisible:    The entry was erased or replaced while it had handles;
+//                  the last Release() frees it.
+//   kDetached:     A handle that was never put in a table (no capacity or
+//                  no free slot).  Release() frees it.
+//
+// Lookup() takes its reference before looking at the entry's key, and
+// gives it back if the entry turns out not to match; moving an entry out
+// of kVisible or kInvisible requires a compare-and-swap from zero
+// references, so an entry cannot be freed under a thread that holds one.
+//
+// Every slot also counts the entries whose probe sequence passed over it
+// on the way to their own slot ("displacements"); a lookup can stop at
+// the first slot that neither matches nor has been passed over.
+
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+#include "leveldb/cache.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/hash.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+namespace {
+
+// Layout of ClockHandle::meta.
+constexpr int kClockShift = 32;
+constexpr int kStateShift = 34;
+constexpr uint64_t kRefsMask = 0xffffffffu;
+constexpr uint64_t kClockMask = uint64_t{3} << kClockShift;
+constexpr uint64_t kOneClock = uint64_t{1} << kClockShift;
+
+enum : uint64_t {
+  kEmpty = 0,
+  kConstruction = 1,
+  kVisible = 2,
+  kInvisible = 3,
+  kDetached = 4,
+};
+
+constexpr uint32_t Refs(uint64_t meta) {
+  return static_cast<uint32_t>(meta & kRefsMask);
+}
+constexpr uint64_t Clock(uint64_t meta) {
+  return (meta & kClockMask) >> kClockShift;
+}
+constexpr uint64_t State(uint64_t meta) { return meta >> kStateShift; }
+
+struct ClockHandle {
+  std::atomic<uint64_t> meta{0};
+  std::atomic<uint32_t> displacements{0};
+  // Read before a reference is held, so it is atomic; the fields below
+  // are only read while holding one.
+  std::atomic<uint32_t> hash{0};
+  char* key_data = nullptr;
+  size_t key_length = 0;
+  void* value = nullptr;
+  void (*deleter)(const Slice& key, void* value) = nullptr;
+  size_t charge = 0;
+
+  Slice key() const { return Slice(key_data, key_length); }
+};
+
+// Entries are sized so that a shard at capacity uses about this many
+// slots per entry.
+constexpr size_t kSlotsPerEntry = 2;
+
+class ClockCacheShard {
+ public:
+  ClockCacheShard() : capacity_(0), length_(0), slots_(nullptr), usage_(0),
+                      occupancy_(0), clock_hand_(0) {}
+  ~ClockCacheShard();
+
+  ClockCacheShard(const ClockCacheShard&) = delete;
+  ClockCacheShard& operator=(const ClockCacheShard&) = delete;
+
+  void Init(size_t capacity, size_t estimated_entry_charge);
+
+  Cache::Handle* Insert(const Slice& key, uint32_t hash, void* value,
+                        size_t charge,
+                        void (*deleter)(const Slice& key, void* value),
+                        Cache::Priority priority);
+  Cache::Handle* Lookup(const Slice& key, uint32_t hash);
+  void Release(ClockHandle* h) { Unref(h); }
+  void Erase(const Slice& key, uint32_t hash);
+  void Prune();
+  size_t TotalCharge() const {
+    return usage_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  uint32_t Home(uint32_t hash) const { return hash & (length_ - 1); }
+  // Odd, so that the probe sequence visits every slot.
+  static uint32_t Increment(uint32_t hash) { return ((hash >> 12) << 1) | 1; }
+
+  // Return the visible entry for "key" with a reference held, or nullptr.
+  // If "touch" is true, a found entry gets the highest CLOCK count.
+  ClockHandle* Find(const Slice& key, uint32_t hash, bool touch);
+
+  // Drop a reference, freeing the entry if it was the last one to an
+  // invisible entry.
+  void Unref(ClockHandle* h);
+
+  // Move *h from kVisible to kInvisible.
+  // REQUIRES: *h is visible and a reference to it is held.
+  void MakeInvisible(ClockHandle* h) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Run the deleter of *h and return its slot to kEmpty.
+  // REQUIRES: the caller moved *h to kConstruction.
+  void Free(ClockHandle* h);
+
+  // Advance the CLOCK hand until one unreferenced entry is evicted.
+  // Returns false if a full sweep found nothing to evict.
+  bool EvictOne() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  size_t capacity_;
+  uint32_t length_;  // A power of two
+  ClockHandle* slots_;
+  std::atomic<size_t> usage_;
+  std::atomic<uint32_t> occupancy_;  // Slots not kEmpty
+  port::Mutex mutex_;
+  uint32_t clock_hand_ GUARDED_BY(mutex_);
+};
+
+void ClockCacheShard::Init(size_t capacity, size_t estimated_entry_charge) {
+  capacity_ = capacity;
+  const size_t entries =
+      (capacity + estimated_entry_charge - 1) / estimated_entry_charge;
+  length_ = 16;
+  while (length_ < entries * kSlotsPerEntry && length_ < (1u << 30)) {
+    length_ *= 2;
+  }
+  slots_ = new ClockHandle[length_];
+}
+
+ClockCacheShard::~ClockCacheShard() {
+  for (uint32_t i = 0; i < length_; i++) {
+    ClockHandle* h = &slots_[i];
+    const uint64_t meta = h->meta.load(std::memory_order_relaxed);
+    if (State(meta) == kVisible || State(meta) == kInvisible) {
+      assert(Refs(meta) == 0);  // Error if caller has an unreleased handle
+      h->meta.store(kConstruction << kStateShift, std::memory_order_relaxed);
+      Free(h);
+    }
+  }
+  delete[] slots_;
+}
+
+ClockHandle* ClockCacheShard::Find(const Slice& key, uint32_t hash,
+                                   bool touch) {
+  const uint32_t increment = Increment(hash);
+  uint32_t index = Home(hash);
+  for (uint32_t probe = 0; probe < length_; probe++) {
+    ClockHandle* h = &slots_[index];
+    if (State(h->meta.load(std::memory_order_relaxed)) == kVisible &&
+        h->hash.load(std::memory_order_relaxed) == hash) {
+      const uint64_t old = h->meta.fetch_add(1, std::memory_order_acquire);
+      if (State(old) == kVisible &&
+          h->hash.load(std::memory_order_relaxed) == hash &&
+          h->key() == key) {
+        if (touch && Clock(old) != 3) {
+          h->meta.fetch_or(kClockMask, std::memory_order_relaxed);
+        }
+        return h;
+      }
+      Unref(h);
+    }
+    if (h->displacements.load(std::memory_order_relaxed) == 0) {
+      break;
+    }
+    index = (index + increment) & (length_ - 1);
+  }
+  return nullptr;
+}
+
+void ClockCacheShard::Unref(ClockHandle* h) {
+  const uint64_t old = h->meta.fetch_sub(1, std::memory_order_acq_rel);
+  assert(Refs(old) > 0);
+  if (State(old) == kDetached) {
+    (*h->deleter)(h->key(), h->value);
+    std::free(h->key_data);
+    delete h;
+  } else if (State(old) == kInvisible && Refs(old) == 1) {
+    // Other threads may hold a reference for a moment while they check
+    // the key; whichever of them drops the last one frees the entry.
+    uint64_t meta = old - 1;
+    while (State(meta) == kInvisible && Refs(meta) == 0) {
+      if (h->meta.compare_exchange_weak(meta, kConstruction << kStateShift,
+                                        std::memory_order_acquire)) {
+        Free(h);
+        return;
+      }
+    }
+  }
+}
+
+void ClockCacheShard::MakeInvisible(ClockHandle* h) {
+  mutex_.AssertHeld();
+  const uint64_t old = h->meta.fetch_add((kInvisible - kVisible) << kStateShift,
+                                         std::memory_order_acq_rel);
+  assert(State(old) == kVisible);
+  (void)old;
+}
+
+void ClockCacheShard::Free(ClockHandle* h) {
+  assert(State(h->meta.load(std::memory_order_relaxed)) == kConstruction);
+  (*h->deleter)(h->key(), h->value);
+  std::free(h->key_data);
+  h->key_data = nullptr;
+  usage_.fetch_sub(h->charge, std::memory_order_relaxed);
+
+  // The entry no longer passes over the slots before it.
+  const uint32_t hash = h->hash.load(std::memory_order_relaxed);
+  const uint32_t increment = Increment(hash);
+  for (uint32_t index = Home(hash); &slots_[index] != h;
+       index = (index + increment) & (length_ - 1)) {
+    slots_[index].displacements.fetch_sub(1, std::memory_order_relaxed);
+  }
+  occupancy_.fetch_sub(1, std::memory_order_relaxed);
+
+  // Keep any references taken for a moment by concurrent lookups.
+  h->meta.fetch_and(kRefsMask, std::memory_order_release);
+}
+
+bool ClockCacheShard::EvictOne() {
+  mutex_.AssertHeld();
+  // Four passes bring every unreferenced entry's count down to zero.
+  for (uint32_t step = 0; step < 4 * length_; step++) {
+    ClockHandle* h = &slots_[clock_hand_];
+    clock_hand_ = (clock_hand_ + 1) & (length_ - 1);
+    uint64_t meta = h->meta.load(std::memory_order_relaxed);
+    if (State(meta) != kVisible || Refs(meta) != 0) {
+      continue;
+    }
+    if (Clock(meta) > 0) {
+      h->meta.compare_exchange_strong(meta, meta - kOneClock,
+                                      std::memory_order_relaxed);
+    } else if (h->meta.compare_exchange_strong(meta,
+                                               kConstruction << kStateShift,
+                                               std::memory_order_acquire)) {
+      Free(h);
+      return true;
+    }
+  }
+  return false;
+}
+
+Cache::Handle* ClockCacheShard::Insert(const Slice& key, uint32_t hash,
+                                       void* value, size_t charge,
+                                       void (*deleter)(const Slice& key,
+                                                       void* value),
+                                       Cache::Priority priority) {
+  ClockHandle* e = nullptr;
+  char* key_data = static_cast<char*>(std::malloc(key.size() + 1));
+  std::memcpy(key_data, key.data(), key.size());
+
+  if (capacity_ > 0) {
+    MutexLock l(&mutex_);
+    ClockHandle* old = Find(key, hash, false);
+    if (old != nullptr) {
+      MakeInvisible(old);
+      Unref(old);
+    }
+
+    // Make room both in capacity and in the table.  Entries that are in
+    // use cannot be evicted, so usage may end up over capacity.
+    while (usage_.load(std::memory_order_relaxed) + charge > capacity_ ||
+           occupancy_.load(std::memory_order_relaxed) >=
+               length_ - length_ / 8) {
+      if (!EvictOne()) {
+        break;
+      }
+    }
+
+    const uint32_t increment = Increment(hash);
+    uint32_t index = Home(hash);
+    uint32_t probe = 0;
+    for (; probe < length_; probe++) {
+      ClockHandle* h = &slots_[index];
+      uint64_t expected = kEmpty;
+      if (h->meta.compare_exchange_strong(expected,
+                                          kConstruction << kStateShift,
+                                          std::memory_order_acquire)) {
+        e = h;
+        break;
+      }
+      h->displacements.fetch_add(1, std::memory_order_relaxed);
+      index = (index + increment) & (length_ - 1);
+    }
+
+    if (e != nullptr) {
+      e->hash.store(hash, std::memory_order_relaxed);
+      e->key_data = key_data;
+      e->key_length = key.size();
+      e->value = value;
+      e->deleter = deleter;
+      e->charge = charge;
+      usage_.fetch_add(charge, std::memory_order_relaxed);
+      occupancy_.fetch_add(1, std::memory_order_relaxed);
+      // Publish the entry with one reference for the caller.  A
+      // high-priority entry starts with the count of a recently hit one.
+      const uint64_t clock =
+          (priority == Cache::Priority::kHigh) ? kClockMask : kOneClock;
+      e->meta.fetch_add(((kVisible - kConstruction) << kStateShift) | clock |
+                            1,
+                        std::memory_order_release);
+      return reinterpret_cast<Cache::Handle*>(e);
+    }
+
+    // Every slot is in use; undo the displacements and hand out an entry
+    // that is not cached.
+    index = Home(hash);
+    for (uint32_t i = 0; i < probe; i++) {
+      slots_[index].displacements.fetch_sub(1, std::memory_order_relaxed);
+      index = (index + increment) & (length_ - 1);
+    }
+  }
+
+  // don't cache. (capacity_==0 is supported and turns off caching.)
+  e = new ClockHandle;
+  e->meta.store((kDetached << kStateShift) | 1, std::memory_order_relaxed);
+  e->hash.store(hash, std::memory_order_relaxed);
+  e->key_data = key_data;
+  e->key_length = key.size();
+  e->value = value;
+  e->deleter = deleter;
+  e->charge = charge;
+  return reinterpret_cast<Cache::Handle*>(e);
+}
+
+Cache::Handle* ClockCacheShard::Lookup(const Slice& key, uint32_t hash) {
+  return reinterpret_cast<Cache::Handle*>(Find(key, hash, true));
+}
+
+void ClockCacheShard::Erase(const Slice& key, uint32_t hash) {
+  MutexLock l(&mutex_);
+  ClockHandle* h = Find(key, hash, false);
+  if (h != nullptr) {
+    MakeInvisible(h);
+    Unref(h);
+  }
+}
+
+void ClockCacheShard::Prune() {
+  MutexLock l(&mutex_);
+  for (uint32_t i = 0; i < length_; i++) {
+    ClockHandle* h = &slots_[i];
+    uint64_t meta = h->meta.load(std::memory_order_relaxed);
+    if (State(meta) == kVisible && Refs(meta) == 0 &&
+        h->meta.compare_exchange_strong(meta, kConstruction << kStateShift,
+                                        std::memory_order_acquire)) {
+      Free(h);
+    }
+  }
+}
+
+static const int kNumShardBits = 4;
+static const int kNumShards = 1 << kNumShardBits;
+
+class ShardedClockCache : public Cache {
+ private:
+  ClockCacheShard shards_[kNumShards];
+  std::atomic<uint64_t> last_id_;
+
+  static inline uint32_t HashSlice(const Slice& key) {
+    return Hash(key.data(), key.size(), 0);
+  }
+
+  static uint32_t Shard(uint32_t hash) { return hash >> (32 - kNumShardBits); }
+
+ public:
+  ShardedClockCache(size_t capacity, size_t estimated_entry_charge)
+      : last_id_(0) {
+    const size_t per_shard = (capacity + kNumShards - 1) / kNumShards;
+    if (estimated_entry_charge == 0) {
+      estimated_entry_charge = 1;
+    }
+    for (int s = 0; s < kNumShards; s++) {
+      shards_[s].Init(per_shard, estimated_entry_charge);
+    }
+  }
+  ~ShardedClockCache() override {}
+
+  Handle* Insert(const Slice& key, void* value, size_t charge,
+                 void (*deleter)(const Slice& key, void* value)) override {
+    return Insert(key, value, charge, deleter, Priority::kLow);
+  }
+  Handle* Insert(const Slice& key, void* value, size_t charge,
+                 void (*deleter)(const Slice& key, void* value),
+                 Priority priority) override {
+    const uint32_t hash = HashSlice(key);
+    return shards_[Shard(hash)].Insert(key, hash, value, charge, deleter,
+                                       priority);
+  }
+
+  Handle* Lookup(const Slice& key) override {
+    const uint32_t hash = HashSlice(key);
+    return shards_[Shard(hash)].Lookup(key, hash);
+  }
+
+  void Release(Handle* handle) override {
+    ClockHandle* h = reinterpret_cast<ClockHandle*>(handle);
+    shards_[Shard(h->hash.load(std::memory_order_relaxed))].Release(h);
+  }
+
+  void Erase(const Slice& key) override {
+    const uint32_t hash = HashSlice(key);
+    shards_[Shard(hash)].Erase(key, hash);
+  }
+
+  void* Value(Handle* handle) override {
+    return reinterpret_cast<ClockHandle*>(handle)->value;
+  }
+
+  uint64_t NewId() override {
+    return last_id_.fetch_add(1, std::memory_order_relaxed) + 1;
+  }
+
+  void Prune() override {
+    for (int s = 0; s < kNumShards; s++) {
+      shards_[s].Prune();
+    }
+  }
+
+  size_t TotalCharge() const override {
+    size_t total = 0;
+    for (int s = 0; s < kNumShards; s++) {
+      total += shards_[s].TotalCharge();
+    }
+    return total;
+  }
+};
+
+}  // namespace
+
+Cache* NewClockCache(size_t capacity, size_t estimated_entry_charge) {
+  return new ShardedClockCache(capacity, estimated_entry_charge);
+}
+
+}  // namespace leveldb
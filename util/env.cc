@@ -22,6 +22,12 @@ Status Env::NewAppendableFile(const std::string& fname, WritableFile** result) {
   return Status::NotSupported("NewAppendableFile", fname);
 }
 
+void Env::SetBackgroundThreads(int number) {}
+
+void Env::ScheduleHighPriority(void (*function)(void* arg), void* arg) {
+  Schedule(function, arg);
+}
+
 Status Env::RemoveDir(const std::string& dirname) { return DeleteDir(dirname); }
 Status Env::DeleteDir(const std::string& dirname) { return RemoveDir(dirname); }
 
@@ -0,0 +1,157 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <cstdio>
+#include <string>
+
+#include "leveldb/env.h"
+
+#include "port/port.h"
+#include "util/env_posix_test_helper.h"
+#include "util/mutexlock.h"
+
+#include "gtest/gtest.h"
+#include "test/util/testutil.h"
+
+namespace leveldb {
+
+static const int kReadOnlyFileLimit = 4;
+static const int kMMapLimit = 4;
+
+class EnvPosixTest : public testing::Test {
+ public:
+  static void SetFileLimits(int read_only_file_limit, int mmap_limit) {
+    EnvPosixTestHelper::SetReadOnlyFDLimit(read_only_file_limit);
+    EnvPosixTestHelper::SetReadOnlyMMapLimit(mmap_limit);
+  }
+
+  static Env* NewEnv() { return EnvPosixTestHelper::NewEnv(); }
+
+  EnvPosixTest() : env_(Env::Default()) {}
+
+  Env* env_;
+};
+
+TEST_F(EnvPosixTest, TestOpenOnRead) {
+  // Write some test data to a single file that will be opened |n| times.
+  std::string test_dir;
+  ASSERT_LEVELDB_OK(env_->GetTestDirectory(&test_dir));
+  std::string test_file = test_dir + "/open_on_read.txt";
+
+  FILE* f = std::fopen(test_file.c_str(), "we");
+  ASSERT_TRUE(f != nullptr);
+  const char kFileData[] = "abcdefghijklmnopqrstuvwxyz";
+  fputs(kFileData, f);
+  std::fclose(f);
+
+  // Open test file some number above the sum of the two limits to force
+  // open-on-read behavior of POSIX Env leveldb::RandomAccessFile.
+  const int kNumFiles = kReadOnlyFileLimit + kMMapLimit + 5;
+  leveldb::RandomAccessFile* files[kNumFiles] = {0};
+  for (int i = 0; i < kNumFiles; i++) {
+    ASSERT_LEVELDB_OK(env_->NewRandomAccessFile(test_file, &files[i]));
+  }
+  char scratch;
+  Slice read_result;
+  for (int i = 0; i < kNumFiles; i++) {
+    ASSERT_LEVELDB_OK(files[i]->Read(i, 1, &read_result, &scratch));
+    ASSERT_EQ(kFileData[i], read_result[0]);
+  }
+  for (int i = 0; i < kNumFiles; i++) {
+    delete files[i];
+  }
+  ASSERT_LEVELDB_OK(env_->RemoveFile(test_file));
+}
+
+TEST_F(EnvPosixTest, BackgroundThreadPool) {
+  // Every work item blocks until all of them are running, which can only
+  // happen if the pool grew to kNumThreads threads.
+  static const int kNumThreads = 4;
+
+  struct PoolState {
+    port::Mutex mu;
+    port::CondVar cvar{&mu};
+    int running = 0;
+    int finished = 0;
+
+    static void Run(void* arg) {
+      PoolState* state = reinterpret_cast<PoolState*>(arg);
+      MutexLock l(&state->mu);
+      state->running++;
+      state->cvar.SignalAll();
+      while (state->running < kNumThreads) {
+        state->cvar.Wait();
+      }
+      state->finished++;
+      state->cvar.SignalAll();
+    }
+  };
+
+  // Grow the pool of an Env of its own, not that of Env::Default().
+  static Env* const env = NewEnv();
+  env->SetBackgroundThreads(kNumThreads);
+  PoolState state;
+  for (int i = 0; i < kNumThreads; i++) {
+    env->Schedule(&PoolState::Run, &state);
+  }
+
+  MutexLock l(&state.mu);
+  while (state.finished < kNumThreads) {
+    state.cvar.Wait();
+  }
+  ASSERT_EQ(kNumThreads, state.running);
+}
+
+TEST_F(EnvPosixTest, ScheduleHighPriority) {
+  // Occupy every low-priority thread with work that can only finish after
+  // the high-priority item ran, so the latter needs a thread of its own.
+  static const int kNumLowPriorityItems = 16;
+
+  struct PriorityState {
+    port::Mutex mu;
+    port::CondVar cvar{&mu};
+    bool high_priority_ran = false;
+    int low_priority_finished = 0;
+
+    static void RunLow(void* arg) {
+      PriorityState* state = reinterpret_cast<PriorityState*>(arg);
+      MutexLock l(&state->mu);
+      while (!state->high_priority_ran) {
+        state->cvar.Wait();
+      }
+      state->low_priority_finished++;
+      state->cvar.SignalAll();
+    }
+
+    static void RunHigh(void* arg) {
+      PriorityState* state = reinterpret_cast<PriorityState*>(arg);
+      MutexLock l(&state->mu);
+      state->high_priority_ran = true;
+      state->cvar.SignalAll();
+    }
+  };
+
+  PriorityState state;
+  for (int i = 0; i < kNumLowPriorityItems; i++) {
+    env_->Schedule(&PriorityState::RunLow, &state);
+  }
+  env_->ScheduleHighPriority(&PriorityState::RunHigh, &state);
+
+  MutexLock l(&state.mu);
+  while (state.low_priority_finished < kNumLowPriorityItems) {
+    state.cvar.Wait();
+  }
+  ASSERT_TRUE(state.high_priority_ran);
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  // All tests currently run with the same read-only file limits.
+  leveldb::EnvPosixTest::SetFileLimits(leveldb::kReadOnlyFileLimit,
+                                       leveldb::kMMapLimit);
+
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
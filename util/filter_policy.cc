@@ -4,4 +4,9 @@ namespace leveldb {
 
 FilterPolicy::~FilterPolicy() {}
 
+void FilterPolicy::CreateFilterForLevel(const Slice* keys, int n,
+                                        std::string* dst, int level) const {
+  CreateFilter(keys, n, dst);
+}
+
 }  // namespace leveldb
@@ -2,6 +2,7 @@
 #ifndef LEVELDB_UTIL_HASH_H
 #define LEVELDB_UTIL_HASH_H
 
+#include <cstddef>
 #include <cstdint>
 namespace leveldb {
 uint32_t Hash(const char* data, size_t n, uint32_t seed);
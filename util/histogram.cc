@@ -0,0 +1,179 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/histogram.h"
+
+#include <cmath>
+#include <cstdio>
+
+namespace leveldb {
+
+namespace {
+
+// Upper bounds of the buckets: 1 to 10 in steps of one, then sixteen
+// steps per decade up to 10^10.  The last bucket catches everything.
+struct BucketLimits {
+  BucketLimits() {
+    static const double kSteps[16] = {1.2, 1.4, 1.6, 1.8, 2.0, 2.5, 3.0, 3.5,
+                                      4.0, 4.5, 5.0, 6.0, 7.0, 8.0, 9.0, 10.0};
+    int b = 0;
+    for (; b < 10; b++) {
+      limit[b] = b + 1;
+    }
+    for (double decade = 10; b < kNumBuckets; decade *= 10) {
+      for (int i = 0; i < 16 && b < kNumBuckets; i++) {
+        limit[b++] = kSteps[i] * decade;
+      }
+    }
+    limit[kNumBuckets - 1] = 1e200;
+  }
+
+  static constexpr int kNumBuckets = Histogram::kNumBuckets;
+  double limit[kNumBuckets];
+};
+
+const double* Limits() {
+  static const BucketLimits limits;
+  return limits.limit;
+}
+
+}  // namespace
+
+void Histogram::Clear() {
+  min_ = Limits()[kNumBuckets - 1];
+  max_ = 0;
+  num_ = 0;
+  sum_ = 0;
+  sum_squares_ = 0;
+  for (int i = 0; i < kNumBuckets; i++) {
+    buckets_[i] = 0;
+  }
+}
+
+int Histogram::BucketIndex(double value) {
+  // Binary search for the first limit above value; Statistics calls
+  // this on every recorded operation.
+  const double* limits = Limits();
+  int lo = 0;
+  int hi = kNumBuckets - 1;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (limits[mid] <= value) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+void Histogram::Add(double value) {
+  buckets_[BucketIndex(value)] += 1.0;
+  if (min_ > value) min_ = value;
+  if (max_ < value) max_ = value;
+  num_++;
+  sum_ += value;
+  sum_squares_ += (value * value);
+}
+
+void Histogram::Merge(const Histogram& other) {
+  if (other.min_ < min_) min_ = other.min_;
+  if (other.max_ > max_) max_ = other.max_;
+  num_ += other.num_;
+  sum_ += other.sum_;
+  sum_squares_ += other.sum_squares_;
+  for (int b = 0; b < kNumBuckets; b++) {
+    buckets_[b] += other.buckets_[b];
+  }
+}
+
+void Histogram::Merge(const uint64_t* buckets, double min, double max,
+                      double num, double sum, double sum_squares) {
+  if (num == 0.0) return;
+  if (min < min_) min_ = min;
+  if (max > max_) max_ = max;
+  num_ += num;
+  sum_ += sum;
+  sum_squares_ += sum_squares;
+  for (int b = 0; b < kNumBuckets; b++) {
+    buckets_[b] += buckets[b];
+  }
+}
+
+double Histogram::Median() const { return Percentile(50.0); }
+
+double Histogram::Percentile(double p) const {
+  if (num_ == 0.0) return 0;
+  const double* limits = Limits();
+  double threshold = num_ * (p / 100.0);
+  double sum = 0;
+  for (int b = 0; b < kNumBuckets; b++) {
+    sum += buckets_[b];
+    if (sum >= threshold) {
+      // Scale linearly within this bucket
+      double left_point = (b == 0) ? 0 : limits[b - 1];
+      double right_point = limits[b];
+      double left_sum = sum - buckets_[b];
+      double right_sum = sum;
+      double pos = (threshold - left_sum) / (right_sum - left_sum);
+      double r = left_point + (right_point - left_point) * pos;
+      if (r < min_) r = min_;
+      if (r > max_) r = max_;
+      return r;
+    }
+  }
+  return max_;
+}
+
+double Histogram::Average() const {
+  if (num_ == 0.0) return 0;
+  return sum_ / num_;
+}
+
+double Histogram::StandardDeviation() const {
+  if (num_ == 0.0) return 0;
+  double variance = (sum_squares_ * num_ - sum_ * sum_) / (num_ * num_);
+  return std::sqrt(variance);
+}
+
+std::string Histogram::ToString() const {
+  const double* limits = Limits();
+  std::string r;
+  char buf[200];
+  std::snprintf(buf, sizeof(buf), "Count: %.0f  Average: %.4f  StdDev: %.2f\n",
+                num_, Average(), StandardDeviation());
+  r.append(buf);
+  std::snprintf(buf, sizeof(buf), "Min: %.4f  Median: %.4f  Max: %.4f\n",
+                (num_ == 0.0 ? 0.0 : min_), Median(), max_);
+  r.append(buf);
+  std::snprintf(buf, sizeof(buf),
+                "Percentiles: P50: %.2f  P75: %.2f  P99: %.2f  P99.9: %.2f  "
+                "P99.99: %.2f\n",
+                Percentile(50), Percentile(75), Percentile(99),
+                Percentile(99.9), Percentile(99.99));
+  r.append(buf);
+  r.append("------------------------------------------------------\n");
+  if (num_ == 0.0) return r;
+  const double mult = 100.0 / num_;
+  double sum = 0;
+  for (int b = 0; b < kNumBuckets; b++) {
+    if (buckets_[b] <= 0.0) continue;
+    sum += buckets_[b];
+    std::snprintf(buf, sizeof(buf), "[ %7.0f, %7.0f ) %7.0f %7.3f%% %7.3f%% ",
+                  ((b == 0) ? 0.0 : limits[b - 1]),  // left
+                  limits[b],                         // right
+                  buckets_[b],                       // count
+                  mult * buckets_[b],                // percentage
+                  mult * sum);                       // cumulative percentage
+    r.append(buf);
+
+    // Add hash marks based on percentage; 20 marks for 100%.
+    int marks = static_cast<int>(20 * (buckets_[b] / num_) + 0.5);
+    r.append(marks, '#');
+    r.push_back('\n');
+  }
+  return r;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,59 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_UTIL_HISTOGRAM_H_
+#define STORAGE_LEVELDB_UTIL_HISTOGRAM_H_
+
+#include <cstdint>
+#include <string>
+
+namespace leveldb {
+
+// Records non-negative values (typically latencies in microseconds) in
+// exponentially growing buckets, keeping enough to report the average,
+// standard deviation and approximate percentiles.  Not thread-safe; use
+// one per thread and Merge() them.
+class Histogram {
+ public:
+  enum { kNumBuckets = 154 };
+
+  Histogram() { Clear(); }
+  ~Histogram() = default;
+
+  void Clear();
+  void Add(double value);
+  void Merge(const Histogram& other);
+
+  // Fold in values summarized elsewhere, e.g. in atomic counters kept
+  // per bucket: "buckets" holds kNumBuckets counts indexed as by
+  // BucketIndex(), and the rest describe the same values.
+  void Merge(const uint64_t* buckets, double min, double max, double num,
+             double sum, double sum_squares);
+
+  // Index of the bucket that Add(value) counts value in.
+  static int BucketIndex(double value);
+
+  double Count() const { return num_; }
+  double Min() const { return min_; }
+  double Max() const { return max_; }
+  double Median() const;
+  double Percentile(double p) const;
+  double Average() const;
+  double StandardDeviation() const;
+
+  std::string ToString() const;
+
+ private:
+  double min_;
+  double max_;
+  double num_;
+  double sum_;
+  double sum_squares_;
+
+  double buckets_[kNumBuckets];
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_HISTOGRAM_H_
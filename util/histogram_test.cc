@@ -0,0 +1,50 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/histogram.h"
+
+#include "gtest/gtest.h"
+
+namespace leveldb {
+
+TEST(HistogramTest, Empty) {
+  Histogram h;
+  ASSERT_EQ(0, h.Count());
+  ASSERT_EQ(0, h.Average());
+  ASSERT_EQ(0, h.StandardDeviation());
+  ASSERT_EQ(0, h.Median());
+}
+
+TEST(HistogramTest, Basic) {
+  Histogram h;
+  for (int i = 1; i <= 1000; i++) {
+    h.Add(i);
+  }
+  ASSERT_EQ(1000, h.Count());
+  ASSERT_EQ(1, h.Min());
+  ASSERT_EQ(1000, h.Max());
+  ASSERT_DOUBLE_EQ(500.5, h.Average());
+  // Percentiles are interpolated within buckets, so only approximate.
+  ASSERT_NEAR(500, h.Median(), 50);
+  ASSERT_NEAR(990, h.Percentile(99), 20);
+  ASSERT_LE(h.Percentile(99.9), h.Max());
+  ASSERT_NEAR(288.7, h.StandardDeviation(), 0.1);
+}
+
+TEST(HistogramTest, Merge) {
+  Histogram a, b;
+  for (int i = 0; i < 100; i++) {
+    a.Add(10);
+    b.Add(1000);
+  }
+  a.Merge(b);
+  ASSERT_EQ(200, a.Count());
+  ASSERT_EQ(10, a.Min());
+  ASSERT_EQ(1000, a.Max());
+  ASSERT_DOUBLE_EQ(505, a.Average());
+  ASSERT_LE(a.Percentile(25), 12);
+  ASSERT_GE(a.Percentile(75), 900);
+}
+
+}  // namespace leveldb
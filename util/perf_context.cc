@@ -0,0 +1,75 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/perf_context.h"
+
+#include <cstdio>
+
+#include "util/perf_context_imp.h"
+
+namespace leveldb {
+
+thread_local PerfLevel perf_level = kDisable;
+thread_local PerfContext perf_context;
+
+namespace {
+
+struct PerfField {
+  const char* name;
+  uint64_t PerfContext::*field;
+};
+
+const PerfField kPerfFields[] = {
+    {"get_nanos", &PerfContext::get_nanos},
+    {"get_from_memtable_count", &PerfContext::get_from_memtable_count},
+    {"get_from_memtable_nanos", &PerfContext::get_from_memtable_nanos},
+    {"get_from_output_files_count", &PerfContext::get_from_output_files_count},
+    {"get_from_output_files_nanos", &PerfContext::get_from_output_files_nanos},
+    {"find_table_count", &PerfContext::find_table_count},
+    {"find_table_nanos", &PerfContext::find_table_nanos},
+    {"table_open_count", &PerfContext::table_open_count},
+    {"index_seek_nanos", &PerfContext::index_seek_nanos},
+    {"filter_check_count", &PerfContext::filter_check_count},
+    {"filter_check_nanos", &PerfContext::filter_check_nanos},
+    {"filter_useful_count", &PerfContext::filter_useful_count},
+    {"block_cache_hit_count", &PerfContext::block_cache_hit_count},
+    {"block_read_count", &PerfContext::block_read_count},
+    {"block_read_bytes", &PerfContext::block_read_bytes},
+    {"block_read_nanos", &PerfContext::block_read_nanos},
+    {"block_checksum_nanos", &PerfContext::block_checksum_nanos},
+    {"block_decompress_nanos", &PerfContext::block_decompress_nanos},
+    {"block_seek_nanos", &PerfContext::block_seek_nanos},
+};
+
+static_assert(sizeof(kPerfFields) / sizeof(kPerfFields[0]) ==
+                  sizeof(PerfContext) / sizeof(uint64_t),
+              "every PerfContext field must be listed in kPerfFields");
+
+}  // namespace
+
+void SetPerfLevel(PerfLevel level) { perf_level = level; }
+
+PerfLevel GetPerfLevel() { return perf_level; }
+
+PerfContext* GetPerfContext() { return &perf_context; }
+
+void PerfContext::Reset() {
+  for (const PerfField& f : kPerfFields) {
+    this->*f.field = 0;
+  }
+}
+
+std::string PerfContext::ToString() const {
+  std::string r;
+  char buf[100];
+  for (const PerfField& f : kPerfFields) {
+    if (this->*f.field == 0) continue;
+    std::snprintf(buf, sizeof(buf), "%s%s = %llu", r.empty() ? "" : ", ",
+                  f.name, static_cast<unsigned long long>(this->*f.field));
+    r.append(buf);
+  }
+  return r;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,61 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_UTIL_PERF_CONTEXT_IMP_H_
+#define STORAGE_LEVELDB_UTIL_PERF_CONTEXT_IMP_H_
+
+#include <chrono>
+#include <cstdint>
+
+#include "leveldb/perf_context.h"
+
+namespace leveldb {
+
+// The calling thread's level and context, as returned by GetPerfLevel()
+// and GetPerfContext().
+extern thread_local PerfLevel perf_level;
+extern thread_local PerfContext perf_context;
+
+// Add "n" to the calling thread's "field" if counts are being recorded.
+inline void PerfCount(uint64_t PerfContext::*field, uint64_t n = 1) {
+  if (perf_level >= kEnableCount) {
+    perf_context.*field += n;
+  }
+}
+
+// Helper class that adds the nanoseconds between its construction and
+// Stop() (or its destruction) to the calling thread's "field".  Does
+// not read the clock unless the level is kEnableTime.
+class PerfTimer {
+ public:
+  explicit PerfTimer(uint64_t PerfContext::*field)
+      : field_(field), running_(perf_level >= kEnableTime) {
+    if (running_) {
+      start_ = std::chrono::steady_clock::now();
+    }
+  }
+
+  ~PerfTimer() { Stop(); }
+
+  PerfTimer(const PerfTimer&) = delete;
+  PerfTimer& operator=(const PerfTimer&) = delete;
+
+  void Stop() {
+    if (running_) {
+      running_ = false;
+      const auto elapsed = std::chrono::steady_clock::now() - start_;
+      perf_context.*field_ +=
+          std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    }
+  }
+
+ private:
+  uint64_t PerfContext::*const field_;
+  bool running_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_PERF_CONTEXT_IMP_H_
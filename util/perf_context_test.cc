@@ -0,0 +1,74 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/perf_context.h"
+
+#include <thread>
+
+#include "gtest/gtest.h"
+#include "util/perf_context_imp.h"
+
+namespace leveldb {
+
+class PerfContextTest : public testing::Test {
+ public:
+  PerfContextTest() { GetPerfContext()->Reset(); }
+  ~PerfContextTest() { SetPerfLevel(kDisable); }
+};
+
+TEST_F(PerfContextTest, Disabled) {
+  ASSERT_EQ(kDisable, GetPerfLevel());
+  PerfCount(&PerfContext::block_read_count);
+  {
+    PerfTimer timer(&PerfContext::block_read_nanos);
+  }
+  ASSERT_EQ(0, GetPerfContext()->block_read_count);
+  ASSERT_EQ(0, GetPerfContext()->block_read_nanos);
+  ASSERT_EQ("", GetPerfContext()->ToString());
+}
+
+TEST_F(PerfContextTest, CountOnly) {
+  SetPerfLevel(kEnableCount);
+  PerfCount(&PerfContext::block_read_count);
+  PerfCount(&PerfContext::block_read_bytes, 4096);
+  {
+    PerfTimer timer(&PerfContext::block_read_nanos);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  ASSERT_EQ(1, GetPerfContext()->block_read_count);
+  ASSERT_EQ(4096, GetPerfContext()->block_read_bytes);
+  ASSERT_EQ(0, GetPerfContext()->block_read_nanos);
+  ASSERT_EQ("block_read_count = 1, block_read_bytes = 4096",
+            GetPerfContext()->ToString());
+}
+
+TEST_F(PerfContextTest, Time) {
+  SetPerfLevel(kEnableTime);
+  {
+    PerfTimer timer(&PerfContext::block_read_nanos);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    timer.Stop();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+  ASSERT_GE(GetPerfContext()->block_read_nanos, 1000000);
+  ASSERT_LT(GetPerfContext()->block_read_nanos, 50000000);
+
+  GetPerfContext()->Reset();
+  ASSERT_EQ(0, GetPerfContext()->block_read_nanos);
+}
+
+TEST_F(PerfContextTest, PerThread) {
+  SetPerfLevel(kEnableCount);
+  PerfCount(&PerfContext::find_table_count);
+  std::thread other([]() {
+    ASSERT_EQ(kDisable, GetPerfLevel());
+    SetPerfLevel(kEnableCount);
+    PerfCount(&PerfContext::find_table_count, 5);
+    ASSERT_EQ(5, GetPerfContext()->find_table_count);
+  });
+  other.join();
+  ASSERT_EQ(1, GetPerfContext()->find_table_count);
+}
+
+}  // namespace leveldb
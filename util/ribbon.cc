@@ -0,0 +1,314 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A Standard Ribbon filter (Dillinger & Walzer, "Ribbon filter: practically
+// smaller than Bloom and Xor").  Each key is a row of a linear system over
+// GF(2): 64 random coefficient bits starting at a random slot, and
+// num_bits random result bits.  The filter stores a solution of num_bits
+// bits per slot, with 5-15% more slots than keys.  A key may match if
+// the parity of its coefficients and the solution gives back its result
+// bits, which happens to other keys with probability 2^-num_bits.
+//
+// Filter layout:
+//    solution: fixed64[num_blocks * num_bits]
+//    seed: uint8
+//    num_bits: uint8
+//    kRibbonMarker: uint8
+//
+// Word b * num_bits + j of the solution holds bit j of the 64 slots of
+// block b, one slot per bit, so a query reads num_bits pairs of words.
+
+#include "util/ribbon.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "leveldb/filter_policy.h"
+#include "leveldb/slice.h"
+
+#include "util/coding.h"
+#include "util/hash.h"
+
+namespace leveldb {
+
+namespace {
+
+constexpr char kRibbonMarker = static_cast<char>(0xfe);
+constexpr int kMaxBits = 16;
+constexpr uint32_t kSlotsPerBlock = 64;
+
+// Attempts with as many seeds before adding slots.  Bigger systems are
+// more likely to be solvable.
+constexpr int kSeedsPerSize = 4;
+
+uint64_t KeyHash(const Slice& key) {
+  return (static_cast<uint64_t>(Hash(key.data(), key.size(), 0xbc9f1d34))
+          << 32) |
+         Hash(key.data(), key.size(), 0x3b0e5e6d);
+}
+
+// Finalizer of MurmurHash3
+uint64_t Mix(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdull;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ull;
+  x ^= x >> 33;
+  return x;
+}
+
+int Parity(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_parityll(x);
+#else
+  x ^= x >> 32;
+  x ^= x >> 16;
+  x ^= x >> 8;
+  x ^= x >> 4;
+  x ^= x >> 2;
+  x ^= x >> 1;
+  return static_cast<int>(x & 1);
+#endif
+}
+
+// REQUIRES: x != 0
+int CountTrailingZeros(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_ctzll(x);
+#else
+  int n = 0;
+  while ((x & 1) == 0) {
+    x >>= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+struct Row {
+  uint32_t start;  // First slot of the coefficients
+  uint64_t coeff;  // Bit i is the coefficient of slot start + i
+  uint32_t result;
+};
+
+// A row starts in [0, num_slots - 63), so that its coefficients fit.
+Row MakeRow(uint64_t key_hash, int seed, uint32_t num_slots, int num_bits) {
+  const uint64_t h =
+      Mix(key_hash + static_cast<uint64_t>(seed + 1) * 0x9e3779b97f4a7c15ull);
+  const uint32_t num_starts = num_slots - (kSlotsPerBlock - 1);
+  Row row;
+  row.start = static_cast<uint32_t>(((h >> 32) * num_starts) >> 32);
+  row.coeff = Mix(h) | 1;
+  row.result = static_cast<uint32_t>(h) & ((1u << num_bits) - 1);
+  return row;
+}
+
+// Gaussian elimination into an echelon form where the row stored at slot
+// i, if any, has its first coefficient at i.  Returns false if the system
+// has no solution.
+bool Band(const std::vector<uint64_t>& hashes, int seed, uint32_t num_slots,
+          int num_bits, std::vector<uint64_t>* coeffs,
+          std::vector<uint16_t>* results) {
+  coeffs->assign(num_slots, 0);
+  results->assign(num_slots, 0);
+  for (uint64_t hash : hashes) {
+    Row row = MakeRow(hash, seed, num_slots, num_bits);
+    uint32_t i = row.start;
+    uint64_t c = row.coeff;
+    uint32_t r = row.result;
+    for (;;) {
+      if ((*coeffs)[i] == 0) {
+        (*coeffs)[i] = c;
+        (*results)[i] = static_cast<uint16_t>(r);
+        break;
+      }
+      c ^= (*coeffs)[i];
+      r ^= (*results)[i];
+      if (c == 0) {
+        // Redundant (as for a duplicate key) if consistent
+        if (r != 0) return false;
+        break;
+      }
+      const int shift = CountTrailingZeros(c);
+      i += shift;
+      c >>= shift;
+    }
+  }
+  return true;
+}
+
+// Back substitution from the last slot, appending the solution to *dst.
+void Solve(const std::vector<uint64_t>& coeffs,
+           const std::vector<uint16_t>& results, int seed, int num_bits,
+           std::string* dst) {
+  const uint32_t num_slots = static_cast<uint32_t>(coeffs.size());
+  const uint32_t num_blocks = num_slots / kSlotsPerBlock;
+  std::vector<uint64_t> solution(num_blocks * num_bits, 0);
+  // Bit k of state[j] is bit j of the solution of slot i + 1 + k
+  uint64_t state[kMaxBits] = {0};
+  for (uint32_t i = num_slots; i-- > 0;) {
+    const uint64_t c = coeffs[i];
+    uint32_t r = results[i];
+    if (c == 0) {
+      // Free variable.  Random values keep the false positive rate of
+      // the keys whose rows cover it.
+      r = static_cast<uint32_t>(Mix(i + (static_cast<uint64_t>(seed) << 32)));
+    }
+    uint64_t* words = &solution[(i / kSlotsPerBlock) * num_bits];
+    for (int j = 0; j < num_bits; j++) {
+      uint64_t bit = (r >> j) & 1;
+      if (c != 0) {
+        bit ^= Parity(state[j] & (c >> 1));
+      }
+      state[j] = (state[j] << 1) | bit;
+      words[j] |= bit << (i % kSlotsPerBlock);
+    }
+  }
+  for (uint64_t word : solution) {
+    PutFixed64(dst, word);
+  }
+}
+
+class RibbonFilterPolicy : public FilterPolicy {
+ public:
+  RibbonFilterPolicy(int bloom_equivalent_bits_per_key, int bloom_before_level)
+      : bloom_(NewBloomFilterPolicy(bloom_equivalent_bits_per_key)),
+        bloom_bits_per_key_(bloom_equivalent_bits_per_key < 1
+                                ? 1
+                                : bloom_equivalent_bits_per_key),
+        bloom_before_level_(bloom_before_level) {
+    // A bloom filter with b bits per key has a false positive rate of
+    // about 0.6185^b = 2^(-0.69 * b).
+    num_bits_ = static_cast<int>(bloom_bits_per_key_ * 0.69 + 0.5);
+    if (num_bits_ < 1) num_bits_ = 1;
+    if (num_bits_ > kMaxBits) num_bits_ = kMaxBits;
+  }
+
+  ~RibbonFilterPolicy() override { delete bloom_; }
+
+  // Shared with the builtin bloom filter policies, which read the same
+  // filters.
+  const char* Name() const override { return "leveldb.BuiltinBloomFilter2"; }
+
+  void CreateFilter(const Slice* keys, int n, std::string* dst) const override {
+    CreateFilterForLevel(keys, n, dst, -1);
+  }
+
+  void CreateFilterForLevel(const Slice* keys, int n, std::string* dst,
+                            int level) const override {
+    // Small filters are smaller as bloom filters: a ribbon filter has
+    // at least one block of slots.
+    const size_t bloom_bytes =
+        (static_cast<size_t>(n) * bloom_bits_per_key_ + 7) / 8 + 1;
+    uint32_t num_slots = SlotsFor(n);
+    if ((level >= 0 && level < bloom_before_level_) ||
+        bloom_bytes <= RibbonBytes(num_slots)) {
+      bloom_->CreateFilter(keys, n, dst);
+      return;
+    }
+
+    std::vector<uint64_t> hashes(n);
+    for (int i = 0; i < n; i++) {
+      hashes[i] = KeyHash(keys[i]);
+    }
+    std::vector<uint64_t> coeffs;
+    std::vector<uint16_t> results;
+    for (int attempt = 0;; attempt++) {
+      const int seed = attempt & 0xff;
+      if (attempt > 0 && attempt % kSeedsPerSize == 0) {
+        num_slots += RoundUp(num_slots / 32);
+      }
+      if (Band(hashes, seed, num_slots, num_bits_, &coeffs, &results)) {
+        Solve(coeffs, results, seed, num_bits_, dst);
+        dst->push_back(static_cast<char>(seed));
+        dst->push_back(static_cast<char>(num_bits_));
+        dst->push_back(kRibbonMarker);
+        return;
+      }
+    }
+  }
+
+  bool KeyMayMatch(const Slice& key, const Slice& filter) const override {
+    if (IsRibbonFilter(filter)) {
+      return RibbonFilterMayMatch(key, filter);
+    }
+    return bloom_->KeyMayMatch(key, filter);
+  }
+
+ private:
+  static uint32_t RoundUp(uint32_t slots) {
+    return (slots + kSlotsPerBlock - 1) / kSlotsPerBlock * kSlotsPerBlock;
+  }
+
+  // Larger systems need more slack to be solvable, about 0.6% more
+  // slots than keys per doubling of the number of keys.
+  static uint32_t SlotsFor(int n) {
+    int log2 = 0;
+    while ((1 << log2) < n && log2 < 30) log2++;
+    const uint64_t slack = static_cast<uint64_t>(n) * log2 * 6 / 1000;
+    const uint32_t slots = RoundUp(n + slack + kSlotsPerBlock / 2);
+    return slots < kSlotsPerBlock ? kSlotsPerBlock : slots;
+  }
+
+  size_t RibbonBytes(uint32_t num_slots) const {
+    return num_slots / 8 * num_bits_ + 3;
+  }
+
+  const FilterPolicy* const bloom_;
+  const size_t bloom_bits_per_key_;
+  const int bloom_before_level_;
+  int num_bits_;
+};
+
+}  // namespace
+
+bool IsRibbonFilter(const Slice& filter) {
+  const size_t len = filter.size();
+  if (len < 3 || filter[len - 1] != kRibbonMarker) {
+    return false;
+  }
+  const int num_bits = static_cast<uint8_t>(filter[len - 2]);
+  return num_bits >= 1 && num_bits <= kMaxBits;
+}
+
+bool RibbonFilterMayMatch(const Slice& key, const Slice& filter) {
+  const size_t len = filter.size();
+  const int seed = static_cast<uint8_t>(filter[len - 3]);
+  const int num_bits = static_cast<uint8_t>(filter[len - 2]);
+  // Trailing bytes that are not a whole block are ignored
+  const uint32_t num_blocks =
+      static_cast<uint32_t>(len - 3) / static_cast<uint32_t>(8 * num_bits);
+  if (num_blocks == 0) {
+    return false;
+  }
+
+  const Row row = MakeRow(KeyHash(key), seed,
+                          static_cast<uint32_t>(num_blocks * kSlotsPerBlock),
+                          num_bits);
+  const uint32_t offset = row.start % kSlotsPerBlock;
+  const char* block =
+      filter.data() + (row.start / kSlotsPerBlock) * num_bits * 8;
+  // The coefficients that do not fit in the first block apply to the
+  // next one.
+  const uint64_t coeff_lo = row.coeff << offset;
+  const uint64_t coeff_hi =
+      offset == 0 ? 0 : row.coeff >> (kSlotsPerBlock - offset);
+  const char* next_block = (coeff_hi == 0 ? block : block + num_bits * 8);
+  uint32_t result = 0;
+  for (int j = 0; j < num_bits; j++) {
+    const uint64_t slots = (DecodeFixed64(block + j * 8) & coeff_lo) ^
+                           (DecodeFixed64(next_block + j * 8) & coeff_hi);
+    result |= static_cast<uint32_t>(Parity(slots)) << j;
+  }
+  return result == row.result;
+}
+
+const FilterPolicy* NewRibbonFilterPolicy(int bloom_equivalent_bits_per_key,
+                                          int bloom_before_level) {
+  return new RibbonFilterPolicy(bloom_equivalent_bits_per_key,
+                                bloom_before_level);
+}
+
+}  // namespace leveldb
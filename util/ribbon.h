@@ -0,0 +1,24 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Reading the filters of NewRibbonFilterPolicy().  The builtin bloom
+// filter policies share their Name() with it and read its filters too.
+
+#ifndef STORAGE_LEVELDB_UTIL_RIBBON_H_
+#define STORAGE_LEVELDB_UTIL_RIBBON_H_
+
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+// Return true if "filter" was built by NewRibbonFilterPolicy() as a
+// ribbon filter, rather than as a bloom filter.
+bool IsRibbonFilter(const Slice& filter);
+
+// REQUIRES: IsRibbonFilter(filter)
+bool RibbonFilterMayMatch(const Slice& key, const Slice& filter);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_RIBBON_H_
@@ -0,0 +1,142 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/ribbon.h"
+
+#include <string>
+#include <vector>
+
+#include "leveldb/filter_policy.h"
+#include "util/coding.h"
+
+#include "gtest/gtest.h"
+
+namespace leveldb {
+
+static constexpr int kVerbose = 1;
+
+static Slice Key(int i, char* buffer) {
+  EncodeFixed32(buffer, i);
+  return Slice(buffer, sizeof(uint32_t));
+}
+
+class RibbonTest : public testing::Test {
+ public:
+  RibbonTest() : policy_(NewRibbonFilterPolicy(10, 2)) {}
+  ~RibbonTest() { delete policy_; }
+
+  // Build a filter of keys [0, n) into filter_, for a table of "level".
+  void Build(int n, int level = -1) {
+    char buffer[sizeof(int)];
+    std::vector<std::string> keys;
+    for (int i = 0; i < n; i++) {
+      keys.push_back(Key(i, buffer).ToString());
+    }
+    std::vector<Slice> key_slices(keys.begin(), keys.end());
+    filter_.clear();
+    policy_->CreateFilterForLevel(key_slices.data(), n, &filter_, level);
+  }
+
+  bool Matches(int i) {
+    char buffer[sizeof(int)];
+    return policy_->KeyMayMatch(Key(i, buffer), filter_);
+  }
+
+  double FalsePositiveRate() {
+    int result = 0;
+    for (int i = 0; i < 10000; i++) {
+      if (Matches(i + 1000000000)) {
+        result++;
+      }
+    }
+    return result / 10000.0;
+  }
+
+ protected:
+  const FilterPolicy* policy_;
+  std::string filter_;
+};
+
+TEST_F(RibbonTest, EmptyFilter) {
+  Build(0);
+  ASSERT_TRUE(!Matches(0));
+  ASSERT_TRUE(!Matches(100));
+}
+
+TEST_F(RibbonTest, SmallFiltersAreBloomFilters) {
+  Build(10);
+  ASSERT_FALSE(IsRibbonFilter(filter_));
+  for (int i = 0; i < 10; i++) {
+    ASSERT_TRUE(Matches(i));
+  }
+}
+
+TEST_F(RibbonTest, BloomBeforeLevel) {
+  Build(10000, 0);
+  ASSERT_FALSE(IsRibbonFilter(filter_));
+  Build(10000, 1);
+  ASSERT_FALSE(IsRibbonFilter(filter_));
+  Build(10000, 2);
+  ASSERT_TRUE(IsRibbonFilter(filter_));
+  Build(10000, -1);
+  ASSERT_TRUE(IsRibbonFilter(filter_));
+}
+
+TEST_F(RibbonTest, VaryingLengths) {
+  for (int length = 300; length <= 1000000; length *= 2) {
+    Build(length);
+    ASSERT_TRUE(IsRibbonFilter(filter_)) << length;
+
+    // All added keys must match
+    for (int i = 0; i < length; i++) {
+      ASSERT_TRUE(Matches(i)) << "Length " << length << "; key " << i;
+    }
+
+    // About the false positive rate of a bloom filter, which takes
+    // 10 bits per key
+    double rate = FalsePositiveRate();
+    double bits_per_key = filter_.size() * 8.0 / length;
+    if (kVerbose >= 1) {
+      std::fprintf(stderr,
+                   "False positives: %5.2f%% @ length = %7d ; "
+                   "bits/key = %5.2f\n",
+                   rate * 100.0, length, bits_per_key);
+    }
+    ASSERT_LE(rate, 0.015);
+    if (length >= 10000) {
+      ASSERT_LE(bits_per_key, 8.0);
+    }
+  }
+}
+
+TEST_F(RibbonTest, Duplicates) {
+  char buffer[sizeof(int)];
+  std::vector<std::string> keys;
+  for (int i = 0; i < 5000; i++) {
+    keys.push_back(Key(i % 1000, buffer).ToString());
+  }
+  std::vector<Slice> key_slices(keys.begin(), keys.end());
+  policy_->CreateFilter(key_slices.data(), static_cast<int>(key_slices.size()),
+                        &filter_);
+  ASSERT_TRUE(IsRibbonFilter(filter_));
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_TRUE(Matches(i)) << i;
+  }
+}
+
+TEST_F(RibbonTest, ReadByBloomPolicies) {
+  Build(10000);
+  ASSERT_TRUE(IsRibbonFilter(filter_));
+  char buffer[sizeof(int)];
+  for (const FilterPolicy* reader :
+       {NewBloomFilterPolicy(10), NewBlockedBloomFilterPolicy(10)}) {
+    ASSERT_EQ(std::string(policy_->Name()), std::string(reader->Name()));
+    for (int i = 0; i < 10000; i++) {
+      ASSERT_TRUE(reader->KeyMayMatch(Key(i, buffer), filter_)) << i;
+    }
+    delete reader;
+  }
+}
+
+}  // namespace leveldb
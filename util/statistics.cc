@@ -0,0 +1,246 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/statistics.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <functional>
+#include <limits>
+#include <thread>
+
+#include "port/port.h"
+#include "util/histogram.h"
+
+namespace leveldb {
+
+namespace {
+
+const char* const kTickerNames[kNumTickers] = {
+    "leveldb.block.cache.hit",
+    "leveldb.block.cache.miss",
+    "leveldb.filter.useful",
+    "leveldb.filter.positive",
+    "leveldb.filter.true.positive",
+    "leveldb.memtable.hit",
+    "leveldb.memtable.miss",
+    "leveldb.keys.written",
+    "leveldb.bytes.written",
+    "leveldb.keys.read",
+    "leveldb.bytes.read",
+    "leveldb.wal.bytes",
+    "leveldb.wal.synced",
+    "leveldb.stall.micros",
+    "leveldb.compact.read.bytes",
+    "leveldb.compact.write.bytes",
+};
+
+const char* const kHistogramNames[kNumHistogramTypes] = {
+    "leveldb.db.get.micros",        "leveldb.db.write.micros",
+    "leveldb.db.seek.micros",       "leveldb.compaction.micros",
+    "leveldb.wal.sync.micros",      "leveldb.table.sync.micros",
+};
+
+// Shards beyond this many stop paying for themselves: reads have to
+// visit every shard and each one is several kilobytes.
+constexpr int kMaxShards = 16;
+
+// One histogram in one shard.  All updates are relaxed: each field is
+// exact on its own, and a reader racing with writers may see a value
+// counted in some fields and not yet in others.
+struct HistogramShard {
+  std::atomic<uint64_t> buckets[Histogram::kNumBuckets];
+  std::atomic<uint64_t> num;
+  std::atomic<uint64_t> sum;
+  std::atomic<double> sum_squares;
+  std::atomic<uint64_t> min;
+  std::atomic<uint64_t> max;
+
+  void Add(uint64_t value) {
+    buckets[Histogram::BucketIndex(value)].fetch_add(
+        1, std::memory_order_relaxed);
+    num.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(value, std::memory_order_relaxed);
+
+    // The shard is normally touched by one core at a time, so these
+    // loops rarely go around more than once.
+    const double square = static_cast<double>(value) * value;
+    double old_squares = sum_squares.load(std::memory_order_relaxed);
+    while (!sum_squares.compare_exchange_weak(old_squares,
+                                              old_squares + square,
+                                              std::memory_order_relaxed)) {
+    }
+    uint64_t old_min = min.load(std::memory_order_relaxed);
+    while (value < old_min &&
+           !min.compare_exchange_weak(old_min, value,
+                                      std::memory_order_relaxed)) {
+    }
+    uint64_t old_max = max.load(std::memory_order_relaxed);
+    while (value > old_max &&
+           !max.compare_exchange_weak(old_max, value,
+                                      std::memory_order_relaxed)) {
+    }
+  }
+
+  void MergeInto(Histogram* h) const {
+    uint64_t counts[Histogram::kNumBuckets];
+    for (int b = 0; b < Histogram::kNumBuckets; b++) {
+      counts[b] = buckets[b].load(std::memory_order_relaxed);
+    }
+    h->Merge(counts, min.load(std::memory_order_relaxed),
+             max.load(std::memory_order_relaxed),
+             num.load(std::memory_order_relaxed),
+             sum.load(std::memory_order_relaxed),
+             sum_squares.load(std::memory_order_relaxed));
+  }
+
+  void Clear() {
+    for (auto& bucket : buckets) {
+      bucket.store(0, std::memory_order_relaxed);
+    }
+    num.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+    sum_squares.store(0, std::memory_order_relaxed);
+    min.store(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+    max.store(0, std::memory_order_relaxed);
+  }
+};
+
+// Everything one core records.  Aligned so that cores never write to
+// the same cache line.
+struct alignas(64) StatisticsShard {
+  std::atomic<uint64_t> tickers[kNumTickers];
+  HistogramShard histograms[kNumHistogramTypes];
+};
+
+class ShardedStatistics : public Statistics {
+ public:
+  ShardedStatistics() : num_shards_(NumShards()) {
+    shards_ = new StatisticsShard[num_shards_];
+    Reset();
+  }
+
+  ~ShardedStatistics() override { delete[] shards_; }
+
+  void RecordTick(Ticker ticker, uint64_t count) override {
+    assert(ticker < kNumTickers);
+    Shard()->tickers[ticker].fetch_add(count, std::memory_order_relaxed);
+  }
+
+  void MeasureTime(HistogramType type, uint64_t value) override {
+    assert(type < kNumHistogramTypes);
+    Shard()->histograms[type].Add(value);
+  }
+
+  uint64_t GetTickerCount(Ticker ticker) const override {
+    assert(ticker < kNumTickers);
+    uint64_t total = 0;
+    for (int s = 0; s < num_shards_; s++) {
+      total += shards_[s].tickers[ticker].load(std::memory_order_relaxed);
+    }
+    return total;
+  }
+
+  void GetHistogramData(HistogramType type,
+                        HistogramData* data) const override {
+    assert(type < kNumHistogramTypes);
+    Histogram h;
+    uint64_t sum = 0;
+    for (int s = 0; s < num_shards_; s++) {
+      const HistogramShard& shard = shards_[s].histograms[type];
+      shard.MergeInto(&h);
+      sum += shard.sum.load(std::memory_order_relaxed);
+    }
+    data->count = static_cast<uint64_t>(h.Count());
+    data->sum = sum;
+    data->min = (h.Count() == 0) ? 0 : static_cast<uint64_t>(h.Min());
+    data->max = static_cast<uint64_t>(h.Max());
+    data->average = h.Average();
+    data->standard_deviation = h.StandardDeviation();
+    data->median = h.Median();
+    data->percentile95 = h.Percentile(95);
+    data->percentile99 = h.Percentile(99);
+  }
+
+  void Reset() override {
+    for (int s = 0; s < num_shards_; s++) {
+      for (auto& ticker : shards_[s].tickers) {
+        ticker.store(0, std::memory_order_relaxed);
+      }
+      for (auto& histogram : shards_[s].histograms) {
+        histogram.Clear();
+      }
+    }
+  }
+
+  std::string ToString() const override {
+    std::string r;
+    char buf[200];
+    for (int t = 0; t < kNumTickers; t++) {
+      const Ticker ticker = static_cast<Ticker>(t);
+      std::snprintf(buf, sizeof(buf), "%s COUNT : %llu\n", TickerName(ticker),
+                    static_cast<unsigned long long>(GetTickerCount(ticker)));
+      r.append(buf);
+    }
+    for (int t = 0; t < kNumHistogramTypes; t++) {
+      const HistogramType type = static_cast<HistogramType>(t);
+      HistogramData data;
+      GetHistogramData(type, &data);
+      std::snprintf(buf, sizeof(buf),
+                    "%s P50 : %.2f P95 : %.2f P99 : %.2f MAX : %llu "
+                    "COUNT : %llu SUM : %llu\n",
+                    HistogramName(type), data.median, data.percentile95,
+                    data.percentile99, static_cast<unsigned long long>(data.max),
+                    static_cast<unsigned long long>(data.count),
+                    static_cast<unsigned long long>(data.sum));
+      r.append(buf);
+    }
+    return r;
+  }
+
+ private:
+  // The smallest power of two that gives every core its own shard, up
+  // to kMaxShards.
+  static int NumShards() {
+    const int cores = static_cast<int>(std::thread::hardware_concurrency());
+    int shards = 1;
+    while (shards < cores && shards < kMaxShards) {
+      shards *= 2;
+    }
+    return shards;
+  }
+
+  StatisticsShard* Shard() const {
+    int core = port::PhysicalCoreID();
+    if (core < 0) {
+      // No way to ask for the core; spread threads out by id instead.
+      static thread_local const size_t thread_hash =
+          std::hash<std::thread::id>()(std::this_thread::get_id());
+      core = static_cast<int>(thread_hash & 0x7fffffff);
+    }
+    return &shards_[core & (num_shards_ - 1)];
+  }
+
+  const int num_shards_;
+  StatisticsShard* shards_;
+};
+
+}  // namespace
+
+Statistics::~Statistics() = default;
+
+const char* Statistics::TickerName(Ticker ticker) {
+  assert(ticker < kNumTickers);
+  return kTickerNames[ticker];
+}
+
+const char* Statistics::HistogramName(HistogramType type) {
+  assert(type < kNumHistogramTypes);
+  return kHistogramNames[type];
+}
+
+Statistics* NewStatistics() { return new ShardedStatistics; }
+
+}  // namespace leveldb
@@ -0,0 +1,98 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/statistics.h"
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace leveldb {
+
+TEST(StatisticsTest, Tickers) {
+  std::unique_ptr<Statistics> stats(NewStatistics());
+  for (int t = 0; t < kNumTickers; t++) {
+    ASSERT_EQ(0, stats->GetTickerCount(static_cast<Ticker>(t)));
+  }
+  stats->RecordTick(kBlockCacheHit, 1);
+  stats->RecordTick(kBlockCacheHit, 2);
+  stats->RecordTick(kBytesWritten, 1000);
+  ASSERT_EQ(3, stats->GetTickerCount(kBlockCacheHit));
+  ASSERT_EQ(0, stats->GetTickerCount(kBlockCacheMiss));
+  ASSERT_EQ(1000, stats->GetTickerCount(kBytesWritten));
+
+  stats->Reset();
+  ASSERT_EQ(0, stats->GetTickerCount(kBlockCacheHit));
+  ASSERT_EQ(0, stats->GetTickerCount(kBytesWritten));
+}
+
+TEST(StatisticsTest, Histograms) {
+  std::unique_ptr<Statistics> stats(NewStatistics());
+  HistogramData data;
+  stats->GetHistogramData(kGetMicros, &data);
+  ASSERT_EQ(0, data.count);
+  ASSERT_EQ(0, data.min);
+  ASSERT_EQ(0, data.max);
+
+  for (int i = 1; i <= 100; i++) {
+    stats->MeasureTime(kGetMicros, i);
+  }
+  stats->GetHistogramData(kGetMicros, &data);
+  ASSERT_EQ(100, data.count);
+  ASSERT_EQ(5050, data.sum);
+  ASSERT_EQ(1, data.min);
+  ASSERT_EQ(100, data.max);
+  ASSERT_DOUBLE_EQ(50.5, data.average);
+  ASSERT_NEAR(50, data.median, 5);
+  ASSERT_NEAR(99, data.percentile99, 5);
+
+  stats->GetHistogramData(kWriteMicros, &data);
+  ASSERT_EQ(0, data.count);
+
+  stats->Reset();
+  stats->GetHistogramData(kGetMicros, &data);
+  ASSERT_EQ(0, data.count);
+}
+
+TEST(StatisticsTest, ConcurrentUpdates) {
+  std::unique_ptr<Statistics> stats(NewStatistics());
+  const int kThreads = 8;
+  const int kOps = 10000;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&stats, t]() {
+      for (int i = 0; i < kOps; i++) {
+        stats->RecordTick(kKeysRead, 1);
+        stats->MeasureTime(kSeekMicros, t + 1);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ASSERT_EQ(kThreads * kOps, stats->GetTickerCount(kKeysRead));
+  HistogramData data;
+  stats->GetHistogramData(kSeekMicros, &data);
+  ASSERT_EQ(kThreads * kOps, data.count);
+  ASSERT_EQ(1, data.min);
+  ASSERT_EQ(kThreads, data.max);
+  ASSERT_EQ(kOps * kThreads * (kThreads + 1) / 2, data.sum);
+}
+
+TEST(StatisticsTest, ToString) {
+  std::unique_ptr<Statistics> stats(NewStatistics());
+  stats->RecordTick(kWalSynced, 7);
+  stats->MeasureTime(kWalSyncMicros, 10);
+  const std::string s = stats->ToString();
+  ASSERT_NE(std::string::npos, s.find("leveldb.wal.synced COUNT : 7\n"));
+  ASSERT_NE(std::string::npos, s.find("leveldb.wal.sync.micros P50"));
+  for (int t = 0; t < kNumTickers; t++) {
+    ASSERT_NE(std::string::npos,
+              s.find(Statistics::TickerName(static_cast<Ticker>(t))));
+  }
+}
+
+}  // namespace leveldb
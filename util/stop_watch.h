@@ -0,0 +1,59 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_UTIL_STOP_WATCH_H_
+#define STORAGE_LEVELDB_UTIL_STOP_WATCH_H_
+
+#include <cstdint>
+
+#include "leveldb/env.h"
+#include "leveldb/statistics.h"
+
+namespace leveldb {
+
+// Add "count" to "ticker" if statistics are being collected.
+inline void RecordTick(Statistics* statistics, Ticker ticker,
+                       uint64_t count = 1) {
+  if (statistics != nullptr) {
+    statistics->RecordTick(ticker, count);
+  }
+}
+
+// Helper class that records the time between its construction and
+// destruction in a histogram of "statistics".  Does nothing, and does
+// not even read the clock, if "statistics" is null.
+//
+// Typical usage:
+//
+//   Status DBImpl::Get(...) {
+//     StopWatch sw(env_, options_.statistics, kGetMicros);
+//     ... some complex code, possibly with multiple return paths ...
+//   }
+class StopWatch {
+ public:
+  StopWatch(Env* env, Statistics* statistics, HistogramType type)
+      : env_(env),
+        statistics_(statistics),
+        type_(type),
+        start_micros_(statistics != nullptr ? env->NowMicros() : 0) {}
+
+  ~StopWatch() {
+    if (statistics_ != nullptr) {
+      statistics_->MeasureTime(type_, env_->NowMicros() - start_micros_);
+    }
+  }
+
+  StopWatch(const StopWatch&) = delete;
+  StopWatch& operator=(const StopWatch&) = delete;
+
+ private:
+  Env* const env_;
+  Statistics* const statistics_;
+  const HistogramType type_;
+  const uint64_t start_micros_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_STOP_WATCH_H_
@@ -0,0 +1,167 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/thread_local.h"
+
+#include <atomic>
+#include <cassert>
+
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/mutexlock.h"
+#include "util/no_destructor.h"
+
+namespace leveldb {
+
+// Keeps the values of every thread and the ids of every ThreadLocalPtr.
+//
+// Each thread owns a ThreadData holding one slot per id.  The owning thread
+// reads and writes its slots without locking; the slot vector itself only
+// grows from the owning thread, under mutex_, so that Scrape() and
+// ReclaimId() can walk all threads' slots while holding mutex_.
+class ThreadLocalPtr::StaticMeta {
+ public:
+  StaticMeta() : next_id_(0) { head_.next = head_.prev = &head_; }
+
+  uint32_t AcquireId(UnrefHandler handler) {
+    MutexLock l(&mutex_);
+    uint32_t id;
+    if (!free_ids_.empty()) {
+      id = free_ids_.back();
+      free_ids_.pop_back();
+      handlers_[id] = handler;
+    } else {
+      id = next_id_++;
+      handlers_.push_back(handler);
+    }
+    return id;
+  }
+
+  void ReclaimId(uint32_t id) {
+    MutexLock l(&mutex_);
+    for (ThreadData* t = head_.next; t != &head_; t = t->next) {
+      if (id < t->entries.size()) {
+        t->entries[id].ptr.store(nullptr, std::memory_order_relaxed);
+      }
+    }
+    handlers_[id] = nullptr;
+    free_ids_.push_back(id);
+  }
+
+  std::atomic<void*>* Slot(uint32_t id) {
+    ThreadData* t = Local();
+    if (id >= t->entries.size()) {
+      MutexLock l(&mutex_);
+      t->entries.resize(next_id_);
+    }
+    return &t->entries[id].ptr;
+  }
+
+  void* Get(uint32_t id) {
+    ThreadData* t = Local();
+    if (id >= t->entries.size()) {
+      return nullptr;
+    }
+    return t->entries[id].ptr.load(std::memory_order_acquire);
+  }
+
+  void Scrape(uint32_t id, std::vector<void*>* ptrs, void* replacement) {
+    MutexLock l(&mutex_);
+    for (ThreadData* t = head_.next; t != &head_; t = t->next) {
+      if (id < t->entries.size()) {
+        void* ptr =
+            t->entries[id].ptr.exchange(replacement, std::memory_order_acq_rel);
+        if (ptr != nullptr) {
+          ptrs->push_back(ptr);
+        }
+      }
+    }
+  }
+
+ private:
+  struct Entry {
+    Entry() : ptr(nullptr) {}
+    Entry(const Entry& e) : ptr(e.ptr.load(std::memory_order_relaxed)) {}
+
+    std::atomic<void*> ptr;
+  };
+
+  // Lives in thread-local storage; linked into the list of all threads
+  // on construction and unlinked when the thread exits.
+  struct ThreadData {
+    explicit ThreadData(StaticMeta* meta) : meta(meta) {
+      MutexLock l(&meta->mutex_);
+      next = &meta->head_;
+      prev = meta->head_.prev;
+      prev->next = this;
+      next->prev = this;
+    }
+
+    ~ThreadData() {
+      if (meta != nullptr) meta->OnThreadExit(this);
+    }
+
+    ThreadData() : meta(nullptr), next(nullptr), prev(nullptr) {}
+
+    StaticMeta* const meta;  // nullptr for the list head
+    std::vector<Entry> entries;
+    ThreadData* next;
+    ThreadData* prev;
+  };
+
+  ThreadData* Local() {
+    thread_local ThreadData data(this);
+    return &data;
+  }
+
+  void OnThreadExit(ThreadData* t) {
+    MutexLock l(&mutex_);
+    for (uint32_t id = 0; id < t->entries.size(); id++) {
+      void* ptr = t->entries[id].ptr.load(std::memory_order_relaxed);
+      if (ptr != nullptr && handlers_[id] != nullptr) {
+        (*handlers_[id])(ptr);
+      }
+    }
+    t->prev->next = t->next;
+    t->next->prev = t->prev;
+  }
+
+  port::Mutex mutex_;
+  ThreadData head_ GUARDED_BY(mutex_);  // Dummy head of the thread list
+  uint32_t next_id_ GUARDED_BY(mutex_);
+  std::vector<uint32_t> free_ids_ GUARDED_BY(mutex_);
+  std::vector<UnrefHandler> handlers_ GUARDED_BY(mutex_);
+};
+
+ThreadLocalPtr::StaticMeta* ThreadLocalPtr::Instance() {
+  // Never destroyed: threads may exit after static destructors have run.
+  static NoDestructor<StaticMeta> meta;
+  return meta.get();
+}
+
+ThreadLocalPtr::ThreadLocalPtr(UnrefHandler handler)
+    : id_(Instance()->AcquireId(handler)) {}
+
+ThreadLocalPtr::~ThreadLocalPtr() { Instance()->ReclaimId(id_); }
+
+void* ThreadLocalPtr::Get() const { return Instance()->Get(id_); }
+
+void ThreadLocalPtr::Reset(void* ptr) {
+  Instance()->Slot(id_)->store(ptr, std::memory_order_release);
+}
+
+void* ThreadLocalPtr::Swap(void* ptr) {
+  return Instance()->Slot(id_)->exchange(ptr, std::memory_order_acq_rel);
+}
+
+bool ThreadLocalPtr::CompareAndSwap(void* ptr, void** expected) {
+  return Instance()->Slot(id_)->compare_exchange_strong(
+      *expected, ptr, std::memory_order_acq_rel);
+}
+
+void ThreadLocalPtr::Scrape(std::vector<void*>* ptrs, void* replacement) {
+  Instance()->Scrape(id_, ptrs, replacement);
+}
+
+}  // namespace leveldb
@@ -0,0 +1,63 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_UTIL_THREAD_LOCAL_H_
+#define STORAGE_LEVELDB_UTIL_THREAD_LOCAL_H_
+
+#include <cstdint>
+#include <vector>
+
+namespace leveldb {
+
+// A ThreadLocalPtr holds one void* per thread.  Unlike a plain C++
+// thread_local variable it may be created and destroyed at any time,
+// and another thread can atomically take away every thread's value with
+// Scrape().  Get(), Reset(), Swap() and CompareAndSwap() only touch the
+// calling thread's value and never block.
+//
+// When a thread exits, the handler passed to the constructor (if any) is
+// called on the thread's value if it is non-null.  The handler runs under
+// an internal lock and must not use any ThreadLocalPtr.  Values still held
+// when the ThreadLocalPtr is destroyed are dropped without calling the
+// handler; use Scrape() first to release them.
+class ThreadLocalPtr {
+ public:
+  typedef void (*UnrefHandler)(void* ptr);
+
+  explicit ThreadLocalPtr(UnrefHandler handler = nullptr);
+
+  ThreadLocalPtr(const ThreadLocalPtr&) = delete;
+  ThreadLocalPtr& operator=(const ThreadLocalPtr&) = delete;
+
+  ~ThreadLocalPtr();
+
+  // Return the calling thread's value.  Initially nullptr.
+  void* Get() const;
+
+  // Set the calling thread's value to "ptr".
+  void Reset(void* ptr);
+
+  // Set the calling thread's value to "ptr" and return the previous one.
+  void* Swap(void* ptr);
+
+  // If the calling thread's value is *expected, replace it with "ptr" and
+  // return true.  Otherwise store the current value in *expected and
+  // return false.
+  bool CompareAndSwap(void* ptr, void** expected);
+
+  // Replace the value of every thread that has stored one with
+  // "replacement", appending the previous non-null values to *ptrs.
+  void Scrape(std::vector<void*>* ptrs, void* replacement);
+
+ private:
+  class StaticMeta;
+
+  static StaticMeta* Instance();
+
+  const uint32_t id_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_THREAD_LOCAL_H_
@@ -0,0 +1,112 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/thread_local.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace leveldb {
+
+static std::atomic<int> unref_count(0);
+
+static void CountUnref(void* ptr) { unref_count.fetch_add(1); }
+
+TEST(ThreadLocalTest, SingleThread) {
+  ThreadLocalPtr tls;
+  int a = 1, b = 2;
+  ASSERT_EQ(nullptr, tls.Get());
+  tls.Reset(&a);
+  ASSERT_EQ(&a, tls.Get());
+  ASSERT_EQ(&a, tls.Swap(&b));
+  ASSERT_EQ(&b, tls.Get());
+
+  void* expected = &a;
+  ASSERT_TRUE(!tls.CompareAndSwap(nullptr, &expected));
+  ASSERT_EQ(&b, expected);
+  ASSERT_TRUE(tls.CompareAndSwap(nullptr, &expected));
+  ASSERT_EQ(nullptr, tls.Get());
+
+  // Ids are independent.
+  ThreadLocalPtr other;
+  other.Reset(&a);
+  ASSERT_EQ(nullptr, tls.Get());
+  ASSERT_EQ(&a, other.Get());
+}
+
+TEST(ThreadLocalTest, PerThreadValues) {
+  ThreadLocalPtr tls;
+  int main_value = 0;
+  tls.Reset(&main_value);
+
+  static const int kNumThreads = 8;
+  int values[kNumThreads];
+  std::vector<std::thread> threads;
+  std::atomic<int> mismatches(0);
+  for (int i = 0; i < kNumThreads; i++) {
+    threads.emplace_back([&, i]() {
+      if (tls.Get() != nullptr) mismatches.fetch_add(1);
+      tls.Reset(&values[i]);
+      std::this_thread::yield();
+      if (tls.Get() != &values[i]) mismatches.fetch_add(1);
+    });
+  }
+  for (std::thread& t : threads) {
+    t.join();
+  }
+  ASSERT_EQ(0, mismatches.load());
+  ASSERT_EQ(&main_value, tls.Get());
+}
+
+TEST(ThreadLocalTest, UnrefOnThreadExit) {
+  unref_count.store(0);
+  ThreadLocalPtr tls(CountUnref);
+  int value = 0;
+  std::thread([&]() { tls.Reset(&value); }).join();
+  std::thread([&]() { tls.Reset(nullptr); }).join();
+  ASSERT_EQ(1, unref_count.load());
+}
+
+TEST(ThreadLocalTest, Scrape) {
+  unref_count.store(0);
+  ThreadLocalPtr tls(CountUnref);
+  int replacement = 0;
+  static const int kNumThreads = 4;
+  int values[kNumThreads];
+
+  std::atomic<int> stored(0);
+  std::atomic<bool> scraped(false);
+  std::atomic<int> replaced(0);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kNumThreads; i++) {
+    threads.emplace_back([&, i]() {
+      tls.Reset(&values[i]);
+      stored.fetch_add(1);
+      while (!scraped.load()) std::this_thread::yield();
+      if (tls.Get() == &replacement) replaced.fetch_add(1);
+      tls.Reset(nullptr);
+    });
+  }
+  while (stored.load() < kNumThreads) std::this_thread::yield();
+
+  std::vector<void*> ptrs;
+  tls.Scrape(&ptrs, &replacement);
+  scraped.store(true);
+  for (std::thread& t : threads) {
+    t.join();
+  }
+
+  ASSERT_EQ(kNumThreads, ptrs.size());
+  for (int i = 0; i < kNumThreads; i++) {
+    ASSERT_TRUE(std::find(ptrs.begin(), ptrs.end(), &values[i]) != ptrs.end());
+  }
+  ASSERT_EQ(kNumThreads, replaced.load());
+  ASSERT_EQ(0, unref_count.load());
+}
+
+}  // namespace leveldb